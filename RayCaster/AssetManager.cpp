@@ -2,24 +2,388 @@
  
  RayCaster - A Simple C++ Ray Caster Game
  Copyright 2013 Core S2 - See License.txt for details
- 
+
 ***************************************************************/
 
 #include "AssetManager.h"
 
+#include <map>
+#include <list>
+#include <deque>
+#include <algorithm>
+#include "ThreadPool.h"
+
+/*** Private ***/
+
+// Bytes of pixels uploaded at a time; the time budget is checked between bands
+static const int AssetManager_UploadBandSize = 256 * 1024;
+
+// Memory each class of asset may keep until set otherwise
+static const Uint64 AssetManager_DefaultBudgets[AssetClassCount] =
+{
+	256 * 1024 * 1024,		// Textures
+	64 * 1024 * 1024,		// Sounds
+	32 * 1024 * 1024,		// Maps
+};
+
+struct Asset
+{
+	std::string m_fileName;
+	AssetClass m_class;
+	AssetState m_state;
+	Uint64 m_byteSize;			// Counted in the resident bytes once loaded
+
+	// Image
+	SDL_Surface* m_surface;		// Decoded image, until its texture is made
+	SDL_Texture* m_texture;
+	int m_uploadedRows;
+
+	// Sound
+	SDL_AudioSpec m_soundSpec;
+	Uint8* m_soundBuffer;
+	Uint32 m_soundLength;
+
+	// Map
+	SimpleJSON::JsonDocument* m_document;
+
+	// References taken by requests; once none are left, the asset's place among
+	// the unreferenced assets of its class, least recently released first
+	int m_refCount;
+	std::list< Asset* >::iterator m_unusedPosition;
+};
+
 class AssetManager_Impl : public AssetManager
 {
 public:
 
-	const void* GetImage( const std::string& fileName )
+	AssetManager_Impl();
+	~AssetManager_Impl();
+
+	void SetLoaderThreadCount( int threadCount );
+	void SetRenderer( SDL_Renderer* renderer );
+	void SetBudget( AssetClass assetClass, Uint64 budgetBytes );
+	AssetHandle RequestImage( const std::string& fileName );
+	AssetHandle RequestSound( const std::string& fileName );
+	AssetHandle RequestMap( const std::string& fileName );
+	void Release( AssetHandle asset );
+	AssetState GetState( AssetHandle asset );
+	AssetState Wait( AssetHandle asset );
+	SDL_Texture* GetTexture( AssetHandle asset );
+	const Uint8* GetSound( AssetHandle asset, Uint32* length, SDL_AudioSpec* spec );
+	const SimpleJSON::JsonDocument* GetMap( AssetHandle asset );
+	int Update( float timeBudget );
+	AssetCacheStats GetStats( AssetClass assetClass );
+	void Clear();
+
+private:
+
+	// Background job loading a single asset
+	class LoadJob;
+	friend class LoadJob;
+
+	// Takes a reference on the asset of the given file, queuing its load if it is
+	// not cached yet; NULL if the file is cached as another class of asset
+	AssetHandle Request( const std::string& fileName, AssetClass assetClass );
+
+	// Loader thread: reads the given image, and converts it to the given pixel format
+	void LoadImage( Asset* asset, Uint32 pixelFormat );
+
+	// Loader thread: reads the given sound, or parses the given map
+	void LoadSound( Asset* asset );
+	void LoadMap( Asset* asset );
+
+	// Loader thread: marks the given asset loaded at the given size, or failed if
+	// it has none; images are queued for upload in the same step
+	void SetLoaded( Asset* asset, Uint64 byteSize );
+
+	// Main thread: uploads the next band of rows of the given decoded image, making
+	// its texture first; returns true once it is ready (or failed)
+	bool UploadBand( Asset* asset );
+
+	// Main thread: frees unreferenced assets of the given class, least recently
+	// released first, until it is back under budget
+	void Evict( AssetClass assetClass );
+
+	// Main thread: frees the contents of the given asset, then the asset itself
+	void FreeAsset( Asset* asset );
+
+	// Every asset cached, by file name; main thread only
+	std::map< std::string, Asset* > m_assets;
+
+	// Unreferenced assets of each class, least recently released first; main thread only
+	std::list< Asset* > m_unusedAssets[AssetClassCount];
+
+	// Cache counters of each class; the resident bytes are shared with the loader
+	// threads, the rest are main thread only
+	AssetCacheStats m_stats[AssetClassCount];
+
+	// Shared with the loader threads: the states of the assets, and the images
+	// decoded but not yet uploaded, in the order they were decoded
+	SDL_mutex* m_mutex;
+	SDL_cond* m_loadedCondition;		// Signaled whenever an asset is loaded
+	std::deque< Asset* > m_decodedAssets;
+
+	// SDL 2.0 shares pixel formats between surfaces in a list it does not lock, so
+	// every surface made or freed here (even by making a texture) is under this
+	SDL_mutex* m_surfaceMutex;
+
+	SDL_Renderer* m_renderer;
+	Uint32 m_pixelFormat;
+
+	ThreadPool* m_loaderPool;
+
+};
+
+class AssetManager_Impl::LoadJob : public ThreadJob
+{
+public:
+
+	LoadJob( AssetManager_Impl* manager, Asset* asset, Uint32 pixelFormat )
+		: m_manager( manager ), m_asset( asset ), m_pixelFormat( pixelFormat )
 	{
-		// Todo: implement the dictionary look-up
-		return NULL;
 	}
 
+	void Run()
+	{
+		if( m_asset->m_class == AssetClass_Texture )
+			m_manager->LoadImage( m_asset, m_pixelFormat );
+		else if( m_asset->m_class == AssetClass_Sound )
+			m_manager->LoadSound( m_asset );
+		else
+			m_manager->LoadMap( m_asset );
+	}
+
+private:
+
+	AssetManager_Impl* m_manager;
+	Asset* m_asset;
+	Uint32 m_pixelFormat;
+
 };
 
-static const AssetManager* GetSingleton()
+AssetHandle AssetManager_Impl::Request( const std::string& fileName, AssetClass assetClass )
+{
+	// A return visit takes the asset back from the unreferenced ones
+	std::map< std::string, Asset* >::iterator it = m_assets.find( fileName );
+	if( it != m_assets.end() )
+	{
+		Asset* asset = it->second;
+		if( asset->m_class != assetClass )
+			return NULL;
+		if( asset->m_refCount++ == 0 )
+			m_unusedAssets[assetClass].erase( asset->m_unusedPosition );
+		m_stats[assetClass].m_hitCount++;
+		return asset;
+	}
+
+	Asset* asset = new Asset();
+	asset->m_fileName = fileName;
+	asset->m_class = assetClass;
+	asset->m_state = AssetState_Loading;
+	asset->m_byteSize = 0;
+	asset->m_surface = NULL;
+	asset->m_texture = NULL;
+	asset->m_uploadedRows = 0;
+	SDL_zero( asset->m_soundSpec );
+	asset->m_soundBuffer = NULL;
+	asset->m_soundLength = 0;
+	asset->m_document = NULL;
+	asset->m_refCount = 1;
+	m_assets[fileName] = asset;
+	m_stats[assetClass].m_missCount++;
+	m_stats[assetClass].m_assetCount++;
+
+	m_loaderPool->Push( new LoadJob( this, asset, m_pixelFormat ) );
+	return asset;
+}
+
+void AssetManager_Impl::LoadImage( Asset* asset, Uint32 pixelFormat )
+{
+	// The file is read, and the pixels converted, outside the surface lock; only
+	// the surfaces themselves are made and freed under it
+	UtilMappedFile mappedFile;
+	SDL_Surface* surface = NULL;
+	if( mappedFile.Open( asset->m_fileName.c_str() ) )
+	{
+		SDL_LockMutex( m_surfaceMutex );
+		SDL_Surface* loadedSurface = SDL_LoadBMP_RW( SDL_RWFromConstMem( mappedFile.GetData(), (int)mappedFile.GetSize() ), 1 );
+		SDL_UnlockMutex( m_surfaceMutex );
+		mappedFile.Close();
+
+		// Converted here, so that making the texture is only a copy; palette images
+		// can only be converted through a surface blit, so under the lock
+		surface = loadedSurface;
+		if( loadedSurface != NULL && loadedSurface->format->format != pixelFormat )
+		{
+			int bitsPerPixel;
+			Uint32 rMask, gMask, bMask, aMask;
+			SDL_PixelFormatEnumToMasks( pixelFormat, &bitsPerPixel, &rMask, &gMask, &bMask, &aMask );
+
+			SDL_LockMutex( m_surfaceMutex );
+			if( SDL_ISPIXELFORMAT_INDEXED( loadedSurface->format->format ) )
+				surface = SDL_ConvertSurfaceFormat( loadedSurface, pixelFormat, 0 );
+			else
+				surface = SDL_CreateRGBSurface( 0, loadedSurface->w, loadedSurface->h, bitsPerPixel, rMask, gMask, bMask, aMask );
+			SDL_UnlockMutex( m_surfaceMutex );
+
+			if( surface != NULL && !SDL_ISPIXELFORMAT_INDEXED( loadedSurface->format->format ) &&
+				SDL_ConvertPixels( surface->w, surface->h, loadedSurface->format->format, loadedSurface->pixels, loadedSurface->pitch, surface->format->format, surface->pixels, surface->pitch ) != 0 )
+			{
+				SDL_LockMutex( m_surfaceMutex );
+				SDL_FreeSurface( surface );
+				SDL_UnlockMutex( m_surfaceMutex );
+				surface = NULL;
+			}
+
+			SDL_LockMutex( m_surfaceMutex );
+			SDL_FreeSurface( loadedSurface );
+			SDL_UnlockMutex( m_surfaceMutex );
+		}
+	}
+
+	// Counted at the size of its pixels, which its texture then takes over; the
+	// surface is the main thread's as soon as it is queued, so is not touched after
+	Uint64 byteSize = (surface != NULL) ? (Uint64)surface->pitch * surface->h : 0;
+	asset->m_surface = surface;
+	SetLoaded( asset, byteSize );
+}
+
+void AssetManager_Impl::LoadSound( Asset* asset )
+{
+	UtilMappedFile mappedFile;
+	if( mappedFile.Open( asset->m_fileName.c_str() ) )
+		SDL_LoadWAV_RW( SDL_RWFromConstMem( mappedFile.GetData(), (int)mappedFile.GetSize() ), 1, &asset->m_soundSpec, &asset->m_soundBuffer, &asset->m_soundLength );
+	mappedFile.Close();
+
+	SetLoaded( asset, (asset->m_soundBuffer != NULL) ? asset->m_soundLength : 0 );
+}
+
+void AssetManager_Impl::LoadMap( Asset* asset )
+{
+	// Parsed straight out of the mapping, as in the batch loader
+	SimpleJSON::JsonDocument* document = new SimpleJSON::JsonDocument();
+	UtilMappedFile mappedFile;
+	if( !mappedFile.Open( asset->m_fileName.c_str() ) || !document->Parse( (const char*)mappedFile.GetData(), mappedFile.GetSize() ) )
+	{
+		delete document;
+		document = NULL;
+	}
+	mappedFile.Close();
+
+	asset->m_document = document;
+	SetLoaded( asset, (document != NULL) ? document->GetMemoryFootprint() : 0 );
+}
+
+void AssetManager_Impl::SetLoaded( Asset* asset, Uint64 byteSize )
+{
+	// Images still have to be uploaded; the state, size and queue change together,
+	// so the main thread never sees one without the others
+	SDL_LockMutex( m_mutex );
+	asset->m_byteSize = byteSize;
+	if( byteSize == 0 )
+		asset->m_state = AssetState_Failed;
+	else if( asset->m_class == AssetClass_Texture )
+	{
+		asset->m_state = AssetState_Uploading;
+		m_decodedAssets.push_back( asset );
+	}
+	else
+		asset->m_state = AssetState_Ready;
+	m_stats[asset->m_class].m_residentBytes += byteSize;
+	SDL_CondBroadcast( m_loadedCondition );
+	SDL_UnlockMutex( m_mutex );
+}
+
+bool AssetManager_Impl::UploadBand( Asset* asset )
+{
+	SDL_Surface* surface = asset->m_surface;
+	if( asset->m_texture == NULL )
+	{
+		SDL_LockMutex( m_surfaceMutex );
+		if( m_renderer != NULL )
+			asset->m_texture = SDL_CreateTexture( m_renderer, surface->format->format, SDL_TEXTUREACCESS_STATIC, surface->w, surface->h );
+		SDL_UnlockMutex( m_surfaceMutex );
+		if( asset->m_texture != NULL && surface->format->Amask != 0 )
+			SDL_SetTextureBlendMode( asset->m_texture, SDL_BLENDMODE_BLEND );
+	}
+
+	bool isValid = (asset->m_texture != NULL);
+	if( isValid )
+	{
+		int rowCount = min( max( 1, AssetManager_UploadBandSize / surface->pitch ), surface->h - asset->m_uploadedRows );
+		SDL_Rect band = { 0, asset->m_uploadedRows, surface->w, rowCount };
+		isValid = SDL_UpdateTexture( asset->m_texture, &band, (const Uint8*)surface->pixels + asset->m_uploadedRows * surface->pitch, surface->pitch ) == 0;
+		asset->m_uploadedRows += rowCount;
+		if( isValid && asset->m_uploadedRows < surface->h )
+			return false;
+	}
+
+	// Done with the pixels either way
+	SDL_LockMutex( m_surfaceMutex );
+	if( !isValid && asset->m_texture != NULL )
+	{
+		SDL_DestroyTexture( asset->m_texture );
+		asset->m_texture = NULL;
+	}
+	SDL_FreeSurface( surface );
+	SDL_UnlockMutex( m_surfaceMutex );
+	asset->m_surface = NULL;
+
+	SDL_LockMutex( m_mutex );
+	asset->m_state = isValid ? AssetState_Ready : AssetState_Failed;
+	if( !isValid )
+	{
+		m_stats[AssetClass_Texture].m_residentBytes -= asset->m_byteSize;
+		asset->m_byteSize = 0;
+	}
+	SDL_UnlockMutex( m_mutex );
+	return true;
+}
+
+void AssetManager_Impl::Evict( AssetClass assetClass )
+{
+	std::list< Asset* >& unusedAssets = m_unusedAssets[assetClass];
+	std::list< Asset* >::iterator it = unusedAssets.begin();
+	while( it != unusedAssets.end() && GetStats( assetClass ).m_residentBytes > m_stats[assetClass].m_budgetBytes )
+	{
+		// Passes over assets still in the hands of a load job, or of the upload queue
+		Asset* asset = *it;
+		AssetState state = GetState( asset );
+		if( state == AssetState_Loading || state == AssetState_Uploading )
+		{
+			++it;
+			continue;
+		}
+
+		it = unusedAssets.erase( it );
+		m_assets.erase( asset->m_fileName );
+		FreeAsset( asset );
+		m_stats[assetClass].m_evictionCount++;
+	}
+}
+
+void AssetManager_Impl::FreeAsset( Asset* asset )
+{
+	SDL_LockMutex( m_surfaceMutex );
+	if( asset->m_surface != NULL )
+		SDL_FreeSurface( asset->m_surface );
+	if( asset->m_texture != NULL )
+		SDL_DestroyTexture( asset->m_texture );
+	SDL_UnlockMutex( m_surfaceMutex );
+	if( asset->m_soundBuffer != NULL )
+		SDL_FreeWAV( asset->m_soundBuffer );
+	delete asset->m_document;
+
+	SDL_LockMutex( m_mutex );
+	m_stats[asset->m_class].m_residentBytes -= asset->m_byteSize;
+	SDL_UnlockMutex( m_mutex );
+	m_stats[asset->m_class].m_assetCount--;
+	delete asset;
+}
+
+/*** Public ***/
+
+AssetManager* AssetManager::GetSingleton()
 {
 	static AssetManager_Impl* singleton = NULL;
 
@@ -30,3 +394,188 @@ static const AssetManager* GetSingleton()
 
 	return singleton;
 }
+
+AssetManager_Impl::AssetManager_Impl()
+	: m_renderer( NULL )
+	, m_pixelFormat( SDL_PIXELFORMAT_ARGB8888 )
+{
+	for(int i = 0; i < AssetClassCount; i++)
+	{
+		SDL_zero( m_stats[i] );
+		m_stats[i].m_budgetBytes = AssetManager_DefaultBudgets[i];
+	}
+
+	m_mutex = SDL_CreateMutex();
+	m_loadedCondition = SDL_CreateCond();
+	m_surfaceMutex = SDL_CreateMutex();
+	m_loaderPool = new ThreadPool();
+}
+
+AssetManager_Impl::~AssetManager_Impl()
+{
+	Clear();
+	delete m_loaderPool;
+	SDL_DestroyMutex( m_surfaceMutex );
+	SDL_DestroyCond( m_loadedCondition );
+	SDL_DestroyMutex( m_mutex );
+}
+
+void AssetManager_Impl::SetLoaderThreadCount( int threadCount )
+{
+	// Waits for the queued loads
+	delete m_loaderPool;
+	m_loaderPool = new ThreadPool( threadCount );
+}
+
+void AssetManager_Impl::SetRenderer( SDL_Renderer* renderer )
+{
+	// 32-bit color with alpha if the renderer takes it, as any BMP fits it; else the
+	// renderer's first format (planar video formats can't be decoded into)
+	m_renderer = renderer;
+	m_pixelFormat = SDL_PIXELFORMAT_ARGB8888;
+	SDL_RendererInfo info;
+	if( renderer != NULL && SDL_GetRendererInfo( renderer, &info ) == 0 && info.num_texture_formats > 0 )
+	{
+		bool hasArgb = false;
+		for(Uint32 i = 0; i < info.num_texture_formats; i++)
+			hasArgb |= (info.texture_formats[i] == SDL_PIXELFORMAT_ARGB8888);
+		if( !hasArgb && !SDL_ISPIXELFORMAT_FOURCC( info.texture_formats[0] ) )
+			m_pixelFormat = info.texture_formats[0];
+	}
+}
+
+void AssetManager_Impl::SetBudget( AssetClass assetClass, Uint64 budgetBytes )
+{
+	m_stats[assetClass].m_budgetBytes = budgetBytes;
+	Evict( assetClass );
+}
+
+AssetHandle AssetManager_Impl::RequestImage( const std::string& fileName )
+{
+	return Request( fileName, AssetClass_Texture );
+}
+
+AssetHandle AssetManager_Impl::RequestSound( const std::string& fileName )
+{
+	return Request( fileName, AssetClass_Sound );
+}
+
+AssetHandle AssetManager_Impl::RequestMap( const std::string& fileName )
+{
+	return Request( fileName, AssetClass_Map );
+}
+
+void AssetManager_Impl::Release( AssetHandle asset )
+{
+	if( asset == NULL || --asset->m_refCount > 0 )
+		return;
+
+	std::list< Asset* >& unusedAssets = m_unusedAssets[asset->m_class];
+	asset->m_unusedPosition = unusedAssets.insert( unusedAssets.end(), asset );
+	Evict( asset->m_class );
+}
+
+AssetState AssetManager_Impl::GetState( AssetHandle asset )
+{
+	if( asset == NULL )
+		return AssetState_Failed;
+
+	SDL_LockMutex( m_mutex );
+	AssetState state = asset->m_state;
+	SDL_UnlockMutex( m_mutex );
+	return state;
+}
+
+AssetState AssetManager_Impl::Wait( AssetHandle asset )
+{
+	if( asset == NULL )
+		return AssetState_Failed;
+
+	SDL_LockMutex( m_mutex );
+	while( asset->m_state == AssetState_Loading )
+		SDL_CondWait( m_loadedCondition, m_mutex );
+
+	// Jumps the upload queue, and goes up whole
+	bool isUploading = (asset->m_state == AssetState_Uploading);
+	if( isUploading )
+		m_decodedAssets.erase( std::find( m_decodedAssets.begin(), m_decodedAssets.end(), asset ) );
+	SDL_UnlockMutex( m_mutex );
+
+	if( isUploading )
+	{
+		while( !UploadBand( asset ) )
+			continue;
+	}
+	return GetState( asset );
+}
+
+SDL_Texture* AssetManager_Impl::GetTexture( AssetHandle asset )
+{
+	// Images being uploaded have their texture already, but only part of it
+	return (GetState( asset ) == AssetState_Ready) ? asset->m_texture : NULL;
+}
+
+const Uint8* AssetManager_Impl::GetSound( AssetHandle asset, Uint32* length, SDL_AudioSpec* spec )
+{
+	if( GetState( asset ) != AssetState_Ready || asset->m_soundBuffer == NULL )
+		return NULL;
+
+	*length = asset->m_soundLength;
+	*spec = asset->m_soundSpec;
+	return asset->m_soundBuffer;
+}
+
+const SimpleJSON::JsonDocument* AssetManager_Impl::GetMap( AssetHandle asset )
+{
+	return (GetState( asset ) == AssetState_Ready) ? asset->m_document : NULL;
+}
+
+int AssetManager_Impl::Update( float timeBudget )
+{
+	int readyCount = 0;
+	UtilHighresClock clock( true );
+	do
+	{
+		SDL_LockMutex( m_mutex );
+		Asset* asset = m_decodedAssets.empty() ? NULL : m_decodedAssets.front();
+		SDL_UnlockMutex( m_mutex );
+		if( asset == NULL )
+			break;
+
+		if( UploadBand( asset ) )
+		{
+			SDL_LockMutex( m_mutex );
+			m_decodedAssets.pop_front();
+			SDL_UnlockMutex( m_mutex );
+			readyCount += (asset->m_texture != NULL) ? 1 : 0;
+		}
+		clock.Stop();
+	}
+	while( clock.GetTime() < timeBudget );
+
+	// Assets released while still loading could not be freed then
+	for(int i = 0; i < AssetClassCount; i++)
+		Evict( (AssetClass)i );
+
+	return readyCount;
+}
+
+AssetCacheStats AssetManager_Impl::GetStats( AssetClass assetClass )
+{
+	SDL_LockMutex( m_mutex );
+	AssetCacheStats stats = m_stats[assetClass];
+	SDL_UnlockMutex( m_mutex );
+	return stats;
+}
+
+void AssetManager_Impl::Clear()
+{
+	m_loaderPool->WaitAll();
+
+	for(std::map< std::string, Asset* >::iterator it = m_assets.begin(); it != m_assets.end(); ++it)
+		FreeAsset( it->second );
+	m_assets.clear();
+	m_decodedAssets.clear();
+	for(int i = 0; i < AssetClassCount; i++)
+		m_unusedAssets[i].clear();
+}
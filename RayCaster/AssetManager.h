@@ -9,24 +9,125 @@
  File: AssetManager.cpp/h
  Desc: An asynchronous asset manager, which supports loading
  an asset for the run-time client. Implemented as singleton.
+ 
+ Requests return a handle right away; the file is then read and
+ decoded on a pool of loader threads, into a pixel format the
+ renderer takes. Textures can only be made on the main thread, so
+ it uploads decoded images once a frame, in bands of rows, within
+ a time budget: a large image takes a few frames, rather than
+ stalling one (only making the texture itself can't be split).
+ 
+ Sounds (WAV) and maps (JSON documents) load the same way, but
+ are ready as soon as their loader thread is done. Assets are
+ reference counted: every request takes a reference, and every
+ handle is released once done with. Unreferenced assets stay
+ cached, so a return visit is a hit, until their class (textures,
+ sounds, maps) goes over its memory budget: the least recently
+ released are then freed first.
 
 ***************************************************************/
 
 #ifndef __ASSETMANAGER_H__
 #define __ASSETMANAGER_H__
 
+#include <string>
+
 #include "Utilities.h"
+#include "SimpleJSON.h"
 #include "SDL.h"
 
+// Kinds of asset, each with its own memory budget
+enum AssetClass
+{
+	AssetClass_Texture,		// Counted by their pixels, decoded or uploaded
+	AssetClass_Sound,		// Counted by their samples
+	AssetClass_Map,			// Counted by their parsed document
+	AssetClassCount,
+};
+
+// Load states of an asset, in order
+enum AssetState
+{
+	AssetState_Loading,		// Queued, or being read and decoded on a loader thread
+	AssetState_Uploading,	// Decoded, and waiting on the main thread to make its texture
+	AssetState_Ready,
+	AssetState_Failed,		// The file is missing, or not in a format SDL can read
+};
+
+// Handle on a requested asset, valid until released; NULL is no asset
+struct Asset;
+typedef Asset* AssetHandle;
+
+// Cache counters of a class of asset, since the manager was made
+struct AssetCacheStats
+{
+	Uint64 m_hitCount;			// Requests for an asset already loaded, or loading
+	Uint64 m_missCount;			// Requests that had to queue a load
+	Uint64 m_evictionCount;		// Unreferenced assets freed to get back under budget
+	Uint64 m_residentBytes;		// Memory of the assets loaded, referenced or not
+	Uint64 m_budgetBytes;
+	int m_assetCount;			// Assets cached, loading or not
+};
+
 class AssetManager
 {
 public:
 
-	// Access our singleton; will construct self if not yet build
-	static const AssetManager* GetSingleton();
+	// Access our singleton; will construct self if not yet build, with one loader
+	// thread per CPU core
+	static AssetManager* GetSingleton();
+
+	virtual ~AssetManager() { }
+
+	// Restarts the loader threads with the given count (zero means one per CPU core),
+	// once the loads already queued are done
+	virtual void SetLoaderThreadCount( int threadCount ) = 0;
+
+	// Renderer the textures are made for; set it before requesting any image, so
+	// that images get decoded straight into a pixel format it takes
+	virtual void SetRenderer( SDL_Renderer* renderer ) = 0;
+
+	// Memory the given class of asset may keep (by default 256 MB of textures, 64 MB
+	// of sounds, 32 MB of maps); referenced assets are never freed, so a class can
+	// go over budget while they are in use
+	virtual void SetBudget( AssetClass assetClass, Uint64 budgetBytes ) = 0;
+
+	// Requests an image (BMP, the only format SDL reads on its own), a sound (WAV)
+	// or a map (JSON); returns at once, queuing the load unless the file is cached.
+	// Each request takes a reference on the asset, to be released once done with
+	virtual AssetHandle RequestImage( const std::string& fileName ) = 0;
+	virtual AssetHandle RequestSound( const std::string& fileName ) = 0;
+	virtual AssetHandle RequestMap( const std::string& fileName ) = 0;
+
+	// Main thread: drops a reference taken by a request; the handle must not be
+	// used after, as the asset may be freed whenever its class is over budget
+	virtual void Release( AssetHandle asset ) = 0;
+
+	// Load state of the given asset; never blocks
+	virtual AssetState GetState( AssetHandle asset ) = 0;
+
+	// Main thread: blocks until the given asset is loaded, and uploads it at once
+	// if it is an image; returns its final state (ready or failed)
+	virtual AssetState Wait( AssetHandle asset ) = 0;
+
+	// Contents of the given asset once ready, owned by the manager; NULL until then,
+	// or if it is of another class. Sound samples are in the format of their spec
+	virtual SDL_Texture* GetTexture( AssetHandle asset ) = 0;
+	virtual const Uint8* GetSound( AssetHandle asset, Uint32* length, SDL_AudioSpec* spec ) = 0;
+	virtual const SimpleJSON::JsonDocument* GetMap( AssetHandle asset ) = 0;
+
+	// Main thread, once a frame: uploads decoded images until the given time (in
+	// seconds) is spent, a band of rows at a time, and always at least one band,
+	// then frees unreferenced assets of any class over budget; returns how many
+	// images became ready
+	virtual int Update( float timeBudget ) = 0;
+
+	// Cache counters of the given class of asset
+	virtual AssetCacheStats GetStats( AssetClass assetClass ) = 0;
 
-	// Get image asset
-	virtual const void* GetImage( const std::string& fileName ) = NULL;
+	// Main thread: waits for the loads in progress, then frees every asset, even
+	// referenced, and every handle goes stale; do this before destroying the renderer
+	virtual void Clear() = 0;
 
 };
 
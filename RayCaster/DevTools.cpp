@@ -0,0 +1,1705 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+
+***************************************************************/
+
+#include "DevTools.h"
+#include "Utilities.h"
+
+#include <vector>
+#ifdef SIMPLEJSON_BENCH
+	#include <new>
+	#ifdef __APPLE__
+		#include <malloc/malloc.h>
+	#else
+		#include <malloc.h>
+	#endif
+#endif
+#include "World.h"
+#include "WorldChunkCache.h"
+#include "WorldFileWatcher.h"
+#include "WorldBlockFile.h"
+#include "WorldGenerator.h"
+#include "WorldStack.h"
+#include "WorldView.h"
+#include "SimpleJSON.h"
+#include "JsonBatchLoader.h"
+#include "AssetManager.h"
+
+/*** Tools ***/
+
+// Benchmarks fold their results in here, so the compiler can't skip the work
+static volatile int s_benchmarkSink = 0;
+
+#ifdef SIMPLEJSON_BENCH
+
+// Heap use while s_isCountingAllocations is set, as counted by the global new and
+// delete below: the allocation count, and the bytes held and their peak (in the
+// allocator's own block sizes, up to 2 GB). Only built in with SIMPLEJSON_BENCH
+// defined, for --bench-json, so the game's own allocations never come through here
+static SDL_atomic_t s_isCountingAllocations;
+static SDL_atomic_t s_allocationCount;
+static SDL_atomic_t s_allocatedBytes;
+static SDL_atomic_t s_peakAllocatedBytes;
+
+static inline int GetAllocatedSize( void* block )
+{
+	#ifdef _WIN32
+		return (int)_msize( block );
+	#elif __APPLE__
+		return (int)malloc_size( block );
+	#else
+		return (int)malloc_usable_size( block );
+	#endif
+}
+
+// Starts or stops counting heap use, from zero
+static void CountAllocations( bool isCounting )
+{
+	if( isCounting )
+	{
+		SDL_AtomicSet( &s_allocationCount, 0 );
+		SDL_AtomicSet( &s_allocatedBytes, 0 );
+		SDL_AtomicSet( &s_peakAllocatedBytes, 0 );
+	}
+	SDL_AtomicSet( &s_isCountingAllocations, isCounting ? 1 : 0 );
+}
+
+void* operator new( size_t size )
+{
+	void* block = malloc( (size > 0) ? size : 1 );
+	if( block == NULL )
+		throw std::bad_alloc();
+
+	if( SDL_AtomicAdd( &s_isCountingAllocations, 0 ) != 0 )
+	{
+		SDL_AtomicAdd( &s_allocationCount, 1 );
+		int blockSize = GetAllocatedSize( block );
+		int allocatedBytes = SDL_AtomicAdd( &s_allocatedBytes, blockSize ) + blockSize;
+		int peakBytes = SDL_AtomicAdd( &s_peakAllocatedBytes, 0 );
+		while( allocatedBytes > peakBytes && !SDL_AtomicCAS( &s_peakAllocatedBytes, peakBytes, allocatedBytes ) )
+			peakBytes = SDL_AtomicAdd( &s_peakAllocatedBytes, 0 );
+	}
+	return block;
+}
+
+void* operator new[]( size_t size )
+{
+	return operator new( size );
+}
+
+void operator delete( void* block ) throw()
+{
+	if( block != NULL && SDL_AtomicAdd( &s_isCountingAllocations, 0 ) != 0 )
+		SDL_AtomicAdd( &s_allocatedBytes, -GetAllocatedSize( block ) );
+	free( block );
+}
+
+void operator delete[]( void* block ) throw()
+{
+	operator delete( block );
+}
+
+#endif
+
+// Generates a world, and writes it out in the given format ("text", "binary", "chunked" or "compressed")
+static int GenerateWorld( const char* typeName, int width, int height, unsigned int seed, const char* outFileName, const char* formatName )
+{
+	WorldGeneratorSettings settings;
+	if( !WorldGenerator::GetTypeFromName( typeName, &settings.m_type ) )
+	{
+		printf("Unknown generator \"%s\"; use maze, caves, rooms or arena\n", typeName);
+		return 1;
+	}
+	settings.m_worldSize = Vector2i( width, height );
+	settings.m_seed = seed;
+
+	UtilHighresClock generateClock( true );
+	WorldGenerator generator( settings );
+	World* world = generator.Generate();
+	generateClock.Stop();
+
+	UtilHighresClock saveClock( true );
+	bool isSaved = false;
+	if( strcmp(formatName, "text") == 0 )
+		isSaved = world->SaveText( outFileName );
+	else if( strcmp(formatName, "chunked") == 0 )
+		isSaved = world->SaveChunked( outFileName, 64 );
+	else if( strcmp(formatName, "compressed") == 0 )
+		isSaved = world->SaveCompressed( outFileName, 128 );
+	else
+		isSaved = world->SaveBinary( outFileName );
+	saveClock.Stop();
+
+	const std::string* spawn = world->GetMetadata( "SPWN" );
+	printf("Generated:      %s %dx%d, seed %u\n", typeName, width, height, seed);
+	printf("Generate time:  %.2f ms\n", 1000.0f * generateClock.GetTime());
+	printf("Save time:      %.2f ms (%s, \"%s\")\n", 1000.0f * saveClock.GetTime(), formatName, outFileName);
+	printf("Spawn:          %s\n", (spawn != NULL) ? spawn->c_str() : "none");
+
+	delete world;
+	if( !isSaved )
+	{
+		printf("Failed to write \"%s\"\n", outFileName);
+		return 1;
+	}
+	return 0;
+}
+
+// Loads any world file, and writes it out in the binary format, in the given tile layout
+static int ConvertWorld( const char* inFileName, const char* outFileName, WorldLayout layout )
+{
+	World world( inFileName );
+	world.SetMetadata( "SRCE", inFileName );
+	world.SetLayout( layout );
+
+	if( !world.SaveBinary( outFileName ) )
+	{
+		printf("Failed to write \"%s\"\n", outFileName);
+		return 1;
+	}
+
+	Vector2i worldSize = world.GetWorldSize();
+	printf("Converted \"%s\" (%dx%d) to \"%s\"\n", inFileName, worldSize.x, worldSize.y, outFileName);
+	return 0;
+}
+
+// Loads any non-chunked world file, and writes it out in the chunked format
+static int ConvertWorldChunked( const char* inFileName, const char* outFileName, int chunkSize )
+{
+	World world( inFileName );
+	if( !world.SaveChunked( outFileName, chunkSize ) )
+	{
+		printf("Failed to write \"%s\"\n", outFileName);
+		return 1;
+	}
+
+	Vector2i worldSize = world.GetWorldSize();
+	printf("Converted \"%s\" (%dx%d) to \"%s\" in %dx%d chunks\n", inFileName, worldSize.x, worldSize.y, outFileName, chunkSize, chunkSize);
+	return 0;
+}
+
+// Loads any non-chunked world file, and writes it out in the compressed format
+static int ConvertWorldCompressed( const char* inFileName, const char* outFileName, int blockSize )
+{
+	World world( inFileName );
+
+	UtilHighresClock clock( true );
+	bool isSaved = world.SaveCompressed( outFileName, blockSize );
+	clock.Stop();
+	if( !isSaved )
+	{
+		printf("Failed to write \"%s\"\n", outFileName);
+		return 1;
+	}
+
+	WorldBlockFile blockFile( outFileName );
+	Vector2i worldSize = world.GetWorldSize();
+	Uint64 tileBytes = (Uint64)worldSize.x * (Uint64)worldSize.y * sizeof(WorldTile);
+	printf("Converted \"%s\" (%dx%d) to \"%s\" in %dx%d blocks, in %.2f ms\n", inFileName, worldSize.x, worldSize.y, outFileName, blockSize, blockSize, 1000.0f * clock.GetTime());
+	printf("Size:           %.2f MB of tiles to %.2f MB (%.1fx)\n", tileBytes / (1024.0f * 1024.0f), blockFile.GetFileSize() / (1024.0f * 1024.0f), (float)tileBytes / (float)blockFile.GetFileSize());
+	return 0;
+}
+
+// Times how long each world takes to open, and then how long until every tile
+// has been read once; the latter matters for mapped worlds, which load lazily
+static int BenchmarkWorldLoad( int fileCount, char* fileNames[] )
+{
+	static const int iterationCount = 5;
+
+	printf("%-32s %12s %12s %12s\n", "World", "Size", "Open (ms)", "Touch (ms)");
+	for(int i = 0; i < fileCount; i++)
+	{
+		float openTime = 0.0f;
+		float touchTime = 0.0f;
+		Vector2i worldSize;
+
+		for(int j = 0; j < iterationCount; j++)
+		{
+			UtilHighresClock clock( true );
+			World world( fileNames[i] );
+			clock.Stop();
+			openTime += clock.GetTime();
+
+			clock.Start();
+			worldSize = world.GetWorldSize();
+			int checksum = 0;
+			for(int y = 0; y < worldSize.y; y++)
+			for(int x = 0; x < worldSize.x; x++)
+				checksum += world.GetWorldTile( x, y )->m_tileId;
+			clock.Stop();
+			touchTime += clock.GetTime();
+			s_benchmarkSink += checksum;
+		}
+
+		char sizeString[32];
+		sprintf(sizeString, "%dx%d", worldSize.x, worldSize.y);
+		printf("%-32s %12s %12.2f %12.2f\n", fileNames[i], sizeString, 1000.0f * openTime / iterationCount, 1000.0f * touchTime / iterationCount);
+	}
+
+	return 0;
+}
+
+// Casts rays from random tile centers at random angles; the seed is fixed, so
+// the same world always gets the same rays
+static int BenchmarkRays( const char* fileName, int rayCount )
+{
+	World world( fileName );
+	Player player( Vector3f( 0.5f, 0.5f, 0.5f ), 0.0f );
+	WorldView worldView( &world, &player );
+	Vector2i worldSize = world.GetWorldSize();
+
+	// Pre-generate the rays, so only the casts are timed
+	UtilRand rand( 1234u );
+	std::vector< Vector3f > rays( rayCount );
+	for(int i = 0; i < rayCount; i++)
+	{
+		rays[i].x = (float)((rand.Rand() >> 8) % worldSize.x) + 0.5f;
+		rays[i].y = (float)((rand.Rand() >> 8) % worldSize.y) + 0.5f;
+		rays[i].z = (float)((rand.Rand() >> 8) % 3600) / 3600.0f * 2.0f * (float)UtilPI;
+	}
+
+	float checksum = 0.0f;
+	UtilHighresClock clock( true );
+	for(int i = 0; i < rayCount; i++)
+	{
+		Vector3f hit = worldView.CollisionCheck( Vector3f( rays[i].x, rays[i].y, 0.5f ), rays[i].z );
+		checksum += hit.x;
+	}
+	clock.Stop();
+	s_benchmarkSink += (int)checksum;
+
+	// The player can walk off the map, and rays from there must stop right away,
+	// rather than walk past the border ring; a few from each side, and the corners
+	int offMapCount = 0;
+	for(int i = 0; i < 64; i++)
+	{
+		float along = (float)((rand.Rand() >> 8) % 1000) / 1000.0f;
+		float depth = 0.5f + (float)(i / 8);
+		Vector3f origin( along * worldSize.x, along * worldSize.y, 0.5f );
+		if( i % 4 == 0 )
+			origin.x = -depth;
+		else if( i % 4 == 1 )
+			origin.x = (float)worldSize.x + depth;
+		else if( i % 4 == 2 )
+			origin.y = -depth;
+		else
+			origin = Vector3f( (float)worldSize.x + depth, -depth, 0.5f );
+
+		Vector3f hit = worldView.CollisionCheck( origin, (float)i / 64.0f * 2.0f * (float)UtilPI );
+		offMapCount += (hit.x == origin.x && hit.y == origin.y) ? 1 : 0;
+	}
+
+	printf("World:          %s (%dx%d)\n", fileName, worldSize.x, worldSize.y);
+	printf("Memory:         %.2f MB\n", world.GetMemoryFootprint() / (1024.0f * 1024.0f));
+	printf("Rays:           %d in %.2f ms\n", rayCount, 1000.0f * clock.GetTime());
+	printf("Throughput:     %.3f Mrays/s\n", (float)rayCount / clock.GetTime() / 1e6f);
+	printf("Off the map:    %d of 64 rays stopped at their origin\n", offMapCount);
+	return (offMapCount == 64) ? 0 : 1;
+}
+
+// Renders frames (casting only) from random spots of each level of a stack, and
+// compares them against the same level rendered on its own, without the stack
+static int BenchmarkLevels( const char* fileName, int frameCount )
+{
+	static const Vector2i windowSize( 800, 600 );
+
+	WorldStack worldStack( fileName );
+	Vector2i worldSize = worldStack.GetLevel( 0 )->GetWorldSize();
+	printf("Levels:         %d of %dx%d\n", worldStack.GetLevelCount(), worldSize.x, worldSize.y);
+
+	for(int level = 0; level < worldStack.GetLevelCount(); level++)
+	{
+		// Same spots for both runs, on the level's open floor
+		const World* world = worldStack.GetLevel( level );
+		UtilRand rand( 1234u );
+		std::vector< Vector3f > spots;
+		for(int i = 0; i < frameCount * 100 && (int)spots.size() < frameCount; i++)
+		{
+			int x = (int)((rand.Rand() >> 8) % worldSize.x);
+			int y = (int)((rand.Rand() >> 8) % worldSize.y);
+			if( !world->IsSolid( x, y ) )
+				spots.push_back( Vector3f( x + 0.5f, y + 0.5f, (float)((rand.Rand() >> 8) % 3600) / 3600.0f * 2.0f * (float)UtilPI ) );
+		}
+		if( spots.empty() )
+			continue;
+
+		float frameTimes[2];
+		int levelSpans = 0;
+		for(int run = 0; run < 2; run++)
+		{
+			Player player( Vector3f( 0.5f, 0.5f, level + 0.5f ), 0.0f );
+			WorldView worldView( world, &player );
+			if( run == 1 )
+				worldView.SetWorldStack( &worldStack );
+
+			UtilHighresClock clock( true );
+			for(size_t i = 0; i < spots.size(); i++)
+			{
+				player.SetPosition( Vector3f( spots[i].x, spots[i].y, level + 0.5f ) );
+				player.SetFacing( spots[i].z );
+				worldView.CastColumns( windowSize );
+				if( run == 1 )
+					levelSpans += worldView.GetStats().m_levelSpans;
+			}
+			clock.Stop();
+			frameTimes[run] = clock.GetTime() / (float)spots.size();
+		}
+
+		printf("Level %d:        %.3f ms per frame on its own, %.3f ms stacked (%.2fx); %s, %.1f spans of other levels per frame\n",
+			level, 1000.0f * frameTimes[0], 1000.0f * frameTimes[1], frameTimes[1] / frameTimes[0],
+			worldStack.HasOpenFloor( level ) ? "holes in the floor" : "no holes", (float)levelSpans / (float)spots.size());
+	}
+
+	// The player can walk off the map, and every level must still render from
+	// there, as solid ground, without tracing past the border ring
+	int offMapFrames = 0;
+	int offMapCount = 0;
+	for(int level = 0; level < worldStack.GetLevelCount(); level++)
+	{
+		Player player( Vector3f( 0.5f, 0.5f, level + 0.5f ), 0.0f );
+		WorldView worldView( worldStack.GetLevel( level ), &player );
+		worldView.SetWorldStack( &worldStack );
+
+		const Vector2f offMapSpots[] = { Vector2f( -0.5f, worldSize.y / 2.0f ), Vector2f( worldSize.x + 2.5f, worldSize.y / 2.0f ),
+			Vector2f( worldSize.x / 2.0f, -3.5f ), Vector2f( -1.5f, worldSize.y + 1.5f ) };
+		for(int i = 0; i < 4; i++)
+		{
+			player.SetPosition( Vector3f( offMapSpots[i].x, offMapSpots[i].y, level + 0.5f ) );
+			player.SetFacing( (float)i * 0.5f * (float)UtilPI + 0.3f );
+			worldView.CastColumns( windowSize );
+			offMapCount += (worldView.GetStats().m_raysCast == worldView.GetStats().m_columnCount) ? 1 : 0;
+			offMapFrames++;
+		}
+	}
+	printf("Off the map:    %d of %d frames cast as solid ground\n", offMapCount, offMapFrames);
+	return (offMapCount == offMapFrames) ? 0 : 1;
+}
+
+// Casts the same rays through a world in each tile layout, at a few fixed
+// angles and at random ones, to compare their cache behaviour
+static int BenchmarkLayouts( const char* fileName, int rayCount )
+{
+	World world( fileName );
+	Player player( Vector3f( 0.5f, 0.5f, 0.5f ), 0.0f );
+	WorldView worldView( &world, &player );
+	Vector2i worldSize = world.GetWorldSize();
+
+	// Same origins for every run; a negative angle means a random one
+	UtilRand rand( 1234u );
+	std::vector< Vector3f > rays( rayCount );
+	for(int i = 0; i < rayCount; i++)
+	{
+		rays[i].x = (float)((rand.Rand() >> 8) % worldSize.x) + 0.5f;
+		rays[i].y = (float)((rand.Rand() >> 8) % worldSize.y) + 0.5f;
+		rays[i].z = (float)((rand.Rand() >> 8) % 3600) / 3600.0f * 2.0f * (float)UtilPI;
+	}
+
+	static const float angles[] = { 0.0f, 22.5f, 45.0f, 67.5f, 90.0f, -1.0f };
+	static const int angleCount = sizeof(angles) / sizeof(angles[0]);
+	static const char* layoutNames[] = { "row-major", "morton" };
+
+	printf("World:          %s (%dx%d), %d rays per run\n", fileName, worldSize.x, worldSize.y, rayCount);
+	printf("%-10s", "Angle");
+	for(int layout = WorldLayout_RowMajor; layout <= WorldLayout_Morton; layout++)
+		printf("%14s", layoutNames[layout]);
+	printf("   (Mrays/s)\n");
+
+	// Each angle is run in both layouts back to back
+	for(int angle = 0; angle < angleCount; angle++)
+	{
+		if( angles[angle] < 0.0f )
+			printf("%-10s", "random");
+		else
+			printf("%-10.1f", angles[angle]);
+
+		for(int layout = WorldLayout_RowMajor; layout <= WorldLayout_Morton; layout++)
+		{
+			world.SetLayout( (WorldLayout)layout );
+
+			float radians = angles[angle] / 180.0f * (float)UtilPI;
+			float checksum = 0.0f;
+			UtilHighresClock clock( true );
+			for(int i = 0; i < rayCount; i++)
+			{
+				Vector3f hit = worldView.CollisionCheck( Vector3f( rays[i].x, rays[i].y, 0.5f ), (angles[angle] < 0.0f) ? rays[i].z : radians );
+				checksum += hit.x;
+			}
+			clock.Stop();
+			s_benchmarkSink += (int)checksum;
+
+			printf("%14.3f", (float)rayCount / clock.GetTime() / 1e6f);
+		}
+		printf("\n");
+	}
+
+	return 0;
+}
+
+// Walks diagonally across a chunked world, reading the tiles around each step
+// like the renderer would, and reports the streaming counters
+static int BenchmarkWorldStreaming( const char* fileName )
+{
+	World world( fileName );
+	WorldChunkCache* chunkCache = world.GetChunkCache();
+	if( chunkCache == NULL )
+	{
+		printf("\"%s\" is not a chunked world\n", fileName);
+		return 1;
+	}
+
+	Vector2i worldSize = world.GetWorldSize();
+	int stepCount = min( worldSize.x, worldSize.y );
+	int checksum = 0;
+
+	UtilHighresClock clock( true );
+	for(int i = 0; i < stepCount; i++)
+	{
+		Vector3f position( (float)i + 0.5f, (float)i + 0.5f, 0.5f );
+		world.UpdateStreaming( position );
+
+		for(int y = max( 0, i - 8 ); y < min( worldSize.y, i + 8 ); y++)
+		for(int x = max( 0, i - 8 ); x < min( worldSize.x, i + 8 ); x++)
+			checksum += world.GetWorldTile( x, y )->m_tileId;
+	}
+	clock.Stop();
+	s_benchmarkSink += checksum;
+
+	const WorldChunkStats& stats = chunkCache->GetStats();
+	printf("Steps:          %d in %.2f ms\n", stepCount, 1000.0f * clock.GetTime());
+	printf("Hit rate:       %.2f%% (%llu hits, %llu misses)\n", 100.0f * stats.GetHitRate(), (unsigned long long)stats.m_hits, (unsigned long long)stats.m_misses);
+	printf("Stall time:     %.2f ms\n", 1000.0f * stats.m_stallTime);
+	printf("Loads:          %llu\n", (unsigned long long)stats.m_loads);
+	printf("Evictions:      %llu\n", (unsigned long long)stats.m_evictions);
+	printf("Resident:       %d chunks, %.1f MB\n", stats.m_residentChunks, stats.m_residentBytes / (1024.0f * 1024.0f));
+	return 0;
+}
+
+static int BenchmarkFirstFrame( const char* fileName )
+{
+	// Synchronous load, as the reference
+	UtilHighresClock clock( true );
+	Vector2i worldSize;
+	{
+		World world( fileName );
+		worldSize = world.GetWorldSize();
+	}
+	clock.Stop();
+	float syncTime = clock.GetTime();
+
+	// Background load from the world's center: the world is playable once the
+	// rows around the origin are in, which is the first band posted
+	Vector2i origin( worldSize.x / 2, worldSize.y / 2 );
+	Vector3f position( origin.x + 0.5f, origin.y + 0.5f, 0.5f );
+	clock.Start();
+	World world( fileName, true, origin );
+	clock.Stop();
+	float constructTime = clock.GetTime();
+
+	// Installing the first band bumps the revision
+	Uint32 revision = world.GetRevision();
+	float firstPlayableTime = 0.0f;
+	while( world.IsLoading() )
+	{
+		world.UpdateStreaming( position );
+		if( firstPlayableTime == 0.0f && world.GetRevision() != revision )
+		{
+			clock.Stop();
+			firstPlayableTime = clock.GetTime();
+		}
+		SDL_Delay( 1 );
+	}
+	world.FlushEdits();
+	clock.Stop();
+
+	printf("World:            %dx%d\n", worldSize.x, worldSize.y);
+	printf("Synchronous load: %.2f ms\n", 1000.0f * syncTime);
+	printf("Background load:  %.2f ms to return, %.2f ms to the origin's rows, %.2f ms in full\n",
+		1000.0f * constructTime, 1000.0f * firstPlayableTime, 1000.0f * clock.GetTime());
+	return 0;
+}
+
+// Saves a text copy of the world with one tile changed at a time, and times how
+// long each save takes to reach a second copy of the world through the watcher
+static int BenchmarkReload( const char* fileName, int editCount )
+{
+	static const float timeout = 5.0f;
+
+	// Work on a copy; the world file itself is left alone
+	std::string copyFileName = std::string( fileName ) + ".reload.txt";
+	World editedWorld( fileName );
+	Vector2i worldSize = editedWorld.GetWorldSize();
+	if( !editedWorld.SaveText( copyFileName ) )
+	{
+		printf("Unable to write \"%s\"\n", copyFileName.c_str());
+		return 1;
+	}
+
+	WorldFileWatcher watcher( copyFileName );
+	World world( copyFileName );
+	if( !watcher.IsWatching() )
+	{
+		remove( copyFileName.c_str() );
+		return 1;
+	}
+
+	// Hands the world over as the version saves are compared against
+	watcher.ApplyChanges( &world );
+
+	UtilRand rand( 1234u );
+	float totalLatency = 0.0f;
+	float maxLatency = 0.0f;
+	int mismatchCount = 0;
+	for(int i = 0; i < editCount; i++)
+	{
+		int x = rand.Rand() % worldSize.x;
+		int y = rand.Rand() % worldSize.y;
+		Uint8 tileId = (editedWorld.GetWorldTile( x, y )->m_tileId == WorldTile_Empty) ? WorldTile_Solid : WorldTile_Empty;
+		editedWorld.SetTile( x, y, tileId );
+		editedWorld.SaveText( copyFileName );
+
+		// The latency runs from when the watcher noticed the save
+		float latency = 0.0f;
+		UtilHighresClock waitClock( true );
+		while( watcher.ApplyChanges( &world, &latency ) == 0 )
+		{
+			waitClock.Stop();
+			if( waitClock.GetTime() > timeout )
+			{
+				printf("No reload within %.0f s\n", timeout);
+				remove( copyFileName.c_str() );
+				return 1;
+			}
+			SDL_Delay( 1 );
+		}
+		world.FlushEdits();
+
+		if( world.GetWorldTile( x, y )->m_tileId != tileId )
+			mismatchCount++;
+		totalLatency += latency;
+		maxLatency = max( maxLatency, latency );
+	}
+
+	remove( copyFileName.c_str() );
+
+	printf("World:   %dx%d\n", worldSize.x, worldSize.y);
+	printf("Reloads: %d single-tile saves, %d not applied\n", editCount, mismatchCount);
+	printf("Latency: %.2f ms on average, %.2f ms at most\n", 1000.0f * totalLatency / max( editCount, 1 ), 1000.0f * maxLatency);
+	return (mismatchCount == 0) ? 0 : 1;
+}
+
+// Decompresses a whole compressed world on one thread and on all of them, then
+// random regions, and reports the throughput in decompressed tiles
+static int BenchmarkCompressed( const char* fileName )
+{
+	static const int regionCount = 1000;
+	static const int regionSize = 256;
+
+	WorldBlockFile blockFile( fileName );
+	Vector2i worldSize = blockFile.GetWorldSize();
+	Uint64 tileBytes = (Uint64)worldSize.x * (Uint64)worldSize.y * sizeof(WorldTile);
+	std::vector< WorldTile > tiles( (size_t)worldSize.x * worldSize.y );
+	WorldRegion region = { 0, 0, worldSize.x, worldSize.y };
+
+	printf("World:          %dx%d in %dx%d blocks\n", worldSize.x, worldSize.y, blockFile.GetBlockSize(), blockFile.GetBlockSize());
+	printf("Size:           %.2f MB of tiles in %.2f MB (%.1fx)\n", tileBytes / (1024.0f * 1024.0f), blockFile.GetFileSize() / (1024.0f * 1024.0f), (float)tileBytes / (float)blockFile.GetFileSize());
+
+	// Touch the whole mapping once, so the disk cache doesn't skew the first run
+	UtilHighresClock clock( true );
+	blockFile.ReadRegion( region, &tiles[0], worldSize.x );
+	clock.Stop();
+	printf("First read:     %.2f ms\n", 1000.0f * clock.GetTime());
+
+	clock.Start();
+	bool isValid = blockFile.ReadRegion( region, &tiles[0], worldSize.x );
+	clock.Stop();
+	printf("One thread:     %.2f ms, %.2f GB/s\n", 1000.0f * clock.GetTime(), tileBytes / (clock.GetTime() * 1024.0f * 1024.0f * 1024.0f));
+
+	ThreadPool threadPool;
+	clock.Start();
+	isValid &= blockFile.ReadRegion( region, &tiles[0], worldSize.x, &threadPool );
+	clock.Stop();
+	printf("%2d threads:     %.2f ms, %.2f GB/s\n", threadPool.GetThreadCount(), 1000.0f * clock.GetTime(), tileBytes / (clock.GetTime() * 1024.0f * 1024.0f * 1024.0f));
+
+	// Random regions only decompress the blocks under them
+	UtilRand rand( 1234u );
+	int width = min( regionSize, worldSize.x );
+	int height = min( regionSize, worldSize.y );
+	clock.Start();
+	for(int i = 0; i < regionCount && isValid; i++)
+	{
+		WorldRegion randomRegion = { (int)(rand.Rand() % (worldSize.x - width + 1)), (int)(rand.Rand() % (worldSize.y - height + 1)), width, height };
+		isValid &= blockFile.ReadRegion( randomRegion, &tiles[0], width );
+	}
+	clock.Stop();
+	printf("Region reads:   %.3f ms per %dx%d region\n", 1000.0f * clock.GetTime() / regionCount, width, height);
+
+	if( !isValid )
+	{
+		printf("\"%s\" is corrupt\n", fileName);
+		return 1;
+	}
+	return 0;
+}
+
+// Spawn record of an entity, as read from an entity dump
+struct EntitySpawn
+{
+	char m_spriteName[64];
+	Vector3f m_position;
+};
+
+// Streams the entities of a dump ({ "entities": [ { "sprite": ..., "position": [ x, y, z ], ... }, ... ] })
+// straight into a fixed-size batch of spawn records, without building any tree; other
+// members are skipped
+class EntityDumpHandler : public SimpleJSON::JsonHandler
+{
+public:
+
+	EntityDumpHandler()
+		: m_depth( 0 )
+		, m_isSpriteKey( false )
+		, m_isPositionKey( false )
+		, m_positionIndex( 0 )
+		, m_batchCount( 0 )
+		, m_entityCount( 0 )
+	{
+	}
+
+	// Depth 1 is the root, 2 the entity array, 3 an entity, 4 its position (or any other array)
+	bool OnObjectStart()
+	{
+		if( ++m_depth == 3 )
+		{
+			m_batch[m_batchCount].m_spriteName[0] = '\0';
+			m_batch[m_batchCount].m_position = Vector3f( 0.0f, 0.0f, 0.0f );
+		}
+		return true;
+	}
+
+	bool OnKey( const char* key, size_t keyLength )
+	{
+		m_isSpriteKey = (m_depth == 3 && keyLength == 6 && memcmp( key, "sprite", 6 ) == 0);
+		m_isPositionKey = (m_depth == 3 && keyLength == 8 && memcmp( key, "position", 8 ) == 0);
+		return true;
+	}
+
+	bool OnObjectEnd()
+	{
+		// Entity done; spawn the batch once full
+		if( m_depth-- == 3 && ++m_batchCount == EntityBatchSize )
+			SpawnBatch();
+		return true;
+	}
+
+	bool OnArrayStart()
+	{
+		m_depth++;
+		m_positionIndex = 0;
+		return true;
+	}
+
+	bool OnArrayEnd()
+	{
+		m_depth--;
+		return true;
+	}
+
+	bool OnNumber( double value )
+	{
+		Vector3f& position = m_batch[m_batchCount].m_position;
+		if( m_depth == 4 && m_isPositionKey && m_positionIndex < 3 )
+		{
+			if( m_positionIndex == 0 )
+				position.x = (float)value;
+			else if( m_positionIndex == 1 )
+				position.y = (float)value;
+			else
+				position.z = (float)value;
+			m_positionIndex++;
+		}
+		return true;
+	}
+
+	bool OnString( const char* value, size_t length )
+	{
+		if( m_depth == 3 && m_isSpriteKey )
+		{
+			size_t copyLength = min( length, sizeof(m_batch[0].m_spriteName) - 1 );
+			memcpy( m_batch[m_batchCount].m_spriteName, value, copyLength );
+			m_batch[m_batchCount].m_spriteName[copyLength] = '\0';
+		}
+		return true;
+	}
+
+	// Spawns what is left in the batch
+	void SpawnBatch()
+	{
+		// Stands in for creating the entities
+		for(int i = 0; i < m_batchCount; i++)
+			s_benchmarkSink += (int)m_batch[i].m_position.x + m_batch[i].m_spriteName[0];
+		m_entityCount += m_batchCount;
+		m_batchCount = 0;
+	}
+
+	int GetEntityCount() const { return m_entityCount; }
+
+private:
+
+	static const int EntityBatchSize = 256;
+
+	int m_depth;
+	bool m_isSpriteKey;
+	bool m_isPositionKey;
+	int m_positionIndex;
+
+	EntitySpawn m_batch[EntityBatchSize];
+	int m_batchCount;
+	int m_entityCount;
+
+};
+
+// Writes an entity dump of about the given size, then streams it back through an
+// EntityDumpHandler, and reports the throughput and the peak memory use
+static int BenchmarkJsonStream( const char* fileName, int megabyteCount )
+{
+	static const char* const spriteNames[] = { "Guard.bmp", "Barrel.bmp", "Lamp.bmp", "Key.bmp" };
+
+	FILE* file = fopen( fileName, "wb" );
+	if( file == NULL )
+	{
+		printf("Unable to write \"%s\"\n", fileName);
+		return 1;
+	}
+
+	UtilRand rand( 1234u );
+	Uint64 targetSize = (Uint64)megabyteCount * 1024 * 1024;
+	Uint64 fileSize = fprintf( file, "{\n  \"version\": 1,\n  \"entities\": [\n" );
+	int entityCount = 0;
+	while( fileSize < targetSize )
+	{
+		int spriteIndex = (rand.Rand() >> 8) % 4;
+		fileSize += fprintf( file, "%s    { \"sprite\": \"Sprites/%s\", \"position\": [ %.3f, %.3f, 0.5 ], \"health\": %d, \"tags\": [ \"%s\", \"spawned\" ], \"active\": %s }",
+			(entityCount > 0) ? ",\n" : "", spriteNames[spriteIndex], (rand.Rand() >> 8) % 409600 / 100.0f, (rand.Rand() >> 8) % 409600 / 100.0f,
+			(int)((rand.Rand() >> 8) % 200), (spriteIndex == 0) ? "enemy" : "prop", ((rand.Rand() >> 8) & 1) ? "true" : "false" );
+		entityCount++;
+	}
+	fileSize += fprintf( file, "\n  ]\n}\n" );
+	fclose( file );
+
+	printf("Dump:           %.1f MB, %d entities\n", fileSize / (1024.0f * 1024.0f), entityCount);
+	printf("Peak memory:    %.1f MB before streaming\n", UtilGetPeakMemoryUsage() / (1024.0f * 1024.0f));
+
+	file = fopen( fileName, "rb" );
+	EntityDumpHandler handler;
+	UtilHighresClock clock( true );
+	bool isValid = SimpleJSON::StreamSimpleJSON( file, &handler );
+	handler.SpawnBatch();
+	clock.Stop();
+	fclose( file );
+
+	printf("Streamed:       %.2f s, %.1f MB/s, %d entities spawned\n", clock.GetTime(), fileSize / (clock.GetTime() * 1024.0f * 1024.0f), handler.GetEntityCount());
+	printf("Peak memory:    %.1f MB after streaming\n", UtilGetPeakMemoryUsage() / (1024.0f * 1024.0f));
+
+	if( !isValid || handler.GetEntityCount() != entityCount )
+	{
+		printf("Stream parse failed\n");
+		return 1;
+	}
+	return 0;
+}
+
+// Writes an array of random numbers, as JSON would hold them (any double in full
+// precision, short coordinates and 64-bit integers), parses it into a document,
+// and checks every number against the value written and against strtod(...), then
+// times the parse against strtod(...) going through the same text
+static int BenchmarkJsonNumbers( int numberCount )
+{
+	UtilRand rand( 1234u );
+	std::string text = "[";
+	std::vector< double > values;
+	std::vector< bool > isIntegers;
+	std::vector< long long > integers;
+	char numberString[64];
+	while( (int)values.size() < numberCount )
+	{
+		// Any finite double, from 64 random bits
+		Uint64 bits = 0;
+		for(int i = 0; i < 3; i++)
+			bits = (bits << 24) | ((rand.Rand() >> 8) & 0xFFFFFF);
+		double value = 0.0;
+		memcpy( &value, &bits, sizeof(value) );
+
+		// Infinities and NaNs are written as integers instead
+		int kind = values.size() % 3;
+		if( kind == 0 && value - value != 0.0 )
+			kind = 2;
+
+		if( kind == 0 )
+			sprintf( numberString, "%.17g", value );
+		else if( kind == 1 )
+			sprintf( numberString, "%.3f", (int)((rand.Rand() >> 8) % 819200) / 100.0 - 4096.0 );
+		else
+			sprintf( numberString, "%lld", (long long)bits );
+
+		if( values.size() > 0 )
+			text += ", ";
+		text += numberString;
+		values.push_back( (kind == 0) ? value : strtod( numberString, NULL ) );
+		// Anything written without a fraction or exponent (%.17g can be) is an integer
+		long long integer = 0;
+		isIntegers.push_back( strpbrk( numberString, ".eE" ) == NULL );
+		integers.push_back( (sscanf( numberString, "%lld", &integer ) == 1) ? integer : 0 );
+	}
+	text += "]";
+
+	// Correctly rounded: every number, bit for bit, and 64-bit integers exactly
+	SimpleJSON::JsonDocument document;
+	UtilHighresClock clock( true );
+	bool isValid = document.Parse( text.c_str(), text.length() );
+	clock.Stop();
+	float parseTime = clock.GetTime();
+
+	int mismatchCount = 0;
+	SimpleJSON::JsonRef root = document.GetRoot();
+	for(int i = 0; isValid && i < numberCount; i++)
+	{
+		SimpleJSON::JsonRef element = root.GetElement( i );
+		double value = element.GetNumber();
+		bool isIntegerValid = (element.IsInteger() == isIntegers[i]) && (!isIntegers[i] || element.GetInteger() == integers[i]);
+		if( memcmp( &value, &values[i], sizeof(value) ) != 0 || !isIntegerValid )
+		{
+			if( mismatchCount++ < 10 )
+				printf("Mismatch:       element %d, %.17g for %.17g\n", i, value, values[i]);
+		}
+	}
+
+	// The same numbers through strtod(...)
+	clock.Start();
+	double sum = 0.0;
+	const char* cursor = text.c_str() + 1;
+	for(int i = 0; i < numberCount; i++)
+	{
+		char* numberEnd = NULL;
+		sum += strtod( cursor, &numberEnd );
+		cursor = numberEnd + 2;
+	}
+	clock.Stop();
+	s_benchmarkSink += (int)(sum != 0.0);
+
+	printf("Numbers:        %d, %.1f MB of text\n", numberCount, text.length() / (1024.0f * 1024.0f));
+	printf("Document parse: %.1f ms, %.1f ns per number\n", parseTime * 1000.0f, parseTime * 1e9f / numberCount);
+	printf("strtod:         %.1f ms, %.1f ns per number\n", clock.GetTime() * 1000.0f, clock.GetTime() * 1e9f / numberCount);
+	printf("Mismatches:     %d\n", mismatchCount);
+
+	if( !isValid || mismatchCount > 0 )
+	{
+		printf("Number parse failed\n");
+		return 1;
+	}
+	return 0;
+}
+
+// Writes per-frame telemetry of about the given size through the JsonWriter builder
+// calls, out to the given file in one write; then parses it back and writes the
+// tree and the document out again, which have to match. Also writes random doubles
+// and reads them back. Reports the throughput of each
+static int BenchmarkJsonWrite( const char* fileName, int megabyteCount )
+{
+	static const char* const eventNames[] = { "spawn", "pickup", "door \"north\"", "hit\tcritical" };
+
+	UtilRand rand( 1234u );
+	SimpleJSON::JsonWriter writer;
+	Uint64 targetSize = (Uint64)megabyteCount * 1024 * 1024;
+	UtilHighresClock clock( true );
+	writer.StartObject();
+	writer.Key( "frames" );
+	writer.StartArray();
+	for(int frame = 0; writer.GetLength() < targetSize; frame++)
+	{
+		writer.StartObject();
+		writer.Key( "frame" );
+		writer.Integer( frame );
+		writer.Key( "time" );
+		writer.Number( frame / 60.0 );
+		writer.Key( "position" );
+		writer.StartArray();
+		for(int i = 0; i < 3; i++)
+			writer.Number( (rand.Rand() >> 8) % 409600 / 100.0 );
+		writer.EndArray();
+		writer.Key( "frameTime" );
+		writer.Number( 1.0 / (55 + (rand.Rand() >> 8) % 10) );
+		writer.Key( "level" );
+		writer.String( "Levels/Castle.levels" );
+		writer.Key( "events" );
+		writer.StartArray();
+		for(int i = (rand.Rand() >> 8) % 3; i > 0; i--)
+			writer.String( eventNames[(rand.Rand() >> 8) % 4] );
+		writer.EndArray();
+		writer.Key( "paused" );
+		writer.Bool( false );
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writer.EndObject();
+	clock.Stop();
+	float buildTime = clock.GetTime();
+
+	FILE* file = fopen( fileName, "wb" );
+	if( file == NULL )
+	{
+		printf("Unable to write \"%s\"\n", fileName);
+		return 1;
+	}
+	clock.Start();
+	bool isWritten = writer.WriteToFile( file );
+	fclose( file );
+	clock.Stop();
+
+	float megabytes = writer.GetLength() / (1024.0f * 1024.0f);
+	printf("Telemetry:      %.1f MB, %.1f MB/s built, written in %.2f s\n", megabytes, megabytes / buildTime, clock.GetTime());
+
+	// Back out of a tree and a document; both have their keys sorted
+	SimpleJSON::JsonValue rootValue;
+	SimpleJSON::JsonDocument document;
+	bool isValid = isWritten && SimpleJSON::ParseSimpleJSON( writer.GetData(), writer.GetLength(), &rootValue ) &&
+		document.Parse( writer.GetData(), writer.GetLength() );
+
+	SimpleJSON::JsonWriter treeWriter;
+	clock.Start();
+	treeWriter.Value( &rootValue );
+	clock.Stop();
+	printf("Tree:           %.1f MB/s\n", treeWriter.GetLength() / (clock.GetTime() * 1024.0f * 1024.0f));
+
+	SimpleJSON::JsonWriter documentWriter;
+	clock.Start();
+	documentWriter.Value( document.GetRoot() );
+	clock.Stop();
+	printf("Document:       %.1f MB/s\n", documentWriter.GetLength() / (clock.GetTime() * 1024.0f * 1024.0f));
+
+	isValid = isValid && treeWriter.GetLength() == documentWriter.GetLength() &&
+		memcmp( treeWriter.GetData(), documentWriter.GetData(), treeWriter.GetLength() ) == 0;
+
+	// Any finite double reads back exactly
+	const int numberCount = 1000000;
+	std::vector< double > values;
+	while( (int)values.size() < numberCount )
+	{
+		Uint64 bits = 0;
+		for(int i = 0; i < 3; i++)
+			bits = (bits << 24) | ((rand.Rand() >> 8) & 0xFFFFFF);
+		double value = 0.0;
+		memcpy( &value, &bits, sizeof(value) );
+		if( value - value == 0.0 )
+			values.push_back( value );
+	}
+
+	SimpleJSON::JsonWriter numberWriter;
+	clock.Start();
+	numberWriter.StartArray();
+	for(int i = 0; i < numberCount; i++)
+		numberWriter.Number( values[i] );
+	numberWriter.EndArray();
+	clock.Stop();
+	printf("Numbers:        %.1f ns per number\n", clock.GetTime() * 1e9f / numberCount);
+
+	int mismatchCount = 0;
+	isValid = isValid && document.Parse( numberWriter.GetData(), numberWriter.GetLength() );
+	for(int i = 0; isValid && i < numberCount; i++)
+	{
+		double value = document.GetRoot().GetElement( i ).GetNumber();
+		if( memcmp( &value, &values[i], sizeof(value) ) != 0 && mismatchCount++ < 10 )
+			printf("Mismatch:       %.17g read back as %.17g\n", values[i], value);
+	}
+
+	if( !isValid || mismatchCount > 0 )
+	{
+		printf("Write failed\n");
+		return 1;
+	}
+	return 0;
+}
+
+// Looks up values of a generated tile and tuning configuration the way game code
+// would: with std::map::find chains on the parsed tree, and with compiled JsonPaths
+// on the tree and on a document, first uncached, then cached; reports the time per
+// look-up of each, and checks they all find the same values
+static int BenchmarkJsonPaths( int lookupCount )
+{
+	static const int tileCount = 256;
+
+	// The configuration, written out and parsed back both ways
+	SimpleJSON::JsonWriter writer;
+	writer.StartObject();
+	writer.Key( "tiles" );
+	writer.StartArray();
+	char textureName[64];
+	for(int i = 0; i < tileCount; i++)
+	{
+		sprintf( textureName, "Textures/Tile%d.bmp", i );
+		writer.StartObject();
+		writer.Key( "id" );
+		writer.Integer( i );
+		writer.Key( "texture" );
+		writer.String( textureName );
+		writer.Key( "height" );
+		writer.Number( (i % 10) / 10.0 );
+		writer.Key( "solid" );
+		writer.Bool( (i & 1) != 0 );
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writer.Key( "tuning" );
+	writer.StartObject();
+	writer.Key( "player" );
+	writer.StartObject();
+	writer.Key( "speed" );
+	writer.Number( 3.5 );
+	writer.Key( "turnRate" );
+	writer.Number( 2.25 );
+	writer.EndObject();
+	writer.EndObject();
+	writer.EndObject();
+
+	SimpleJSON::JsonValue rootValue;
+	SimpleJSON::JsonDocument document;
+	if( !SimpleJSON::ParseSimpleJSON( writer.GetData(), writer.GetLength(), &rootValue ) || !document.Parse( writer.GetData(), writer.GetLength() ) )
+	{
+		printf("Unable to parse the configuration\n");
+		return 1;
+	}
+
+	// Each tile's texture, and a tuning value, compiled once
+	std::vector< SimpleJSON::JsonPath > texturePaths( tileCount );
+	for(int i = 0; i < tileCount; i++)
+	{
+		sprintf( textureName, "/tiles/%d/texture", i );
+		texturePaths[i].Compile( textureName );
+	}
+	SimpleJSON::JsonPath speedPath( "/tuning/player/speed" );
+
+	// Chained finds, with a temporary key string at each level
+	int mismatchCount = 0;
+	size_t textureLengths = 0;
+	double speeds = 0.0;
+	UtilHighresClock clock( true );
+	for(int i = 0; i < lookupCount; i++)
+	{
+		const SimpleJSON::JsonObject& root = *rootValue.m_data.m_object;
+		const SimpleJSON::JsonArray& tiles = *root.find( "tiles" )->second->m_data.m_array;
+		textureLengths += tiles[i % tileCount]->m_data.m_object->find( "texture" )->second->m_data.m_string->length();
+		const SimpleJSON::JsonObject& tuning = *root.find( "tuning" )->second->m_data.m_object;
+		speeds += tuning.find( "player" )->second->m_data.m_object->find( "speed" )->second->m_data.m_number;
+	}
+	clock.Stop();
+	float findTime = clock.GetTime();
+	size_t expectedLengths = textureLengths;
+	double expectedSpeeds = speeds;
+
+	textureLengths = 0;
+	speeds = 0.0;
+	clock.Start();
+	for(int i = 0; i < lookupCount; i++)
+	{
+		textureLengths += texturePaths[i % tileCount].Resolve( &rootValue )->m_data.m_string->length();
+		speeds += speedPath.Resolve( &rootValue )->m_data.m_number;
+	}
+	clock.Stop();
+	float treeTime = clock.GetTime();
+	mismatchCount += (textureLengths != expectedLengths || speeds != expectedSpeeds) ? 1 : 0;
+
+	// Every path's first look-up in the document is uncached
+	textureLengths = 0;
+	speeds = 0.0;
+	clock.Start();
+	for(int i = 0; i < tileCount; i++)
+		textureLengths += texturePaths[i].Resolve( document ).GetString().m_length;
+	clock.Stop();
+	float uncachedTime = clock.GetTime();
+	textureLengths = 0;
+
+	clock.Start();
+	for(int i = 0; i < lookupCount; i++)
+	{
+		textureLengths += texturePaths[i % tileCount].Resolve( document ).GetString().m_length;
+		speeds += speedPath.Resolve( document ).GetNumber();
+	}
+	clock.Stop();
+	float cachedTime = clock.GetTime();
+	mismatchCount += (textureLengths != expectedLengths || speeds != expectedSpeeds) ? 1 : 0;
+
+	printf("Chained finds:  %.1f ns per look-up\n", findTime * 1e9f / (2.0f * lookupCount));
+	printf("Tree paths:     %.1f ns per look-up\n", treeTime * 1e9f / (2.0f * lookupCount));
+	printf("Document paths: %.1f ns per look-up uncached, %.1f ns cached\n", uncachedTime * 1e9f / tileCount, cachedTime * 1e9f / (2.0f * lookupCount));
+
+	if( mismatchCount > 0 )
+	{
+		printf("Look-ups disagree\n");
+		return 1;
+	}
+	return 0;
+}
+
+// Loads every JSON file matching the given pattern one after the other, into trees
+// as start-up does now, then in a batch on one thread and on the given count of
+// threads (one per core by default); reports the time and throughput of each
+static int BenchmarkJsonBatch( const char* pattern, int threadCount )
+{
+	std::vector< std::string > fileNames;
+	if( UtilFindFiles( pattern, fileNames ) == 0 )
+	{
+		printf("No files match \"%s\"\n", pattern);
+		return 1;
+	}
+
+	// Once through untimed, so the disk cache doesn't skew the first run
+	JsonBatchLoader* loader = new JsonBatchLoader();
+	loader->Load( fileNames );
+	int failedCount = loader->WaitAll();
+	float megabytes = loader->GetLoadedBytes() / (1024.0f * 1024.0f);
+	delete loader;
+
+	printf("Files:          %d, %.2f MB, %d not valid JSON\n", (int)fileNames.size(), megabytes, failedCount);
+
+	UtilHighresClock clock( true );
+	int treeFailedCount = 0;
+	for(size_t i = 0; i < fileNames.size(); i++)
+	{
+		FILE* file = fopen( fileNames[i].c_str(), "rb" );
+		SimpleJSON::JsonValue rootValue;
+		treeFailedCount += (file != NULL && SimpleJSON::ParseSimpleJSON( file, &rootValue )) ? 0 : 1;
+		if( file != NULL )
+			fclose( file );
+	}
+	clock.Stop();
+	printf("In sequence:    %.2f ms, %.1f MB/s\n", 1000.0f * clock.GetTime(), megabytes / clock.GetTime());
+
+	int batchFailedCounts[2] = { 0, 0 };
+	for(int pass = 0; pass < 2; pass++)
+	{
+		ThreadPool threadPool( (pass == 0) ? 1 : threadCount );
+		loader = new JsonBatchLoader( &threadPool );
+		loader->Load( fileNames );
+		batchFailedCounts[pass] = loader->WaitAll();
+		printf("%2d thread%s     %.2f ms, %.1f MB/s\n", threadPool.GetThreadCount(), (threadPool.GetThreadCount() == 1) ? ": " : "s:", 1000.0f * loader->GetLoadTime(), megabytes / loader->GetLoadTime());
+		delete loader;
+	}
+
+	if( treeFailedCount != failedCount || batchFailedCounts[0] != failedCount || batchFailedCounts[1] != failedCount )
+	{
+		printf("Loads disagree on which files are valid\n");
+		return 1;
+	}
+	return 0;
+}
+
+// In-memory text to stream from
+class JsonTextSource : public SimpleJSON::JsonSource
+{
+public:
+
+	JsonTextSource( const std::string& text ) : m_text( text ), m_offset( 0 ) { }
+
+	size_t Read( char* buffer, size_t size )
+	{
+		size_t readSize = min( size, m_text.size() - m_offset );
+		memcpy( buffer, m_text.data() + m_offset, readSize );
+		m_offset += readSize;
+		return readSize;
+	}
+
+private:
+
+	const std::string& m_text;
+	size_t m_offset;
+
+};
+
+// Parses (then frees) the given JSON text into a tree, a document, or as a stream
+static bool ParseCorpusText( int parserIndex, const std::string& text )
+{
+	if( parserIndex == 0 )
+	{
+		SimpleJSON::JsonValue rootValue;
+		return SimpleJSON::ParseSimpleJSON( text.data(), text.size(), &rootValue );
+	}
+	else if( parserIndex == 1 )
+	{
+		SimpleJSON::JsonDocument document;
+		return document.Parse( text.data(), text.size() );
+	}
+	else
+	{
+		JsonTextSource source( text );
+		SimpleJSON::JsonHandler handler;
+		return SimpleJSON::StreamSimpleJSON( &source, &handler );
+	}
+}
+
+// Writes a value nested the given count of levels deep, alternating objects and arrays
+static void WriteNestedValue( SimpleJSON::JsonWriter* writer, int depth, UtilRand* rand )
+{
+	if( depth == 0 )
+		writer->Integer( (rand->Rand() >> 8) % 1000 );
+	else if( depth & 1 )
+	{
+		writer->StartObject();
+		writer->Key( "id" );
+		writer->Integer( depth );
+		writer->Key( "child" );
+		WriteNestedValue( writer, depth - 1, rand );
+		writer->EndObject();
+	}
+	else
+	{
+		writer->StartArray();
+		writer->Bool( true );
+		WriteNestedValue( writer, depth - 1, rand );
+		writer->EndArray();
+	}
+}
+
+// Generates a corpus of JSON of the given size per kind: small configuration files
+// (each one parsed on its own), a large array of numbers, deeply nested values, and
+// long strings. It is the same on every run, so results can be compared across
+// changes. Then parses it all into trees, documents, and as streams, and reports the
+// throughput (best of a few runs), allocations per MB and peak heap use of each
+static int BenchmarkJsonCorpus( int megabyteCount )
+{
+	static const char* const kindNames[] = { "configs", "numbers", "nesting", "strings" };
+	static const char* const parserNames[] = { "tree", "document", "stream" };
+	static const int kindCount = 4;
+	static const int parserCount = 3;
+	static const int runCount = 3;
+
+	UtilRand rand( 1234u );
+	size_t targetSize = (size_t)megabyteCount * 1024 * 1024;
+	std::vector< std::string > corpus[kindCount];
+	SimpleJSON::JsonWriter writer;
+	char name[64];
+
+	// Configurations of a few hundred bytes each, like the tile types
+	for(size_t size = 0; size < targetSize; size += corpus[0].back().size())
+	{
+		int id = (int)corpus[0].size();
+		writer.Clear();
+		writer.StartObject();
+		sprintf( name, "Tile%d", id );
+		writer.Key( "name" );
+		writer.String( name );
+		sprintf( name, "Textures/Tile%d.bmp", id );
+		writer.Key( "texture" );
+		writer.String( name );
+		writer.Key( "solid" );
+		writer.Bool( (id & 1) != 0 );
+		writer.Key( "height" );
+		writer.Number( (rand.Rand() >> 8) % 100 / 100.0 );
+		writer.Key( "frames" );
+		writer.StartArray();
+		for(int i = 4 + (rand.Rand() >> 8) % 8; i > 0; i--)
+			writer.Integer( (rand.Rand() >> 8) % 256 );
+		writer.EndArray();
+		writer.Key( "sound" );
+		writer.StartObject();
+		writer.Key( "file" );
+		writer.String( "Sounds/Step.wav" );
+		writer.Key( "volume" );
+		writer.Number( (rand.Rand() >> 8) % 1000 / 1000.0 );
+		writer.EndObject();
+		writer.EndObject();
+		corpus[0].push_back( std::string( writer.GetData(), writer.GetLength() ) );
+	}
+
+	// Integers, short coordinates and doubles in full precision
+	writer.Clear();
+	writer.StartArray();
+	while( writer.GetLength() < targetSize )
+	{
+		unsigned int kind = (rand.Rand() >> 8) % 3;
+		if( kind == 0 )
+			writer.Integer( (rand.Rand() >> 8) % 100000 );
+		else if( kind == 1 )
+			writer.Number( (int)((rand.Rand() >> 8) % 409600) / 100.0 );
+		else
+			writer.Number( (rand.Rand() >> 8) / (double)(rand.Rand() | 1) );
+	}
+	writer.EndArray();
+	corpus[1].push_back( std::string( writer.GetData(), writer.GetLength() ) );
+
+	// Values up to 400 levels deep, within the limit of the tree and document parsers
+	writer.Clear();
+	writer.StartArray();
+	while( writer.GetLength() < targetSize )
+		WriteNestedValue( &writer, 1 + (rand.Rand() >> 8) % 400, &rand );
+	writer.EndArray();
+	corpus[2].push_back( std::string( writer.GetData(), writer.GetLength() ) );
+
+	// Strings of 1 to 64 KB, of text with escapes and multi-byte characters
+	static const char* const pieces[] = { "The quick brown fox ", "\"quoted\" ", "back\\slash ", "line\n", "tab\t", "caf\xc3\xa9 ", "\xe2\x82\xac ", "jumps over the lazy dog. " };
+	writer.Clear();
+	writer.StartArray();
+	std::string text;
+	while( writer.GetLength() < targetSize )
+	{
+		text.clear();
+		for(size_t length = 1024 + (rand.Rand() >> 8) % (63 * 1024); text.size() < length; )
+			text += pieces[(rand.Rand() >> 8) % 8];
+		writer.String( text.data(), text.size() );
+	}
+	writer.EndArray();
+	corpus[3].push_back( std::string( writer.GetData(), writer.GetLength() ) );
+
+	printf("Corpus:         %d MB of each kind, best of %d runs\n", megabyteCount, runCount);
+
+	bool isValid = true;
+	for(int kind = 0; kind < kindCount; kind++)
+	{
+		size_t corpusSize = 0;
+		for(size_t i = 0; i < corpus[kind].size(); i++)
+			corpusSize += corpus[kind][i].size();
+		float megabytes = corpusSize / (1024.0f * 1024.0f);
+
+		for(int parser = 0; parser < parserCount; parser++)
+		{
+			// Heap use of one run (if counted), then the time of the fastest
+			#ifdef SIMPLEJSON_BENCH
+				CountAllocations( true );
+			#endif
+			for(size_t i = 0; i < corpus[kind].size(); i++)
+				isValid &= ParseCorpusText( parser, corpus[kind][i] );
+			#ifdef SIMPLEJSON_BENCH
+				CountAllocations( false );
+			#endif
+
+			float bestTime = 0.0f;
+			for(int run = 0; run < runCount; run++)
+			{
+				UtilHighresClock clock( true );
+				for(size_t i = 0; i < corpus[kind].size(); i++)
+					ParseCorpusText( parser, corpus[kind][i] );
+				clock.Stop();
+				bestTime = (run == 0) ? clock.GetTime() : min( bestTime, clock.GetTime() );
+			}
+
+			#ifdef SIMPLEJSON_BENCH
+				printf("%-8s %-8s  %8.1f MB/s %10.0f allocations/MB %10.0f KB peak heap\n", kindNames[kind], parserNames[parser],
+					megabytes / bestTime, SDL_AtomicAdd( &s_allocationCount, 0 ) / megabytes, SDL_AtomicAdd( &s_peakAllocatedBytes, 0 ) / 1024.0f);
+			#else
+				printf("%-8s %-8s  %8.1f MB/s\n", kindNames[kind], parserNames[parser], megabytes / bestTime);
+			#endif
+		}
+	}
+	printf("Peak memory:    %.1f MB\n", UtilGetPeakMemoryUsage() / (1024.0f * 1024.0f));
+
+	if( !isValid )
+	{
+		printf("Some of the corpus failed to parse\n");
+		return 1;
+	}
+	return 0;
+}
+
+// Loads every image matching the given pattern into textures of a software renderer,
+// first one after the other within a frame, as a game loading on demand would, then
+// through the asset manager, with the given time per frame for uploads; reports the
+// longest stall of each
+static int BenchmarkAssets( const char* pattern, float uploadTime )
+{
+	std::vector< std::string > fileNames;
+	if( UtilFindFiles( pattern, fileNames ) == 0 )
+	{
+		printf("No files match \"%s\"\n", pattern);
+		return 1;
+	}
+
+	SDL_Surface* target = SDL_CreateRGBSurface( 0, 640, 480, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000 );
+	SDL_Renderer* renderer = (target != NULL) ? SDL_CreateSoftwareRenderer( target ) : NULL;
+	if( renderer == NULL )
+	{
+		printf("Unable to create a renderer: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	// Once through untimed, so the disk cache doesn't skew the first run
+	std::vector< Vector2i > imageSizes( fileNames.size(), Vector2i( 0, 0 ) );
+	for(size_t i = 0; i < fileNames.size(); i++)
+	{
+		SDL_Surface* surface = SDL_LoadBMP( fileNames[i].c_str() );
+		if( surface != NULL )
+		{
+			imageSizes[i] = Vector2i( surface->w, surface->h );
+			SDL_FreeSurface( surface );
+		}
+	}
+
+	float longestTime = 0.0f;
+	UtilHighresClock totalClock( true );
+	for(size_t i = 0; i < fileNames.size(); i++)
+	{
+		UtilHighresClock clock( true );
+		SDL_Surface* surface = SDL_LoadBMP( fileNames[i].c_str() );
+		SDL_Texture* texture = (surface != NULL) ? SDL_CreateTextureFromSurface( renderer, surface ) : NULL;
+		clock.Stop();
+		longestTime = max( longestTime, clock.GetTime() );
+
+		if( texture != NULL )
+			SDL_DestroyTexture( texture );
+		if( surface != NULL )
+			SDL_FreeSurface( surface );
+	}
+	totalClock.Stop();
+	printf("Images:         %d\n", (int)fileNames.size());
+	printf("In the frame:   %.2f ms, longest stall %.2f ms\n", 1000.0f * totalClock.GetTime(), 1000.0f * longestTime);
+
+	AssetManager* assetManager = AssetManager::GetSingleton();
+	assetManager->SetRenderer( renderer );
+	std::vector< AssetHandle > assets( fileNames.size() );
+	longestTime = 0.0f;
+	int frameCount = 0;
+	totalClock.Start();
+	for(size_t i = 0; i < fileNames.size(); i++)
+		assets[i] = assetManager->RequestImage( fileNames[i] );
+	for(size_t loadingCount = assets.size(); loadingCount > 0; frameCount++)
+	{
+		UtilHighresClock clock( true );
+		assetManager->Update( uploadTime );
+		clock.Stop();
+		longestTime = max( longestTime, clock.GetTime() );
+
+		loadingCount = 0;
+		for(size_t i = 0; i < assets.size(); i++)
+		{
+			AssetState state = assetManager->GetState( assets[i] );
+			loadingCount += (state == AssetState_Loading || state == AssetState_Uploading) ? 1 : 0;
+		}
+	}
+	totalClock.Stop();
+	printf("Asset manager:  %.2f ms over %d frames, longest stall %.2f ms\n", 1000.0f * totalClock.GetTime(), frameCount, 1000.0f * longestTime);
+
+	// Every image that loads on its own must come out the same size
+	int mismatchCount = 0;
+	for(size_t i = 0; i < assets.size(); i++)
+	{
+		int width = 0, height = 0;
+		SDL_Texture* texture = assetManager->GetTexture( assets[i] );
+		if( texture != NULL )
+			SDL_QueryTexture( texture, NULL, NULL, &width, &height );
+		mismatchCount += (width != imageSizes[i].x || height != imageSizes[i].y) ? 1 : 0;
+	}
+
+	assetManager->Clear();
+	assetManager->SetRenderer( NULL );
+	SDL_DestroyRenderer( renderer );
+	SDL_FreeSurface( target );
+
+	if( mismatchCount > 0 )
+	{
+		printf("%d images differ from loading them directly\n", mismatchCount);
+		return 1;
+	}
+	return 0;
+}
+
+// Walks a long session through areas of a few images each, matching the given pattern,
+// back and forth: each area's images are requested and waited on, then the previous
+// area's released, as the player moves on. Runs once with no memory budget, as before
+// assets could be evicted, then with the given texture budget, and compares them
+static int BenchmarkAssetCache( const char* pattern, Uint64 budgetBytes )
+{
+	static const int AreaSize = 8;
+	static const int LapCount = 4;
+
+	std::vector< std::string > fileNames;
+	if( UtilFindFiles( pattern, fileNames ) == 0 )
+	{
+		printf("No files match \"%s\"\n", pattern);
+		return 1;
+	}
+
+	SDL_Surface* target = SDL_CreateRGBSurface( 0, 640, 480, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000 );
+	SDL_Renderer* renderer = (target != NULL) ? SDL_CreateSoftwareRenderer( target ) : NULL;
+	if( renderer == NULL )
+	{
+		printf("Unable to create a renderer: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	// Areas overlap by half, so that neighbours share images
+	int areaCount = max( 1, ((int)fileNames.size() - AreaSize) / (AreaSize / 2) + 1 );
+	std::vector< int > visits;
+	for(int lap = 0; lap < LapCount; lap++)
+	{
+		for(int i = 0; i < areaCount; i++)
+			visits.push_back( (lap % 2 == 0) ? i : areaCount - 1 - i );
+	}
+
+	AssetManager* assetManager = AssetManager::GetSingleton();
+	assetManager->SetRenderer( renderer );
+	printf("Images:         %d, in %d areas visited %d times\n", (int)fileNames.size(), areaCount, (int)visits.size());
+
+	bool isValid = true;
+	for(int run = 0; run < 2; run++)
+	{
+		Uint64 runBudget = (run == 0) ? ~(Uint64)0 : budgetBytes;
+		assetManager->SetBudget( AssetClass_Texture, runBudget );
+		AssetCacheStats startStats = assetManager->GetStats( AssetClass_Texture );
+
+		Uint64 peakBytes = 0;
+		std::vector< AssetHandle > areaAssets, lastAreaAssets;
+		UtilHighresClock clock( true );
+		for(size_t visit = 0; visit < visits.size(); visit++)
+		{
+			areaAssets.clear();
+			for(int i = 0; i < AreaSize; i++)
+			{
+				size_t fileIndex = visits[visit] * (AreaSize / 2) + i;
+				if( fileIndex < fileNames.size() )
+					areaAssets.push_back( assetManager->RequestImage( fileNames[fileIndex] ) );
+			}
+			for(size_t i = 0; i < areaAssets.size(); i++)
+				assetManager->Wait( areaAssets[i] );
+
+			for(size_t i = 0; i < lastAreaAssets.size(); i++)
+				assetManager->Release( lastAreaAssets[i] );
+			lastAreaAssets.swap( areaAssets );
+
+			assetManager->Update( 0.0f );
+			peakBytes = max( peakBytes, assetManager->GetStats( AssetClass_Texture ).m_residentBytes );
+		}
+		for(size_t i = 0; i < lastAreaAssets.size(); i++)
+			assetManager->Release( lastAreaAssets[i] );
+		clock.Stop();
+
+		// With nothing referenced, the cache must be back under budget
+		AssetCacheStats stats = assetManager->GetStats( AssetClass_Texture );
+		printf("%-15s %8.2f ms, %6d hits, %6d misses, %6d evictions, %8.2f MB peak, %8.2f MB resident\n", (run == 0) ? "No budget:" : "Budget:",
+			1000.0f * clock.GetTime(), (int)(stats.m_hitCount - startStats.m_hitCount), (int)(stats.m_missCount - startStats.m_missCount),
+			(int)(stats.m_evictionCount - startStats.m_evictionCount), peakBytes / (1024.0f * 1024.0f), stats.m_residentBytes / (1024.0f * 1024.0f));
+		isValid &= (stats.m_residentBytes <= runBudget);
+
+		assetManager->Clear();
+	}
+
+	assetManager->SetRenderer( NULL );
+	SDL_DestroyRenderer( renderer );
+	SDL_FreeSurface( target );
+
+	if( !isValid )
+	{
+		printf("The cache stayed over budget with nothing referenced\n");
+		return 1;
+	}
+	return 0;
+}
+
+/*** Public ***/
+
+bool RunDevTools( int argc, char* argv[], int* exitCode )
+{
+	if( argc >= 4 && strcmp(argv[1], "--convert") == 0 )
+	{
+		bool isMorton = (argc >= 5) && strcmp(argv[4], "morton") == 0;
+		*exitCode = ConvertWorld( argv[2], argv[3], isMorton ? WorldLayout_Morton : WorldLayout_RowMajor );
+		return true;
+	}
+	else if( argc >= 4 && strcmp(argv[1], "--convert-chunked") == 0 )
+	{
+		*exitCode = ConvertWorldChunked( argv[2], argv[3], (argc >= 5) ? atoi(argv[4]) : 64 );
+		return true;
+	}
+	else if( argc >= 7 && strcmp(argv[1], "--generate") == 0 )
+	{
+		*exitCode = GenerateWorld( argv[2], atoi(argv[3]), atoi(argv[4]), (unsigned int)strtoul(argv[5], NULL, 10), argv[6], (argc >= 8) ? argv[7] : "binary" );
+		return true;
+	}
+	else if( argc >= 4 && strcmp(argv[1], "--convert-compressed") == 0 )
+	{
+		*exitCode = ConvertWorldCompressed( argv[2], argv[3], (argc >= 5) ? atoi(argv[4]) : 128 );
+		return true;
+	}
+	else if( argc >= 3 && strcmp(argv[1], "--bench-compressed") == 0 )
+	{
+		*exitCode = BenchmarkCompressed( argv[2] );
+		return true;
+	}
+	else if( argc >= 3 && strcmp(argv[1], "--bench-load") == 0 )
+	{
+		*exitCode = BenchmarkWorldLoad( argc - 2, argv + 2 );
+		return true;
+	}
+	else if( argc >= 3 && strcmp(argv[1], "--bench-rays") == 0 )
+	{
+		*exitCode = BenchmarkRays( argv[2], (argc >= 4) ? atoi(argv[3]) : 1000000 );
+		return true;
+	}
+	else if( argc >= 3 && strcmp(argv[1], "--bench-layout") == 0 )
+	{
+		*exitCode = BenchmarkLayouts( argv[2], (argc >= 4) ? atoi(argv[3]) : 1000000 );
+		return true;
+	}
+	else if( argc >= 3 && strcmp(argv[1], "--bench-levels") == 0 )
+	{
+		*exitCode = BenchmarkLevels( argv[2], (argc >= 4) ? atoi(argv[3]) : 1000 );
+		return true;
+	}
+	else if( argc >= 3 && strcmp(argv[1], "--bench-first-frame") == 0 )
+	{
+		*exitCode = BenchmarkFirstFrame( argv[2] );
+		return true;
+	}
+	else if( argc >= 3 && strcmp(argv[1], "--bench-reload") == 0 )
+	{
+		*exitCode = BenchmarkReload( argv[2], (argc >= 4) ? atoi(argv[3]) : 20 );
+		return true;
+	}
+	else if( argc >= 3 && strcmp(argv[1], "--bench-json-stream") == 0 )
+	{
+		*exitCode = BenchmarkJsonStream( argv[2], (argc >= 4) ? atoi(argv[3]) : 1024 );
+		return true;
+	}
+	else if( argc >= 3 && strcmp(argv[1], "--bench-json-write") == 0 )
+	{
+		*exitCode = BenchmarkJsonWrite( argv[2], (argc >= 4) ? atoi(argv[3]) : 256 );
+		return true;
+	}
+	else if( argc >= 2 && strcmp(argv[1], "--bench-json") == 0 )
+	{
+		*exitCode = BenchmarkJsonCorpus( (argc >= 3) ? atoi(argv[2]) : 8 );
+		return true;
+	}
+	else if( argc >= 2 && strcmp(argv[1], "--bench-json-numbers") == 0 )
+	{
+		*exitCode = BenchmarkJsonNumbers( (argc >= 3) ? atoi(argv[2]) : 2000000 );
+		return true;
+	}
+	else if( argc >= 2 && strcmp(argv[1], "--bench-json-paths") == 0 )
+	{
+		*exitCode = BenchmarkJsonPaths( (argc >= 3) ? atoi(argv[2]) : 1000000 );
+		return true;
+	}
+	else if( argc >= 3 && strcmp(argv[1], "--bench-json-batch") == 0 )
+	{
+		*exitCode = BenchmarkJsonBatch( argv[2], (argc >= 4) ? atoi(argv[3]) : 0 );
+		return true;
+	}
+	else if( argc >= 3 && strcmp(argv[1], "--bench-assets") == 0 )
+	{
+		*exitCode = BenchmarkAssets( argv[2], ((argc >= 4) ? (float)atof(argv[3]) : 2.0f) / 1000.0f );
+		return true;
+	}
+	else if( argc >= 3 && strcmp(argv[1], "--bench-asset-cache") == 0 )
+	{
+		*exitCode = BenchmarkAssetCache( argv[2], (Uint64)(((argc >= 4) ? atof(argv[3]) : 16.0) * 1024.0 * 1024.0) );
+		return true;
+	}
+	else if( argc >= 3 && strcmp(argv[1], "--bench-stream") == 0 )
+	{
+		*exitCode = BenchmarkWorldStreaming( argv[2] );
+		return true;
+	}
+
+	// No tool; run the game
+	return false;
+}
@@ -0,0 +1,94 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: DevTools.cpp/h
+ Desc: Command-line developer tools, such as world-file conversion
+ and load-time benchmarks. These run instead of the game when the
+ executable is given one of the tool switches:
+ 
+   --convert <in world> <out world> [morton]
+     Converts any world file to the binary world format, optionally
+     with the tiles in Morton-ordered blocks
+   --convert-chunked <in world> <out world> [chunk size]
+     Converts any non-chunked world file to the chunked world format
+   --convert-compressed <in world> <out world> [block size]
+     Converts any non-chunked world file to the compressed world
+     format, and reports the size reduction
+   --generate <maze|caves|rooms|arena> <width> <height> <seed> <out world> [text|binary|chunked|compressed]
+     Generates a world procedurally (see WorldGenerator.h); the same
+     seed always gives the same world. Binary by default
+   --bench-load <world> [<world> ...]
+     Times loading of each given world file
+   --bench-rays <world> [ray count]
+     Casts rays from random positions and angles, and reports the
+     rays per second along with the world's memory footprint; then
+     checks that rays from off the map stop at their origin
+   --bench-layout <world> [ray count]
+     Casts the same rays through the world in row-major and Morton
+     tile layouts, at fixed and random angles, and compares them
+   --bench-levels <levels file> [frame count]
+     Casts the columns of frames from random spots on each level of a
+     stack, and compares them to the level rendered on its own; then
+     checks that frames from off the map still render
+   --bench-stream <chunked world>
+     Walks across a chunked world, and reports the streaming counters
+   --bench-compressed <compressed world>
+     Decompresses the whole world on one thread and on all of them,
+     then random regions, and reports the throughput
+   --bench-first-frame <text world>
+     Compares loading a world synchronously against loading it in the
+     background, up to its center rows being playable and in full
+   --bench-reload <world> [edit count]
+     Saves a text copy of the world with one tile changed at a time,
+     and times how long each save takes to be hot-reloaded
+   --bench-json-stream <out file> [size in MB]
+     Writes an entity dump of the given size (1 GB by default), then
+     streams the entities back out of it, and reports the throughput
+     and peak memory use
+   --bench-json [size in MB]
+     Parses a generated corpus of configurations, numbers, deep nesting
+     and long strings (8 MB of each by default, the same every run)
+     into trees, documents and streams, and reports the throughput of
+     each; built with SIMPLEJSON_BENCH defined, which counts every heap
+     allocation, it also reports allocations per MB and peak heap use
+   --bench-json-numbers [count]
+     Parses random doubles, coordinates and 64-bit integers (2 million
+     by default), checks each is read back exactly, and times it
+     against strtod
+   --bench-json-write <out file> [size in MB]
+     Writes telemetry of the given size (256 MB by default) to the
+     file, writes it again from a tree and a document, and writes
+     random doubles and checks they read back exactly; reports the
+     throughput of each
+   --bench-json-paths [look-up count]
+     Times looking values up in a tile configuration with chained
+     finds, and with compiled JSON paths on a tree and a document
+   --bench-assets <image file pattern> [upload time in ms]
+     Loads every matching image into a texture, one after the other,
+     then through the asset manager with the given time per frame for
+     uploads (2 ms by default), and compares the longest stalls
+   --bench-asset-cache <image file pattern> [texture budget in MB]
+     Walks through areas of matching images back and forth, releasing
+     each area on leaving it, with no budget then with the given one
+     (16 MB by default); compares the hits, evictions and peak memory
+   --bench-json-batch <file pattern> [thread count]
+     Loads every JSON file matching the pattern (such as "*.json" in a
+     folder) one after the other, then in a batch on one thread and on
+     the given count of threads (one per core by default), and compares
+     them
+
+***************************************************************/
+
+#ifndef __DEVTOOLS_H__
+#define __DEVTOOLS_H__
+
+// Runs the developer tool requested on the command line, if any, and
+// returns true if one was run; the process exit code is posted to exitCode
+bool RunDevTools( int argc, char* argv[], int* exitCode );
+
+#endif
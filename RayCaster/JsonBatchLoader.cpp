@@ -0,0 +1,213 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+
+***************************************************************/
+
+#include "JsonBatchLoader.h"
+
+#include <algorithm>
+#include <sys/stat.h>
+
+/*** Private ***/
+
+// File size without opening the file; 0 if it cannot be found
+static Uint64 JsonBatchLoader_GetFileSize( const std::string& fileName )
+{
+	#ifdef _WIN32
+		struct _stat64 fileStat;
+		if( _stat64( fileName.c_str(), &fileStat ) != 0 )
+			return 0;
+	#else
+		struct stat fileStat;
+		if( stat( fileName.c_str(), &fileStat ) != 0 )
+			return 0;
+	#endif
+	return (Uint64)fileStat.st_size;
+}
+
+class JsonBatchLoader::LoadJob : public ThreadJob
+{
+public:
+
+	LoadJob( JsonBatchLoader* loader, LoadedFile* file )
+		: m_loader( loader ), m_file( file )
+	{
+	}
+
+	void Run()
+	{
+		m_loader->LoadFile( m_file );
+	}
+
+private:
+
+	JsonBatchLoader* m_loader;
+	LoadedFile* m_file;
+
+};
+
+void JsonBatchLoader::LoadFile( LoadedFile* file )
+{
+	// Parsed straight out of the mapping, with no copy of the text
+	SimpleJSON::JsonDocument* document = new SimpleJSON::JsonDocument();
+	UtilMappedFile mappedFile;
+	if( !mappedFile.Open( file->m_fileName.c_str() ) || !document->Parse( (const char*)mappedFile.GetData(), mappedFile.GetSize() ) )
+	{
+		delete document;
+		document = NULL;
+	}
+	Uint64 fileSize = (Uint64)mappedFile.GetSize();
+	mappedFile.Close();
+
+	SDL_LockMutex( m_mutex );
+	file->m_document = document;
+	file->m_isDone = true;
+	file->m_isParsed = (document != NULL);
+	m_loadedCount++;
+	m_loadedBytes += fileSize;
+	if( --m_pendingCount == 0 )
+		m_loadClock.Stop();
+	SDL_CondBroadcast( m_doneCondition );
+	SDL_UnlockMutex( m_mutex );
+}
+
+/*** Public ***/
+
+JsonBatchLoader::JsonBatchLoader( ThreadPool* threadPool )
+	: m_pendingCount( 0 ), m_loadedCount( 0 ), m_loadedBytes( 0 ), m_threadPool( threadPool ), m_isOwnPool( threadPool == NULL )
+{
+	m_mutex = SDL_CreateMutex();
+	m_doneCondition = SDL_CreateCond();
+	if( m_isOwnPool )
+		m_threadPool = new ThreadPool();
+}
+
+JsonBatchLoader::~JsonBatchLoader()
+{
+	// The jobs point at the loader, so they must all be done first
+	WaitAll();
+	if( m_isOwnPool )
+		delete m_threadPool;
+
+	for(size_t i = 0; i < m_files.size(); i++)
+	{
+		delete m_files[i]->m_document;
+		delete m_files[i];
+	}
+
+	SDL_DestroyCond( m_doneCondition );
+	SDL_DestroyMutex( m_mutex );
+}
+
+int JsonBatchLoader::Load( const std::vector< std::string >& fileNames )
+{
+	int firstIndex = (int)m_files.size();
+	if( fileNames.empty() )
+		return firstIndex;
+
+	std::vector< LoadedFile* > newFiles( fileNames.size() );
+	for(size_t i = 0; i < fileNames.size(); i++)
+	{
+		LoadedFile* file = new LoadedFile();
+		file->m_fileName = fileNames[i];
+		file->m_fileSize = JsonBatchLoader_GetFileSize( fileNames[i] );
+		file->m_document = NULL;
+		file->m_isDone = false;
+		file->m_isParsed = false;
+		newFiles[i] = file;
+		m_files.push_back( file );
+	}
+
+	SDL_LockMutex( m_mutex );
+	if( m_pendingCount == 0 )
+		m_loadClock.Start();
+	m_pendingCount += (int)newFiles.size();
+	SDL_UnlockMutex( m_mutex );
+
+	// A large file left until last would finish alone, after the others
+	std::stable_sort( newFiles.begin(), newFiles.end(), IsLarger );
+	for(size_t i = 0; i < newFiles.size(); i++)
+		m_threadPool->Push( new LoadJob( this, newFiles[i] ) );
+
+	return firstIndex;
+}
+
+int JsonBatchLoader::Load( const std::string& fileName )
+{
+	return Load( std::vector< std::string >( 1, fileName ) );
+}
+
+int JsonBatchLoader::LoadMatching( const char* pattern )
+{
+	std::vector< std::string > fileNames;
+	if( UtilFindFiles( pattern, fileNames ) == 0 )
+		return -1;
+	return Load( fileNames );
+}
+
+bool JsonBatchLoader::IsDone( int index )
+{
+	SDL_LockMutex( m_mutex );
+	bool isDone = m_files[index]->m_isDone;
+	SDL_UnlockMutex( m_mutex );
+	return isDone;
+}
+
+const SimpleJSON::JsonDocument* JsonBatchLoader::Wait( int index )
+{
+	SDL_LockMutex( m_mutex );
+	while( !m_files[index]->m_isDone )
+		SDL_CondWait( m_doneCondition, m_mutex );
+	const SimpleJSON::JsonDocument* document = m_files[index]->m_document;
+	SDL_UnlockMutex( m_mutex );
+	return document;
+}
+
+int JsonBatchLoader::WaitAll()
+{
+	SDL_LockMutex( m_mutex );
+	while( m_pendingCount > 0 )
+		SDL_CondWait( m_doneCondition, m_mutex );
+	SDL_UnlockMutex( m_mutex );
+
+	int failedCount = 0;
+	for(size_t i = 0; i < m_files.size(); i++)
+		failedCount += m_files[i]->m_isParsed ? 0 : 1;
+	return failedCount;
+}
+
+SimpleJSON::JsonDocument* JsonBatchLoader::TakeDocument( int index )
+{
+	Wait( index );
+
+	// Done files are no longer touched by the jobs
+	SimpleJSON::JsonDocument* document = m_files[index]->m_document;
+	m_files[index]->m_document = NULL;
+	return document;
+}
+
+int JsonBatchLoader::GetLoadedCount()
+{
+	SDL_LockMutex( m_mutex );
+	int loadedCount = m_loadedCount;
+	SDL_UnlockMutex( m_mutex );
+	return loadedCount;
+}
+
+Uint64 JsonBatchLoader::GetLoadedBytes()
+{
+	SDL_LockMutex( m_mutex );
+	Uint64 loadedBytes = m_loadedBytes;
+	SDL_UnlockMutex( m_mutex );
+	return loadedBytes;
+}
+
+float JsonBatchLoader::GetLoadTime()
+{
+	SDL_LockMutex( m_mutex );
+	float loadTime = (m_pendingCount == 0) ? m_loadClock.GetTime() : 0.0f;
+	SDL_UnlockMutex( m_mutex );
+	return loadTime;
+}
@@ -0,0 +1,110 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: JsonBatchLoader.cpp/h
+ Desc: Loads many JSON files at once (tile types, entities, sounds,
+ levels...) on a pool of worker threads, each file mapped then
+ parsed into its own JsonDocument. Files are queued largest first,
+ so that the load takes about as long as the total size over the
+ thread count, however many small files there are. The main thread
+ waits on a single file, or on the whole batch.
+
+***************************************************************/
+
+#ifndef __JSONBATCHLOADER_H__
+#define __JSONBATCHLOADER_H__
+
+#include <string>
+#include <vector>
+
+#include "Utilities.h"
+#include "ThreadPool.h"
+#include "SimpleJSON.h"
+
+class JsonBatchLoader
+{
+public:
+
+	// Loads on the given pool, which must outlive the loader; if none is given,
+	// the loader starts its own, of one thread per CPU core
+	JsonBatchLoader( ThreadPool* threadPool = NULL );
+
+	// Waits for the files still loading; frees every document not taken
+	~JsonBatchLoader();
+
+	// Queues the given files, largest first, and returns the index of the first;
+	// the others follow in the given order
+	int Load( const std::vector< std::string >& fileNames );
+	int Load( const std::string& fileName );
+
+	// Queues the files matching the given pattern (see UtilFindFiles), as above;
+	// returns the index of the first, or -1 if none match
+	int LoadMatching( const char* pattern );
+
+	// Number of files queued so far, and their names
+	int GetFileCount() const { return (int)m_files.size(); }
+	const std::string& GetFileName( int index ) const { return m_files[index]->m_fileName; }
+
+	// True once the given file is loaded (or failed to); never blocks
+	bool IsDone( int index );
+
+	// Blocks until the given file is loaded; returns its document, owned by the
+	// loader, or NULL if the file could not be read or is not valid JSON
+	const SimpleJSON::JsonDocument* Wait( int index );
+
+	// Blocks until every queued file is loaded; returns how many failed
+	int WaitAll();
+
+	// As Wait(), but the document is gifted to the caller, and the loader forgets it
+	SimpleJSON::JsonDocument* TakeDocument( int index );
+
+	// Files and bytes loaded so far, and the time since the first file was queued
+	// until the last finished
+	int GetLoadedCount();
+	Uint64 GetLoadedBytes();
+	float GetLoadTime();
+
+private:
+
+	// Background job loading a single file
+	class LoadJob;
+	friend class LoadJob;
+
+	// A queued file; shared with its load job until it is done
+	struct LoadedFile
+	{
+		std::string m_fileName;
+		Uint64 m_fileSize;
+		SimpleJSON::JsonDocument* m_document;	// NULL on failure, or once taken
+		bool m_isDone;
+		bool m_isParsed;
+	};
+
+	// Worker thread: maps and parses the given file, then marks it done
+	void LoadFile( LoadedFile* file );
+
+	// Orders files largest first
+	static bool IsLarger( const LoadedFile* a, const LoadedFile* b ) { return a->m_fileSize > b->m_fileSize; }
+
+	// Each allocated once, and only freed on destruction, so jobs can keep them
+	std::vector< LoadedFile* > m_files;
+
+	// Shared with the load jobs
+	SDL_mutex* m_mutex;
+	SDL_cond* m_doneCondition;		// Signaled whenever a file is done
+	int m_pendingCount;
+	int m_loadedCount;
+	Uint64 m_loadedBytes;
+	UtilHighresClock m_loadClock;
+
+	ThreadPool* m_threadPool;
+	bool m_isOwnPool;
+
+};
+
+#endif
@@ -9,11 +9,17 @@
 
 #include "SDL.h"
 #include "MainWindow.h"
+#include "DevTools.h"
 
 int main( int argc, char* argv[] )
 {
-	// Create main window, and run the game
-	MainWindow gameWindow;
+	// Developer tools run instead of the game
+	int exitCode = 0;
+	if( RunDevTools( argc, argv, &exitCode ) )
+		return exitCode;
+
+	// Create main window, and run the game; the world file may be given on the command line
+	MainWindow gameWindow( (argc > 1) ? argv[1] : "DemoWorld.txt" );
 	gameWindow.Run();
 
 	return 0;
@@ -8,16 +8,30 @@
 #include "MainWindow.h"
 
 #include "Utilities.h"
+#include "AssetManager.h"
+#include "WorldChunkCache.h"
+#include "WorldFileWatcher.h"
+#include "WorldStack.h"
 #include <math.h>
 
-MainWindow::MainWindow()
+// Time each frame may spend making textures of the images loaded in the background
+static const float MainWindow_AssetUploadTime = 0.002f;
+
+MainWindow::MainWindow( const std::string& worldFileName )
 	: m_window( NULL )
 	, m_renderer( NULL )
 	, m_windowSize( 800, 600 )
+	, m_worldStack( NULL )
 	, m_gameWorld( NULL )
+	, m_worldWatcher( NULL )
 	, m_player( NULL )
 	, m_worldView( NULL )
 	, m_minimapView( NULL )
+	, m_statsTime( 0.0f )
+	, m_startupClock( true )
+	, m_isFirstFrame( true )
+	, m_wasLoading( false )
+	, m_playerTile( -1, -1 )
 {
 	/*** 1. Graphics ***/
 
@@ -31,13 +45,44 @@ MainWindow::MainWindow()
 	// Initialize the renderer within the window
 	m_renderer = SDL_CreateRenderer(m_window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
 
+	// Images get decoded into the renderer's own pixel format
+	AssetManager::GetSingleton()->SetRenderer( m_renderer );
+
 	/*** 2. Game Logic ***/
 
-	// Load the game's controller, and the two main rendering views
-	m_gameWorld = new World( "DemoWorld.txt" );
-	m_player = new Player( Vector3f(6.5f, 6.5f, 0.5f), 0.0f );
+	// Load the game's controller, and the two main rendering views; the world
+	// fills in around the spawn point first. Generated worlds carry their own.
+	// A levels file stacks several worlds, the player starting on the bottom one.
+	// Tile types come from the tile definitions file, if there is one
+	TileTypeTable tileTypes;
+	std::string tileTypesError;
+	if( !tileTypes.LoadDefinitions( "TileTypes.json", &tileTypesError ) )
+		printf( "%s; using the built-in tile types\n", tileTypesError.c_str() );
+
+	Vector2i spawn( 6, 6 );
+	if( WorldStack::IsLevelsFile( worldFileName ) )
+	{
+		m_worldStack = new WorldStack( worldFileName, true, spawn, tileTypes );
+	}
+	else
+	{
+		// Saves of a text world's file get applied as they happen; the watch
+		// starts before the world is read, so saves during the load count too
+		if( World::IsTextFile( worldFileName ) )
+			m_worldWatcher = new WorldFileWatcher( worldFileName );
+
+		m_worldStack = new WorldStack( new World( worldFileName, true, spawn, tileTypes ) );
+	}
+	m_gameWorld = m_worldStack->GetLevel( 0 );
+	m_wasLoading = m_worldStack->IsLoading();
+
+	const std::string* spawnData = m_gameWorld->GetMetadata( "SPWN" );
+	if( spawnData != NULL )
+		sscanf( spawnData->c_str(), "%d %d", &spawn.x, &spawn.y );
+	m_player = new Player( Vector3f(spawn.x + 0.5f, spawn.y + 0.5f, 0.5f), 0.0f );
 
 	m_worldView = new WorldView( m_gameWorld, m_player );
+	m_worldView->SetWorldStack( m_worldStack );
 	m_minimapView = new MinimapView( Vector2i(10, 10), 8, m_gameWorld, m_player );
 }
 
@@ -52,8 +97,14 @@ MainWindow::~MainWindow()
 	if( m_player != NULL )
 		delete m_player;
 
-	if( m_gameWorld != NULL )
-		delete m_gameWorld;
+	if( m_worldWatcher != NULL )
+		delete m_worldWatcher;
+
+	if( m_worldStack != NULL )
+		delete m_worldStack;
+
+	// Textures go before their renderer
+	AssetManager::GetSingleton()->Clear();
 
 	if( m_renderer != NULL )
 		SDL_DestroyRenderer( m_renderer );
@@ -90,6 +141,13 @@ void MainWindow::Run()
 			// 3. Present back-buffer that we've just drawn onto (flip)
 			SDL_RenderPresent( m_renderer );
 
+			if( m_isFirstFrame )
+			{
+				m_startupClock.Stop();
+				printf( "First frame after %.1f ms (world %.0f%% loaded)\n", 1000.0f * m_startupClock.GetTime(), 100.0f * m_worldStack->GetLoadProgress() );
+				m_isFirstFrame = false;
+			}
+
 		}
 		highresClock.Stop();
 
@@ -110,12 +168,62 @@ bool MainWindow::Update(float dTime)
 		// Pass the key event to any observers
 		if( e.type == SDL_QUIT || (e.type == SDL_KEYUP && e.key.keysym.sym == SDLK_ESCAPE) )
 			return false;
-		else
-			m_player->UpdateKeys( e );
+		
+		// Cycle through full, foveated and checkerboard column shading
+		if( e.type == SDL_KEYUP && e.key.keysym.sym == SDLK_f )
+		{
+			WorldViewShading shading = m_worldView->GetShading();
+			if( shading == WorldViewShading_Full )
+				m_worldView->SetShading( WorldViewShading_Foveated );
+			else if( shading == WorldViewShading_Foveated )
+				m_worldView->SetShading( WorldViewShading_Checkerboard );
+			else
+				m_worldView->SetShading( WorldViewShading_Full );
+		}
+
+		// Knock out the wall the player is looking at
+		if( e.type == SDL_KEYUP && e.key.keysym.sym == SDLK_SPACE )
+			BreakWall();
+
+		m_player->UpdateKeys( e );
 	} 
 	
-	// Full player update
+	// Full player update, then stairs and holes; the player walks through walls,
+	// but not off the map, as rays have to start on it
+	Vector3f lastPosition = m_player->GetPosition();
 	m_player->Update( dTime );
+	Vector3f position = m_player->GetPosition();
+	if( !m_gameWorld->IsOnMap( (int)floor( position.x ), (int)floor( lastPosition.y ) ) )
+		position.x = lastPosition.x;
+	if( !m_gameWorld->IsOnMap( (int)floor( position.x ), (int)floor( position.y ) ) )
+		position.y = lastPosition.y;
+	m_player->SetPosition( position );
+	UpdateLevel();
+
+	// Page the world in around the player, if it's streamed, or take in the rows loaded so far
+	m_worldStack->UpdateStreaming( m_player->GetPosition() );
+
+	if( m_wasLoading && !m_worldStack->IsLoading() )
+	{
+		printf( "World loaded in %.1f ms\n", 1000.0f * m_worldStack->GetLevel( 0 )->GetLoadTime() );
+		m_wasLoading = false;
+	}
+
+	// Take in the changes of any save of the world file
+	if( m_worldWatcher != NULL )
+	{
+		float reloadLatency = 0.0f;
+		int reloadCount = m_worldWatcher->ApplyChanges( m_worldStack->GetLevel( 0 ), &reloadLatency );
+		if( reloadCount > 0 )
+			printf( "World file reloaded, %.1f ms after it was saved\n", 1000.0f * reloadLatency );
+	}
+
+	// Let the views catch up with this frame's world edits
+	m_worldStack->FlushEdits();
+
+	// Make textures of the images loaded since, as far as this frame's share of time allows,
+	// and free the assets no longer used of any class over its memory budget
+	AssetManager::GetSingleton()->Update( MainWindow_AssetUploadTime );
 
 	// All good!
 	return true;
@@ -126,6 +234,87 @@ void MainWindow::Render(float dTime)
 	// Render world
 	m_worldView->Render( m_renderer, m_windowSize );
 
+	// Report the world view's ray counts in the title bar, once a second
+	m_statsTime += dTime;
+	if( m_statsTime >= 1.0f )
+	{
+		const WorldViewStats& stats = m_worldView->GetStats();
+
+		char title[256];
+		int titleLength = sprintf( title, "RayCaster Demo - %d columns, %d rays cast, %d rays saved", stats.m_columnCount, stats.m_raysCast, stats.m_raysSaved );
+
+		// Background load progress
+		if( m_worldStack->IsLoading() )
+			titleLength += sprintf( title + titleLength, ", loading %.0f%%", 100.0f * m_worldStack->GetLoadProgress() );
+
+		// Level, for stacked worlds
+		if( m_worldStack->GetLevelCount() > 1 )
+			titleLength += sprintf( title + titleLength, ", level %d of %d", m_worldStack->GetLevelAt( m_player->GetPosition().z ) + 1, m_worldStack->GetLevelCount() );
+
+		// Streaming counters, for chunked worlds
+		const WorldChunkCache* chunkCache = m_gameWorld->GetChunkCache();
+		if( chunkCache != NULL )
+		{
+			const WorldChunkStats& chunkStats = chunkCache->GetStats();
+			sprintf( title + titleLength, ", chunk hit rate %.1f%%, stalled %.1f ms", 100.0f * chunkStats.GetHitRate(), 1000.0f * chunkStats.m_stallTime );
+		}
+
+		SDL_SetWindowTitle( m_window, title );
+		m_statsTime = 0.0f;
+	}
+
 	// Render the minimap
 	m_minimapView->Render( m_renderer );
 }
+
+void MainWindow::UpdateLevel()
+{
+	// Stairs and holes only lead anywhere once all the levels are in
+	if( m_worldStack->GetLevelCount() < 2 || m_worldStack->IsLoading() )
+		return;
+
+	// Only stepping onto a tile counts, so that the stairs at the other end
+	// don't send the player straight back
+	Vector3f position = m_player->GetPosition();
+	Vector2i tile( (int)floor( position.x ), (int)floor( position.y ) );
+	Vector2i worldSize = m_gameWorld->GetWorldSize();
+	if( (tile.x == m_playerTile.x && tile.y == m_playerTile.y) || tile.x < 0 || tile.y < 0 || tile.x >= worldSize.x || tile.y >= worldSize.y )
+		return;
+	m_playerTile = tile;
+
+	// Holes drop the player a level
+	const TileTypeTable& tileTypes = m_gameWorld->GetTileTypes();
+	Uint8 tileId = m_gameWorld->GetWorldTile( tile.x, tile.y )->m_tileId;
+	int levelChange = tileTypes.IsOpenFloor( tileId ) ? -1 : tileTypes.GetLevelChange( tileId );
+	if( levelChange == 0 )
+		return;
+
+	// The other end has to be clear
+	int level = m_worldStack->GetLevelAt( position.z ) + levelChange;
+	World* levelWorld = m_worldStack->GetLevel( level );
+	if( levelWorld == NULL || levelWorld->GetTileTypes().IsSolid( levelWorld->GetWorldTile( tile.x, tile.y )->m_tileId ) )
+		return;
+
+	m_player->SetPosition( Vector3f( position.x, position.y, (float)level + 0.5f ) );
+	m_gameWorld = levelWorld;
+	m_minimapView->SetWorld( m_gameWorld );
+}
+
+void MainWindow::BreakWall()
+{
+	// Streamed worlds can't be edited, nor worlds still loading
+	if( m_gameWorld->GetChunkCache() != NULL || m_gameWorld->IsLoading() )
+		return;
+
+	// Step a little past the hit point, into the wall itself
+	Vector3f position = m_player->GetPosition();
+	float facing = m_player->GetFacing();
+	Vector3f hitPos = m_worldView->CollisionCheck( position, facing );
+	int tileX = (int)floor( hitPos.x + cos( facing ) * 0.01f );
+	int tileY = (int)floor( hitPos.y - sin( facing ) * 0.01f );
+
+	// Hits on the world's border can't be broken
+	Vector2i worldSize = m_gameWorld->GetWorldSize();
+	if( tileX >= 0 && tileY >= 0 && tileX < worldSize.x && tileY < worldSize.y )
+		m_gameWorld->SetTile( tileX, tileY, WorldTile_Empty );
+}
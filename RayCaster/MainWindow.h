@@ -16,7 +16,10 @@
 #ifndef __MAINWINDOW_H__
 #define __MAINWINDOW_H__
 
+#include <string>
+
 #include "SDL.h"
+#include "Utilities.h"
 #include "VectorMath.h"
 
 #include "World.h"
@@ -24,12 +27,21 @@
 #include "MinimapView.h"
 #include "WorldView.h"
 
+// Hot-reloads the world file
+class WorldFileWatcher;
+
+// Stacked levels
+class WorldStack;
+
 class MainWindow
 {
 public:
 
-	// Construct / destruct window
-	MainWindow();
+	// Construct / destruct window; the world loads in the background, the player
+	// can move around as soon as the rows around the spawn point are in. Saves
+	// of a text world's file are hot-reloaded. Levels files load a stack of worlds
+	// (see WorldStack.h)
+	MainWindow( const std::string& worldFileName );
 	~MainWindow();
 
 	// Start the main loop; once this is called, it only returns on application exit
@@ -44,18 +56,38 @@ protected:
 	// High-level rendering logic
 	void Render(float dTime);
 
+	// Moves the player up or down a level on stepping onto stairs or a hole
+	void UpdateLevel();
+
+	// Turns the wall tile in front of the player into an empty tile
+	void BreakWall();
+
 private:
 
 	SDL_Window* m_window;
 	SDL_Renderer* m_renderer; // This is kind of like a main context that must be used by SDL for most render-related calls
 	Vector2i m_windowSize;
 
+	// All the levels, and the one the player is on
+	WorldStack* m_worldStack;
 	World* m_gameWorld;
+	WorldFileWatcher* m_worldWatcher;
 	Player* m_player;
 
 	WorldView* m_worldView;
 	MinimapView* m_minimapView;
 
+	// Time since the title-bar stats were last refreshed
+	float m_statsTime;
+
+	// Time from startup to the first frame, and to the world being fully loaded
+	UtilHighresClock m_startupClock;
+	bool m_isFirstFrame;
+	bool m_wasLoading;
+
+	// Tile the player was last on, for stairs and holes
+	Vector2i m_playerTile;
+
 };
 
 #endif
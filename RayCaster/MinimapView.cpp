@@ -13,40 +13,90 @@ MinimapView::MinimapView( Vector2i pos, int tileSize, const World* gameWorld, co
 	, m_player( player )
 	, m_minimapPos( pos )
 	, m_minimapTileSize( tileSize )
+	, m_texture( NULL )
+	, m_windowPos( 0, 0 )
+	, m_windowSize( 0, 0 )
+	, m_disabled( false )
+	, m_tilesDrawn( 0 )
 {
+	m_gameWorld->AddListener( this );
 }
 
 MinimapView::~MinimapView()
 {
+	m_gameWorld->RemoveListener( this );
+
+	if( m_texture != NULL )
+		SDL_DestroyTexture( m_texture );
+}
+
+void MinimapView::SetWorld( const World* gameWorld )
+{
+	m_gameWorld->RemoveListener( this );
+	m_gameWorld = gameWorld;
+	m_gameWorld->AddListener( this );
+
+	if( m_texture != NULL )
+	{
+		SDL_DestroyTexture( m_texture );
+		m_texture = NULL;
+	}
+	m_disabled = false;
 }
 
 void MinimapView::Render( SDL_Renderer* renderer )
 {
 	SDL_Rect rect;
-
-	// For each tile in the game world
 	Vector2i worldSize = m_gameWorld->GetWorldSize();
-	for(int y = 0; y < worldSize.y; y++)
-	for(int x = 0; x < worldSize.x; x++)
+
+	if( m_disabled )
+		return;
+
+	// Size the window to the world, capped to what the renderer can hold
+	if( m_texture == NULL )
 	{
-		int tileId = m_gameWorld->GetWorldTile(x, y)->m_tileId;
-		
-		if(tileId == ' ')
-			SDL_SetRenderDrawColor( renderer, 255, 255, 255, 255 );
-		else
-			SDL_SetRenderDrawColor( renderer, 32, 32, 32, 255 );
-		
-		rect.x = m_minimapPos.x + x * m_minimapTileSize;
-		rect.y = m_minimapPos.y + y * m_minimapTileSize;
-		rect.h = rect.w = m_minimapTileSize;
-
-		SDL_RenderFillRect( renderer, &rect );
+		m_windowSize.x = min( worldSize.x, (int)cMaxWindowTiles );
+		m_windowSize.y = min( worldSize.y, (int)cMaxWindowTiles );
+
+		SDL_RendererInfo info;
+		if( SDL_GetRendererInfo( renderer, &info ) == 0 )
+		{
+			if( info.max_texture_width > 0 )
+				m_windowSize.x = min( m_windowSize.x, info.max_texture_width );
+			if( info.max_texture_height > 0 )
+				m_windowSize.y = min( m_windowSize.y, info.max_texture_height );
+		}
+
+		m_texture = SDL_CreateTexture( renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, m_windowSize.x, m_windowSize.y );
+		if( m_texture == NULL )
+		{
+			printf( "Failed to create the minimap texture: %s; the minimap is disabled\n", SDL_GetError() );
+			m_disabled = true;
+			return;
+		}
+
+		// Draw all tiles of the window once; after that, only edits get redrawn
+		FollowPlayer( worldSize );
+		WorldRegion region = { m_windowPos.x, m_windowPos.y, m_windowSize.x, m_windowSize.y };
+		DrawRegion( region );
 	}
+	else if( FollowPlayer( worldSize ) )
+	{
+		WorldRegion region = { m_windowPos.x, m_windowPos.y, m_windowSize.x, m_windowSize.y };
+		DrawRegion( region );
+	}
+
+	// Stretch it out to the minimap's tile size
+	rect.x = m_minimapPos.x;
+	rect.y = m_minimapPos.y;
+	rect.w = m_windowSize.x * m_minimapTileSize;
+	rect.h = m_windowSize.y * m_minimapTileSize;
+	SDL_RenderCopy( renderer, m_texture, NULL, &rect );
 
 	// Draw wherever the player is as a circle, then draw the facing vector
 	Vector3f ppos = m_player->GetPosition();
-	rect.x = (int)((float)m_minimapPos.x + ppos.x * (float)m_minimapTileSize - 1.0f);
-	rect.y = (int)((float)m_minimapPos.y + ppos.y * (float)m_minimapTileSize - 1.0f);
+	rect.x = (int)((float)m_minimapPos.x + (ppos.x - (float)m_windowPos.x) * (float)m_minimapTileSize - 1.0f);
+	rect.y = (int)((float)m_minimapPos.y + (ppos.y - (float)m_windowPos.y) * (float)m_minimapTileSize - 1.0f);
 	rect.h = rect.w = 3;
 
 	SDL_SetRenderDrawColor( renderer, 0, 0, 128, 255 );
@@ -60,3 +110,60 @@ void MinimapView::Render( SDL_Renderer* renderer )
 	SDL_SetRenderDrawColor( renderer, 255, 0, 0, 255 );
 	SDL_RenderDrawLine( renderer, rect.x + 1, rect.y + 1, rect.x + dx + 1, rect.y + dy + 1 );
 }
+
+void MinimapView::OnWorldChanged( const World* world, const WorldRegion& region )
+{
+	// Not drawn yet; the first render draws everything anyway
+	if( m_texture != NULL )
+		DrawRegion( region );
+}
+
+void MinimapView::DrawRegion( const WorldRegion& region )
+{
+	// Only the part of the region inside the window is kept
+	int left = max( region.m_x, m_windowPos.x );
+	int top = max( region.m_y, m_windowPos.y );
+	int right = min( region.m_x + region.m_width, m_windowPos.x + m_windowSize.x );
+	int bottom = min( region.m_y + region.m_height, m_windowPos.y + m_windowSize.y );
+	if( left >= right || top >= bottom )
+		return;
+
+	int width = right - left;
+	int height = bottom - top;
+
+	// Streamed worlds read back solid for any tile that isn't loaded
+	const TileTypeTable& tileTypes = m_gameWorld->GetTileTypes();
+	m_pixels.resize( width * height );
+	for(int y = 0; y < height; y++)
+	for(int x = 0; x < width; x++)
+	{
+		m_pixels[y * width + x] = tileTypes.GetMinimapColor( m_gameWorld->GetWorldTile( left + x, top + y )->m_tileId );
+	}
+
+	SDL_Rect rect = { left - m_windowPos.x, top - m_windowPos.y, width, height };
+	SDL_UpdateTexture( m_texture, &rect, &m_pixels[0], width * sizeof(Uint32) );
+	m_tilesDrawn += m_pixels.size();
+}
+
+bool MinimapView::FollowPlayer( const Vector2i& worldSize )
+{
+	Vector3f ppos = m_player->GetPosition();
+	Vector2i windowPos = m_windowPos;
+
+	// Centre on the player along any axis where they left the middle half, keeping the window on the map
+	int playerX = (int)ppos.x;
+	if( playerX < m_windowPos.x + m_windowSize.x / 4 || playerX >= m_windowPos.x + m_windowSize.x - m_windowSize.x / 4 )
+		windowPos.x = max( 0, min( worldSize.x - m_windowSize.x, playerX - m_windowSize.x / 2 ) );
+
+	int playerY = (int)ppos.y;
+	if( playerY < m_windowPos.y + m_windowSize.y / 4 || playerY >= m_windowPos.y + m_windowSize.y - m_windowSize.y / 4 )
+		windowPos.y = max( 0, min( worldSize.y - m_windowSize.y, playerY - m_windowSize.y / 2 ) );
+
+	// A window kept from another world may not fit on this one
+	windowPos.x = max( 0, min( worldSize.x - m_windowSize.x, windowPos.x ) );
+	windowPos.y = max( 0, min( worldSize.y - m_windowSize.y, windowPos.y ) );
+
+	bool moved = windowPos.x != m_windowPos.x || windowPos.y != m_windowPos.y;
+	m_windowPos = windowPos;
+	return moved;
+}
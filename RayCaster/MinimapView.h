@@ -7,18 +7,24 @@
  + Jeremy Bridon jbridon@cores2.com
  
  File: MinimapView.cpp/h
- Desc: Renders a preview of the world (minimap) on-screen.
+ Desc: Renders a preview of the world (minimap) on-screen. The
+ tiles around the player are kept in a texture, one pixel per
+ tile, which is only redrawn where the world gets edited or when
+ the player walks out of the middle of it. The texture is capped
+ in size, so huge worlds don't need a huge texture.
 
 ***************************************************************/
 
 #ifndef __MINIMAPVIEW_H__
 #define __MINIMAPVIEW_H__
 
+#include <vector>
+
 #include "VectorMath.h"
 #include "World.h"
 #include "Player.h"
 
-class MinimapView
+class MinimapView : public WorldListener
 {
 public:
 
@@ -27,7 +33,25 @@ public:
 
 	void Render( SDL_Renderer* renderer );
 
+	// Shows another world (such as another level of a stack); redrawn in full on the next render
+	void SetWorld( const World* gameWorld );
+
+	// Redraws the edited tiles into the texture
+	void OnWorldChanged( const World* world, const WorldRegion& region );
+
+	// Tiles drawn into the texture so far, full builds included
+	Uint64 GetTilesDrawn() const { return m_tilesDrawn; }
+
 private:
+
+	// Largest window of tiles shown, on either axis
+	static const int cMaxWindowTiles = 64;
+
+	// Draws the tiles of the given region (clipped to the window) into the texture
+	void DrawRegion( const WorldRegion& region );
+
+	// Re-centres the window on the player once they leave the middle half of it; true if it moved
+	bool FollowPlayer( const Vector2i& worldSize );
 	
 	const World* m_gameWorld;
 	const Player* m_player;
@@ -35,6 +59,16 @@ private:
 	Vector2i m_minimapPos;
 	int m_minimapTileSize;
 
+	// One pixel per tile of the window; created on the first render, as it needs the renderer
+	SDL_Texture* m_texture;
+	Vector2i m_windowPos;
+	Vector2i m_windowSize;
+
+	// Set if the texture couldn't be created; the minimap is then not drawn
+	bool m_disabled;
+	std::vector< Uint32 > m_pixels;
+	Uint64 m_tilesDrawn;
+
 };
 
 #endif
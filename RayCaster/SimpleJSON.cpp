@@ -9,6 +9,23 @@
 #include "SimpleJSON.h"
 using namespace SimpleJSON;
 
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+// Streaming from SDL files
+#include "SDL_rwops.h"
+#include "SDL_atomic.h"
+
+// Vector scans: SSE2 is on every x64 CPU, and looked for at runtime on 32-bit x86
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+    #define SIMPLEJSON_SSE2
+    #include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
 // Win32: suppress the security warning associated with C-string functions
 #ifdef WIN32
     #pragma warning(disable : 4996)
@@ -16,278 +33,803 @@ using namespace SimpleJSON;
 
 /*** Forward Declare ***/
 
-static char* GetToken( FILE* fileHandle );
-static void UngetToken( FILE* fileHandle, char** tokenString );
-static bool ParseString( const char* tokenString );
-static bool ParseNumber( const char* tokenString, float* fValue );
-static bool ParseBoolean( const char* tokenString, bool* boolValueOut );
-static bool ParseValue( FILE* fileHandle, JsonValue** valueOut );
-static bool ParseObject( FILE* fileHandle, JsonObject** objectOut );
-static bool ParseArray( FILE* fileHandle, JsonArray** arrayOut );
+// Single forward cursor over the whole input; nothing is ever put back. Also
+// counts the objects and arrays open around the cursor, for the parsers that
+// recurse into each (see JsonMaxDepth)
+struct JsonReader
+{
+    const char* m_cursor;
+    const char* m_end;
+    int m_depth;
+};
 
-/*** Private ***/
+// Number as parsed: the nearest double, and for numbers written as whole numbers
+// that fit in 64 bits, the exact value
+struct JsonNumber
+{
+    double m_value;
+    Sint64 m_integer;
+    bool m_isInteger;
+};
 
-// Given the file handle, return the next token; skips whitespaces, etc.
-// Note that the returned pointer is malloc'ed, so make sure to release it!
-static char* GetToken( FILE* fileHandle )
+static void SkipWhitespace( JsonReader* reader );
+template< typename CharBuffer > static bool ParseString( JsonReader* reader, CharBuffer* stringOut );
+static bool ParseNumber( JsonReader* reader, JsonNumber* number );
+static bool ParseLiteral( JsonReader* reader, const char* literal );
+static bool ParseValue( JsonReader* reader, JsonValue** valueOut );
+static bool ParseObject( JsonReader* reader, JsonObject** objectOut );
+static bool ParseArray( JsonReader* reader, JsonArray** arrayOut );
+
+// Member of an object being sorted by key; the order it came in breaks ties, so
+// that the first of duplicate keys wins, like it does in JsonObject
+struct JsonMemberSort
+{
+    JsonNode m_key;
+    JsonNode m_value;
+    unsigned int m_order;
+};
+
+// Parse state of a JsonDocument: the reader, the document's arenas, and the nodes
+// of the containers still open, which move to the node arena as each one closes
+// (so that the nodes of any container end up contiguous)
+struct JsonBuilder
+{
+    JsonReader m_reader;
+    std::vector< JsonNode >* m_nodes;
+    std::vector< char >* m_chars;
+    std::vector< JsonNode > m_pending;
+    std::vector< JsonMemberSort > m_members;
+};
+
+static bool ReadFileData( FILE* fileHandle, std::vector< char >* fileData, size_t* dataLength );
+static bool BuildValue( JsonBuilder* builder );
+static bool BuildString( JsonBuilder* builder );
+static bool BuildObject( JsonBuilder* builder );
+static bool BuildArray( JsonBuilder* builder );
+
+// Input buffer of a streamed parse, over a JsonSource. Structural characters are
+// read one at a time; strings, numbers and literals are first loaded whole into the
+// buffer, so that they go through the same parsing as in-memory text
+class JsonStreamReader
 {
-    static const int bufferLength = 512;
-    char buffer[bufferLength] = { '\0' };
+public:
 
-    int charCount = 0;
-    int nextChar = 0;
-    bool isStringLiteral = 0;
+    JsonStreamReader( JsonSource* source );
 
-    while( (nextChar = fgetc(fileHandle)) != EOF )
+    // Next character, without moving past it; -1 at the end of the input
+    inline int Peek()
     {
-        // Skip if whitespace but not in a string literal
-        if( !isStringLiteral && isspace(nextChar) )
-            continue;
+        if( m_cursor == m_end && !Refill() )
+            return -1;
+        return (unsigned char)m_buffer[m_cursor];
+    }
 
-        // If it's an object, array, or key-value association character, read it off and bail out
-        if( !isStringLiteral && (nextChar == '{' || nextChar == '}' || nextChar == '[' || nextChar == ']' || nextChar == ':') )
-        {
-            buffer[0] = nextChar;
-            charCount = 1;
-            break;
-        }
-        // Is it the start of a string literal?
-        else if( !isStringLiteral && nextChar == '"' )
+    // Moves past the next character
+    void Advance() { m_cursor++; }
+
+    // Moves past any whitespace
+    void SkipWhitespace();
+
+    // Makes sure the whole token at the cursor (a string up to its closing quote,
+    // anything else up to the next whitespace or structural character) is in the
+    // buffer, and sets the given reader over it; returns false at the end of the input
+    bool LoadToken( JsonReader* tokenReader );
+
+    // Moves the cursor to where the given token reader stopped
+    void Consume( const JsonReader& tokenReader ) { m_cursor = tokenReader.m_cursor - &m_buffer[0]; }
+
+private:
+
+    // Moves what is left from the cursor on to the start of the buffer (growing it
+    // if that is all of it), and reads more after it; returns false at the end
+    bool Refill();
+
+    JsonSource* m_source;
+    std::vector< char > m_buffer;
+    size_t m_cursor;
+    size_t m_end;
+
+};
+
+// Sources of streamed parses
+class JsonFileSource : public JsonSource
+{
+public:
+
+    JsonFileSource( FILE* fileHandle ) : m_fileHandle( fileHandle ) { }
+    size_t Read( char* buffer, size_t size ) { return fread( buffer, 1, size, m_fileHandle ); }
+
+private:
+
+    FILE* m_fileHandle;
+
+};
+
+class JsonRWopsSource : public JsonSource
+{
+public:
+
+    JsonRWopsSource( SDL_RWops* rwops ) : m_rwops( rwops ) { }
+    size_t Read( char* buffer, size_t size ) { return SDL_RWread( m_rwops, buffer, 1, size ); }
+
+private:
+
+    SDL_RWops* m_rwops;
+
+};
+
+// Stream read buffer size; tokens longer than this grow it
+static const size_t JsonStreamBufferSize = 64 * 1024;
+
+/*** Private ***/
+
+// Deepest nesting of objects and arrays in trees and documents: their parsers
+// recurse once per level, so deeper input would run out of stack (a worker
+// thread's stack can be as small as 64 KB) rather than just fail
+static const int JsonMaxDepth = 512;
+
+// Exact powers of ten; doubles hold all of them without rounding
+static const double JsonPowersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Range of powers of ten numbers are converted through Eisel-Lemire with (past
+// -342 and 308, a mantissa of up to 19 digits is always zero or infinite), and
+// that doubles are scaled by to be written (up to 10^326, for the smallest)
+static const int JsonPowersOfFive_Min = -342;
+static const int JsonPowersOfFive_Max = 326;
+
+// Powers of five from 5^-342 up to 5^326 as 128-bit mantissas, the top bit set, each
+// as a high then a low word; built once on start-up (see InitPowersOfFive)
+static Uint64 JsonPowersOfFive[2 * (JsonPowersOfFive_Max - JsonPowersOfFive_Min + 1)];
+
+// Limbs (32 bits each, least significant first) of the big numbers the table is
+// built from; enough for the largest numerator below
+static const int JsonBigNumber_Limbs = 56;
+
+// Top 128 bits of the given big number, as a high and a low word, truncated
+static void GetTopBits( const Uint32* limbs, Uint64* high, Uint64* low )
+{
+    int bitCount = 32 * JsonBigNumber_Limbs;
+    while( bitCount > 0 && ((limbs[(bitCount - 1) >> 5] >> ((bitCount - 1) & 31)) & 1) == 0 )
+        bitCount--;
+
+    Uint64 words[2] = { 0, 0 };
+    for(int i = 0; i < 128; i++)
+    {
+        int bit = bitCount - 128 + i;
+        if( bit >= 0 && ((limbs[bit >> 5] >> (bit & 31)) & 1) != 0 )
+            words[i >> 6] |= (Uint64)1 << (i & 63);
+    }
+    *high = words[1];
+    *low = words[0];
+}
+
+// Builds the table the way Lemire's reference tables are, exactly, on big numbers:
+// positive powers are truncated, and negative ones are floor(2^b / 5^n) + 1, with
+// b large enough for 128 bits (and then truncated), where 2^b is just past 5^n
+static void InitPowersOfFive()
+{
+    // The numerator is a larger power of two; floor(2^b / 5^n) is it divided by five
+    // n times, then shifted down to 2^b. The denominator is kept for its bit count
+    Uint32 power[JsonBigNumber_Limbs];
+    Uint32 quotient[JsonBigNumber_Limbs];
+    Uint32 entry[JsonBigNumber_Limbs];
+    memset( power, 0, sizeof(power) );
+    memset( quotient, 0, sizeof(quotient) );
+    power[0] = 1;
+    quotient[JsonBigNumber_Limbs - 1] = 0x80000000;
+    const int numeratorBits = 32 * JsonBigNumber_Limbs - 1;
+
+    for(int n = 0; n <= std::max( JsonPowersOfFive_Max, -JsonPowersOfFive_Min ); n++)
+    {
+        if( n <= JsonPowersOfFive_Max )
         {
-            // Flip state on/off
-            isStringLiteral = true;
-            break;
+            int index = 2 * (n - JsonPowersOfFive_Min);
+            GetTopBits( power, &JsonPowersOfFive[index], &JsonPowersOfFive[index + 1] );
         }
-        // Read off the buffer
-        else if( isStringLiteral )
+
+        if( n > 0 && n <= -JsonPowersOfFive_Min )
         {
-            // Escape-char sequence
-            if( nextChar == '\\' )
+            int powerBits = 32 * JsonBigNumber_Limbs;
+            while( ((power[(powerBits - 1) >> 5] >> ((powerBits - 1) & 31)) & 1) == 0 )
+                powerBits--;
+            int shift = numeratorBits - ((n <= 27) ? powerBits + 127 : 2 * powerBits + 128);
+
+            // Shifted down, plus one
+            Uint64 carry = 1;
+            for(int i = 0; i < JsonBigNumber_Limbs; i++)
             {
-                int escapeChar = fgetc(fileHandle);
-                switch(escapeChar)
-                {
-                    case '"':   nextChar = '"';     break;
-                    case '\\':  nextChar = '\\';    break;
-                    case '/':   nextChar = '/';     break;
-                    case 'b':   nextChar = '\b';    break;
-                    case 'f':   nextChar = '\f';    break;
-                    case 'n':   nextChar = '\n';    break;
-                    case 'r':   nextChar = '\r';    break;
-                    case 't':   nextChar = '\t';    break;
-                    default:    return false; // Fails out
-                }
+                int source = i + shift / 32;
+                Uint64 word = (source < JsonBigNumber_Limbs) ? quotient[source] : 0;
+                if( shift % 32 != 0 )
+                    word = (word >> (shift % 32)) | ((source + 1 < JsonBigNumber_Limbs) ? ((Uint64)quotient[source + 1] << (32 - shift % 32)) & 0xFFFFFFFF : 0);
+                word += carry;
+                entry[i] = (Uint32)word;
+                carry = word >> 32;
             }
 
-            // Place character, handled if control character
-            buffer[charCount++] = nextChar;
+            int index = 2 * (-n - JsonPowersOfFive_Min);
+            GetTopBits( entry, &JsonPowersOfFive[index], &JsonPowersOfFive[index + 1] );
+        }
+
+        // Next power of five, and the numerator divided by it
+        Uint64 carry = 0;
+        for(int i = 0; i < JsonBigNumber_Limbs; i++)
+        {
+            Uint64 product = (Uint64)power[i] * 5 + carry;
+            power[i] = (Uint32)product;
+            carry = product >> 32;
         }
-    }
 
-    // Null-terminate string and duplicate the result onto the buffer..
-    buffer[charCount] = '\0';
-    return strdup(buffer);
+        Uint64 remainder = 0;
+        for(int i = JsonBigNumber_Limbs - 1; i >= 0; i--)
+        {
+            Uint64 dividend = (remainder << 32) | quotient[i];
+            quotient[i] = (Uint32)(dividend / 5);
+            remainder = dividend % 5;
+        }
+    }
 }
 
-// Puts the token back into the given file-buffer; correctly pushes the letters in the
-// correct way so that re-reading the buffer, through GetToken(...), will return correct results
-// Note that the given token string will also be deleted through a delete[]
-static void UngetToken( FILE* fileHandle, char** tokenString )
+static struct JsonPowersOfFiveInit
 {
-    // Put string back on track
-    ungetc( ' ', fileHandle );
-    const int tokenLength = strlen(*tokenString);
-    for(int i = tokenLength - 1; i >= 0; i--)
-        ungetc( (*tokenString)[i], fileHandle );
+    JsonPowersOfFiveInit() { InitPowersOfFive(); }
+} s_powersOfFiveInit;
 
-    // Release full string
-    delete[] tokenString;
+// Full 128-bit product of the given words: returns the high word, and posts the low one
+static inline Uint64 MultiplyFull( Uint64 a, Uint64 b, Uint64* low )
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    Uint64 high;
+    *low = _umul128( a, b, &high );
+    return high;
+#elif defined(__SIZEOF_INT128__)
+    unsigned __int128 product = (unsigned __int128)a * b;
+    *low = (Uint64)product;
+    return (Uint64)(product >> 64);
+#else
+    Uint64 aLow = a & 0xFFFFFFFF, aHigh = a >> 32;
+    Uint64 bLow = b & 0xFFFFFFFF, bHigh = b >> 32;
+    Uint64 lowLow = aLow * bLow;
+    Uint64 highLow = aHigh * bLow;
+    Uint64 lowHigh = aLow * bHigh;
+    Uint64 middle = (lowLow >> 32) + (highLow & 0xFFFFFFFF) + (lowHigh & 0xFFFFFFFF);
+    *low = (middle << 32) | (lowLow & 0xFFFFFFFF);
+    return aHigh * bHigh + (highLow >> 32) + (lowHigh >> 32) + (middle >> 32);
+#endif
 }
 
-// Given a string, returns true if it is a well-formed JSON string, else false on error
-static bool ParseString( const char* tokenString )
+// Count of leading zero bits of the given non-zero word
+static inline int GetLeadingZeros( Uint64 bits )
 {
-    if(tokenString == NULL)
-        return false;
-    
-    int tokenLength = strlen(tokenString);
-    return ( tokenString[0] == '"' && tokenString[tokenLength - 1] == '"' );
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanReverse64( &index, bits );
+    return 63 - (int)index;
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if( _BitScanReverse( &index, (unsigned long)(bits >> 32) ) )
+        return 31 - (int)index;
+    _BitScanReverse( &index, (unsigned long)bits );
+    return 63 - (int)index;
+#else
+    return __builtin_clzll( bits );
+#endif
 }
 
-// Given a string, parse as a float, with the syntax of "[+|-]DIGITS[.][DIGITS][(e|E)[+|-]DIGITS]"
-// Returns true on success, false on failure / error
-// Note that this can even parse a number-string like "-3.01967E-20"
-// Note that we could also use atof(...) from the cstd-lib, but that's no fun..
-static bool ParseNumber( const char* tokenString, float* fValue )
+// Bits of the double nearest to the given non-zero mantissa times ten to the given
+// power, through the Eisel-Lemire algorithm: the mantissa times a 128-bit mantissa
+// of the power of five gives all the bits a double keeps and enough past them to
+// round correctly, bar exact halfway cases, which it picks out (see Lemire,
+// "Number Parsing at a Gigabyte per Second", and Mushtak and Lemire, "Fast Number
+// Parsing Without Fallback", for why a 19-digit mantissa never needs more)
+static Uint64 ComputeDouble( Uint64 mantissa, int exponent )
 {
-    const int tokenLength = strlen(tokenString);
-    int tokenIndex = 0;
-    if(tokenLength <= 0)
-        return false;
-    
-    bool isNegative = false;
-    if( tokenString[0] == '-' )
+    const Uint64 infinity = (Uint64)0x7FF << 52;
+    if( exponent < JsonPowersOfFive_Min )
+        return 0;
+    if( exponent > JsonPowersOfFive_Max )
+        return infinity;
+
+    // Normalized mantissa times the power of five; the low word is only needed if
+    // the high one has all ones below the 55 bits that go into rounding
+    int leadingZeros = GetLeadingZeros( mantissa );
+    mantissa <<= leadingZeros;
+    int index = 2 * (exponent - JsonPowersOfFive_Min);
+    Uint64 low = 0;
+    Uint64 high = MultiplyFull( mantissa, JsonPowersOfFive[index], &low );
+    if( (high & 0x1FF) == 0x1FF )
+    {
+        Uint64 secondLow = 0;
+        Uint64 secondHigh = MultiplyFull( mantissa, JsonPowersOfFive[index + 1], &secondLow );
+        low += secondHigh;
+        if( secondHigh > low )
+            high++;
+    }
+
+    // 54 bits of mantissa plus one to round with; the binary exponent of ten to the
+    // power is floor(exponent * log2(10)), biased
+    int upperBit = (int)(high >> 63);
+    int shift = upperBit + 9;
+    Uint64 bits = high >> shift;
+    int binaryExponent = (((152170 + 65536) * exponent) >> 16) + 63 + upperBit - leadingZeros + 1023;
+
+    // Subnormal
+    if( binaryExponent <= 0 )
     {
-        tokenIndex++;
-        isNegative = true;
+        if( -binaryExponent + 1 >= 64 )
+            return 0;
+        bits >>= -binaryExponent + 1;
+        bits += bits & 1;
+        bits >>= 1;
+        return bits | ((bits < ((Uint64)1 << 52)) ? 0 : ((Uint64)1 << 52));
     }
-    else if( tokenString[0] == '+' )
+
+    // Rounds up, but exactly halfway between two doubles (which needs a small
+    // power of ten) rounds to even
+    if( low <= 1 && exponent >= -4 && exponent <= 23 && (bits & 3) == 1 && (bits << shift) == high )
+        bits &= ~(Uint64)1;
+    bits += bits & 1;
+    bits >>= 1;
+    if( bits >= ((Uint64)2 << 52) )
     {
-        tokenIndex++;
+        bits = (Uint64)1 << 52;
+        binaryExponent++;
     }
+    bits &= ~((Uint64)1 << 52);
 
-    // Read in the integer up to the end / dot
-    int tokenEndIndex = tokenLength - 1;
-    for(int i = tokenIndex; i < tokenLength; i++)
+    if( binaryExponent >= 0x7FF )
+        return infinity;
+    return bits | ((Uint64)binaryExponent << 52);
+}
+
+// True if the CPU runs SSE2; only in doubt on 32-bit x86
+#ifdef SIMPLEJSON_SSE2
+static bool HasSSE2()
+{
+#if defined(_MSC_VER) && defined(_M_IX86)
+    int cpuInfo[4];
+    __cpuid( cpuInfo, 1 );
+    return (cpuInfo[3] & (1 << 26)) != 0;
+#else
+    return true;
+#endif
+}
+static const bool JsonHasSSE2 = HasSSE2();
+#endif
+
+// Index of the lowest set bit of the given non-zero mask
+static inline int GetLowestBit( unsigned int bits )
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward( &index, bits );
+    return (int)index;
+#else
+    return __builtin_ctz( bits );
+#endif
+}
+
+static inline bool IsWhitespace( char givenChar )
+{
+    return givenChar == ' ' || givenChar == '\n' || givenChar == '\r' || givenChar == '\t';
+}
+
+// First quote or backslash from the cursor on; the end if there is none. Goes
+// through 16 characters at a time, as a mask of which of them are either
+static const char* FindQuoteOrBackslash( const char* cursor, const char* end )
+{
+#ifdef SIMPLEJSON_SSE2
+    if( JsonHasSSE2 )
     {
-        if( isdigit(tokenString[i]) )
+        const __m128i quotes = _mm_set1_epi8( '"' );
+        const __m128i backslashes = _mm_set1_epi8( '\\' );
+        for(; end - cursor >= 16; cursor += 16)
         {
-            tokenEndIndex = i - 1;
-            break;
+            __m128i chars = _mm_loadu_si128( (const __m128i*)cursor );
+            unsigned int mask = _mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8( chars, quotes ), _mm_cmpeq_epi8( chars, backslashes ) ) );
+            if( mask != 0 )
+                return cursor + GetLowestBit( mask );
         }
     }
+#endif
+
+    while( cursor < end && *cursor != '"' && *cursor != '\\' )
+        cursor++;
+    return cursor;
+}
+
+// First non-whitespace character from the cursor on; the end if there is none.
+// Runs are mostly a single space or none at all, so that is looked at first, then
+// 16 characters at a time, as a mask of which of them are whitespace
+static const char* FindNonWhitespace( const char* cursor, const char* end )
+{
+    if( cursor < end && IsWhitespace( *cursor ) )
+        cursor++;
+    if( cursor >= end || !IsWhitespace( *cursor ) )
+        return cursor;
 
-    // Re-read from right to left to parse
-    int factor = 1;
-    int sum = 0;
-    for(int i = tokenEndIndex; i >= tokenIndex; i--)
+#ifdef SIMPLEJSON_SSE2
+    if( JsonHasSSE2 )
     {
-        sum += (tokenString[i] - '0') * factor;
-        factor *= 10;
+        for(; end - cursor >= 16; cursor += 16)
+        {
+            __m128i chars = _mm_loadu_si128( (const __m128i*)cursor );
+            __m128i isWhitespace = _mm_or_si128(
+                _mm_or_si128( _mm_cmpeq_epi8( chars, _mm_set1_epi8( ' ' ) ), _mm_cmpeq_epi8( chars, _mm_set1_epi8( '\n' ) ) ),
+                _mm_or_si128( _mm_cmpeq_epi8( chars, _mm_set1_epi8( '\r' ) ), _mm_cmpeq_epi8( chars, _mm_set1_epi8( '\t' ) ) ) );
+            unsigned int mask = ~_mm_movemask_epi8( isWhitespace ) & 0xFFFF;
+            if( mask != 0 )
+                return cursor + GetLowestBit( mask );
+        }
     }
-    tokenIndex = tokenEndIndex;
+#endif
 
-    // TODO: Read off the rest of the string, and deal with the 'e'/'E' character..
-    *fValue = 1.0f;
+    while( cursor < end && IsWhitespace( *cursor ) )
+        cursor++;
+    return cursor;
 }
 
-static bool ParseBoolean( const char* tokenString, bool* boolValueOut )
+// Moves the cursor past any whitespace
+static void SkipWhitespace( JsonReader* reader )
 {
-    const int tokenLength = strlen(tokenString);
-    char buffer[512];
+    reader->m_cursor = FindNonWhitespace( reader->m_cursor, reader->m_end );
+}
+
+// Value of the given hex digit; -1 if it isn't one
+static int GetHexDigit( char givenChar )
+{
+    if( givenChar >= '0' && givenChar <= '9' )
+        return givenChar - '0';
+    else if( givenChar >= 'a' && givenChar <= 'f' )
+        return givenChar - 'a' + 10;
+    else if( givenChar >= 'A' && givenChar <= 'F' )
+        return givenChar - 'A' + 10;
+    return -1;
+}
 
-    if(tokenLength > 5)
+// Parses the string literal at the cursor, with its escape sequences resolved, and
+// moves past it; returns true on success, false on failure / error. Strings without
+// escapes are copied out in one go. The characters are appended to the given
+// buffer (a std::string, or the char arena of a document)
+template< typename CharBuffer >
+static bool ParseString( JsonReader* reader, CharBuffer* stringOut )
+{
+    const char* cursor = reader->m_cursor;
+    const char* end = reader->m_end;
+    if( cursor >= end || *cursor != '"' )
         return false;
+    cursor++;
 
-    strncpy(buffer, tokenString, tokenLength + 1);
-    for(int i = 0; i < tokenLength; i++)
-        buffer[i] = tolower( buffer[i] );
+    // Plain run up to the closing quote or the first escape
+    const char* runStart = cursor;
+    cursor = FindQuoteOrBackslash( cursor, end );
+    stringOut->insert( stringOut->end(), runStart, cursor );
 
-    if( strcmp(buffer, "true") == 0 )
-    {
-        *boolValueOut = true;
-        return true;
-    }
-    else if( strcmp(buffer, "false") == 0 )
+    while( cursor < end && *cursor != '"' )
     {
-        *boolValueOut = false;
-        return true;
+        // Escape-char sequence
+        char escapeChar = (++cursor < end) ? *cursor++ : '\0';
+        switch(escapeChar)
+        {
+            case '"':   stringOut->push_back( '"' );      break;
+            case '\\':  stringOut->push_back( '\\' );     break;
+            case '/':   stringOut->push_back( '/' );      break;
+            case 'b':   stringOut->push_back( '\b' );     break;
+            case 'f':   stringOut->push_back( '\f' );     break;
+            case 'n':   stringOut->push_back( '\n' );     break;
+            case 'r':   stringOut->push_back( '\r' );     break;
+            case 't':   stringOut->push_back( '\t' );     break;
+
+            // Code point, stored as UTF-8 (surrogate pairs are not joined)
+            case 'u':
+            {
+                unsigned int codePoint = 0;
+                for(int i = 0; i < 4; i++)
+                {
+                    int hexDigit = (cursor < end) ? GetHexDigit( *cursor++ ) : -1;
+                    if( hexDigit < 0 )
+                        return false;
+                    codePoint = codePoint * 16 + hexDigit;
+                }
+
+                if( codePoint >= 0x800 )
+                {
+                    stringOut->push_back( (char)(0xE0 | (codePoint >> 12)) );
+                    stringOut->push_back( (char)(0x80 | ((codePoint >> 6) & 0x3F)) );
+                    stringOut->push_back( (char)(0x80 | (codePoint & 0x3F)) );
+                }
+                else if( codePoint >= 0x80 )
+                {
+                    stringOut->push_back( (char)(0xC0 | (codePoint >> 6)) );
+                    stringOut->push_back( (char)(0x80 | (codePoint & 0x3F)) );
+                }
+                else
+                {
+                    stringOut->push_back( (char)codePoint );
+                }
+                break;
+            }
+
+            default:    return false; // Fails out
+        }
+
+        // Next plain run
+        runStart = cursor;
+        cursor = FindQuoteOrBackslash( cursor, end );
+        stringOut->insert( stringOut->end(), runStart, cursor );
     }
-    else
-    {
+
+    // Unterminated
+    if( cursor >= end )
         return false;
-    }
+
+    reader->m_cursor = cursor + 1;
+    return true;
 }
 
-// Returns true on success, false on failure / error
-// Posts the result on the given ObjectData object
-static bool ParseValue( FILE* fileHandle, JsonValue** valueOut )
+// Parses the number at the cursor, with the syntax of "[-]DIGITS[.DIGITS][(e|E)[+|-]DIGITS]",
+// and moves past it; returns true on success, false on failure / error
+// Note that this can even parse a number-string like "-3.01967E-20"
+static bool ParseNumber( JsonReader* reader, JsonNumber* number )
 {
-    // Initialize working memory
-    *valueOut = NULL;
-    float fValue;
-    bool bValue;
-    JsonObject* jsonObject = NULL;
-    JsonArray* jsonArray = NULL;
+    const char* cursor = reader->m_cursor;
+    const char* end = reader->m_end;
+    const char* numberStart = cursor;
+
+    bool isNegative = (cursor < end && *cursor == '-');
+    if( isNegative )
+        cursor++;
 
-    // Peek (and then un-get) the string token
-    char* tokenString = GetToken(fileHandle);
-    
-    // Given the token, figure out the type and parse it appropriately
-    if( ParseString(tokenString) )
+    // Digits go into the mantissa as long as it stays exact (19 digits); the
+    // exponent makes up for the digits dropped and those after the dot
+    Uint64 mantissa = 0;
+    int digitCount = 0;
+    int exponent = 0;
+    bool isTruncated = false;
+
+    // Integer part, without leading zeros
+    if( cursor >= end || *cursor < '0' || *cursor > '9' )
+        return false;
+    else if( *cursor == '0' )
+        cursor++;
+    else while( cursor < end && *cursor >= '0' && *cursor <= '9' )
     {
-        *valueOut = new JsonValue( std::string(tokenString) );
-        delete[] tokenString;
+        if( digitCount < 19 )
+        {
+            mantissa = mantissa * 10 + (*cursor - '0');
+            digitCount++;
+        }
+        else
+        {
+            exponent++;
+            isTruncated |= (*cursor != '0');
+        }
+        cursor++;
     }
-    else if( ParseNumber(tokenString, &fValue) )
+
+    // Whole numbers that fit keep their exact value
+    bool isInteger = (exponent == 0);
+
+    // Fraction
+    if( cursor < end && *cursor == '.' )
     {
-        *valueOut = new JsonValue( fValue );
-        delete[] tokenString;
+        isInteger = false;
+        cursor++;
+        if( cursor >= end || *cursor < '0' || *cursor > '9' )
+            return false;
+        while( cursor < end && *cursor >= '0' && *cursor <= '9' )
+        {
+            if( digitCount < 19 )
+            {
+                mantissa = mantissa * 10 + (*cursor - '0');
+                digitCount += (mantissa != 0) ? 1 : 0;
+                exponent--;
+            }
+            else
+            {
+                isTruncated |= (*cursor != '0');
+            }
+            cursor++;
+        }
     }
-    else if( ParseBoolean(tokenString, &bValue) )
+
+    // Exponent
+    if( cursor < end && (*cursor == 'e' || *cursor == 'E') )
     {
-        *valueOut = new JsonValue( bValue );
-        delete[] tokenString;
+        isInteger = false;
+        cursor++;
+        bool isExponentNegative = (cursor < end && *cursor == '-');
+        if( cursor < end && (*cursor == '+' || *cursor == '-') )
+            cursor++;
+        if( cursor >= end || *cursor < '0' || *cursor > '9' )
+            return false;
+
+        int givenExponent = 0;
+        while( cursor < end && *cursor >= '0' && *cursor <= '9' )
+        {
+            if( givenExponent < 100000 )
+                givenExponent = givenExponent * 10 + (*cursor - '0');
+            cursor++;
+        }
+        exponent += isExponentNegative ? -givenExponent : givenExponent;
     }
 
-    // To test for object / array, we must put back the string
+    // Exact mantissa and small power of ten: one correctly rounded multiply or
+    // divide. Otherwise Eisel-Lemire; a truncated mantissa rounds the same either
+    // way, or goes through strtod(...), off a terminated copy
+    double value = 0.0;
+    if( mantissa == 0 )
+    {
+        value = 0.0;
+    }
+    else if( mantissa < ((Uint64)1 << 53) && exponent >= -22 && exponent <= 22 )
+    {
+        value = (double)mantissa;
+        value = (exponent < 0) ? (value / JsonPowersOfTen[-exponent]) : (value * JsonPowersOfTen[exponent]);
+    }
     else
     {
-        UngetToken(fileHandle, &tokenString);
-
-        if( ParseObject(fileHandle, &jsonObject) )
+        Uint64 bits = ComputeDouble( mantissa, exponent );
+        if( !isTruncated || ComputeDouble( mantissa + 1, exponent ) == bits )
         {
-            *valueOut = new JsonValue( jsonObject );
+            memcpy( &value, &bits, sizeof(value) );
         }
-        else if( ParseArray(fileHandle, &jsonArray) )
+        else
         {
-            *valueOut = new JsonValue( jsonArray );
+            char numberBuffer[64];
+            std::string numberString;
+            const char* digitStart = numberStart + (isNegative ? 1 : 0);
+            size_t numberLength = cursor - digitStart;
+            if( numberLength < sizeof(numberBuffer) )
+            {
+                memcpy( numberBuffer, digitStart, numberLength );
+                numberBuffer[numberLength] = '\0';
+                value = strtod( numberBuffer, NULL );
+            }
+            else
+            {
+                numberString.assign( digitStart, cursor );
+                value = strtod( numberString.c_str(), NULL );
+            }
         }
     }
-    
+
+    // -0 stays a double, as integers have no negative zero
+    number->m_value = isNegative ? -value : value;
+    number->m_isInteger = isInteger && (isNegative ? mantissa != 0 && mantissa <= (Uint64)1 << 63 : mantissa <= ((Uint64)1 << 63) - 1);
+    number->m_integer = isNegative ? (Sint64)(~mantissa + 1) : (Sint64)mantissa;
+    reader->m_cursor = cursor;
+    return true;
+}
+
+// Moves past the given literal (true, false, null) if it is at the cursor; returns false if not
+static bool ParseLiteral( JsonReader* reader, const char* literal )
+{
+    size_t literalLength = strlen( literal );
+    if( (size_t)(reader->m_end - reader->m_cursor) < literalLength || memcmp( reader->m_cursor, literal, literalLength ) != 0 )
+        return false;
+
+    reader->m_cursor += literalLength;
+    return true;
+}
+
+// Returns true on success, false on failure / error
+// Posts the result on the given ObjectData object
+static bool ParseValue( JsonReader* reader, JsonValue** valueOut )
+{
+    // Initialize working memory
+    *valueOut = NULL;
+    JsonNumber number;
+    JsonObject* jsonObject = NULL;
+    JsonArray* jsonArray = NULL;
+
+    SkipWhitespace( reader );
+    if( reader->m_cursor >= reader->m_end )
+        return false;
+
+    // The first character tells the type
+    switch( *reader->m_cursor )
+    {
+        // Parsed straight into the value's own string
+        case '"':
+            *valueOut = new JsonValue( std::string() );
+            if( !ParseString(reader, (*valueOut)->m_data.m_string) )
+            {
+                delete *valueOut;
+                *valueOut = NULL;
+            }
+            break;
+
+        case '{':
+            if( ParseObject(reader, &jsonObject) )
+                *valueOut = new JsonValue( jsonObject );
+            break;
+
+        case '[':
+            if( ParseArray(reader, &jsonArray) )
+                *valueOut = new JsonValue( jsonArray );
+            break;
+
+        case 't':
+            if( ParseLiteral(reader, "true") )
+                *valueOut = new JsonValue( true );
+            break;
+
+        case 'f':
+            if( ParseLiteral(reader, "false") )
+                *valueOut = new JsonValue( false );
+            break;
+
+        case 'n':
+            if( ParseLiteral(reader, "null") )
+                *valueOut = new JsonValue();
+            break;
+
+        default:
+            if( ParseNumber(reader, &number) )
+                *valueOut = number.m_isInteger ? new JsonValue( (long long)number.m_integer ) : new JsonValue( number.m_value );
+            break;
+    }
+
     // Done; return true (success) if the valueOut is set
     return ((*valueOut) != NULL) ? true : false;
 }
 
 // Parse the given object stream; returns true on success, false on error
 // Does recursive parsing as needed
-static bool ParseObject( FILE* fileHandle, JsonObject** objectOut )
+static bool ParseObject( JsonReader* reader, JsonObject** objectOut )
 {
     // Initialize working memory
     bool isValid = true;
     *objectOut = new JsonObject();
-    
-    // Must start with '{'
-    char* tokenString = GetToken( fileHandle );
-    if( tokenString == NULL || tokenString[0] != '{' )
-    {
-        delete[] tokenString;
+
+    // Must start with '{'; only an empty object may end right away
+    SkipWhitespace( reader );
+    if( reader->m_cursor >= reader->m_end || *reader->m_cursor != '{' || ++reader->m_depth > JsonMaxDepth )
         isValid = false;
-    }
-    
+    else
+        reader->m_cursor++;
+
+    SkipWhitespace( reader );
+    bool isObjectEnd = isValid && reader->m_cursor < reader->m_end && *reader->m_cursor == '}';
+    if( isObjectEnd )
+        reader->m_cursor++;
+
     // Keep reading
-    while( isValid )
+    std::string keyString;
+    while( isValid && !isObjectEnd )
     {
         // We're expecting a "key-string : value" format
-        tokenString = GetToken( fileHandle );
-        bool isObjectEnd = (tokenString != NULL && tokenString[0] == '}');
-        bool isKeyString = ParseString( tokenString );
-        std::string KeyString = tokenString;
-        delete[] tokenString;
-
-        // If we're at the end of the key-value list, break-out!
-        if( isObjectEnd )
-            break;
+        SkipWhitespace( reader );
+        keyString.clear();
+        bool isKeyString = ParseString( reader, &keyString );
 
         // Expecting a colon (key:value)
-        tokenString = GetToken( fileHandle );
-        bool isColon = (tokenString != NULL && tokenString[0] == ':');
-        delete[] tokenString;
+        SkipWhitespace( reader );
+        bool isColon = isKeyString && reader->m_cursor < reader->m_end && *reader->m_cursor == ':';
+        if( isColon )
+            reader->m_cursor++;
 
         // Expecting a value (could be object, string, array, etc.)
-        JsonValue* jsonValue;
-        bool isValue = ParseValue( fileHandle, &jsonValue );
-
-        // Error checking
-        if( !isKeyString || !isColon || !isValue )
-        {
-            isValue = false;
-        }
-        // Post result
-        else
+        JsonValue* jsonValue = NULL;
+        if( !isColon || !ParseValue( reader, &jsonValue ) )
         {
-            (*objectOut)->insert( JsonObjectPair(KeyString, jsonValue) );
+            isValid = false;
+            break;
         }
+
+        // Post result; the first of duplicate keys wins
+        if( !(*objectOut)->insert( JsonObjectPair(keyString, jsonValue) ).second )
+            delete jsonValue;
+
+        // Either a comma and the next pair, or the end of the object
+        SkipWhitespace( reader );
+        char nextChar = (reader->m_cursor < reader->m_end) ? *reader->m_cursor++ : '\0';
+        isObjectEnd = (nextChar == '}');
+        isValid = isObjectEnd || nextChar == ',';
     }
 
     // Release buffer if on error
@@ -302,48 +844,36 @@ static bool ParseObject( FILE* fileHandle, JsonObject** objectOut )
         delete *objectOut;
         *objectOut = NULL;
     }
+    reader->m_depth--;
     return isValid;
 }
 
 // Parse the given array stream; returns true on success, false on error
 // Does recursive parsing as needed
-static bool ParseArray( FILE* fileHandle, JsonArray** arrayOut )
+static bool ParseArray( JsonReader* reader, JsonArray** arrayOut )
 {
     // Initialize working memory
     bool isValid = true;
     *arrayOut = new JsonArray();
 
-    // Must start with '[' character
-    char* tokenString = GetToken( fileHandle );
-    if( tokenString == NULL || tokenString[0] != '[' )
-    {
-        delete[] tokenString;
-        return false;
-    }
+    // Must start with '[' character; only an empty array may end right away
+    SkipWhitespace( reader );
+    if( reader->m_cursor >= reader->m_end || *reader->m_cursor != '[' || ++reader->m_depth > JsonMaxDepth )
+        isValid = false;
+    else
+        reader->m_cursor++;
+
+    SkipWhitespace( reader );
+    bool isArrayEnd = isValid && reader->m_cursor < reader->m_end && *reader->m_cursor == ']';
+    if( isArrayEnd )
+        reader->m_cursor++;
 
     // Go through the array...
-    while( isValid )
+    while( isValid && !isArrayEnd )
     {
-        // Peek at end for end-condition
-        tokenString = GetToken( fileHandle );
-        if( tokenString == NULL )
-        {
-            isValid = false;
-            break;
-        }
-        // End of array, break out!
-        else if( tokenString[0] == ']' )
-        {
-            delete[] tokenString;
-            break;
-        }
-
-        // Put the value back, in case it's data for the next array
-        UngetToken( fileHandle, &tokenString );
-
         // Parse the object in question
         JsonValue* jsonValue;
-        if(!ParseValue(fileHandle, &jsonValue))
+        if(!ParseValue(reader, &jsonValue))
         {
             isValid = false;
             break;
@@ -352,23 +882,11 @@ static bool ParseArray( FILE* fileHandle, JsonArray** arrayOut )
         // Save off object
         (*arrayOut)->push_back( jsonValue );
 
-        // Peek at the next token, reading off any comma-characters
-        tokenString = GetToken( fileHandle );
-        if( tokenString != NULL && tokenString[0] == ',')
-        {
-            delete[] tokenString;
-        }
-        // Some sort of error
-        else if(tokenString == NULL)
-        {
-            isValid = false;
-            break;
-        }
-        // Else, put back token for next read
-        else
-        {
-            UngetToken( fileHandle, &tokenString );
-        }
+        // Either a comma and the next value, or the end of the array
+        SkipWhitespace( reader );
+        char nextChar = (reader->m_cursor < reader->m_end) ? *reader->m_cursor++ : '\0';
+        isArrayEnd = (nextChar == ']');
+        isValid = isArrayEnd || nextChar == ',';
     }
 
     // Release buffer if on error
@@ -386,45 +904,748 @@ static bool ParseArray( FILE* fileHandle, JsonArray** arrayOut )
         delete *arrayOut;
         *arrayOut = NULL;
     }
+    reader->m_depth--;
     return isValid;
 }
 
-/*** Public ***/
-
-JsonValue::JsonValue()
+// Reads in the rest of the file, in one go when its size is known, else in growing
+// blocks (pipes and the like); the data is followed by at least one spare byte.
+// Returns false on a read error
+static bool ReadFileData( FILE* fileHandle, std::vector< char >* fileData, size_t* dataLength )
 {
-    m_type = JsonType_Null;
-    memset( this, 0, sizeof(this) );
-}
+    fileData->clear();
+    long position = ftell( fileHandle );
+    if( position >= 0 && fseek( fileHandle, 0, SEEK_END ) == 0 )
+    {
+        long fileLength = ftell( fileHandle );
+        fseek( fileHandle, position, SEEK_SET );
+        fileData->resize( (fileLength > position) ? (size_t)(fileLength - position) + 1 : 1 );
+    }
 
-JsonValue::JsonValue( const bool givenBool )
-{
-    m_type = JsonType_Bool;
+    *dataLength = 0;
+    for(;;)
+    {
+        if( fileData->size() == *dataLength )
+            fileData->resize( fileData->empty() ? 65536 : fileData->size() * 2 );
+
+        size_t readLength = fread( &(*fileData)[*dataLength], 1, fileData->size() - *dataLength, fileHandle );
+        *dataLength += readLength;
+        if( readLength == 0 )
+            break;
+    }
+
+    return ferror( fileHandle ) == 0;
+}
+
+// Orders members by key, then by the order they came in
+class JsonMemberLess
+{
+public:
+
+    JsonMemberLess( const char* chars ) : m_chars( chars ) { }
+
+    bool operator()( const JsonMemberSort& left, const JsonMemberSort& right ) const
+    {
+        int order = CompareKeys( left.m_key, right.m_key );
+        return (order != 0) ? (order < 0) : (left.m_order < right.m_order);
+    }
+
+    // Compares two key nodes, like strcmp(...) does (but they may hold zeros)
+    int CompareKeys( const JsonNode& left, const JsonNode& right ) const
+    {
+        size_t commonLength = (left.m_length < right.m_length) ? left.m_length : right.m_length;
+        int order = memcmp( m_chars + left.m_data.m_offset, m_chars + right.m_data.m_offset, commonLength );
+        if( order != 0 )
+            return order;
+        return (left.m_length < right.m_length) ? -1 : ((left.m_length > right.m_length) ? 1 : 0);
+    }
+
+private:
+
+    const char* m_chars;
+
+};
+
+// Parses the value at the cursor, and pushes its node onto the pending nodes
+// Returns true on success, false on failure / error
+static bool BuildValue( JsonBuilder* builder )
+{
+    JsonReader* reader = &builder->m_reader;
+    SkipWhitespace( reader );
+    if( reader->m_cursor >= reader->m_end )
+        return false;
+
+    JsonNode node;
+    node.m_length = 0;
+    node.m_data.m_offset = 0;
+
+    // The first character tells the type
+    switch( *reader->m_cursor )
+    {
+        case '"':
+            return BuildString( builder );
+
+        case '{':
+            return BuildObject( builder );
+
+        case '[':
+            return BuildArray( builder );
+
+        case 't':
+        case 'f':
+            node.m_type = JsonType_Bool;
+            node.m_data.m_boolean = (*reader->m_cursor == 't');
+            if( !ParseLiteral( reader, node.m_data.m_boolean ? "true" : "false" ) )
+                return false;
+            break;
+
+        case 'n':
+            node.m_type = JsonType_Null;
+            if( !ParseLiteral( reader, "null" ) )
+                return false;
+            break;
+
+        default:
+        {
+            JsonNumber number;
+            if( !ParseNumber( reader, &number ) )
+                return false;
+            node.m_type = JsonType_Number;
+            node.m_length = number.m_isInteger ? 1 : 0;
+            if( number.m_isInteger )
+                node.m_data.m_integer = number.m_integer;
+            else
+                node.m_data.m_number = number.m_value;
+            break;
+        }
+    }
+
+    builder->m_pending.push_back( node );
+    return true;
+}
+
+// Parses the string literal at the cursor into the char arena, zero-terminated,
+// and pushes its node; returns true on success, false on failure / error
+static bool BuildString( JsonBuilder* builder )
+{
+    JsonNode node;
+    node.m_type = JsonType_String;
+    node.m_data.m_offset = (unsigned int)builder->m_chars->size();
+    if( !ParseString( &builder->m_reader, builder->m_chars ) )
+        return false;
+
+    node.m_length = (unsigned int)(builder->m_chars->size() - node.m_data.m_offset);
+    builder->m_chars->push_back( '\0' );
+    builder->m_pending.push_back( node );
+    return true;
+}
+
+// Parses the object at the cursor, and pushes its node; its members are sorted
+// by key into the node arena. Returns true on success, false on failure / error
+static bool BuildObject( JsonBuilder* builder )
+{
+    JsonReader* reader = &builder->m_reader;
+    std::vector< JsonNode >& pending = builder->m_pending;
+    size_t firstPending = pending.size();
+
+    // Past the '{'; only an empty object may end right away
+    if( ++reader->m_depth > JsonMaxDepth )
+        return false;
+    reader->m_cursor++;
+    SkipWhitespace( reader );
+    bool isObjectEnd = reader->m_cursor < reader->m_end && *reader->m_cursor == '}';
+    if( isObjectEnd )
+        reader->m_cursor++;
+
+    while( !isObjectEnd )
+    {
+        // "key-string : value"
+        SkipWhitespace( reader );
+        if( reader->m_cursor >= reader->m_end || *reader->m_cursor != '"' || !BuildString( builder ) )
+            return false;
+
+        SkipWhitespace( reader );
+        if( reader->m_cursor >= reader->m_end || *reader->m_cursor != ':' )
+            return false;
+        reader->m_cursor++;
+
+        if( !BuildValue( builder ) )
+            return false;
+
+        // Either a comma and the next pair, or the end of the object
+        SkipWhitespace( reader );
+        char nextChar = (reader->m_cursor < reader->m_end) ? *reader->m_cursor++ : '\0';
+        isObjectEnd = (nextChar == '}');
+        if( !isObjectEnd && nextChar != ',' )
+            return false;
+    }
+
+    // Members in key order; most objects are small or already sorted
+    JsonMemberLess memberLess( builder->m_chars->empty() ? NULL : &(*builder->m_chars)[0] );
+    size_t memberCount = (pending.size() - firstPending) / 2;
+    bool isSorted = true;
+    for(size_t i = 1; i < memberCount && isSorted; i++)
+        isSorted = memberLess.CompareKeys( pending[firstPending + 2 * (i - 1)], pending[firstPending + 2 * i] ) < 0;
+
+    JsonNode node;
+    node.m_type = JsonType_Object;
+    node.m_data.m_offset = (unsigned int)builder->m_nodes->size();
+    if( isSorted )
+    {
+        builder->m_nodes->insert( builder->m_nodes->end(), pending.begin() + firstPending, pending.end() );
+        node.m_length = (unsigned int)memberCount;
+    }
+    else
+    {
+        std::vector< JsonMemberSort >& members = builder->m_members;
+        members.resize( memberCount );
+        for(size_t i = 0; i < memberCount; i++)
+        {
+            members[i].m_key = pending[firstPending + 2 * i];
+            members[i].m_value = pending[firstPending + 2 * i + 1];
+            members[i].m_order = (unsigned int)i;
+        }
+        std::sort( members.begin(), members.end(), memberLess );
+
+        // The first of duplicate keys wins
+        node.m_length = 0;
+        for(size_t i = 0; i < memberCount; i++)
+        {
+            if( i > 0 && memberLess.CompareKeys( members[i - 1].m_key, members[i].m_key ) == 0 )
+                continue;
+
+            builder->m_nodes->push_back( members[i].m_key );
+            builder->m_nodes->push_back( members[i].m_value );
+            node.m_length++;
+        }
+    }
+
+    pending.resize( firstPending );
+    pending.push_back( node );
+    reader->m_depth--;
+    return true;
+}
+
+// Parses the array at the cursor, and pushes its node; its elements go to the
+// node arena. Returns true on success, false on failure / error
+static bool BuildArray( JsonBuilder* builder )
+{
+    JsonReader* reader = &builder->m_reader;
+    std::vector< JsonNode >& pending = builder->m_pending;
+    size_t firstPending = pending.size();
+
+    // Past the '['; only an empty array may end right away
+    if( ++reader->m_depth > JsonMaxDepth )
+        return false;
+    reader->m_cursor++;
+    SkipWhitespace( reader );
+    bool isArrayEnd = reader->m_cursor < reader->m_end && *reader->m_cursor == ']';
+    if( isArrayEnd )
+        reader->m_cursor++;
+
+    while( !isArrayEnd )
+    {
+        if( !BuildValue( builder ) )
+            return false;
+
+        // Either a comma and the next value, or the end of the array
+        SkipWhitespace( reader );
+        char nextChar = (reader->m_cursor < reader->m_end) ? *reader->m_cursor++ : '\0';
+        isArrayEnd = (nextChar == ']');
+        if( !isArrayEnd && nextChar != ',' )
+            return false;
+    }
+
+    JsonNode node;
+    node.m_type = JsonType_Array;
+    node.m_length = (unsigned int)(pending.size() - firstPending);
+    node.m_data.m_offset = (unsigned int)builder->m_nodes->size();
+    builder->m_nodes->insert( builder->m_nodes->end(), pending.begin() + firstPending, pending.end() );
+
+    pending.resize( firstPending );
+    pending.push_back( node );
+    reader->m_depth--;
+    return true;
+}
+
+// Last parse id handed out; ids are unique across documents and threads
+static SDL_atomic_t s_lastParseId;
+
+static unsigned int GetNextParseId()
+{
+    return (unsigned int)SDL_AtomicAdd( &s_lastParseId, 1 ) + 1;
+}
+
+// Returns true if the character ends a number or literal: whitespace, a structural
+// character, or the start of a string
+static bool IsTokenEnd( char givenChar )
+{
+    switch( givenChar )
+    {
+        case ' ': case '\n': case '\r': case '\t':
+        case '{': case '}': case '[': case ']': case ':': case ',': case '"':
+            return true;
+        default:
+            return false;
+    }
+}
+
+JsonStreamReader::JsonStreamReader( JsonSource* source )
+    : m_source( source )
+    , m_buffer( JsonStreamBufferSize )
+    , m_cursor( 0 )
+    , m_end( 0 )
+{
+}
+
+void JsonStreamReader::SkipWhitespace()
+{
+    for(;;)
+    {
+        m_cursor = FindNonWhitespace( &m_buffer[0] + m_cursor, &m_buffer[0] + m_end ) - &m_buffer[0];
+        if( m_cursor < m_end || !Refill() )
+            return;
+    }
+}
+
+bool JsonStreamReader::LoadToken( JsonReader* tokenReader )
+{
+    if( Peek() < 0 )
+        return false;
+
+    // Look for the end of the token, reading more as the buffer runs out
+    bool isString = (m_buffer[m_cursor] == '"');
+    size_t tokenLength = isString ? 1 : 0;
+    for(;;)
+    {
+        size_t index = m_cursor + tokenLength;
+        bool isTokenEnd = false;
+        if( isString )
+        {
+            // An escape cut off by the end of the buffer is looked at again after the refill
+            for(;;)
+            {
+                index = FindQuoteOrBackslash( &m_buffer[0] + index, &m_buffer[0] + m_end ) - &m_buffer[0];
+                if( index >= m_end || m_buffer[index] == '"' || index + 1 >= m_end )
+                    break;
+                index += 2;
+            }
+
+            // Past the closing quote
+            isTokenEnd = index < m_end && m_buffer[index] == '"';
+            if( isTokenEnd )
+                index++;
+        }
+        else
+        {
+            while( index < m_end && !IsTokenEnd( m_buffer[index] ) )
+                index++;
+            isTokenEnd = index < m_end;
+        }
+        tokenLength = index - m_cursor;
+
+        // At the end of the input, a token runs up to it (and strings are left unterminated)
+        if( isTokenEnd || !Refill() )
+            break;
+    }
+
+    tokenReader->m_cursor = &m_buffer[m_cursor];
+    tokenReader->m_end = &m_buffer[m_cursor] + tokenLength;
+    return true;
+}
+
+bool JsonStreamReader::Refill()
+{
+    // Keep what is left, and make room for more
+    if( m_cursor > 0 )
+    {
+        memmove( &m_buffer[0], &m_buffer[m_cursor], m_end - m_cursor );
+        m_end -= m_cursor;
+        m_cursor = 0;
+    }
+    if( m_end == m_buffer.size() )
+        m_buffer.resize( m_buffer.size() * 2 );
+
+    size_t readLength = m_source->Read( &m_buffer[m_end], m_buffer.size() - m_end );
+    m_end += readLength;
+    return readLength > 0;
+}
+
+// First character from the cursor on that has to be escaped in a string (a quote,
+// a backslash or a control character); the end if there is none. 16 characters at
+// a time, as in FindQuoteOrBackslash
+static const char* FindEscapedChar( const char* cursor, const char* end )
+{
+#ifdef SIMPLEJSON_SSE2
+    if( JsonHasSSE2 )
+    {
+        const __m128i quotes = _mm_set1_epi8( '"' );
+        const __m128i backslashes = _mm_set1_epi8( '\\' );
+        const __m128i lastControl = _mm_set1_epi8( 0x1F );
+        for(; end - cursor >= 16; cursor += 16)
+        {
+            __m128i chars = _mm_loadu_si128( (const __m128i*)cursor );
+            __m128i isControl = _mm_cmpeq_epi8( _mm_min_epu8( chars, lastControl ), chars );
+            unsigned int mask = _mm_movemask_epi8( _mm_or_si128( isControl,
+                _mm_or_si128( _mm_cmpeq_epi8( chars, quotes ), _mm_cmpeq_epi8( chars, backslashes ) ) ) );
+            if( mask != 0 )
+                return cursor + GetLowestBit( mask );
+        }
+    }
+#endif
+
+    while( cursor < end && *cursor != '"' && *cursor != '\\' && (unsigned char)*cursor >= 0x20 )
+        cursor++;
+    return cursor;
+}
+
+// Writes the given non-negative integer's digits at the given position; returns
+// the position after them
+static char* WriteDigits( Uint64 value, char* position )
+{
+    char digits[20];
+    int digitCount = 0;
+    do
+    {
+        digits[digitCount++] = (char)('0' + value % 10);
+        value /= 10;
+    } while( value != 0 );
+
+    while( digitCount > 0 )
+        *position++ = digits[--digitCount];
+    return position;
+}
+
+// Floating point number of a 64-bit mantissa and a binary exponent, worth
+// m_mantissa * 2^m_exponent, as in Loitsch's "Printing Floating-Point Numbers
+// Quickly and Accurately with Integers"
+struct JsonBinaryFloat
+{
+    Uint64 m_mantissa;
+    int m_exponent;
+};
+
+// Product of the given numbers, rounded to 64 bits of mantissa
+static inline JsonBinaryFloat MultiplyFloats( const JsonBinaryFloat& a, const JsonBinaryFloat& b )
+{
+    Uint64 low = 0;
+    JsonBinaryFloat product;
+    product.m_mantissa = MultiplyFull( a.m_mantissa, b.m_mantissa, &low ) + (low >> 63);
+    product.m_exponent = a.m_exponent + b.m_exponent + 64;
+    return product;
+}
+
+// Given power of ten with a normalized 64-bit mantissa, rounded, from the same table
+// numbers are parsed with: ten to a power is five to it times two to it
+static inline JsonBinaryFloat GetPowerOfTen( int exponent )
+{
+    int index = 2 * (exponent - JsonPowersOfFive_Min);
+    JsonBinaryFloat power;
+    power.m_mantissa = JsonPowersOfFive[index] + (JsonPowersOfFive[index + 1] >> 63);
+    power.m_exponent = (((152170 + 65536) * exponent) >> 16) - 63;
+    return power;
+}
+
+// Moves the last digit down as long as that brings the digits closer to the exact
+// value, and keeps them within the range that reads back as it
+static void RoundDigits( char* digits, int digitCount, Uint64 delta, Uint64 rest, Uint64 tenToKappa, Uint64 distance )
+{
+    while( rest < distance && delta - rest >= tenToKappa &&
+           (rest + tenToKappa < distance || distance - rest > rest + tenToKappa - distance) )
+    {
+        digits[digitCount - 1]--;
+        rest += tenToKappa;
+    }
+}
+
+// Writes digits of a positive, finite double that read back as it, and posts the
+// power of ten they are to be multiplied by; returns the digit count (at most 17).
+// This is Grisu2: the double's neighbors halfway to the next doubles up and down
+// are scaled by a power of ten, so that their integer and fraction parts can be
+// read off in 64-bit integers, and digits are generated until they fall between
+// them. As the scaling is inexact, the range is narrowed a little to be safe, so
+// in a small fraction of cases the digits are longer than need be; posts whether
+// they may be, that is, whether the digits without the last one, or those rounded
+// up, are within that error of the range
+static int GetGrisuDigits( double value, char* digits, int* decimalExponent, bool* mayBeShorter )
+{
+    Uint64 bits = 0;
+    memcpy( &bits, &value, sizeof(bits) );
+    int biasedExponent = (int)(bits >> 52);
+    JsonBinaryFloat number;
+    number.m_mantissa = bits & (((Uint64)1 << 52) - 1);
+    number.m_exponent = -1074;
+    if( biasedExponent != 0 )
+    {
+        number.m_mantissa |= (Uint64)1 << 52;
+        number.m_exponent = biasedExponent - 1075;
+    }
+
+    // Halfway to the neighbors; the one below is closer for powers of two
+    JsonBinaryFloat upper;
+    upper.m_mantissa = (number.m_mantissa << 1) + 1;
+    upper.m_exponent = number.m_exponent - 1;
+    int shift = GetLeadingZeros( upper.m_mantissa );
+    upper.m_mantissa <<= shift;
+    upper.m_exponent -= shift;
+
+    JsonBinaryFloat lower;
+    bool isLowerCloser = (number.m_mantissa == ((Uint64)1 << 52));
+    lower.m_mantissa = isLowerCloser ? (number.m_mantissa << 2) - 1 : (number.m_mantissa << 1) - 1;
+    lower.m_exponent = number.m_exponent - (isLowerCloser ? 2 : 1);
+    lower.m_mantissa <<= lower.m_exponent - upper.m_exponent;
+    lower.m_exponent = upper.m_exponent;
+
+    shift = GetLeadingZeros( number.m_mantissa );
+    number.m_mantissa <<= shift;
+    number.m_exponent -= shift;
+
+    // Power of ten that brings the upper neighbor's binary exponent into -59 to -55,
+    // so the integer part has a few bits, and the fraction times ten fits in 64 bits
+    int powerExponent = (((-59 - upper.m_exponent) * 78913) + (1 << 18) - 1) >> 18;
+    JsonBinaryFloat power = GetPowerOfTen( powerExponent );
+    while( upper.m_exponent + power.m_exponent + 64 > -55 )
+        power = GetPowerOfTen( --powerExponent );
+    while( upper.m_exponent + power.m_exponent + 64 < -59 )
+        power = GetPowerOfTen( ++powerExponent );
+
+    JsonBinaryFloat scaled = MultiplyFloats( number, power );
+    JsonBinaryFloat scaledUpper = MultiplyFloats( upper, power );
+    JsonBinaryFloat scaledLower = MultiplyFloats( lower, power );
+    scaledUpper.m_mantissa--;
+    scaledLower.m_mantissa++;
+    *decimalExponent = -powerExponent;
+
+    // Integer part a digit at a time, then the fraction, until the rest of the upper
+    // neighbor is within the range
+    // Each scaled neighbor is within 2 of the exact one
+    Uint64 delta = scaledUpper.m_mantissa - scaledLower.m_mantissa;
+    Uint64 distance = scaledUpper.m_mantissa - scaled.m_mantissa;
+    Uint64 error = 2;
+    int fractionBits = -scaledUpper.m_exponent;
+    Uint64 one = (Uint64)1 << fractionBits;
+    Uint32 integerPart = (Uint32)(scaledUpper.m_mantissa >> fractionBits);
+    Uint64 fractionPart = scaledUpper.m_mantissa & (one - 1);
+
+    static const Uint32 smallPowersOfTen[] = { 1, 10, 100 };
+    int kappa = (integerPart >= 100) ? 3 : (integerPart >= 10) ? 2 : (integerPart >= 1) ? 1 : 0;
+    int digitCount = 0;
+    while( kappa > 0 )
+    {
+        Uint32 digit = integerPart / smallPowersOfTen[kappa - 1];
+        integerPart %= smallPowersOfTen[kappa - 1];
+        if( digit != 0 || digitCount != 0 )
+            digits[digitCount++] = (char)('0' + digit);
+        kappa--;
+
+        Uint64 rest = ((Uint64)integerPart << fractionBits) + fractionPart;
+        if( rest <= delta )
+        {
+            Uint64 unit = (Uint64)smallPowersOfTen[kappa] << fractionBits;
+            Uint64 previousRest = rest + digit * unit;
+            *mayBeShorter = digitCount > 1 && (previousRest <= delta + error || previousRest + error >= 10 * unit);
+            *decimalExponent += kappa;
+            RoundDigits( digits, digitCount, delta, rest, unit, distance );
+            return digitCount;
+        }
+    }
+
+    // Past the point, everything is scaled up ten times a digit; the distance and
+    // error only matter at the end
+    Uint64 scale = 1;
+    for(;;)
+    {
+        fractionPart *= 10;
+        delta *= 10;
+        scale *= 10;
+        Uint64 previousRest = fractionPart;
+        int digit = (int)(fractionPart >> fractionBits);
+        if( digit != 0 || digitCount != 0 )
+            digits[digitCount++] = (char)('0' + digit);
+        fractionPart &= one - 1;
+        kappa--;
+
+        if( fractionPart < delta )
+        {
+            *mayBeShorter = digitCount > 1 && (previousRest <= delta + error * scale || previousRest + error * scale >= 10 * one);
+            *decimalExponent += kappa;
+            RoundDigits( digits, digitCount, delta, fractionPart, one, distance * scale );
+            return digitCount;
+        }
+    }
+}
+
+// As above, but the shortest digits that read back as the double: when they may
+// be shorter, shorter ones, the digits divided by ten rounded either way, are tried
+// as long as ComputeDouble reads one of them back as it
+static int GetShortestDigits( double value, char* digits, int* decimalExponent )
+{
+    bool mayBeShorter = false;
+    int digitCount = GetGrisuDigits( value, digits, decimalExponent, &mayBeShorter );
+    if( !mayBeShorter )
+        return digitCount;
+
+    Uint64 mantissa = 0;
+    for(int i = 0; i < digitCount; i++)
+        mantissa = mantissa * 10 + (digits[i] - '0');
+
+    Uint64 bits = 0;
+    memcpy( &bits, &value, sizeof(bits) );
+    while( mantissa >= 10 )
+    {
+        // The closer of the two first
+        bool isUpperCloser = (mantissa % 10 > 5);
+        Uint64 closer = mantissa / 10 + (isUpperCloser ? 1 : 0);
+        Uint64 further = isUpperCloser ? closer - 1 : closer + 1;
+        if( ComputeDouble( closer, *decimalExponent + 1 ) == bits )
+            mantissa = closer;
+        else if( ComputeDouble( further, *decimalExponent + 1 ) == bits )
+            mantissa = further;
+        else
+            break;
+        (*decimalExponent)++;
+    }
+    while( mantissa % 10 == 0 )
+    {
+        mantissa /= 10;
+        (*decimalExponent)++;
+    }
+
+    return (int)(WriteDigits( mantissa, digits ) - digits);
+}
+
+// Writes the given finite double at the given position, in its shortest digits,
+// as JavaScript would write it (plain up to 21 digits before the point, and down
+// to 6 zeros after it; in exponent notation past that), but with ".0" on whole
+// numbers; returns the position after it. Needs room for 25 characters
+static char* WriteDouble( double value, char* position )
+{
+    if( value < 0.0 || (value == 0.0 && 1.0 / value < 0.0) )
+    {
+        *position++ = '-';
+        value = -value;
+    }
+    if( value == 0.0 )
+    {
+        memcpy( position, "0.0", 3 );
+        return position + 3;
+    }
+
+    // The digits are written in place, then moved around them
+    int decimalExponent = 0;
+    int digitCount = GetShortestDigits( value, position, &decimalExponent );
+    int pointPosition = digitCount + decimalExponent;
+
+    if( decimalExponent >= 0 && pointPosition <= 21 )
+    {
+        // 1234e7 -> 12340000000.0
+        memset( position + digitCount, '0', pointPosition - digitCount );
+        memcpy( position + pointPosition, ".0", 2 );
+        return position + pointPosition + 2;
+    }
+    else if( pointPosition > 0 && pointPosition <= 21 )
+    {
+        // 1234e-2 -> 12.34
+        memmove( position + pointPosition + 1, position + pointPosition, digitCount - pointPosition );
+        position[pointPosition] = '.';
+        return position + digitCount + 1;
+    }
+    else if( pointPosition > -6 && pointPosition <= 0 )
+    {
+        // 1234e-6 -> 0.001234
+        int offset = 2 - pointPosition;
+        memmove( position + offset, position, digitCount );
+        position[0] = '0';
+        position[1] = '.';
+        memset( position + 2, '0', offset - 2 );
+        return position + digitCount + offset;
+    }
+
+    // 1234e30 -> 1.234e33, 1e30
+    if( digitCount > 1 )
+    {
+        memmove( position + 2, position + 1, digitCount - 1 );
+        position[1] = '.';
+        position += digitCount + 1;
+    }
+    else
+    {
+        position++;
+    }
+    *position++ = 'e';
+    int exponent = pointPosition - 1;
+    if( exponent < 0 )
+    {
+        *position++ = '-';
+        exponent = -exponent;
+    }
+    return WriteDigits( (Uint64)exponent, position );
+}
+
+/*** Public ***/
+
+JsonValue::JsonValue()
+{
+    m_type = JsonType_Null;
+    memset( &m_data, 0, sizeof(m_data) );
+    m_isInteger = false;
+    m_integer = 0;
+}
+
+JsonValue::JsonValue( const bool givenBool )
+{
+    m_type = JsonType_Bool;
     m_data.m_boolean = givenBool;
+    m_isInteger = false;
+    m_integer = 0;
 }
 
 JsonValue::JsonValue( JsonArray* /*gifted*/ givenArray )
 {
     m_type = JsonType_Array;
     m_data.m_array = givenArray;
+    m_isInteger = false;
+    m_integer = 0;
 }
 
 JsonValue::JsonValue( JsonObject* /*gifted*/ givenObject )
 {
     m_type = JsonType_Object;
     m_data.m_object = givenObject;
+    m_isInteger = false;
+    m_integer = 0;
 }
 
 JsonValue::JsonValue( const float givenFloat )
 {
     m_type = JsonType_Number;
     m_data.m_number = givenFloat;
+    m_isInteger = false;
+    m_integer = 0;
+}
+
+JsonValue::JsonValue( const double givenDouble )
+{
+    m_type = JsonType_Number;
+    m_data.m_number = givenDouble;
+    m_isInteger = false;
+    m_integer = 0;
+}
+
+JsonValue::JsonValue( const long long givenInteger )
+{
+    m_type = JsonType_Number;
+    m_data.m_number = (double)givenInteger;
+    m_isInteger = true;
+    m_integer = givenInteger;
 }
 
 JsonValue::JsonValue( const std::string& givenString )
 {
     m_type = JsonType_String;
     m_data.m_string = new std::string(givenString);
+    m_isInteger = false;
+    m_integer = 0;
 }
 
 JsonValue::~JsonValue()
@@ -456,29 +1677,698 @@ JsonValue::~JsonValue()
     }
 }
 
-bool ParseSimpleJSON( FILE* fileHandle, JsonValue* rootValue )
+bool SimpleJSON::ParseSimpleJSON( const char* data, size_t length, JsonValue* rootValue )
 {
+    JsonReader reader = { data, data + length, 0 };
+
     // All valid JSON files start as anonymous root-objects or root-arrays
-    char* firstToken = GetToken( fileHandle );
-    if(firstToken == NULL)
+    SkipWhitespace( &reader );
+    if( reader.m_cursor >= reader.m_end )
         return false;
 
-    bool isObject = (firstToken[0] == '{');
-    bool isArray = (firstToken[0] == '[');
+    bool isObject = (*reader.m_cursor == '{');
+    bool isArray = (*reader.m_cursor == '[');
     bool isValid = false;
 
-    UngetToken( fileHandle, &firstToken );
-
     if( isObject )
     {
         rootValue->m_type = JsonType_Object;
-        isValid = ParseObject(fileHandle, &(rootValue->m_data.m_object));
+        isValid = ParseObject(&reader, &(rootValue->m_data.m_object));
     }
     else if( isArray )
     {
         rootValue->m_type = JsonType_Array;
-        isValid = ParseArray(fileHandle, &(rootValue->m_data.m_array));
+        isValid = ParseArray(&reader, &(rootValue->m_data.m_array));
     }
 
-    return isValid;
+    // Nothing may follow the root
+    SkipWhitespace( &reader );
+    return isValid && reader.m_cursor == reader.m_end;
+}
+
+bool SimpleJSON::ParseSimpleJSON( FILE* fileHandle, JsonValue* rootValue )
+{
+    std::vector< char > fileData;
+    size_t dataLength = 0;
+    if( !ReadFileData( fileHandle, &fileData, &dataLength ) )
+        return false;
+
+    return ParseSimpleJSON( &fileData[0], dataLength, rootValue );
+}
+
+bool JsonStringView::Equals( const char* givenString ) const
+{
+    return strlen( givenString ) == m_length && memcmp( givenString, m_data, m_length ) == 0;
+}
+
+bool JsonRef::GetBool( bool defaultValue ) const
+{
+    return (GetType() == JsonType_Bool) ? m_node->m_data.m_boolean : defaultValue;
+}
+
+double JsonRef::GetNumber( double defaultValue ) const
+{
+    if( GetType() != JsonType_Number )
+        return defaultValue;
+    return (m_node->m_length != 0) ? (double)m_node->m_data.m_integer : m_node->m_data.m_number;
+}
+
+long long JsonRef::GetInteger( long long defaultValue ) const
+{
+    return IsInteger() ? m_node->m_data.m_integer : defaultValue;
+}
+
+JsonStringView JsonRef::GetString() const
+{
+    JsonStringView stringView = { "", 0 };
+    if( GetType() == JsonType_String )
+    {
+        stringView.m_data = &m_document->m_chars[ m_node->m_data.m_offset ];
+        stringView.m_length = m_node->m_length;
+    }
+    return stringView;
+}
+
+int JsonRef::GetCount() const
+{
+    JsonType type = GetType();
+    return (type == JsonType_Array || type == JsonType_Object) ? (int)m_node->m_length : 0;
+}
+
+JsonRef JsonRef::GetElement( int index ) const
+{
+    if( GetType() != JsonType_Array || index < 0 || index >= (int)m_node->m_length )
+        return JsonRef();
+    return JsonRef( m_document, &m_document->m_nodes[ m_node->m_data.m_offset + index ] );
+}
+
+JsonStringView JsonRef::GetMemberKey( int index ) const
+{
+    if( GetType() != JsonType_Object || index < 0 || index >= (int)m_node->m_length )
+    {
+        JsonStringView stringView = { "", 0 };
+        return stringView;
+    }
+    return JsonRef( m_document, &m_document->m_nodes[ m_node->m_data.m_offset + 2 * index ] ).GetString();
+}
+
+JsonRef JsonRef::GetMemberValue( int index ) const
+{
+    if( GetType() != JsonType_Object || index < 0 || index >= (int)m_node->m_length )
+        return JsonRef();
+    return JsonRef( m_document, &m_document->m_nodes[ m_node->m_data.m_offset + 2 * index + 1 ] );
+}
+
+JsonRef JsonRef::GetMember( const char* key ) const
+{
+    return GetMember( key, strlen( key ) );
+}
+
+JsonRef JsonRef::GetMember( const char* key, size_t keyLength ) const
+{
+    if( GetType() != JsonType_Object || m_node->m_length == 0 )
+        return JsonRef();
+
+    // Binary search over the sorted keys
+    const JsonNode* members = &m_document->m_nodes[ m_node->m_data.m_offset ];
+    const char* chars = &m_document->m_chars[0];
+    int low = 0;
+    int high = (int)m_node->m_length - 1;
+    while( low <= high )
+    {
+        int middle = (low + high) / 2;
+        const JsonNode& memberKey = members[ 2 * middle ];
+        size_t commonLength = (memberKey.m_length < keyLength) ? memberKey.m_length : keyLength;
+        int order = memcmp( chars + memberKey.m_data.m_offset, key, commonLength );
+        if( order == 0 )
+            order = (memberKey.m_length < keyLength) ? -1 : ((memberKey.m_length > keyLength) ? 1 : 0);
+
+        if( order == 0 )
+            return JsonRef( m_document, &members[ 2 * middle + 1 ] );
+        else if( order < 0 )
+            low = middle + 1;
+        else
+            high = middle - 1;
+    }
+    return JsonRef();
+}
+
+JsonDocument::JsonDocument()
+    : m_rootIndex( -1 )
+{
+    m_parseId = GetNextParseId();
+}
+
+bool JsonDocument::Parse( const char* data, size_t length )
+{
+    Clear();
+    JsonBuilder builder;
+    builder.m_reader.m_cursor = data;
+    builder.m_reader.m_end = data + length;
+    builder.m_reader.m_depth = 0;
+    builder.m_nodes = &m_nodes;
+    builder.m_chars = &m_chars;
+
+    // All valid JSON files start as anonymous root-objects or root-arrays
+    JsonReader* reader = &builder.m_reader;
+    SkipWhitespace( reader );
+    bool isValid = reader->m_cursor < reader->m_end && (*reader->m_cursor == '{' || *reader->m_cursor == '[') && BuildValue( &builder );
+
+    // Nothing may follow the root
+    SkipWhitespace( reader );
+    if( !isValid || reader->m_cursor != reader->m_end )
+    {
+        Clear();
+        return false;
+    }
+
+    m_nodes.push_back( builder.m_pending.back() );
+    m_rootIndex = (int)m_nodes.size() - 1;
+    return true;
+}
+
+bool JsonDocument::Parse( FILE* fileHandle )
+{
+    std::vector< char > fileData;
+    size_t dataLength = 0;
+    if( !ReadFileData( fileHandle, &fileData, &dataLength ) )
+    {
+        Clear();
+        return false;
+    }
+
+    return Parse( &fileData[0], dataLength );
+}
+
+void JsonDocument::Clear()
+{
+    m_nodes.clear();
+    m_chars.clear();
+    m_rootIndex = -1;
+    m_parseId = GetNextParseId();
+}
+
+JsonRef JsonDocument::GetRoot() const
+{
+    if( m_rootIndex < 0 )
+        return JsonRef();
+    return JsonRef( this, &m_nodes[m_rootIndex] );
+}
+
+size_t JsonDocument::GetMemoryFootprint() const
+{
+    return m_nodes.capacity() * sizeof(JsonNode) + m_chars.capacity();
+}
+
+JsonPath::JsonPath()
+{
+    m_isValid = false;
+    memset( m_cache, 0, sizeof(m_cache) );
+}
+
+JsonPath::JsonPath( const char* pointer )
+{
+    memset( m_cache, 0, sizeof(m_cache) );
+    Compile( pointer );
+}
+
+bool JsonPath::Compile( const char* pointer )
+{
+    m_steps.clear();
+    memset( m_cache, 0, sizeof(m_cache) );
+    m_isValid = (*pointer == '\0' || *pointer == '/');
+
+    while( m_isValid && *pointer == '/' )
+    {
+        // Key up to the next step, unescaped
+        Step step;
+        for(pointer++; *pointer != '\0' && *pointer != '/'; pointer++)
+        {
+            if( *pointer != '~' )
+                step.m_key += *pointer;
+            else if( pointer[1] == '0' || pointer[1] == '1' )
+                step.m_key += (*++pointer == '0') ? '~' : '/';
+            else
+                m_isValid = false;
+        }
+
+        // Array indices are digits, without leading zeros
+        bool isIndex = !step.m_key.empty() && step.m_key.length() <= 9 && (step.m_key[0] != '0' || step.m_key.length() == 1);
+        for(size_t i = 0; i < step.m_key.length() && isIndex; i++)
+            isIndex = (step.m_key[i] >= '0' && step.m_key[i] <= '9');
+        step.m_index = isIndex ? atoi( step.m_key.c_str() ) : -1;
+
+        m_steps.push_back( step );
+    }
+
+    if( !m_isValid )
+        m_steps.clear();
+    return m_isValid;
+}
+
+JsonRef JsonPath::Resolve( const JsonDocument& document ) const
+{
+    if( !m_isValid )
+        return JsonRef();
+
+    // Same document, not parsed since
+    CacheEntry& entry = m_cache[ document.m_parseId % CacheSize ];
+    if( entry.m_parseId == document.m_parseId )
+        return (entry.m_nodeIndex >= 0) ? JsonRef( &document, &document.m_nodes[entry.m_nodeIndex] ) : JsonRef();
+
+    JsonRef value = document.GetRoot();
+    for(size_t i = 0; i < m_steps.size() && value.IsValid(); i++)
+    {
+        const Step& step = m_steps[i];
+        if( value.GetType() == JsonType_Object )
+            value = value.GetMember( step.m_key.c_str(), step.m_key.length() );
+        else if( value.GetType() == JsonType_Array && step.m_index >= 0 )
+            value = value.GetElement( step.m_index );
+        else
+            value = JsonRef();
+    }
+
+    entry.m_parseId = document.m_parseId;
+    entry.m_nodeIndex = value.IsValid() ? (int)(value.m_node - &document.m_nodes[0]) : -1;
+    return value;
+}
+
+const JsonValue* JsonPath::Resolve( const JsonValue* rootValue ) const
+{
+    const JsonValue* value = m_isValid ? rootValue : NULL;
+    for(size_t i = 0; i < m_steps.size() && value != NULL; i++)
+    {
+        const Step& step = m_steps[i];
+        if( value->m_type == JsonType_Object )
+        {
+            JsonObject::const_iterator member = value->m_data.m_object->find( step.m_key );
+            value = (member != value->m_data.m_object->end()) ? member->second : NULL;
+        }
+        else if( value->m_type == JsonType_Array && step.m_index >= 0 && step.m_index < (int)value->m_data.m_array->size() )
+        {
+            value = (*value->m_data.m_array)[ step.m_index ];
+        }
+        else
+        {
+            value = NULL;
+        }
+    }
+    return value;
+}
+
+bool SimpleJSON::StreamSimpleJSON( JsonSource* source, JsonHandler* handler )
+{
+    JsonStreamReader reader( source );
+    std::string stringValue;
+    std::vector< char > containers;    // '{' or '[' per open container
+
+    // All valid JSON files start as anonymous root-objects or root-arrays
+    reader.SkipWhitespace();
+    if( reader.Peek() != '{' && reader.Peek() != '[' )
+        return false;
+
+    // Each step reads a value, then what follows it in its container, until the root closes
+    bool isKeyNext = false;
+    for(;;)
+    {
+        JsonReader tokenReader;
+        reader.SkipWhitespace();
+
+        // Key (and colon) of the next member
+        if( isKeyNext )
+        {
+            stringValue.clear();
+            if( reader.Peek() != '"' || !reader.LoadToken( &tokenReader ) || !ParseString( &tokenReader, &stringValue ) )
+                return false;
+            reader.Consume( tokenReader );
+            if( !handler->OnKey( stringValue.c_str(), stringValue.length() ) )
+                return false;
+
+            reader.SkipWhitespace();
+            if( reader.Peek() != ':' )
+                return false;
+            reader.Advance();
+            reader.SkipWhitespace();
+            isKeyNext = false;
+        }
+
+        // Value; containers open here, and only an empty one closes right away
+        int nextChar = reader.Peek();
+        bool isValueDone = true;
+        if( nextChar == '{' || nextChar == '[' )
+        {
+            reader.Advance();
+            if( !((nextChar == '{') ? handler->OnObjectStart() : handler->OnArrayStart()) )
+                return false;
+            containers.push_back( (char)nextChar );
+
+            reader.SkipWhitespace();
+            if( reader.Peek() == ((nextChar == '{') ? '}' : ']') )
+            {
+                reader.Advance();
+                containers.pop_back();
+                if( !((nextChar == '{') ? handler->OnObjectEnd() : handler->OnArrayEnd()) )
+                    return false;
+            }
+            else
+            {
+                isKeyNext = (nextChar == '{');
+                isValueDone = false;
+            }
+        }
+        else
+        {
+            if( !reader.LoadToken( &tokenReader ) )
+                return false;
+
+            bool isValid = true;
+            JsonNumber number;
+            if( nextChar == '"' )
+            {
+                stringValue.clear();
+                isValid = ParseString( &tokenReader, &stringValue ) && handler->OnString( stringValue.c_str(), stringValue.length() );
+            }
+            else if( nextChar == 't' || nextChar == 'f' )
+            {
+                isValid = ParseLiteral( &tokenReader, (nextChar == 't') ? "true" : "false" ) && handler->OnBool( nextChar == 't' );
+            }
+            else if( nextChar == 'n' )
+            {
+                isValid = ParseLiteral( &tokenReader, "null" ) && handler->OnNull();
+            }
+            else
+            {
+                isValid = ParseNumber( &tokenReader, &number ) &&
+                    (number.m_isInteger ? handler->OnInteger( number.m_integer ) : handler->OnNumber( number.m_value ));
+            }
+
+            if( !isValid )
+                return false;
+            reader.Consume( tokenReader );
+        }
+
+        // After a value: a comma and the next one, or the end of its container (and
+        // then the same for the container itself)
+        while( isValueDone && !containers.empty() )
+        {
+            reader.SkipWhitespace();
+            char container = containers.back();
+            int separator = reader.Peek();
+            if( separator < 0 )
+                return false;
+
+            reader.Advance();
+            if( separator == ',' )
+            {
+                isKeyNext = (container == '{');
+                break;
+            }
+            else if( separator != ((container == '{') ? '}' : ']') )
+            {
+                return false;
+            }
+
+            containers.pop_back();
+            if( !((container == '{') ? handler->OnObjectEnd() : handler->OnArrayEnd()) )
+                return false;
+        }
+
+        if( containers.empty() )
+            break;
+    }
+
+    // Nothing may follow the root
+    reader.SkipWhitespace();
+    return reader.Peek() < 0;
+}
+
+bool SimpleJSON::StreamSimpleJSON( FILE* fileHandle, JsonHandler* handler )
+{
+    JsonFileSource source( fileHandle );
+    return StreamSimpleJSON( &source, handler );
+}
+
+bool SimpleJSON::StreamSimpleJSON( SDL_RWops* rwops, JsonHandler* handler )
+{
+    JsonRWopsSource source( rwops );
+    return StreamSimpleJSON( &source, handler );
+}
+
+JsonWriter::JsonWriter()
+{
+    m_length = 0;
+    m_hasRootValue = false;
+    m_isAfterKey = false;
+}
+
+void JsonWriter::Grow( size_t length )
+{
+    m_buffer.resize( std::max( m_buffer.size() * 2, std::max( m_length + length, (size_t)4096 ) ) );
+}
+
+void JsonWriter::StartValue()
+{
+    if( m_isAfterKey )
+    {
+        m_isAfterKey = false;
+    }
+    else if( !m_levels.empty() )
+    {
+        if( m_levels.back() != 0 )
+            WriteChar( ',' );
+        m_levels.back() = 1;
+    }
+    else
+    {
+        if( m_hasRootValue )
+            WriteChar( '\n' );
+        m_hasRootValue = true;
+    }
+}
+
+void JsonWriter::StartObject()
+{
+    StartValue();
+    WriteChar( '{' );
+    m_levels.push_back( 0 );
+}
+
+void JsonWriter::EndObject()
+{
+    WriteChar( '}' );
+    m_levels.pop_back();
+}
+
+void JsonWriter::StartArray()
+{
+    StartValue();
+    WriteChar( '[' );
+    m_levels.push_back( 0 );
+}
+
+void JsonWriter::EndArray()
+{
+    WriteChar( ']' );
+    m_levels.pop_back();
+}
+
+void JsonWriter::Key( const char* key, size_t keyLength )
+{
+    String( key, keyLength );
+    WriteChar( ':' );
+    m_isAfterKey = true;
+}
+
+void JsonWriter::Key( const char* key )
+{
+    Key( key, strlen( key ) );
+}
+
+void JsonWriter::Null()
+{
+    StartValue();
+    memcpy( Reserve( 4 ), "null", 4 );
+    m_length += 4;
+}
+
+void JsonWriter::Bool( bool value )
+{
+    StartValue();
+    memcpy( Reserve( 5 ), value ? "true" : "false", value ? 4 : 5 );
+    m_length += value ? 4 : 5;
+}
+
+void JsonWriter::Number( double value )
+{
+    if( value - value != 0.0 )
+    {
+        Null();
+        return;
+    }
+
+    StartValue();
+    char* position = Reserve( 25 );
+    m_length += WriteDouble( value, position ) - position;
+}
+
+void JsonWriter::Integer( long long value )
+{
+    StartValue();
+    char* position = Reserve( 20 );
+    char* start = position;
+    if( value < 0 )
+        *position++ = '-';
+    m_length += WriteDigits( (value < 0) ? ~(Uint64)value + 1 : (Uint64)value, position ) - start;
+}
+
+void JsonWriter::String( const char* value, size_t length )
+{
+    static const char hexDigits[] = "0123456789ABCDEF";
+
+    // Runs of characters that need no escaping are copied whole
+    StartValue();
+    const char* end = value + length;
+    char* position = Reserve( length + 2 );
+    *position++ = '"';
+    for(;;)
+    {
+        const char* runEnd = FindEscapedChar( value, end );
+        memcpy( position, value, runEnd - value );
+        position += runEnd - value;
+        m_length = position - &m_buffer[0];
+        value = runEnd;
+        if( value == end )
+            break;
+
+        // Room for the longest escape, and for the rest as is
+        position = Reserve( 6 + (end - value) + 1 );
+        *position++ = '\\';
+        switch( *value )
+        {
+        case '"':   *position++ = '"'; break;
+        case '\\':  *position++ = '\\'; break;
+        case '\b':  *position++ = 'b'; break;
+        case '\f':  *position++ = 'f'; break;
+        case '\n':  *position++ = 'n'; break;
+        case '\r':  *position++ = 'r'; break;
+        case '\t':  *position++ = 't'; break;
+        default:
+            memcpy( position, "u00", 3 );
+            position[3] = hexDigits[(unsigned char)*value >> 4];
+            position[4] = hexDigits[*value & 0xF];
+            position += 5;
+            break;
+        }
+        value++;
+    }
+    *position++ = '"';
+    m_length++;
+}
+
+void JsonWriter::String( const char* value )
+{
+    String( value, strlen( value ) );
+}
+
+void JsonWriter::Value( const JsonValue* value )
+{
+    switch( value->m_type )
+    {
+    case JsonType_Null:
+        Null();
+        break;
+    case JsonType_Bool:
+        Bool( value->m_data.m_boolean );
+        break;
+    case JsonType_Number:
+        if( value->m_isInteger )
+            Integer( value->m_integer );
+        else
+            Number( value->m_data.m_number );
+        break;
+    case JsonType_String:
+        String( value->m_data.m_string->c_str(), value->m_data.m_string->length() );
+        break;
+    case JsonType_Array:
+        StartArray();
+        for(size_t i = 0; i < value->m_data.m_array->size(); i++)
+            Value( (*value->m_data.m_array)[i] );
+        EndArray();
+        break;
+    case JsonType_Object:
+        StartObject();
+        for(JsonObject::const_iterator member = value->m_data.m_object->begin(); member != value->m_data.m_object->end(); ++member)
+        {
+            Key( member->first.c_str(), member->first.length() );
+            Value( member->second );
+        }
+        EndObject();
+        break;
+    }
+}
+
+void JsonWriter::Value( JsonRef value )
+{
+    switch( value.GetType() )
+    {
+    case JsonType_Null:
+        Null();
+        break;
+    case JsonType_Bool:
+        Bool( value.GetBool() );
+        break;
+    case JsonType_Number:
+        if( value.IsInteger() )
+            Integer( value.GetInteger() );
+        else
+            Number( value.GetNumber() );
+        break;
+    case JsonType_String:
+    {
+        JsonStringView stringView = value.GetString();
+        String( stringView.m_data, stringView.m_length );
+        break;
+    }
+    case JsonType_Array:
+        StartArray();
+        for(int i = 0; i < value.GetCount(); i++)
+            Value( value.GetElement( i ) );
+        EndArray();
+        break;
+    case JsonType_Object:
+        StartObject();
+        for(int i = 0; i < value.GetCount(); i++)
+        {
+            JsonStringView key = value.GetMemberKey( i );
+            Key( key.m_data, key.m_length );
+            Value( value.GetMemberValue( i ) );
+        }
+        EndObject();
+        break;
+    }
+}
+
+void JsonWriter::Clear()
+{
+    m_length = 0;
+    m_levels.clear();
+    m_hasRootValue = false;
+    m_isAfterKey = false;
+}
+
+bool JsonWriter::WriteToFile( FILE* fileHandle ) const
+{
+    return fwrite( GetData(), 1, m_length, fileHandle ) == m_length;
+}
+
+bool JsonWriter::WriteToFile( SDL_RWops* rwops ) const
+{
+    return SDL_RWwrite( rwops, GetData(), 1, m_length ) == m_length;
+}
+
+bool SimpleJSON::WriteSimpleJSON( FILE* fileHandle, const JsonValue* rootValue )
+{
+    JsonWriter writer;
+    writer.Value( rootValue );
+    return writer.WriteToFile( fileHandle );
 }
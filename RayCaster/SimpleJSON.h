@@ -11,6 +11,12 @@
  implementation focuses on supporting arbitrary-large data, which
  means new / delete is heavily used. Also note that many of the
  containers are standard C++ STL classes.
+ 
+ Three ways to parse: into a tree of JsonValue, into a flat
+ JsonDocument, or streamed as events to a JsonHandler, which never
+ holds more than a small buffer of the input. JsonWriter writes
+ trees and documents back out, or values given one at a time, and
+ JsonPath looks values up in either by JSON Pointer.
 
 ***************************************************************/
 
@@ -18,10 +24,14 @@
 #define __SIMPLEJSON_H__
 
 // Forward declaration
+#include <stdio.h>
 #include <map>
 #include <vector>
 #include <string>
 
+// SDL's file abstraction, for streaming from it
+struct SDL_RWops;
+
 // The entire code-base resides here
 namespace SimpleJSON
 {
@@ -52,10 +62,15 @@ struct JsonValue
         bool m_boolean;
         JsonArray* m_array;
         JsonObject* m_object;
-        float m_number;
+        double m_number;
         std::string* m_string;
     } m_data;
 
+    // Numbers written as whole numbers that fit in 64 bits (but -0, which only a
+    // double holds) also keep their exact value here; m_number is the nearest double to it
+    bool m_isInteger;
+    long long m_integer;
+
     // Initialize data to NULL
     JsonValue();
 
@@ -65,15 +80,304 @@ struct JsonValue
     JsonValue( JsonArray* givenArray );
     JsonValue( JsonObject* givenObject );
     JsonValue( const float givenFloat );
+    JsonValue( const double givenDouble );
+    JsonValue( const long long givenInteger );
     JsonValue( const std::string& givenString );
 
     // Clean release (recursive)
     ~JsonValue();
 };
 
-// Given a file handle, parse and return an STL map
+// Given the whole JSON text in memory (a file read in or mapped; it needs no
+// terminating zero), parse it in a single pass onto the given root value. Objects
+// and arrays nested more than 512 deep fail the parse
+bool ParseSimpleJSON( const char* data, size_t length, JsonValue* rootValue );
+
+// Given a file handle, read in the rest of the file, then parse it as above
 bool ParseSimpleJSON( FILE* fileHandle, JsonValue* rootValue );
 
+/*** Flat documents ***/
+
+// Value of a JsonDocument. The elements of an array, and the members of an
+// object (each a key string node followed by its value node, sorted by key),
+// are contiguous in the document's node arena
+struct JsonNode
+{
+    JsonType m_type;
+    unsigned int m_length;              // Array: element count; object: member count; string: byte count; number: 1 if m_integer
+    union {
+        bool m_boolean;
+        double m_number;
+        long long m_integer;            // Whole numbers that fit in 64 bits
+        unsigned int m_offset;          // Array / object: first node; string: first character
+    } m_data;
+};
+
+// String of a JsonDocument; points into the document's char arena, so it is only
+// valid as long as the document is, and is always zero-terminated
+struct JsonStringView
+{
+    const char* m_data;
+    size_t m_length;
+
+    // True if equal to the given string
+    bool Equals( const char* givenString ) const;
+    std::string ToString() const { return std::string( m_data, m_length ); }
+};
+
+class JsonDocument;
+
+// Handle on a node of a JsonDocument; invalid handles (from missing members, out of
+// range elements, etc.) read as null, so that look-ups can be chained without checks
+class JsonRef
+{
+public:
+
+    JsonRef() : m_document( NULL ), m_node( NULL ) { }
+    JsonRef( const JsonDocument* document, const JsonNode* node ) : m_document( document ), m_node( node ) { }
+
+    // Type & data; the given default is returned for values of other types
+    bool IsValid() const { return m_node != NULL; }
+    JsonType GetType() const { return (m_node != NULL) ? m_node->m_type : JsonType_Null; }
+    bool GetBool( bool defaultValue = false ) const;
+    double GetNumber( double defaultValue = 0.0 ) const;
+    JsonStringView GetString() const;
+
+    // Numbers written as whole numbers that fit in 64 bits (but -0), and their exact value
+    bool IsInteger() const { return GetType() == JsonType_Number && m_node->m_length != 0; }
+    long long GetInteger( long long defaultValue = 0 ) const;
+
+    // Arrays: element count and elements; objects: member count, and members
+    // by index (in key order) or by key, through a binary search
+    int GetCount() const;
+    JsonRef GetElement( int index ) const;
+    JsonStringView GetMemberKey( int index ) const;
+    JsonRef GetMemberValue( int index ) const;
+    JsonRef GetMember( const char* key ) const;
+    JsonRef GetMember( const char* key, size_t keyLength ) const;
+
+private:
+
+    friend class JsonPath;
+
+    const JsonDocument* m_document;
+    const JsonNode* m_node;
+
+};
+
+// A whole JSON document in two flat arenas, one of nodes and one of string
+// characters. Parsing allocates only as the arenas grow, and freeing the
+// document is just freeing the two, however many values it holds
+class JsonDocument
+{
+public:
+
+    JsonDocument();
+
+    // Parses the given JSON text, or the rest of the given file, replacing
+    // anything parsed before (the arenas are reused); returns false on error,
+    // leaving the document empty. Nesting is limited as for ParseSimpleJSON
+    bool Parse( const char* data, size_t length );
+    bool Parse( FILE* fileHandle );
+
+    // Empties the document; the arenas keep their memory
+    void Clear();
+
+    // Root object or array; invalid if nothing was parsed
+    JsonRef GetRoot() const;
+
+    // Bytes held by the arenas
+    size_t GetMemoryFootprint() const;
+
+private:
+
+    friend class JsonRef;
+    friend class JsonPath;
+
+    std::vector< JsonNode > m_nodes;
+    std::vector< char > m_chars;
+    int m_rootIndex;
+
+    // New for every parse or clear of any document, so that cached look-ups know
+    // when they are out of date
+    unsigned int m_parseId;
+
+};
+
+/*** Paths ***/
+
+// JSON Pointer path (RFC 6901), such as "/tiles/12/texture", split into its steps
+// once, so that following it needs no strings built or parsed: each step is an
+// object key, or an array index. Look-ups in documents are also cached, for a few
+// documents at a time, until they are parsed again; repeated look-ups in the same
+// documents (per-frame tuning values, per-entity configuration) are then a compare
+// and an index. The cache makes paths unsafe to share between threads
+class JsonPath
+{
+public:
+
+    JsonPath();
+    explicit JsonPath( const char* pointer );
+
+    // Splits the given pointer into steps; returns false if it is malformed. The
+    // empty pointer is the root; otherwise each step starts with a '/', and "~0" and
+    // "~1" in it stand for '~' and '/'
+    bool Compile( const char* pointer );
+    bool IsValid() const { return m_isValid; }
+
+    // Value at the path; invalid / NULL if there is none
+    JsonRef Resolve( const JsonDocument& document ) const;
+    const JsonValue* Resolve( const JsonValue* rootValue ) const;
+
+private:
+
+    struct Step
+    {
+        std::string m_key;
+        int m_index;                    // Array index, or -1 if the key is not one
+    };
+
+    // Look-up in a document, picked by its parse id
+    struct CacheEntry
+    {
+        unsigned int m_parseId;
+        int m_nodeIndex;                // -1 if there is no value at the path
+    };
+
+    static const int CacheSize = 4;
+
+    std::vector< Step > m_steps;
+    bool m_isValid;
+    mutable CacheEntry m_cache[CacheSize];
+
+};
+
+/*** Streaming ***/
+
+// Receives the events of a streamed parse, in document order; each returns false
+// to stop the parse there. Keys and strings are only valid during the call. Numbers
+// written as whole numbers that fit in 64 bits go to OnInteger, which hands them on
+// to OnNumber unless overridden
+class JsonHandler
+{
+public:
+
+    virtual ~JsonHandler() { }
+
+    virtual bool OnObjectStart() { return true; }
+    virtual bool OnKey( const char* /*key*/, size_t /*keyLength*/ ) { return true; }
+    virtual bool OnObjectEnd() { return true; }
+    virtual bool OnArrayStart() { return true; }
+    virtual bool OnArrayEnd() { return true; }
+    virtual bool OnNull() { return true; }
+    virtual bool OnBool( bool /*value*/ ) { return true; }
+    virtual bool OnNumber( double /*value*/ ) { return true; }
+    virtual bool OnInteger( long long value ) { return OnNumber( (double)value ); }
+    virtual bool OnString( const char* /*value*/, size_t /*length*/ ) { return true; }
+};
+
+// Source of JSON text for streaming
+class JsonSource
+{
+public:
+
+    virtual ~JsonSource() { }
+
+    // Reads up to the given count of bytes into the buffer, and returns how many
+    // were read; 0 at the end of the input, or on error
+    virtual size_t Read( char* buffer, size_t size ) = 0;
+};
+
+// Streams through JSON text of any size in a fixed amount of memory: a read
+// buffer (grown only for strings or numbers longer than it), the longest string,
+// and one byte per level of nesting. Returns true if the whole input was valid
+// JSON and the handler never stopped the parse
+bool StreamSimpleJSON( JsonSource* source, JsonHandler* handler );
+
+// As above, from the rest of the given file, or from the given SDL stream
+bool StreamSimpleJSON( FILE* fileHandle, JsonHandler* handler );
+bool StreamSimpleJSON( SDL_RWops* rwops, JsonHandler* handler );
+
+/*** Writing ***/
+
+// Writes compact JSON text into a buffer that only grows, so that a whole save or
+// a frame of telemetry is written out at once. Values are given in document order
+// through the builder calls, or whole trees at a time; the calls must make valid
+// JSON, which is not checked. Values at the top level go one per line (as in JSON
+// Lines), so a log can keep adding to the same writer. Doubles are written in the
+// fewest digits that read back as the same double, with ".0" on whole ones so they
+// read back as doubles; infinities and NaNs, which JSON has no way to write, as null
+class JsonWriter
+{
+public:
+
+    JsonWriter();
+
+    // Builder calls; an object's members are each a key, then its value
+    void StartObject();
+    void EndObject();
+    void StartArray();
+    void EndArray();
+    void Key( const char* key, size_t keyLength );
+    void Key( const char* key );
+    void Null();
+    void Bool( bool value );
+    void Number( double value );
+    void Integer( long long value );
+    void String( const char* value, size_t length );
+    void String( const char* value );
+
+    // Whole trees, or whole documents
+    void Value( const JsonValue* value );
+    void Value( JsonRef value );
+
+    // The text so far; not zero-terminated
+    const char* GetData() const { return m_buffer.empty() ? NULL : &m_buffer[0]; }
+    size_t GetLength() const { return m_length; }
+
+    // Empties the writer; the buffer keeps its memory
+    void Clear();
+
+    // Writes out the text so far in a single write; returns false on error
+    bool WriteToFile( FILE* fileHandle ) const;
+    bool WriteToFile( SDL_RWops* rwops ) const;
+
+private:
+
+    // Room for the given count of characters at the end of the text; the caller
+    // writes them, and moves m_length past them
+    inline char* Reserve( size_t length )
+    {
+        if( m_length + length > m_buffer.size() )
+            Grow( length );
+        return &m_buffer[m_length];
+    }
+    inline void WriteChar( char givenChar )
+    {
+        *Reserve( 1 ) = givenChar;
+        m_length++;
+    }
+
+    // Grows the buffer to fit the given count of characters more, at least doubling it
+    void Grow( size_t length );
+
+    // Comma or line break before a value or key, as needed
+    void StartValue();
+
+    std::vector< char > m_buffer;
+    size_t m_length;
+
+    // One byte per level of nesting, set once the level has a value; and whether
+    // a key was just written, so that its value needs no comma
+    std::vector< char > m_levels;
+    bool m_hasRootValue;
+    bool m_isAfterKey;
+
+};
+
+// Writes the given tree to the given file, as above; returns false on error
+bool WriteSimpleJSON( FILE* fileHandle, const JsonValue* rootValue );
+
 } // End of namespace
 
 #endif
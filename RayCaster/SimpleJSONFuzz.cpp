@@ -0,0 +1,199 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: SimpleJSONFuzz.cpp
+ Desc: libFuzzer entry point for SimpleJSON; empty unless built
+ with SIMPLEJSON_FUZZ defined. Each input is parsed every way
+ there is (tree, document, stream in small reads), and the results
+ are checked against each other: any crash, sanitizer report or
+ abort is a bug. Build with clang, for example:
+ 
+   clang++ -g -O1 -fsanitize=fuzzer,address,undefined
+     -DSIMPLEJSON_FUZZ -I../External/SDL-2.0.0/include
+     SimpleJSONFuzz.cpp SimpleJSON.cpp -lSDL2 -o SimpleJSONFuzz
+ 
+ then run it on a folder of JSON files to start from (it adds
+ the inputs it finds interesting there):
+ 
+   ./SimpleJSONFuzz Corpus/ -max_len=65536
+
+***************************************************************/
+
+#ifdef SIMPLEJSON_FUZZ
+
+#include "SimpleJSON.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+using namespace SimpleJSON;
+
+/*** Private ***/
+
+// Hands out the input a few bytes at a time, so that tokens straddle reads
+class FuzzSource : public JsonSource
+{
+public:
+
+    FuzzSource( const char* data, size_t length, size_t readSize )
+        : m_data( data ), m_length( length ), m_offset( 0 ), m_readSize( readSize )
+    {
+    }
+
+    size_t Read( char* buffer, size_t size )
+    {
+        size_t readSize = m_length - m_offset;
+        if( readSize > size )
+            readSize = size;
+        if( readSize > m_readSize )
+            readSize = m_readSize;
+        memcpy( buffer, m_data + m_offset, readSize );
+        m_offset += readSize;
+        return readSize;
+    }
+
+private:
+
+    const char* m_data;
+    size_t m_length;
+    size_t m_offset;
+    size_t m_readSize;
+
+};
+
+// Checks that every event comes in a valid order, and that the counts balance
+class FuzzHandler : public JsonHandler
+{
+public:
+
+    FuzzHandler() : m_isKeyNext( false ) { }
+
+    bool OnObjectStart() { StartValue(); m_levels += 'o'; m_isKeyNext = true; return true; }
+    bool OnKey( const char* key, size_t keyLength ) { Check( m_isKeyNext && key != NULL ); m_isKeyNext = false; return true; }
+    bool OnObjectEnd() { Check( m_isKeyNext && !m_levels.empty() && m_levels[m_levels.size() - 1] == 'o' ); EndValue(); return true; }
+    bool OnArrayStart() { StartValue(); m_levels += 'a'; return true; }
+    bool OnArrayEnd() { Check( !m_levels.empty() && m_levels[m_levels.size() - 1] == 'a' ); EndValue(); return true; }
+    bool OnNull() { StartValue(); m_isKeyNext = IsInObject(); return true; }
+    bool OnBool( bool value ) { StartValue(); m_isKeyNext = IsInObject(); return true; }
+    bool OnNumber( double value ) { StartValue(); m_isKeyNext = IsInObject(); return true; }
+    bool OnString( const char* value, size_t length ) { Check( value != NULL ); StartValue(); m_isKeyNext = IsInObject(); return true; }
+
+    bool IsBalanced() const { return m_levels.empty(); }
+
+private:
+
+    static void Check( bool isValid )
+    {
+        if( !isValid )
+            abort();
+    }
+
+    bool IsInObject() const { return !m_levels.empty() && m_levels[m_levels.size() - 1] == 'o'; }
+
+    // A value may not come where a key is due
+    void StartValue() { Check( !m_isKeyNext ); }
+
+    void EndValue()
+    {
+        m_levels.erase( m_levels.size() - 1 );
+        m_isKeyNext = IsInObject();
+    }
+
+    std::string m_levels;
+    bool m_isKeyNext;
+
+};
+
+static void FuzzCheck( bool isValid )
+{
+    if( !isValid )
+        abort();
+}
+
+/*** Public ***/
+
+extern "C" int LLVMFuzzerTestOneInput( const unsigned char* data, size_t size )
+{
+    const char* text = (const char*)data;
+
+    // The tree and the document must agree on whether the input is valid, and if
+    // so, be written out the same, and read back to the same again
+    JsonValue rootValue;
+    bool isTreeValid = ParseSimpleJSON( text, size, &rootValue );
+    JsonDocument document;
+    bool isDocumentValid = document.Parse( text, size );
+    FuzzCheck( isTreeValid == isDocumentValid );
+
+    if( isDocumentValid )
+    {
+        JsonWriter treeWriter;
+        treeWriter.Value( &rootValue );
+        JsonWriter documentWriter;
+        documentWriter.Value( document.GetRoot() );
+        FuzzCheck( treeWriter.GetLength() == documentWriter.GetLength() && memcmp( treeWriter.GetData(), documentWriter.GetData(), treeWriter.GetLength() ) == 0 );
+
+        JsonDocument copy;
+        FuzzCheck( copy.Parse( documentWriter.GetData(), documentWriter.GetLength() ) );
+        JsonWriter copyWriter;
+        copyWriter.Value( copy.GetRoot() );
+        FuzzCheck( copyWriter.GetLength() == documentWriter.GetLength() && memcmp( copyWriter.GetData(), documentWriter.GetData(), copyWriter.GetLength() ) == 0 );
+    }
+
+    // The stream has no depth limit, so it may take more; what both take, it must
+    // take in full, and with its events in order
+    FuzzSource source( text, size, (size > 0) ? 1 + data[0] % 16 : 1 );
+    FuzzHandler handler;
+    bool isStreamValid = StreamSimpleJSON( &source, &handler );
+    FuzzCheck( !isStreamValid || handler.IsBalanced() );
+    FuzzCheck( !isDocumentValid || isStreamValid );
+
+    // A path down the first member or element of every level, escaped as a JSON
+    // Pointer, must lead to the same value in both (keys holding zeros end it)
+    if( isDocumentValid )
+    {
+        std::string pointer;
+        JsonRef value = document.GetRoot();
+        bool isKeyZero = false;
+        while( (value.GetType() == JsonType_Object || value.GetType() == JsonType_Array) && value.GetCount() > 0 && !isKeyZero )
+        {
+            pointer += '/';
+            if( value.GetType() == JsonType_Array )
+            {
+                pointer += '0';
+                value = value.GetElement( 0 );
+                continue;
+            }
+
+            JsonStringView key = value.GetMemberKey( 0 );
+            for(size_t i = 0; i < key.m_length; i++)
+            {
+                isKeyZero |= (key.m_data[i] == '\0');
+                if( key.m_data[i] == '~' )
+                    pointer += "~0";
+                else if( key.m_data[i] == '/' )
+                    pointer += "~1";
+                else
+                    pointer += key.m_data[i];
+            }
+            value = value.GetMemberValue( 0 );
+        }
+
+        JsonPath path;
+        if( !isKeyZero )
+        {
+            FuzzCheck( path.Compile( pointer.c_str() ) );
+            const JsonValue* treeValue = path.Resolve( &rootValue );
+            FuzzCheck( path.Resolve( document ).GetType() == value.GetType() && treeValue != NULL && treeValue->m_type == value.GetType() );
+        }
+    }
+
+    return 0;
+}
+
+#endif
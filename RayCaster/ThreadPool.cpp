@@ -0,0 +1,107 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+
+***************************************************************/
+
+#include "ThreadPool.h"
+#include "Utilities.h"
+
+ThreadPool::ThreadPool( int threadCount )
+	: m_mutex( NULL )
+	, m_jobCondition( NULL )
+	, m_idleCondition( NULL )
+	, m_pendingCount( 0 )
+	, m_isStopping( false )
+{
+	m_mutex = SDL_CreateMutex();
+	m_jobCondition = SDL_CreateCond();
+	m_idleCondition = SDL_CreateCond();
+	UtilAssert( m_mutex != NULL && m_jobCondition != NULL && m_idleCondition != NULL, "Failed to create thread pool primitives" );
+
+	if( threadCount <= 0 )
+		threadCount = max( 1, SDL_GetCPUCount() );
+
+	for(int i = 0; i < threadCount; i++)
+	{
+		SDL_Thread* thread = SDL_CreateThread( WorkerMain, "ThreadPool", this );
+		UtilAssert( thread != NULL, "Failed to create worker thread" );
+		m_threads.push_back( thread );
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	WaitAll();
+
+	// Wake everyone up so they see the stop flag
+	SDL_LockMutex( m_mutex );
+	m_isStopping = true;
+	SDL_CondBroadcast( m_jobCondition );
+	SDL_UnlockMutex( m_mutex );
+
+	for(size_t i = 0; i < m_threads.size(); i++)
+		SDL_WaitThread( m_threads[i], NULL );
+
+	SDL_DestroyCond( m_idleCondition );
+	SDL_DestroyCond( m_jobCondition );
+	SDL_DestroyMutex( m_mutex );
+}
+
+void ThreadPool::Push( ThreadJob* job )
+{
+	SDL_LockMutex( m_mutex );
+	m_jobs.push_back( job );
+	m_pendingCount++;
+	SDL_CondSignal( m_jobCondition );
+	SDL_UnlockMutex( m_mutex );
+}
+
+void ThreadPool::WaitAll()
+{
+	SDL_LockMutex( m_mutex );
+	while( m_pendingCount > 0 )
+		SDL_CondWait( m_idleCondition, m_mutex );
+	SDL_UnlockMutex( m_mutex );
+}
+
+int ThreadPool::GetPendingCount()
+{
+	SDL_LockMutex( m_mutex );
+	int pendingCount = m_pendingCount;
+	SDL_UnlockMutex( m_mutex );
+
+	return pendingCount;
+}
+
+int ThreadPool::WorkerMain( void* data )
+{
+	ThreadPool* pool = (ThreadPool*)data;
+
+	SDL_LockMutex( pool->m_mutex );
+	while( true )
+	{
+		// Sleep until there is work, or we are asked to stop
+		while( pool->m_jobs.empty() && !pool->m_isStopping )
+			SDL_CondWait( pool->m_jobCondition, pool->m_mutex );
+
+		if( pool->m_jobs.empty() )
+			break;
+
+		ThreadJob* job = pool->m_jobs.front();
+		pool->m_jobs.pop_front();
+
+		// Run outside of the lock
+		SDL_UnlockMutex( pool->m_mutex );
+		job->Run();
+		delete job;
+		SDL_LockMutex( pool->m_mutex );
+
+		if( --pool->m_pendingCount == 0 )
+			SDL_CondBroadcast( pool->m_idleCondition );
+	}
+	SDL_UnlockMutex( pool->m_mutex );
+
+	return 0;
+}
@@ -0,0 +1,75 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: ThreadPool.cpp/h
+ Desc: A simple fixed-size pool of worker threads (built on SDL
+ threads) that runs jobs in first-in first-out order.
+
+***************************************************************/
+
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <deque>
+#include <vector>
+
+#include "SDL.h"
+#include "SDL_thread.h"
+
+// A unit of work; derive from this and implement Run(). Jobs are gifted
+// to the pool, which deletes them once they have run
+class ThreadJob
+{
+public:
+
+	virtual ~ThreadJob() { }
+
+	// Called on a worker thread
+	virtual void Run() = 0;
+
+};
+
+class ThreadPool
+{
+public:
+
+	// Starts the given number of worker threads; zero means one per CPU core
+	ThreadPool( int threadCount = 0 );
+
+	// Waits for all queued jobs to complete, then stops the threads
+	~ThreadPool();
+
+	// Queue up a job; the job is gifted, and is deleted once it has run
+	void Push( ThreadJob* job );
+
+	// Blocks until every queued job has completed
+	void WaitAll();
+
+	// Number of queued or running jobs
+	int GetPendingCount();
+
+	int GetThreadCount() const { return (int)m_threads.size(); }
+
+private:
+
+	// Worker thread entry point
+	static int WorkerMain( void* data );
+
+	std::vector< SDL_Thread* > m_threads;
+	std::deque< ThreadJob* > m_jobs;
+
+	SDL_mutex* m_mutex;
+	SDL_cond* m_jobCondition;		// Signaled when a job is queued, or on shutdown
+	SDL_cond* m_idleCondition;		// Signaled when the pending count drops to zero
+
+	int m_pendingCount;
+	bool m_isStopping;
+
+};
+
+#endif
@@ -0,0 +1,215 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+
+***************************************************************/
+
+#include "TileTypes.h"
+#include "Utilities.h"
+#include "SimpleJSON.h"
+
+using namespace SimpleJSON;
+
+/*** Private ***/
+
+// Member of the given object value of the given type; NULL if missing or of another type
+static const JsonValue* TileTypes_GetMember( const JsonValue* object, const char* key, JsonType type )
+{
+	JsonObject::const_iterator it = object->m_data.m_object->find( key );
+	if( it == object->m_data.m_object->end() || it->second->m_type != type )
+		return NULL;
+	return it->second;
+}
+
+// Tile id, given as a one-character string or a number from 0 to 255; returns false if neither
+static bool TileTypes_ParseTileId( const JsonValue* value, Uint8* tileId )
+{
+	if( value->m_type == JsonType_String && value->m_data.m_string->length() == 1 )
+	{
+		*tileId = (Uint8)(*value->m_data.m_string)[0];
+		return true;
+	}
+	else if( value->m_type == JsonType_Number && value->m_data.m_number >= 0.0f && value->m_data.m_number <= 255.0f &&
+		value->m_data.m_number == (float)(int)value->m_data.m_number )
+	{
+		*tileId = (Uint8)value->m_data.m_number;
+		return true;
+	}
+	return false;
+}
+
+/*** Public ***/
+
+TileTypeTable::TileTypeTable()
+{
+	m_textureNames.push_back( "" );
+
+	// Walls by default
+	TileType wall;
+	wall.m_isSolid = true;
+	wall.m_isTransparent = false;
+	wall.m_isOpenFloor = false;
+	wall.m_levelChange = 0;
+	wall.m_height = 1.0f;
+	wall.m_lightEmission = 0.0f;
+	wall.m_minimapColor[0] = 32;
+	wall.m_minimapColor[1] = 32;
+	wall.m_minimapColor[2] = 32;
+	for(int i = 0; i < 256; i++)
+		Set( (Uint8)i, wall );
+
+	// Empty floor
+	TileType floor = wall;
+	floor.m_isSolid = false;
+	floor.m_height = 0.0f;
+	floor.m_minimapColor[0] = 255;
+	floor.m_minimapColor[1] = 255;
+	floor.m_minimapColor[2] = 255;
+	Set( ' ', floor );
+
+	// Hole in the floor, down to the level below
+	TileType hole = floor;
+	hole.m_isOpenFloor = true;
+	hole.m_minimapColor[0] = 64;
+	hole.m_minimapColor[1] = 64;
+	hole.m_minimapColor[2] = 96;
+	Set( 'o', hole );
+
+	// Stairs, up and down a level
+	TileType stairsUp = floor;
+	stairsUp.m_levelChange = 1;
+	stairsUp.m_minimapColor[0] = 96;
+	stairsUp.m_minimapColor[1] = 192;
+	stairsUp.m_minimapColor[2] = 96;
+	Set( '<', stairsUp );
+
+	TileType stairsDown = stairsUp;
+	stairsDown.m_levelChange = -1;
+	stairsDown.m_minimapColor[0] = 192;
+	stairsDown.m_minimapColor[1] = 192;
+	stairsDown.m_minimapColor[2] = 96;
+	Set( '>', stairsDown );
+}
+
+bool TileTypeTable::LoadDefinitions( const std::string& fileName, std::string* errorString )
+{
+	std::string error;
+	FILE* file = fopen( fileName.c_str(), "r" );
+	if( file == NULL )
+	{
+		if( errorString != NULL )
+			*errorString = "Unable to open \"" + fileName + "\"";
+		return false;
+	}
+
+	JsonValue root;
+	bool isValid = ParseSimpleJSON( file, &root );
+	fclose( file );
+
+	// Applied to a copy, so that nothing changes on error
+	TileTypeTable tileTypes = *this;
+	const JsonValue* tiles = NULL;
+	if( !isValid || root.m_type != JsonType_Object )
+		error = "Not a JSON object";
+	else if( (tiles = TileTypes_GetMember( &root, "tiles", JsonType_Array )) == NULL )
+		error = "No \"tiles\" array";
+
+	for(size_t i = 0; error.empty() && i < tiles->m_data.m_array->size(); i++)
+	{
+		const JsonValue* tile = (*tiles->m_data.m_array)[i];
+		const JsonValue* member = NULL;
+		char tileName[32];
+		sprintf( tileName, "Tile %d: ", (int)i );
+
+		// Which id, and what it starts out as
+		Uint8 tileId = 0;
+		if( tile->m_type != JsonType_Object )
+		{
+			error = std::string( tileName ) + "not an object";
+			break;
+		}
+
+		JsonObject::const_iterator idIt = tile->m_data.m_object->find( "id" );
+		if( idIt == tile->m_data.m_object->end() || !TileTypes_ParseTileId( idIt->second, &tileId ) )
+		{
+			error = std::string( tileName ) + "missing or invalid \"id\"";
+			break;
+		}
+
+		TileType tileType = tileTypes.Get( tileId );
+		JsonObject::const_iterator likeIt = tile->m_data.m_object->find( "like" );
+		if( likeIt != tile->m_data.m_object->end() )
+		{
+			Uint8 likeId = 0;
+			if( !TileTypes_ParseTileId( likeIt->second, &likeId ) )
+			{
+				error = std::string( tileName ) + "invalid \"like\"";
+				break;
+			}
+			tileType = tileTypes.Get( likeId );
+		}
+
+		// Properties given
+		if( (member = TileTypes_GetMember( tile, "solid", JsonType_Bool )) != NULL )
+			tileType.m_isSolid = member->m_data.m_boolean;
+		if( (member = TileTypes_GetMember( tile, "transparent", JsonType_Bool )) != NULL )
+			tileType.m_isTransparent = member->m_data.m_boolean;
+		if( (member = TileTypes_GetMember( tile, "openFloor", JsonType_Bool )) != NULL )
+			tileType.m_isOpenFloor = member->m_data.m_boolean;
+		if( (member = TileTypes_GetMember( tile, "levelChange", JsonType_Number )) != NULL )
+			tileType.m_levelChange = (Sint8)max( -127.0f, min( 127.0f, (float)member->m_data.m_number ) );
+		if( (member = TileTypes_GetMember( tile, "height", JsonType_Number )) != NULL )
+			tileType.m_height = max( 0.0f, min( 1.0f, (float)member->m_data.m_number ) );
+		if( (member = TileTypes_GetMember( tile, "light", JsonType_Number )) != NULL )
+			tileType.m_lightEmission = max( 0.0f, min( 1.0f, (float)member->m_data.m_number ) );
+		if( (member = TileTypes_GetMember( tile, "texture", JsonType_String )) != NULL )
+			tileType.m_textureName = *member->m_data.m_string;
+
+		if( (member = TileTypes_GetMember( tile, "minimap", JsonType_Array )) != NULL )
+		{
+			const JsonArray& color = *member->m_data.m_array;
+			if( color.size() != 3 || color[0]->m_type != JsonType_Number || color[1]->m_type != JsonType_Number || color[2]->m_type != JsonType_Number )
+			{
+				error = std::string( tileName ) + "\"minimap\" must be [ r, g, b ]";
+				break;
+			}
+
+			for(int channel = 0; channel < 3; channel++)
+				tileType.m_minimapColor[channel] = (Uint8)max( 0.0f, min( 255.0f, (float)color[channel]->m_data.m_number ) );
+		}
+
+		tileTypes.Set( tileId, tileType );
+	}
+
+	if( !error.empty() )
+	{
+		if( errorString != NULL )
+			*errorString = fileName + ": " + error;
+		return false;
+	}
+
+	*this = tileTypes;
+	return true;
+}
+
+void TileTypeTable::Set( Uint8 tileId, const TileType& tileType )
+{
+	m_types[tileId] = tileType;
+
+	m_isSolid[tileId] = tileType.m_isSolid ? 1 : 0;
+	m_isTransparent[tileId] = tileType.m_isTransparent ? 1 : 0;
+	m_isOpenFloor[tileId] = tileType.m_isOpenFloor ? 1 : 0;
+	m_levelChanges[tileId] = tileType.m_levelChange;
+	m_heights[tileId] = tileType.m_height;
+	m_lightEmissions[tileId] = tileType.m_lightEmission;
+	m_minimapColors[tileId] = 0xFF000000 | (tileType.m_minimapColor[0] << 16) | (tileType.m_minimapColor[1] << 8) | tileType.m_minimapColor[2];
+
+	// Textures are shared by name
+	size_t textureIndex = 0;
+	while( textureIndex < m_textureNames.size() && m_textureNames[textureIndex] != tileType.m_textureName )
+		textureIndex++;
+	if( textureIndex == m_textureNames.size() )
+		m_textureNames.push_back( tileType.m_textureName );
+	m_textureIndices[tileId] = (Uint16)textureIndex;
+}
@@ -0,0 +1,107 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: TileTypes.cpp/h
+ Desc: Per-tile-id properties (is it a wall, what colour is it on
+ the minimap, etc.). Tile ids are single bytes, so the properties
+ are compiled into dense arrays of 256 entries, one per property,
+ and a look-up is a single index.
+ 
+ Tile types can be defined in a JSON file, whose "tiles" array
+ lists the tile ids that differ from the built-in types:
+ 
+   { "tiles": [
+     { "id": "x", "texture": "Brick.bmp", "minimap": [ 32, 32, 32 ] },
+     { "id": "#", "solid": true, "transparent": true, "height": 0.5 },
+     { "id": "*", "solid": false, "light": 1.0, "minimap": [ 255, 220, 96 ] }
+   ] }
+ 
+ The id is a one-character string or a number from 0 to 255, and
+ "like" (a tile id as well) starts from another tile's properties.
+ Other properties are "solid", "transparent", "openFloor" (bools),
+ "levelChange", "height", "light" (numbers), "texture" (a string)
+ and "minimap" (an [ r, g, b ] array); those left out keep the
+ properties of the built-in type.
+
+***************************************************************/
+
+#ifndef __TILETYPES_H__
+#define __TILETYPES_H__
+
+#include <string>
+#include <vector>
+
+#include "SDL.h"
+
+// Properties shared by all tiles of a given id
+struct TileType
+{
+	bool m_isSolid;				// Blocks rays and movement
+	bool m_isTransparent;		// Solid, yet what is behind it shows through (windows, bars)
+	bool m_isOpenFloor;			// No floor: the level below shows through, and the player drops into it
+	Sint8 m_levelChange;		// Stairs: levels moved up (positive) or down (negative) when stepped onto
+	float m_height;				// Wall height, as a fraction of a level (0 to 1)
+	float m_lightEmission;		// Light given off (0 for none, 1 for fully lit)
+	Uint8 m_minimapColor[3];	// RGB
+	std::string m_textureName;	// Wall texture file; empty for none
+};
+
+// Properties of all 256 tile ids
+class TileTypeTable
+{
+public:
+
+	// Starts out with the built-in types: ' ' is empty floor, 'o' a hole in the
+	// floor, '<' and '>' stairs up and down, anything else is a wall
+	TileTypeTable();
+
+	// Applies the tile definitions of the given JSON file (see above) over the
+	// current types; returns false, changing nothing, if the file is missing or
+	// malformed, with the reason posted to the given error string
+	bool LoadDefinitions( const std::string& fileName, std::string* errorString = NULL );
+
+	// Get / set the properties of a tile id; setting compiles them into the look-up arrays
+	const TileType& Get( Uint8 tileId ) const { return m_types[tileId]; }
+	void Set( Uint8 tileId, const TileType& tileType );
+
+	// Look-ups for the hot paths, each a single load
+	bool IsSolid( Uint8 tileId ) const { return m_isSolid[tileId] != 0; }
+	bool IsTransparent( Uint8 tileId ) const { return m_isTransparent[tileId] != 0; }
+	bool IsOpenFloor( Uint8 tileId ) const { return m_isOpenFloor[tileId] != 0; }
+	int GetLevelChange( Uint8 tileId ) const { return m_levelChanges[tileId]; }
+	float GetHeight( Uint8 tileId ) const { return m_heights[tileId]; }
+	float GetLightEmission( Uint8 tileId ) const { return m_lightEmissions[tileId]; }
+
+	// Minimap colour as opaque ARGB8888, ready to be written to a texture
+	Uint32 GetMinimapColor( Uint8 tileId ) const { return m_minimapColors[tileId]; }
+
+	// Index of the tile's texture in the texture name list; 0 (an empty name) for none
+	int GetTextureIndex( Uint8 tileId ) const { return m_textureIndices[tileId]; }
+	const std::vector< std::string >& GetTextureNames() const { return m_textureNames; }
+
+private:
+
+	// Source properties, as given
+	TileType m_types[256];
+
+	// Compiled look-up arrays, one entry per tile id
+	Uint8 m_isSolid[256];
+	Uint8 m_isTransparent[256];
+	Uint8 m_isOpenFloor[256];
+	Sint8 m_levelChanges[256];
+	float m_heights[256];
+	float m_lightEmissions[256];
+	Uint32 m_minimapColors[256];
+	Uint16 m_textureIndices[256];
+
+	// Distinct texture names, the first one empty
+	std::vector< std::string > m_textureNames;
+
+};
+
+#endif
@@ -7,6 +7,24 @@
 
 #include "Utilities.h"
 
+// POSIX file-mapping interface
+#ifndef _WIN32
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/resource.h>
+    #include <glob.h>
+#endif
+
+#include <algorithm>
+
+// Win32: process memory counters
+#ifdef _WIN32
+    #include <psapi.h>
+    #pragma comment(lib, "psapi.lib")
+#endif
+
 void __UtilAssert(const char* FileName, int LineNumber, bool Assertion, const char* FailText, ...)
 {
     // Validate assertion
@@ -99,3 +117,201 @@ void UtilSleep(float SleepTime)
         usleep(useconds_t(1000000.0f * SleepTime)); // Unix micro-second sleep
     #endif
 }
+
+UtilRand::UtilRand(unsigned int seed)
+    : seed(seed)
+{
+}
+
+UtilRand::UtilRand(const char* seed)
+    : seed(5381)
+{
+    // djb2 string hash
+    for(const char* c = seed; c != NULL && *c != '\0'; c++)
+        this->seed = this->seed * 33 + (unsigned char)(*c);
+}
+
+unsigned int UtilRand::Rand()
+{
+    // Note: the low bits of an LCG have short periods; prefer the high bits
+    seed = a * seed + c;
+    return seed;
+}
+
+bool UtilReadAt(FILE* file, Uint64 offset, void* buffer, size_t size)
+{
+    #ifdef _WIN32
+        if( _fseeki64( file, (__int64)offset, SEEK_SET ) != 0 )
+            return false;
+    #else
+        if( fseeko( file, (off_t)offset, SEEK_SET ) != 0 )
+            return false;
+    #endif
+
+    return fread( buffer, 1, size, file ) == size;
+}
+
+Uint64 UtilGetPeakMemoryUsage()
+{
+    #ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if( !GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof(counters) ) )
+            return 0;
+        return (Uint64)counters.PeakWorkingSetSize;
+    #else
+        struct rusage usage;
+        if( getrusage( RUSAGE_SELF, &usage ) != 0 )
+            return 0;
+
+        // Kilobytes on Linux, bytes on OSX
+        #ifdef __APPLE__
+            return (Uint64)usage.ru_maxrss;
+        #else
+            return (Uint64)usage.ru_maxrss * 1024;
+        #endif
+    #endif
+}
+
+int UtilFindFiles(const char* pattern, std::vector<std::string>& fileNames)
+{
+    size_t firstFound = fileNames.size();
+    
+    #ifdef _WIN32
+        
+        // Found names come without the directory, so put it back
+        const char* slash = strrchr(pattern, '\\');
+        if(strrchr(pattern, '/') > slash)
+            slash = strrchr(pattern, '/');
+        std::string directoryName(pattern, (slash != NULL) ? slash + 1 - pattern : 0);
+        
+        WIN32_FIND_DATAA findData;
+        HANDLE findHandle = FindFirstFileA(pattern, &findData);
+        if(findHandle == INVALID_HANDLE_VALUE)
+            return 0;
+        do
+        {
+            if((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+                fileNames.push_back(directoryName + findData.cFileName);
+        }
+        while(FindNextFileA(findHandle, &findData));
+        FindClose(findHandle);
+        
+        // Only NTFS lists names in order
+        std::sort(fileNames.begin() + firstFound, fileNames.end());
+        
+    #else
+        
+        // Directories come back with a trailing slash (GLOB_MARK)
+        glob_t globData;
+        if(glob(pattern, GLOB_MARK, NULL, &globData) != 0)
+            return 0;
+        for(size_t i = 0; i < globData.gl_pathc; i++)
+        {
+            const char* fileName = globData.gl_pathv[i];
+            if(fileName[strlen(fileName) - 1] != '/')
+                fileNames.push_back(fileName);
+        }
+        globfree(&globData);
+        
+    #endif
+    
+    return (int)(fileNames.size() - firstFound);
+}
+
+UtilMappedFile::UtilMappedFile()
+    : data(NULL)
+    , size(0)
+{
+    #ifdef _WIN32
+        fileHandle = INVALID_HANDLE_VALUE;
+        mappingHandle = NULL;
+    #else
+        fileHandle = -1;
+    #endif
+}
+
+UtilMappedFile::~UtilMappedFile()
+{
+    Close();
+}
+
+bool UtilMappedFile::Open(const char* fileName)
+{
+    Close();
+    
+    #ifdef _WIN32
+        
+        // Open, then map a read-only view of the entire file
+        fileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(fileHandle == INVALID_HANDLE_VALUE)
+            return false;
+        
+        LARGE_INTEGER fileSize;
+        if(!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+        {
+            Close();
+            return false;
+        }
+        size = (size_t)fileSize.QuadPart;
+        
+        mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(mappingHandle != NULL)
+            data = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+        
+    #else
+        
+        fileHandle = open(fileName, O_RDONLY);
+        if(fileHandle < 0)
+            return false;
+        
+        struct stat fileStat;
+        if(fstat(fileHandle, &fileStat) != 0 || fileStat.st_size == 0)
+        {
+            Close();
+            return false;
+        }
+        size = (size_t)fileStat.st_size;
+        
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileHandle, 0);
+        if(data == MAP_FAILED)
+            data = NULL;
+        
+    #endif
+    
+    // Release any partial state on failure
+    if(data == NULL)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void UtilMappedFile::Close()
+{
+    #ifdef _WIN32
+        
+        if(data != NULL)
+            UnmapViewOfFile(data);
+        if(mappingHandle != NULL)
+            CloseHandle(mappingHandle);
+        if(fileHandle != INVALID_HANDLE_VALUE)
+            CloseHandle(fileHandle);
+        
+        mappingHandle = NULL;
+        fileHandle = INVALID_HANDLE_VALUE;
+        
+    #else
+        
+        if(data != NULL)
+            munmap(data, size);
+        if(fileHandle >= 0)
+            close(fileHandle);
+        
+        fileHandle = -1;
+        
+    #endif
+    
+    data = NULL;
+    size = 0;
+}
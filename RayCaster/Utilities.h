@@ -52,6 +52,8 @@
 
 // C++ specific includes
 #include <iostream>
+#include <string>
+#include <vector>
 using namespace std;
 
 // Define PI
@@ -74,6 +76,50 @@ void __UtilAssert(const char* FileName, int LineNumber, bool Assertion, const ch
 // Takes in a fraction of a second (as a float)
 void UtilSleep(float SleepTime);
 
+// Seeks to a 64-bit file offset and reads; returns true if everything was read
+bool UtilReadAt(FILE* file, Uint64 offset, void* buffer, size_t size);
+
+// Peak resident memory of the process so far, in bytes; 0 if unknown
+Uint64 UtilGetPeakMemoryUsage();
+
+// Appends the files matching the given pattern (wildcards '*' and '?' in the file
+// name only, such as "Assets/*.json") to the given list, in name order; returns
+// how many were found. Directories are skipped
+int UtilFindFiles(const char* pattern, std::vector<std::string>& fileNames);
+
+// Read-only memory-mapped file; the whole file is mapped into the address
+// space and the OS pages it in on first access, so opening is near-instant
+class UtilMappedFile
+{
+public:
+    
+    UtilMappedFile();
+    ~UtilMappedFile();
+    
+    // Maps the given file; returns false on failure
+    bool Open(const char* fileName);
+    
+    // Unmaps the file; called on destruction
+    void Close();
+    
+    // Mapped contents; NULL if not open
+    inline const void* GetData() const { return data; }
+    inline size_t GetSize() const { return size; }
+    
+private:
+    
+    void* data;
+    size_t size;
+    
+    // Platform file handles
+    #ifdef _WIN32
+        HANDLE fileHandle;
+        HANDLE mappingHandle;
+    #else
+        int fileHandle;
+    #endif
+};
+
 // Random number generator; "Linear Congruential Generator"
 // Based on http://en.wikipedia.org/wiki/Linear_congruential_generator
 class UtilRand
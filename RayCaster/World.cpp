@@ -6,40 +6,844 @@
 ***************************************************************/
 
 #include "World.h"
+#include "WorldFile.h"
+#include "WorldChunkCache.h"
+#include "WorldTextLoader.h"
+#include "WorldBlockFile.h"
+#include "WorldCodec.h"
+#include "ThreadPool.h"
 #include "Utilities.h"
 
-World::World( const std::string& worldFileName )
+#include <vector>
+#include <algorithm>
+
+// Compresses one block of a compressed world file, on a worker thread
+class WorldBlockCompressJob : public ThreadJob
+{
+public:
+
+	WorldBlockCompressJob( const WorldTile* tiles, int pitch, int blockSize, std::vector< Uint8 >* blockData, WorldCodec* codec )
+		: m_tiles( tiles )
+		, m_pitch( pitch )
+		, m_blockSize( blockSize )
+		, m_blockData( blockData )
+		, m_codec( codec )
+	{
+	}
+
+	void Run()
+	{
+		// Gather the block's rows, then compress them
+		std::vector< WorldTile > blockTiles( m_blockSize * m_blockSize );
+		for(int y = 0; y < m_blockSize; y++)
+			memcpy( &blockTiles[y * m_blockSize], m_tiles + y * m_pitch, m_blockSize * sizeof(WorldTile) );
+
+		size_t blockBytes = blockTiles.size() * sizeof(WorldTile);
+		m_blockData->resize( WorldCodecGetBound( blockBytes ) );
+		m_blockData->resize( WorldCodecCompressBest( (const Uint8*)&blockTiles[0], blockBytes, &(*m_blockData)[0], m_codec ) );
+	}
+
+private:
+
+	const WorldTile* m_tiles;
+	int m_pitch;
+	int m_blockSize;
+	std::vector< Uint8 >* m_blockData;
+	WorldCodec* m_codec;
+
+};
+
+World::World( const std::string& worldFileName, bool isBackgroundLoad, const Vector2i& loadOrigin, const TileTypeTable& tileTypes )
 	: m_worldMap( NULL )
+	, m_ownedTiles( NULL )
 	, m_worldSize(0, 0)
+	, m_tileArraySize( 0 )
+	, m_layout( WorldLayout_RowMajor )
+	, m_mortonMaskX( 0 )
+	, m_mortonMaskY( 0 )
+	, m_mortonLowMask( 0 )
+	, m_mortonLowBits( 0 )
+	, m_mappedFile( NULL )
+	, m_chunkCache( NULL )
+	, m_textLoader( NULL )
+	, m_loadTime( 0.0f )
+	, m_tileTypes( tileTypes )
+	, m_solidStride( 0 )
+	, m_revision( 0 )
 {
+	UtilHighresClock loadClock( true );
+
 	// Open up the file
-	FILE* file = fopen(worldFileName.c_str(), "r");
+	FILE* file = fopen(worldFileName.c_str(), "rb");
 	UtilAssert(file != NULL, "Unable to load world file \"%s\"", worldFileName.c_str());
 
+	// Binary worlds start with their magic number, anything else is a text world
+	char magic[4] = { 0 };
+	bool hasMagic = fread(magic, 1, sizeof(magic), file) == sizeof(magic);
+
+	if( hasMagic && memcmp(magic, WorldFile_Magic, sizeof(magic)) == 0 )
+	{
+		fclose(file);
+		LoadBinary( worldFileName );
+	}
+	else if( hasMagic && memcmp(magic, WorldChunkFile_Magic, sizeof(magic)) == 0 )
+	{
+		fclose(file);
+		LoadChunked( worldFileName );
+	}
+	else if( hasMagic && memcmp(magic, WorldBlockFile_Magic, sizeof(magic)) == 0 )
+	{
+		fclose(file);
+		LoadCompressed( worldFileName );
+	}
+	else if( isBackgroundLoad )
+	{
+		// All solid until the rows come in
+		fclose(file);
+		m_textLoader = new WorldTextLoader( worldFileName, loadOrigin, m_tileTypes );
+		m_worldSize = m_textLoader->GetWorldSize();
+		InitLayout( WorldLayout_RowMajor );
+		m_ownedTiles = new WorldTile[ m_tileArraySize ];
+		memset( m_ownedTiles, WorldTile_Solid, m_tileArraySize * sizeof(WorldTile) );
+		m_worldMap = m_ownedTiles;
+	}
+	else
+	{
+		rewind(file);
+		LoadText( file );
+		fclose(file);
+	}
+
+	BuildOccupancy();
+
+	loadClock.Stop();
+	if( m_textLoader == NULL )
+		m_loadTime = loadClock.GetTime();
+}
+
+World::World( const Vector2i& worldSize, WorldTile* tiles, const TileTypeTable& tileTypes )
+	: m_worldMap( tiles )
+	, m_ownedTiles( tiles )
+	, m_worldSize( worldSize )
+	, m_tileArraySize( 0 )
+	, m_layout( WorldLayout_RowMajor )
+	, m_mortonMaskX( 0 )
+	, m_mortonMaskY( 0 )
+	, m_mortonLowMask( 0 )
+	, m_mortonLowBits( 0 )
+	, m_mappedFile( NULL )
+	, m_chunkCache( NULL )
+	, m_textLoader( NULL )
+	, m_loadTime( 0.0f )
+	, m_tileTypes( tileTypes )
+	, m_solidStride( 0 )
+	, m_revision( 0 )
+{
+	InitLayout( WorldLayout_RowMajor );
+	BuildOccupancy();
+}
+
+World::~World()
+{
+	// Stop loading before the tiles go
+	if( m_textLoader != NULL )
+		delete m_textLoader;
+
+	// Mapped or streamed tiles belong to their own owners
+	if( m_chunkCache != NULL )
+		delete m_chunkCache;
+	else if( m_mappedFile != NULL )
+		delete m_mappedFile;
+	else
+		delete[] m_ownedTiles;
+}
+
+bool World::IsTextFile( const std::string& worldFileName )
+{
+	FILE* file = fopen( worldFileName.c_str(), "rb" );
+	if( file == NULL )
+		return false;
+
+	// Same test as the constructor: anything without a binary magic number is text
+	char magic[4] = { 0 };
+	bool hasMagic = fread( magic, 1, sizeof(magic), file ) == sizeof(magic);
+	fclose( file );
+
+	return !hasMagic || ( memcmp( magic, WorldFile_Magic, sizeof(magic) ) != 0
+		&& memcmp( magic, WorldChunkFile_Magic, sizeof(magic) ) != 0
+		&& memcmp( magic, WorldBlockFile_Magic, sizeof(magic) ) != 0 );
+}
+
+const WorldTile* World::GetWorldTile( int x, int y ) const
+{
+	UtilAssert( x >= 0 && x < m_worldSize.x && y >= 0 && y < m_worldSize.y, "Out of bounds world-tile access" );
+	if( m_chunkCache != NULL )
+		return m_chunkCache->GetTile( x, y );
+
+	return GetWorldTileUnchecked( x, y );
+}
+
+void World::SetLayout( WorldLayout layout )
+{
+	// Streamed chunks are always row-major
+	if( m_chunkCache != NULL || layout == m_layout )
+		return;
+	UtilAssert( m_textLoader == NULL, "World is still loading" );
+
+	// Gather the tiles row-major, then scatter them into the new layout; padding tiles are solid
+	std::vector< WorldTile > tiles( m_worldSize.x * m_worldSize.y );
+	for(int y = 0; y < m_worldSize.y; y++)
+	for(int x = 0; x < m_worldSize.x; x++)
+		tiles[ y * m_worldSize.x + x ] = m_worldMap[ GetTileIndex( x, y ) ];
+
+	InitLayout( layout );
+	WorldTile* newMap = new WorldTile[ m_tileArraySize ];
+	memset( newMap, WorldTile_Solid, m_tileArraySize * sizeof(WorldTile) );
+
+	for(int y = 0; y < m_worldSize.y; y++)
+	for(int x = 0; x < m_worldSize.x; x++)
+		newMap[ GetTileIndex( x, y ) ] = tiles[ y * m_worldSize.x + x ];
+
+	// Let go of the old tiles; mapped ones go with their mapping
+	if( m_mappedFile != NULL )
+	{
+		delete m_mappedFile;
+		m_mappedFile = NULL;
+	}
+	else
+	{
+		delete[] m_ownedTiles;
+	}
+
+	m_ownedTiles = newMap;
+	m_worldMap = newMap;
+	BuildOccupancy();
+}
+
+int World::InitLayout( WorldLayout layout )
+{
+	m_layout = layout;
+	m_mortonMaskX = m_mortonMaskY = m_mortonLowMask = 0;
+	m_mortonLowBits = 0;
+
+	if( layout == WorldLayout_RowMajor )
+	{
+		m_tileArraySize = m_worldSize.x * m_worldSize.y;
+		return m_tileArraySize;
+	}
+
+	// Bits needed for each block coordinate, once padded to a power of two; the
+	// border ring adds a tile on each side
+	int blockCountX = (m_worldSize.x + 2 + 7) >> 3;
+	int blockCountY = (m_worldSize.y + 2 + 7) >> 3;
+	int bitsX = 0, bitsY = 0;
+	while( (1 << bitsX) < blockCountX ) bitsX++;
+	while( (1 << bitsY) < blockCountY ) bitsY++;
+
+	// Interleave the bits both have, the longer side's extras go on top
+	int lowBits = min( bitsX, bitsY );
+	m_mortonLowBits = lowBits;
+	m_mortonLowMask = (1u << lowBits) - 1;
+	for(int i = 0; i < lowBits; i++)
+	{
+		m_mortonMaskX |= 1u << (2 * i);
+		m_mortonMaskY |= 1u << (2 * i + 1);
+	}
+	for(int i = lowBits; i < bitsX; i++)
+		m_mortonMaskX |= 1u << (lowBits + i);
+	for(int i = lowBits; i < bitsY; i++)
+		m_mortonMaskY |= 1u << (lowBits + i);
+
+	m_tileArraySize = (1 << (bitsX + bitsY)) * 64;
+	return m_tileArraySize;
+}
+
+bool World::IsStreamedTileSolid( int x, int y ) const
+{
+	// Chunks have no border ring; this is already the slow path
+	if( x < 0 || y < 0 || x >= m_worldSize.x || y >= m_worldSize.y )
+		return true;
+
+	return m_tileTypes.IsSolid( m_chunkCache->GetTile( x, y )->m_tileId );
+}
+
+Uint64 World::GetMemoryFootprint() const
+{
+	if( m_chunkCache != NULL )
+		return m_chunkCache->GetStats().m_residentBytes;
+
+	return (Uint64)m_tileArraySize * sizeof(WorldTile) + m_solidBits.size() * sizeof(Uint32);
+}
+
+void World::BuildOccupancy()
+{
+	// Streamed worlds don't have all tiles at hand
+	m_solidBits.clear();
+	m_solidStride = 0;
+	if( m_chunkCache != NULL )
+		return;
+
+	// Morton blocks are 64 tiles, so the tile array maps straight onto the bits
+	if( m_layout == WorldLayout_Morton )
+	{
+		m_solidBits.assign( (size_t)m_tileArraySize / 32, 0 );
+		for(int i = 0; i < m_tileArraySize; i++)
+		{
+			if( m_tileTypes.IsSolid( m_worldMap[i].m_tileId ) )
+				m_solidBits[i >> 5] |= (1u << (i & 31));
+		}
+		return;
+	}
+
+	// Row-major: rows and columns are shifted by one for the border ring
+	m_solidStride = GetOccupancyStride( m_worldSize.x );
+	m_solidBits.assign( (size_t)m_solidStride * (m_worldSize.y + 2), 0 );
+
+	// Worlds still loading are all solid, until their rows come in
+	if( m_textLoader != NULL )
+		m_solidBits.assign( m_solidBits.size(), ~0u );
+	else
+		BuildOccupancyRows( -1, m_worldSize.y + 2 );
+}
+
+void World::BuildOccupancyRows( int firstRow, int rowCount )
+{
+	for(int y = firstRow; y < firstRow + rowCount; y++)
+	{
+		Uint32* bits = &m_solidBits[(y + 1) * m_solidStride];
+		if( y >= 0 && y < m_worldSize.y )
+		{
+			BuildOccupancyRow( m_tileTypes, &m_worldMap[y * m_worldSize.x], m_worldSize.x, bits );
+			continue;
+		}
+
+		// Border rows are solid all the way
+		memset( bits, 0, m_solidStride * sizeof(Uint32) );
+		for(int x = 0; x < m_worldSize.x + 2; x++)
+			bits[x >> 5] |= (1u << (x & 31));
+	}
+}
+
+void World::BuildOccupancyRow( const TileTypeTable& tileTypes, const WorldTile* tiles, int width, Uint32* bits )
+{
+	// Bit 0 is the left border column, bit width + 1 the right one
+	memset( bits, 0, GetOccupancyStride( width ) * sizeof(Uint32) );
+	bits[0] = 1;
+	for(int x = 0; x < width; x++)
+	{
+		if( tileTypes.IsSolid( tiles[x].m_tileId ) )
+			bits[(x + 1) >> 5] |= (1u << ((x + 1) & 31));
+	}
+	bits[(width + 1) >> 5] |= (1u << ((width + 1) & 31));
+}
+
+void World::SetTile( int x, int y, Uint8 tileId )
+{
+	WorldRegion region = { x, y, 1, 1 };
+	SetRegion( region, &tileId );
+}
+
+void World::SetRegion( const WorldRegion& region, const Uint8* tileIds )
+{
+	UtilAssert( m_chunkCache == NULL, "Streamed worlds can't be edited" );
+	UtilAssert( m_textLoader == NULL, "World is still loading" );
+	UtilAssert( region.m_x >= 0 && region.m_y >= 0 && region.m_width >= 0 && region.m_height >= 0 &&
+		region.m_x + region.m_width <= m_worldSize.x && region.m_y + region.m_height <= m_worldSize.y, "Out of bounds world edit" );
+
+	if( m_mappedFile != NULL )
+		MakeWritable();
+
+	// Only the tiles that really changed count towards the dirty region
+	Vector2i changedMin( m_worldSize.x, m_worldSize.y );
+	Vector2i changedMax( -1, -1 );
+	for(int y = 0; y < region.m_height; y++)
+	for(int x = 0; x < region.m_width; x++)
+	{
+		int tileX = region.m_x + x;
+		int tileY = region.m_y + y;
+		if( WriteTile( tileX, tileY, tileIds[y * region.m_width + x] ) )
+		{
+			changedMin = Vector2i( min( changedMin.x, tileX ), min( changedMin.y, tileY ) );
+			changedMax = Vector2i( max( changedMax.x, tileX ), max( changedMax.y, tileY ) );
+		}
+	}
+
+	if( changedMax.x < 0 )
+		return;
+
+	WorldRegion dirtyRegion = { changedMin.x, changedMin.y, changedMax.x - changedMin.x + 1, changedMax.y - changedMin.y + 1 };
+	AddDirtyRegion( dirtyRegion );
+	m_revision++;
+}
+
+void World::FlushEdits()
+{
+	for(size_t i = 0; i < m_dirtyRegions.size(); i++)
+	for(size_t j = 0; j < m_listeners.size(); j++)
+		m_listeners[j]->OnWorldChanged( this, m_dirtyRegions[i] );
+
+	m_dirtyRegions.clear();
+}
+
+void World::AddListener( WorldListener* listener ) const
+{
+	m_listeners.push_back( listener );
+}
+
+void World::RemoveListener( WorldListener* listener ) const
+{
+	std::vector< WorldListener* >::iterator it = std::find( m_listeners.begin(), m_listeners.end(), listener );
+	if( it != m_listeners.end() )
+		m_listeners.erase( it );
+}
+
+void World::MakeWritable()
+{
+	WorldTile* tiles = new WorldTile[ m_tileArraySize ];
+	memcpy( tiles, m_worldMap, m_tileArraySize * sizeof(WorldTile) );
+
+	delete m_mappedFile;
+	m_mappedFile = NULL;
+	m_ownedTiles = tiles;
+	m_worldMap = tiles;
+}
+
+bool World::WriteTile( int x, int y, Uint8 tileId )
+{
+	UtilAssert( m_ownedTiles != NULL, "Mapped world tiles are read-only" );
+	WorldTile& tile = m_ownedTiles[GetTileIndex( x, y )];
+	if( tile.m_tileId == tileId )
+		return false;
+	tile.m_tileId = tileId;
+
+	// Same bit as IsSolid(...) reads
+	Uint32* word = NULL;
+	Uint32 bit = 0;
+	if( m_layout == WorldLayout_Morton )
+	{
+		int index = GetTileIndex( x, y );
+		word = &m_solidBits[ index >> 5 ];
+		bit = 1u << (index & 31);
+	}
+	else
+	{
+		word = &m_solidBits[ (y + 1) * m_solidStride + ((x + 1) >> 5) ];
+		bit = 1u << ((x + 1) & 31);
+	}
+
+	if( m_tileTypes.IsSolid( tileId ) )
+		*word |= bit;
+	else
+		*word &= ~bit;
+
+	return true;
+}
+
+void World::AddDirtyRegion( const WorldRegion& region )
+{
+	// Grow the new region over every region it overlaps or touches; each
+	// merge can make it reach others, so keep going until nothing is left
+	WorldRegion merged = region;
+	bool wasMerged = true;
+	while( wasMerged )
+	{
+		wasMerged = false;
+		for(size_t i = 0; i < m_dirtyRegions.size(); i++)
+		{
+			const WorldRegion& other = m_dirtyRegions[i];
+			if( other.m_x > merged.m_x + merged.m_width || merged.m_x > other.m_x + other.m_width ||
+				other.m_y > merged.m_y + merged.m_height || merged.m_y > other.m_y + other.m_height )
+				continue;
+
+			int minX = min( merged.m_x, other.m_x );
+			int minY = min( merged.m_y, other.m_y );
+			int maxX = max( merged.m_x + merged.m_width, other.m_x + other.m_width );
+			int maxY = max( merged.m_y + merged.m_height, other.m_y + other.m_height );
+			WorldRegion grown = { minX, minY, maxX - minX, maxY - minY };
+			merged = grown;
+
+			m_dirtyRegions.erase( m_dirtyRegions.begin() + i );
+			wasMerged = true;
+			break;
+		}
+	}
+
+	m_dirtyRegions.push_back( merged );
+}
+
+void World::UpdateStreaming( const Vector3f& position )
+{
+	if( m_textLoader != NULL )
+		InstallLoadedRows();
+
+	if( m_chunkCache == NULL )
+		return;
+
+	m_chunkCache->Update( position );
+
+	// Chunks coming and going change what the tiles read as, just like edits
+	std::vector< WorldRegion > changedRegions;
+	m_chunkCache->PopChangedRegions( changedRegions );
+	for(size_t i = 0; i < changedRegions.size(); i++)
+		AddDirtyRegion( changedRegions[i] );
+
+	if( !changedRegions.empty() )
+		m_revision++;
+}
+
+float World::GetLoadProgress() const
+{
+	return (m_textLoader != NULL) ? m_textLoader->GetProgress() : 1.0f;
+}
+
+void World::InstallLoadedRows()
+{
+	// Check for completion first, so no band can slip in between the last pop and the check
+	bool isDone = m_textLoader->IsDone();
+
+	std::vector< WorldTextBand > bands;
+	m_textLoader->PopLoadedBands( bands );
+	for(size_t i = 0; i < bands.size(); i++)
+	{
+		const WorldTextBand& band = bands[i];
+		memcpy( &m_ownedTiles[band.m_firstRow * m_worldSize.x], band.m_tiles, band.m_rowCount * m_worldSize.x * sizeof(WorldTile) );
+		memcpy( &m_solidBits[(band.m_firstRow + 1) * m_solidStride], band.m_solidBits, band.m_rowCount * m_solidStride * sizeof(Uint32) );
+		delete[] band.m_tiles;
+		delete[] band.m_solidBits;
+
+		WorldRegion region = { 0, band.m_firstRow, m_worldSize.x, band.m_rowCount };
+		AddDirtyRegion( region );
+	}
+
+	if( !bands.empty() )
+		m_revision++;
+
+	if( isDone )
+	{
+		m_loadTime = m_textLoader->GetLoadTime();
+		delete m_textLoader;
+		m_textLoader = NULL;
+	}
+}
+
+const std::string* World::GetMetadata( const std::string& tag ) const
+{
+	std::map< std::string, std::string >::const_iterator it = m_metadata.find( tag );
+	return (it != m_metadata.end()) ? &(it->second) : NULL;
+}
+
+void World::LoadText( FILE* file )
+{
     // World size
     fscanf(file, "%d %d", &m_worldSize.x, &m_worldSize.y);
 	
     // World buffer (N: characters in row, M: number of rows)
-    m_worldMap = new WorldTile[ m_worldSize.x * m_worldSize.y ];
+    InitLayout( WorldLayout_RowMajor );
+    m_ownedTiles = new WorldTile[ m_tileArraySize ];
+    m_worldMap = m_ownedTiles;
     for(int m = 0; m < m_worldSize.y; m++)
     for(int n = 0; n < m_worldSize.x; n++)
     {
         char temp = ' ';
-        while( (temp = getc(file)) == '\n' );
-        m_worldMap[m * m_worldSize.x + n].m_tileId = temp;
+        while( (temp = getc(file)) == '\n' || temp == '\r' );
+        m_ownedTiles[GetTileIndex( n, m )].m_tileId = (Uint8)temp;
     }
+}
+
+void World::LoadBinary( const std::string& worldFileName )
+{
+	// Map the whole file; tiles are paged in by the OS as they get touched
+	m_mappedFile = new UtilMappedFile();
+	UtilAssert( m_mappedFile->Open( worldFileName.c_str() ), "Unable to map world file \"%s\"", worldFileName.c_str() );
+
+	const Uint8* fileData = (const Uint8*)m_mappedFile->GetData();
+	Uint64 fileSize = m_mappedFile->GetSize();
+
+	// Validate the header before trusting any of the offsets
+	const WorldFileHeader* header = (const WorldFileHeader*)fileData;
+	UtilAssert( fileSize >= sizeof(WorldFileHeader) && header->m_headerSize >= sizeof(WorldFileHeader), "Truncated world file header" );
+	UtilAssert( header->m_version >= 2 && header->m_version <= WorldFile_Version, "Unsupported world file version %u; convert it again from the text world", header->m_version );
+	UtilAssert( header->m_tileSize == sizeof(WorldTile), "World file tile size mismatch" );
+	UtilAssert( header->m_width > 0 && header->m_height > 0, "Invalid world size" );
+
+	// Version 2 predates layouts, and is always row-major
+	WorldLayout layout = (header->m_version == 2) ? WorldLayout_RowMajor : (WorldLayout)header->m_layout;
+	UtilAssert( layout == WorldLayout_RowMajor || layout == WorldLayout_Morton, "Unknown world file layout %u", header->m_layout );
+	UtilAssert( header->m_version >= 4 || layout == WorldLayout_RowMajor, "Morton world file predates the border ring; convert it again from the text world" );
+
+	m_worldSize = Vector2i( header->m_width, header->m_height );
+	Uint64 tileArraySize = (Uint64)InitLayout( layout ) * sizeof(WorldTile);
+	UtilAssert( header->m_tileArraySize == tileArraySize && header->m_tileArrayOffset <= fileSize && tileArraySize <= fileSize - header->m_tileArrayOffset, "Truncated world file tile array" );
+	UtilAssert( header->m_tileArrayOffset % WorldFile_Alignment == 0, "Misaligned world file tile array" );
+
+	// Use the tile array in place: no parse, no copy. The mapping is read-only, so
+	// the tiles stay const; edits copy them into memory first (see MakeWritable)
+	m_worldMap = (const WorldTile*)(fileData + header->m_tileArrayOffset);
+
+	// Metadata sections are small, copy them out
+	Uint64 sectionOffset = header->m_sectionTableOffset;
+	for(Uint32 i = 0; i < header->m_sectionCount; i++)
+	{
+		UtilAssert( sectionOffset <= fileSize && sizeof(WorldFileSection) <= fileSize - sectionOffset, "Truncated world file section" );
+		const WorldFileSection* section = (const WorldFileSection*)(fileData + sectionOffset);
+		sectionOffset += sizeof(WorldFileSection);
+
+		UtilAssert( section->m_size <= fileSize - sectionOffset, "Truncated world file section" );
+		std::string tag( section->m_tag, sizeof(section->m_tag) );
+		m_metadata[tag] = std::string( (const char*)(fileData + sectionOffset), (size_t)section->m_size );
+		sectionOffset += section->m_size;
+	}
+}
+
+void World::LoadChunked( const std::string& worldFileName )
+{
+	// Nothing is read yet besides the header and index; see UpdateStreaming(...)
+	m_chunkCache = new WorldChunkCache( worldFileName );
+	m_worldSize = m_chunkCache->GetWorldSize();
+	InitLayout( WorldLayout_RowMajor );
+}
+
+void World::LoadCompressed( const std::string& worldFileName )
+{
+	// Every block is decompressed straight into the row-major tile array, rows
+	// of blocks in parallel
+	WorldBlockFile blockFile( worldFileName );
+	m_worldSize = blockFile.GetWorldSize();
+	InitLayout( WorldLayout_RowMajor );
+	m_ownedTiles = new WorldTile[ m_tileArraySize ];
+	m_worldMap = m_ownedTiles;
+
+	ThreadPool threadPool;
+	WorldRegion region = { 0, 0, m_worldSize.x, m_worldSize.y };
+	UtilAssert( blockFile.ReadRegion( region, m_ownedTiles, m_worldSize.x, &threadPool ), "Corrupt compressed world file \"%s\"", worldFileName.c_str() );
+
+	blockFile.ReadMetadata( m_metadata );
+}
+
+bool World::WriteSections( FILE* file ) const
+{
+	bool isValid = true;
+	for(std::map< std::string, std::string >::const_iterator it = m_metadata.begin(); it != m_metadata.end(); ++it)
+	{
+		WorldFileSection section;
+		memset( &section, 0, sizeof(section) );
+		memcpy( section.m_tag, it->first.c_str(), min( it->first.length(), sizeof(section.m_tag) ) );
+		section.m_size = it->second.length();
+
+		isValid &= fwrite( &section, sizeof(section), 1, file ) == 1;
+		isValid &= fwrite( it->second.data(), 1, it->second.length(), file ) == it->second.length();
+	}
+	return isValid;
+}
+
+bool World::SaveText( const std::string& worldFileName ) const
+{
+	UtilAssert( m_chunkCache == NULL, "Streamed worlds can't be saved" );
+	UtilAssert( m_textLoader == NULL, "World is still loading" );
+
+	FILE* file = fopen(worldFileName.c_str(), "wb");
+	if( file == NULL )
+		return false;
+
+	// Size, then one line of tile characters per row
+	bool isValid = fprintf( file, "%d %d\n", m_worldSize.x, m_worldSize.y ) > 0;
+
+	std::vector< char > row( m_worldSize.x + 1, '\n' );
+	for(int y = 0; y < m_worldSize.y && isValid; y++)
+	{
+		for(int x = 0; x < m_worldSize.x; x++)
+			row[x] = (char)m_worldMap[GetTileIndex( x, y )].m_tileId;
+		isValid = fwrite( &row[0], 1, row.size(), file ) == row.size();
+	}
 
 	fclose(file);
+	return isValid;
 }
 
-World::~World()
+bool World::SaveBinary( const std::string& worldFileName ) const
 {
-	if( m_worldMap != NULL )
-		delete[] m_worldMap;
+	UtilAssert( m_chunkCache == NULL, "Streamed worlds can't be saved" );
+	UtilAssert( m_textLoader == NULL, "World is still loading" );
+
+	FILE* file = fopen(worldFileName.c_str(), "wb");
+	if( file == NULL )
+		return false;
+
+	// Build the tile-type table; layout padding isn't counted
+	std::vector< Uint32 > tileCounts( 256, 0 );
+	for(int y = 0; y < m_worldSize.y; y++)
+	for(int x = 0; x < m_worldSize.x; x++)
+		tileCounts[ m_worldMap[GetTileIndex( x, y )].m_tileId ]++;
+
+	std::vector< WorldFileTileType > tileTypes;
+	for(int tileId = 0; tileId < 256; tileId++)
+	{
+		if( tileCounts[tileId] == 0 )
+			continue;
+
+		WorldFileTileType tileType = { tileId, tileCounts[tileId] };
+		tileTypes.push_back( tileType );
+	}
+
+	// Lay out the file: header, tile types, aligned tile array, then sections
+	WorldFileHeader header;
+	memset( &header, 0, sizeof(header) );
+	memcpy( header.m_magic, WorldFile_Magic, sizeof(header.m_magic) );
+	header.m_version = WorldFile_Version;
+	header.m_headerSize = sizeof(WorldFileHeader);
+	header.m_width = m_worldSize.x;
+	header.m_height = m_worldSize.y;
+	header.m_tileSize = sizeof(WorldTile);
+	header.m_tileTypeCount = (Uint32)tileTypes.size();
+	header.m_tileTypeOffset = sizeof(WorldFileHeader);
+
+	Uint64 tileTypesEnd = header.m_tileTypeOffset + tileTypes.size() * sizeof(WorldFileTileType);
+	header.m_tileArrayOffset = (tileTypesEnd + WorldFile_Alignment - 1) / WorldFile_Alignment * WorldFile_Alignment;
+	header.m_tileArraySize = (Uint64)m_tileArraySize * sizeof(WorldTile);
+	header.m_sectionCount = (Uint32)m_metadata.size();
+	header.m_layout = (Uint32)m_layout;
+	header.m_sectionTableOffset = header.m_tileArrayOffset + header.m_tileArraySize;
+
+	bool isValid = fwrite( &header, sizeof(header), 1, file ) == 1;
+	if( !tileTypes.empty() )
+		isValid &= fwrite( &tileTypes[0], sizeof(WorldFileTileType), tileTypes.size(), file ) == tileTypes.size();
+
+	static const char padding[WorldFile_Alignment] = { 0 };
+	isValid &= fwrite( padding, 1, (size_t)(header.m_tileArrayOffset - tileTypesEnd), file ) == (size_t)(header.m_tileArrayOffset - tileTypesEnd);
+	isValid &= fwrite( m_worldMap, sizeof(WorldTile), m_tileArraySize, file ) == (size_t)m_tileArraySize;
+	isValid &= WriteSections( file );
+
+	fclose(file);
+	return isValid;
 }
 
-const WorldTile* World::GetWorldTile( int x, int y ) const
+bool World::SaveChunked( const std::string& worldFileName, int chunkSize ) const
 {
-	UtilAssert( x >= 0 && x < m_worldSize.x && y >= 0 && y < m_worldSize.y, "Out of bounds world-tile access" );
-	return &(m_worldMap[y * m_worldSize.x + x]);
+	UtilAssert( m_chunkCache == NULL, "Streamed worlds can't be saved" );
+	UtilAssert( m_textLoader == NULL, "World is still loading" );
+	UtilAssert( chunkSize > 0 && (chunkSize & (chunkSize - 1)) == 0, "Chunk size must be a power of two" );
+
+	FILE* file = fopen(worldFileName.c_str(), "wb");
+	if( file == NULL )
+		return false;
+
+	WorldChunkFileHeader header;
+	memset( &header, 0, sizeof(header) );
+	memcpy( header.m_magic, WorldChunkFile_Magic, sizeof(header.m_magic) );
+	header.m_version = WorldChunkFile_Version;
+	header.m_headerSize = sizeof(WorldChunkFileHeader);
+	header.m_width = m_worldSize.x;
+	header.m_height = m_worldSize.y;
+	header.m_tileSize = sizeof(WorldTile);
+	header.m_chunkSize = chunkSize;
+	header.m_chunkCountX = (m_worldSize.x + chunkSize - 1) / chunkSize;
+	header.m_chunkCountY = (m_worldSize.y + chunkSize - 1) / chunkSize;
+
+	// Chunks follow the header back to back, then the index
+	Uint64 chunkBytes = (Uint64)chunkSize * (Uint64)chunkSize * sizeof(WorldTile);
+	std::vector< WorldChunkFileEntry > index( header.m_chunkCountX * header.m_chunkCountY );
+	header.m_indexOffset = sizeof(WorldChunkFileHeader) + index.size() * chunkBytes;
+
+	bool isValid = fwrite( &header, sizeof(header), 1, file ) == 1;
+
+	std::vector< WorldTile > chunk( chunkSize * chunkSize );
+	for(int chunkY = 0; chunkY < header.m_chunkCountY; chunkY++)
+	for(int chunkX = 0; chunkX < header.m_chunkCountX; chunkX++)
+	{
+		// Edge chunks are padded out with solid tiles
+		for(int y = 0; y < chunkSize; y++)
+		for(int x = 0; x < chunkSize; x++)
+		{
+			int worldX = chunkX * chunkSize + x;
+			int worldY = chunkY * chunkSize + y;
+			bool isInside = (worldX < m_worldSize.x && worldY < m_worldSize.y);
+			chunk[y * chunkSize + x].m_tileId = isInside ? m_worldMap[GetTileIndex( worldX, worldY )].m_tileId : WorldTile_Solid;
+		}
+
+		WorldChunkFileEntry& entry = index[chunkY * header.m_chunkCountX + chunkX];
+		entry.m_offset = sizeof(WorldChunkFileHeader) + (chunkY * header.m_chunkCountX + chunkX) * chunkBytes;
+		entry.m_size = chunkBytes;
+		isValid &= fwrite( &chunk[0], sizeof(WorldTile), chunk.size(), file ) == chunk.size();
+	}
+
+	isValid &= fwrite( &index[0], sizeof(WorldChunkFileEntry), index.size(), file ) == index.size();
+
+	fclose(file);
+	return isValid;
+}
+
+bool World::SaveCompressed( const std::string& worldFileName, int blockSize ) const
+{
+	UtilAssert( m_chunkCache == NULL, "Streamed worlds can't be saved" );
+	UtilAssert( m_textLoader == NULL, "World is still loading" );
+	UtilAssert( blockSize >= 8 && (blockSize & (blockSize - 1)) == 0, "Block size must be a power of two, at least 8" );
+
+	FILE* file = fopen(worldFileName.c_str(), "wb");
+	if( file == NULL )
+		return false;
+
+	WorldBlockFileHeader header;
+	memset( &header, 0, sizeof(header) );
+	memcpy( header.m_magic, WorldBlockFile_Magic, sizeof(header.m_magic) );
+	header.m_version = WorldBlockFile_Version;
+	header.m_headerSize = sizeof(WorldBlockFileHeader);
+	header.m_width = m_worldSize.x;
+	header.m_height = m_worldSize.y;
+	header.m_tileSize = sizeof(WorldTile);
+	header.m_blockSize = blockSize;
+	header.m_blockCountX = (m_worldSize.x + blockSize - 1) / blockSize;
+	header.m_blockCountY = (m_worldSize.y + blockSize - 1) / blockSize;
+	header.m_sectionCount = (Uint32)m_metadata.size();
+
+	// Block sizes are only known once compressed, so the header goes in last
+	bool isValid = fwrite( &header, sizeof(header), 1, file ) == 1;
+
+	// One row of blocks at a time: gathered (edge blocks padded out with solid
+	// tiles), compressed in parallel, then written in order
+	int pitch = header.m_blockCountX * blockSize;
+	std::vector< WorldTile > blockRowTiles( pitch * blockSize );
+	std::vector< std::vector< Uint8 > > blockData( header.m_blockCountX );
+	std::vector< WorldCodec > codecs( header.m_blockCountX );
+	std::vector< WorldBlockFileEntry > index( header.m_blockCountX * header.m_blockCountY );
+	Uint64 offset = sizeof(WorldBlockFileHeader);
+
+	ThreadPool threadPool;
+	for(int blockY = 0; blockY < header.m_blockCountY && isValid; blockY++)
+	{
+		for(int y = 0; y < blockSize; y++)
+		for(int x = 0; x < pitch; x++)
+		{
+			int worldY = blockY * blockSize + y;
+			bool isInside = (x < m_worldSize.x && worldY < m_worldSize.y);
+			blockRowTiles[y * pitch + x].m_tileId = isInside ? m_worldMap[GetTileIndex( x, worldY )].m_tileId : WorldTile_Solid;
+		}
+
+		for(int blockX = 0; blockX < header.m_blockCountX; blockX++)
+			threadPool.Push( new WorldBlockCompressJob( &blockRowTiles[blockX * blockSize], pitch, blockSize, &blockData[blockX], &codecs[blockX] ) );
+		threadPool.WaitAll();
+
+		for(int blockX = 0; blockX < header.m_blockCountX; blockX++)
+		{
+			WorldBlockFileEntry& entry = index[blockY * header.m_blockCountX + blockX];
+			entry.m_offset = offset;
+			entry.m_size = (Uint32)blockData[blockX].size();
+			entry.m_codec = (Uint32)codecs[blockX];
+			isValid &= fwrite( &blockData[blockX][0], 1, blockData[blockX].size(), file ) == blockData[blockX].size();
+			offset += entry.m_size;
+		}
+	}
+
+	// The index sits on an 8-byte boundary, then come the sections
+	static const char padding[sizeof(Uint64)] = { 0 };
+	header.m_indexOffset = (offset + sizeof(Uint64) - 1) / sizeof(Uint64) * sizeof(Uint64);
+	header.m_sectionTableOffset = header.m_indexOffset + index.size() * sizeof(WorldBlockFileEntry);
+	isValid &= fwrite( padding, 1, (size_t)(header.m_indexOffset - offset), file ) == (size_t)(header.m_indexOffset - offset);
+	isValid &= fwrite( &index[0], sizeof(WorldBlockFileEntry), index.size(), file ) == index.size();
+	isValid &= WriteSections( file );
+
+	isValid &= fseek( file, 0, SEEK_SET ) == 0;
+	isValid &= fwrite( &header, sizeof(header), 1, file ) == 1;
+
+	fclose(file);
+	return isValid;
 }
@@ -16,15 +16,77 @@
 #ifndef __WORLD_H__
 #define __WORLD_H__
 
+#include <map>
+
+#include <vector>
+
 #include "Utilities.h"
 #include "VectorMath.h"
+#include "TileTypes.h"
+
+// Bit-deposit instruction (BMI2), used for Morton indices when the compiler targets it
+#if defined(__BMI2__)
+	#include <immintrin.h>
+#endif
+
+// Tile ids with a fixed meaning
+static const Uint8 WorldTile_Empty = ' ';
+static const Uint8 WorldTile_Solid = 'x';		// Also what any not-yet-loaded tile reads as
 
-// World tile (the block at the given location)
+// World tile (the block at the given location); a single byte, so that
+// an array of tiles is simply an array of tile ids
 class WorldTile
 {
 public:
 
-	int m_tileId;
+	Uint8 m_tileId;
+
+};
+
+// How the tiles are laid out in memory (and in binary world files)
+enum WorldLayout
+{
+	WorldLayout_RowMajor,	// y * width + x
+	WorldLayout_Morton,		// 8x8-tile (64 byte) blocks, the blocks themselves in Morton (Z) order
+};
+
+// Spreads the low 16 bits of the given value out to the even bits; the
+// building block of Morton (bit-interleaved) indices
+static inline Uint32 WorldSpreadBits( Uint32 value )
+{
+	value = (value | (value << 8)) & 0x00FF00FF;
+	value = (value | (value << 4)) & 0x0F0F0F0F;
+	value = (value | (value << 2)) & 0x33333333;
+	value = (value | (value << 1)) & 0x55555555;
+	return value;
+}
+
+// A rectangle of tiles: from (m_x, m_y) up to, but not including,
+// (m_x + m_width, m_y + m_height)
+struct WorldRegion
+{
+	int m_x, m_y;
+	int m_width, m_height;
+};
+
+class World;
+
+// Streams chunked worlds
+class WorldChunkCache;
+
+// Loads text worlds in the background
+class WorldTextLoader;
+
+// Subscriber to world edits; anything caching data derived from the tiles
+// (textures, acceleration structures) implements this to rebuild only what changed
+class WorldListener
+{
+public:
+
+	virtual ~WorldListener() { }
+
+	// Called from World::FlushEdits(), once per dirty region
+	virtual void OnWorldChanged( const World* world, const WorldRegion& region ) = 0;
 
 };
 
@@ -33,21 +95,250 @@ class World
 {
 public:
 
-	// Construct from a text file
-	World( const std::string& worldFileName );
+	// Construct from a world file; either the text format, the binary format
+	// (see WorldFile.h) which is memory-mapped and used in place, the compressed
+	// format which is decompressed in parallel, or the chunked format which is
+	// streamed in around the player (see UpdateStreaming).
+	// With a background load, text worlds return as soon as their size is
+	// known, all solid, and their rows then arrive through UpdateStreaming,
+	// those around the load origin first (see WorldTextLoader.h); the other
+	// formats don't need it and load as usual. Tiles follow the given tile
+	// types (see TileTypes.h), the built-in ones by default
+	World( const std::string& worldFileName, bool isBackgroundLoad = false, const Vector2i& loadOrigin = Vector2i( 0, 0 ), const TileTypeTable& tileTypes = TileTypeTable() );
+
+	// Construct from the given row-major tiles, allocated with new WorldTile[width * height];
+	// the tiles are gifted to the world
+	World( const Vector2i& worldSize, WorldTile* tiles, const TileTypeTable& tileTypes = TileTypeTable() );
 	~World();
 
+	// True if the given file is a text world, rather than one of the binary formats
+	static bool IsTextFile( const std::string& worldFileName );
+
+	// Write the world out in the text format; returns false on failure
+	bool SaveText( const std::string& worldFileName ) const;
+
+	// Write the world out in the binary format; returns false on failure
+	bool SaveBinary( const std::string& worldFileName ) const;
+
+	// Write the world out in the chunked format, with the given chunk edge
+	// length (a power of two); returns false on failure
+	bool SaveChunked( const std::string& worldFileName, int chunkSize ) const;
+
+	// Write the world out in the compressed format, with the given block edge
+	// length (a power of two, at least 8); blocks are compressed in parallel.
+	// Returns false on failure
+	bool SaveCompressed( const std::string& worldFileName, int blockSize ) const;
+
+	// Chunked worlds: pages chunks in and out around the given position. Text
+	// worlds loading in the background: takes in the rows loaded so far. Should
+	// be called once per frame; does nothing for other worlds. Chunks and rows
+	// that come and go are reported as dirty regions, like edits
+	void UpdateStreaming( const Vector3f& position );
+
+	// Row-major occupancy bitmap: words per row, for a world of the given width,
+	// and the bits of one row of tiles, its two border ring columns included.
+	// Public so that rows loaded in the background get their bits off the main thread
+	static int GetOccupancyStride( int width ) { return (width + 2 + 31) / 32; }
+	static void BuildOccupancyRow( const TileTypeTable& tileTypes, const WorldTile* tiles, int width, Uint32* bits );
+
+	// Background loads: true until every row was taken in, and how far along
+	// it is (0 to 1; 1 for any world not loading). The load time, once done
+	bool IsLoading() const { return m_textLoader != NULL; }
+	float GetLoadProgress() const;
+	float GetLoadTime() const { return m_loadTime; }
+
+	// The chunk streamer of chunked worlds; NULL for any other world
+	WorldChunkCache* GetChunkCache() const { return m_chunkCache; }
+
+	// Properties of each tile id
+	const TileTypeTable& GetTileTypes() const { return m_tileTypes; }
+
+	// True if the tile at the given position blocks rays; reads the packed
+	// occupancy bitmap, so this is meant for ray traversal. The bitmap has a
+	// solid one-tile border ring around the map, so positions from -1 up to
+	// the world size (inclusive) are valid, and a ray walking one tile at a
+	// time from a tile on the map (see IsOnMap) always hits before leaving it.
+	// Only checked in debug builds
+	inline bool IsSolid( int x, int y ) const
+	{
+	#if defined(_DEBUG)
+		UtilAssert( x >= -1 && x <= m_worldSize.x && y >= -1 && y <= m_worldSize.y, "Out of bounds occupancy access" );
+	#endif
+
+		if( m_chunkCache != NULL )
+			return IsStreamedTileSolid( x, y );
+
+		// Morton: the bitmap follows the tile array, each 8x8 block being two words
+		if( m_layout == WorldLayout_Morton )
+		{
+			int index = GetTileIndex( x, y );
+			return ((m_solidBits[ index >> 5 ] >> (index & 31)) & 1) != 0;
+		}
+
+		x++;
+		y++;
+		return ((m_solidBits[ y * m_solidStride + (x >> 5) ] >> (x & 31)) & 1) != 0;
+	}
+
+	// Tile at the given in-bounds position, without any checks, for traversal
+	// code that already knows where it is; not for streamed worlds
+	inline const WorldTile* GetWorldTileUnchecked( int x, int y ) const
+	{
+		return &(m_worldMap[GetTileIndex( x, y )]);
+	}
+
+	// Memory layout of the tiles and occupancy bitmap; text worlds load row-major,
+	// binary worlds in whatever layout they were saved in. Changing it re-lays out
+	// the whole map (a mapped binary world gets copied into memory)
+	void SetLayout( WorldLayout layout );
+	WorldLayout GetLayout() const { return m_layout; }
+
+	// Bytes used by the tiles and the occupancy bitmap (resident chunks only, if streamed)
+	Uint64 GetMemoryFootprint() const;
+
+	// Optional metadata, keyed by a four-character tag; saved with binary worlds
+	void SetMetadata( const std::string& tag, const std::string& data ) { m_metadata[tag] = data; }
+	const std::string* GetMetadata( const std::string& tag ) const;
+
 	// Get world size
 	const Vector2i GetWorldSize() const { return m_worldSize; }
 
+	// True if the given tile is on the map, rather than on its border ring or
+	// beyond; rays must start on it, as only then are they stopped by the ring
+	bool IsOnMap( int x, int y ) const { return x >= 0 && y >= 0 && x < m_worldSize.x && y < m_worldSize.y; }
+
 	// Get tile at given world position
 	const WorldTile* GetWorldTile( int x, int y ) const;
 
+	/*** Edits ***/
+
+	// Changes a single tile, or a region of tiles (from a row-major array of
+	// region width * region height ids); not for streamed worlds. A mapped
+	// binary world gets copied into memory on its first edit
+	void SetTile( int x, int y, Uint8 tileId );
+	void SetRegion( const WorldRegion& region, const Uint8* tileIds );
+
+	// Bumped by every edit that changed at least one tile
+	Uint32 GetRevision() const { return m_revision; }
+
+	// Regions edited since the last flush; overlapping and touching edits are
+	// merged, so this stays a short list
+	const std::vector< WorldRegion >& GetDirtyRegions() const { return m_dirtyRegions; }
+
+	// Passes each dirty region to all listeners, then clears them; call once
+	// per frame, so that many small edits are handled together
+	void FlushEdits();
+
+	// Listeners don't change the world itself, so const worlds can be
+	// subscribed to; the world does not own its listeners
+	void AddListener( WorldListener* listener ) const;
+	void RemoveListener( WorldListener* listener ) const;
+
 protected:
 
-	// 2D array where it's allocated through a new WorldTile[width * height] call
-	WorldTile* m_worldMap;
+	// Format-specific loaders
+	void LoadText( FILE* file );
+	void LoadBinary( const std::string& worldFileName );
+	void LoadChunked( const std::string& worldFileName );
+	void LoadCompressed( const std::string& worldFileName );
+
+	// Writes the metadata sections (see WorldFileSection); returns false on failure
+	bool WriteSections( FILE* file ) const;
+
+	// Rebuilds the occupancy bitmap from the tiles and tile types
+	void BuildOccupancy();
+
+	// Row-major only: rebuilds the occupancy bits of the given rows
+	void BuildOccupancyRows( int firstRow, int rowCount );
+
+	// Copies in the rows, and their occupancy bits, loaded in the background so far
+	void InstallLoadedRows();
+
+	// Streamed worlds have no occupancy bitmap; goes through the tile types instead
+	bool IsStreamedTileSolid( int x, int y ) const;
+
+	// Copies a mapped tile array into memory, so it can be edited
+	void MakeWritable();
+
+	// Writes a tile and its occupancy bit; returns true if the tile changed
+	bool WriteTile( int x, int y, Uint8 tileId );
+
+	// Adds the given region to the dirty list, merging it with the regions it touches
+	void AddDirtyRegion( const WorldRegion& region );
+
+	// Sets up the layout for the current world size, and returns how many
+	// tiles the tile array must hold (Morton adds the border ring, and pads
+	// to powers of two)
+	int InitLayout( WorldLayout layout );
+
+	// Index of the 8x8 block at the given block coordinates, in Morton order: the
+	// low bits of both coordinates are interleaved, the longer side's extra
+	// high bits are simply placed above them
+	inline Uint32 GetBlockIndex( int blockX, int blockY ) const
+	{
+	#if defined(__BMI2__)
+		return _pdep_u32( (Uint32)blockX, m_mortonMaskX ) | _pdep_u32( (Uint32)blockY, m_mortonMaskY );
+	#else
+		Uint32 low = WorldSpreadBits( blockX & m_mortonLowMask ) | (WorldSpreadBits( blockY & m_mortonLowMask ) << 1);
+		return low | (((Uint32)(blockX | blockY) >> m_mortonLowBits) << (m_mortonLowBits << 1));
+	#endif
+	}
+
+	// Index of the given tile in the tile array, for the current layout; Morton
+	// arrays start with the border ring, so they are offset by one tile
+	inline int GetTileIndex( int x, int y ) const
+	{
+		if( m_layout == WorldLayout_Morton )
+		{
+			x++;
+			y++;
+			return (int)((GetBlockIndex( x >> 3, y >> 3 ) << 6) | ((y & 7) << 3) | (x & 7));
+		}
+
+		return y * m_worldSize.x + x;
+	}
+
+	// 2D array where it's allocated through a new WorldTile[m_tileArraySize] call,
+	// or points directly into the read-only mapped file for binary worlds. Only
+	// the allocated array is ever written, through m_ownedTiles, which is NULL
+	// while the tiles are mapped
+	const WorldTile* m_worldMap;
+	WorldTile* m_ownedTiles;
 	Vector2i m_worldSize;
+	int m_tileArraySize;
+
+	// Layout of the tile array and occupancy bitmap; the masks place the block
+	// coordinate bits of the Morton index (see GetBlockIndex)
+	WorldLayout m_layout;
+	Uint32 m_mortonMaskX;
+	Uint32 m_mortonMaskY;
+	Uint32 m_mortonLowMask;
+	int m_mortonLowBits;
+
+	// Backing file of a binary world; NULL if the map was loaded into memory
+	UtilMappedFile* m_mappedFile;
+
+	// Chunk streamer of a chunked world, which then owns all the tiles; NULL otherwise
+	WorldChunkCache* m_chunkCache;
+
+	// Background loader of a text world, until it is done; NULL otherwise
+	WorldTextLoader* m_textLoader;
+	float m_loadTime;
+
+	// Tile id properties, and the packed 1-bit "is solid" occupancy of each tile
+	// derived from them, border ring included; in row-major layout each row
+	// starts on a new 32-bit word, in Morton layout each 8x8 block is two words
+	TileTypeTable m_tileTypes;
+	std::vector< Uint32 > m_solidBits;
+	int m_solidStride;
+
+	// Tag to data
+	std::map< std::string, std::string > m_metadata;
+
+	// Edit tracking
+	Uint32 m_revision;
+	std::vector< WorldRegion > m_dirtyRegions;
+	mutable std::vector< WorldListener* > m_listeners;
 
 };
 
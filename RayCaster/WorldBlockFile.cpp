@@ -0,0 +1,188 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+
+***************************************************************/
+
+#include "WorldBlockFile.h"
+#include "WorldCodec.h"
+
+/*** Private ***/
+
+class WorldBlockFile::BlockRowJob : public ThreadJob
+{
+public:
+
+	BlockRowJob( const WorldBlockFile* blockFile, int blockY, const WorldRegion& region, WorldTile* tiles, int pitch, Uint8* result )
+		: m_blockFile( blockFile )
+		, m_blockY( blockY )
+		, m_region( region )
+		, m_tiles( tiles )
+		, m_pitch( pitch )
+		, m_result( result )
+	{
+	}
+
+	void Run()
+	{
+		// Each job writes its own result, so no locking is needed
+		std::vector< WorldTile > scratchTiles( m_blockFile->GetScratchSize( m_region ) );
+		*m_result = m_blockFile->ReadBlockRow( m_blockY, m_region, m_tiles, m_pitch, &scratchTiles[0] ) ? 1 : 0;
+	}
+
+private:
+
+	const WorldBlockFile* m_blockFile;
+	int m_blockY;
+	WorldRegion m_region;
+	WorldTile* m_tiles;
+	int m_pitch;
+	Uint8* m_result;
+
+};
+
+bool WorldBlockFile::ReadBlockRow( int blockY, const WorldRegion& region, WorldTile* tiles, int pitch, WorldTile* scratchTiles ) const
+{
+	int firstBlockX = region.m_x >> m_blockShift;
+	int lastBlockX = (region.m_x + region.m_width - 1) >> m_blockShift;
+	int blockTileCount = m_blockSize * m_blockSize;
+	for(int blockX = firstBlockX; blockX <= lastBlockX; blockX++)
+	{
+		if( !ReadBlock( blockX, blockY, &scratchTiles[ (blockX - firstBlockX) * blockTileCount ] ) )
+			return false;
+	}
+
+	// Copy out a whole row at a time, so that the writes stay sequential
+	int firstY = max( region.m_y, blockY * m_blockSize );
+	int lastY = min( region.m_y + region.m_height, (blockY + 1) * m_blockSize );
+	for(int y = firstY; y < lastY; y++)
+	{
+		WorldTile* rowTiles = &tiles[ (y - region.m_y) * pitch ];
+		for(int blockX = firstBlockX; blockX <= lastBlockX; blockX++)
+		{
+			int firstX = max( region.m_x, blockX * m_blockSize );
+			int lastX = min( region.m_x + region.m_width, (blockX + 1) * m_blockSize );
+			const WorldTile* source = &scratchTiles[ (blockX - firstBlockX) * blockTileCount + (y - blockY * m_blockSize) * m_blockSize + (firstX - blockX * m_blockSize) ];
+			memcpy( &rowTiles[ firstX - region.m_x ], source, (lastX - firstX) * sizeof(WorldTile) );
+		}
+	}
+
+	return true;
+}
+
+/*** Public ***/
+
+WorldBlockFile::WorldBlockFile( const std::string& worldFileName )
+	: m_fileData( NULL )
+	, m_worldSize( 0, 0 )
+	, m_blockSize( 0 )
+	, m_blockShift( 0 )
+	, m_blockCount( 0, 0 )
+	, m_index( NULL )
+	, m_sectionCount( 0 )
+	, m_sectionTableOffset( 0 )
+{
+	UtilAssert( m_mappedFile.Open( worldFileName.c_str() ), "Unable to map world file \"%s\"", worldFileName.c_str() );
+	m_fileData = (const Uint8*)m_mappedFile.GetData();
+	Uint64 fileSize = m_mappedFile.GetSize();
+
+	// Validate the header before trusting any of the offsets
+	const WorldBlockFileHeader* header = (const WorldBlockFileHeader*)m_fileData;
+	UtilAssert( fileSize >= sizeof(WorldBlockFileHeader) && header->m_headerSize >= sizeof(WorldBlockFileHeader), "Truncated compressed world file header" );
+	UtilAssert( memcmp( header->m_magic, WorldBlockFile_Magic, sizeof(header->m_magic) ) == 0, "Not a compressed world file" );
+	UtilAssert( header->m_version == WorldBlockFile_Version, "Unsupported compressed world file version %u", header->m_version );
+	UtilAssert( header->m_tileSize == sizeof(WorldTile), "Compressed world file tile size mismatch" );
+	UtilAssert( header->m_width > 0 && header->m_height > 0, "Invalid world size" );
+	UtilAssert( header->m_blockSize >= 8 && (header->m_blockSize & (header->m_blockSize - 1)) == 0, "Invalid block size" );
+
+	m_worldSize = Vector2i( header->m_width, header->m_height );
+	m_blockSize = (int)header->m_blockSize;
+	while( (1 << m_blockShift) < m_blockSize )
+		m_blockShift++;
+
+	m_blockCount = Vector2i( header->m_blockCountX, header->m_blockCountY );
+	UtilAssert( m_blockCount.x == (m_worldSize.x + m_blockSize - 1) / m_blockSize && m_blockCount.y == (m_worldSize.y + m_blockSize - 1) / m_blockSize, "Block count mismatch" );
+
+	// The index, and every block it points to, must lie within the file; the
+	// sizes are checked against what's left past each offset, so huge offsets can't wrap
+	Uint64 blockCount = (Uint64)m_blockCount.x * (Uint64)m_blockCount.y;
+	UtilAssert( header->m_indexOffset <= fileSize && blockCount * sizeof(WorldBlockFileEntry) <= fileSize - header->m_indexOffset, "Truncated block index" );
+	UtilAssert( header->m_indexOffset % sizeof(Uint64) == 0, "Misaligned block index" );
+	m_index = (const WorldBlockFileEntry*)(m_fileData + header->m_indexOffset);
+	for(Uint64 i = 0; i < blockCount; i++)
+		UtilAssert( m_index[i].m_offset <= fileSize && m_index[i].m_size <= fileSize - m_index[i].m_offset, "Truncated block %d", (int)i );
+
+	m_sectionCount = header->m_sectionCount;
+	m_sectionTableOffset = header->m_sectionTableOffset;
+}
+
+Uint64 WorldBlockFile::GetCompressedSize() const
+{
+	Uint64 compressedSize = 0;
+	for(int i = 0; i < m_blockCount.x * m_blockCount.y; i++)
+		compressedSize += m_index[i].m_size;
+	return compressedSize;
+}
+
+void WorldBlockFile::ReadMetadata( std::map< std::string, std::string >& metadata ) const
+{
+	// Sections are small, copy them out
+	Uint64 fileSize = m_mappedFile.GetSize();
+	Uint64 sectionOffset = m_sectionTableOffset;
+	for(Uint32 i = 0; i < m_sectionCount; i++)
+	{
+		UtilAssert( sectionOffset <= fileSize && sizeof(WorldFileSection) <= fileSize - sectionOffset, "Truncated world file section" );
+		const WorldFileSection* section = (const WorldFileSection*)(m_fileData + sectionOffset);
+		sectionOffset += sizeof(WorldFileSection);
+
+		UtilAssert( section->m_size <= fileSize - sectionOffset, "Truncated world file section" );
+		std::string tag( section->m_tag, sizeof(section->m_tag) );
+		metadata[tag] = std::string( (const char*)(m_fileData + sectionOffset), (size_t)section->m_size );
+		sectionOffset += section->m_size;
+	}
+}
+
+bool WorldBlockFile::ReadBlock( int blockX, int blockY, WorldTile* tiles ) const
+{
+	const WorldBlockFileEntry& entry = m_index[ blockY * m_blockCount.x + blockX ];
+	return WorldCodecDecompress( (WorldCodec)entry.m_codec, m_fileData + entry.m_offset, entry.m_size, (Uint8*)tiles, m_blockSize * m_blockSize * sizeof(WorldTile) );
+}
+
+size_t WorldBlockFile::GetScratchSize( const WorldRegion& region ) const
+{
+	int blocksAcross = ((region.m_x + region.m_width - 1) >> m_blockShift) - (region.m_x >> m_blockShift) + 1;
+	return (size_t)blocksAcross * m_blockSize * m_blockSize;
+}
+
+bool WorldBlockFile::ReadRegion( const WorldRegion& region, WorldTile* tiles, int pitch, ThreadPool* threadPool ) const
+{
+	UtilAssert( region.m_x >= 0 && region.m_y >= 0 && region.m_x + region.m_width <= m_worldSize.x && region.m_y + region.m_height <= m_worldSize.y, "Out of bounds world region" );
+	if( region.m_width <= 0 || region.m_height <= 0 )
+		return true;
+
+	int firstBlockY = region.m_y >> m_blockShift;
+	int lastBlockY = (region.m_y + region.m_height - 1) >> m_blockShift;
+
+	// One job per block row: rows of blocks write disjoint rows of tiles
+	std::vector< Uint8 > results( lastBlockY - firstBlockY + 1, 0 );
+	if( threadPool != NULL )
+	{
+		for(int blockY = firstBlockY; blockY <= lastBlockY; blockY++)
+			threadPool->Push( new BlockRowJob( this, blockY, region, tiles, pitch, &results[blockY - firstBlockY] ) );
+		threadPool->WaitAll();
+	}
+	else
+	{
+		std::vector< WorldTile > scratchTiles( GetScratchSize( region ) );
+		for(int blockY = firstBlockY; blockY <= lastBlockY; blockY++)
+			results[blockY - firstBlockY] = ReadBlockRow( blockY, region, tiles, pitch, &scratchTiles[0] ) ? 1 : 0;
+	}
+
+	for(size_t i = 0; i < results.size(); i++)
+	{
+		if( results[i] == 0 )
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,89 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: WorldBlockFile.cpp/h
+ Desc: Reader of compressed world files (see WorldFile.h). The file
+ is memory-mapped, and any region of the world can be decompressed
+ on its own: only the blocks covering it are touched, through the
+ block index. Blocks are independent, so a region's blocks can be
+ decompressed in parallel on a thread pool.
+
+***************************************************************/
+
+#ifndef __WORLDBLOCKFILE_H__
+#define __WORLDBLOCKFILE_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Utilities.h"
+#include "VectorMath.h"
+#include "World.h"
+#include "WorldFile.h"
+#include "ThreadPool.h"
+
+class WorldBlockFile
+{
+public:
+
+	// Maps the given compressed world file, and validates its header and block index
+	WorldBlockFile( const std::string& worldFileName );
+
+	// World size, in tiles
+	const Vector2i GetWorldSize() const { return m_worldSize; }
+
+	// Block edge length, in tiles, and blocks across / down
+	int GetBlockSize() const { return m_blockSize; }
+	const Vector2i GetBlockCount() const { return m_blockCount; }
+
+	// Size of the file, and of the compressed blocks alone, in bytes
+	Uint64 GetFileSize() const { return m_mappedFile.GetSize(); }
+	Uint64 GetCompressedSize() const;
+
+	// Copies the metadata sections out
+	void ReadMetadata( std::map< std::string, std::string >& metadata ) const;
+
+	// Decompresses one block into block size * block size tiles, row-major;
+	// safe to call from any thread. Returns false on corrupt data
+	bool ReadBlock( int blockX, int blockY, WorldTile* tiles ) const;
+
+	// Decompresses the tiles of the given region into a row-major array whose
+	// rows are the given number of tiles apart; only the blocks covering the
+	// region are decompressed, spread over the thread pool if one is given.
+	// Returns false on corrupt data
+	bool ReadRegion( const WorldRegion& region, WorldTile* tiles, int pitch, ThreadPool* threadPool = NULL ) const;
+
+private:
+
+	// Decompresses one row of blocks of a region
+	class BlockRowJob;
+	friend class BlockRowJob;
+
+	// Decompresses the blocks of the given block row that cover the region, and
+	// copies their part of the region out; the scratch holds those blocks
+	bool ReadBlockRow( int blockY, const WorldRegion& region, WorldTile* tiles, int pitch, WorldTile* scratchTiles ) const;
+
+	// Tiles of scratch ReadBlockRow needs for the given region
+	size_t GetScratchSize( const WorldRegion& region ) const;
+
+	UtilMappedFile m_mappedFile;
+	const Uint8* m_fileData;
+
+	Vector2i m_worldSize;
+	int m_blockSize;
+	int m_blockShift;
+	Vector2i m_blockCount;
+
+	const WorldBlockFileEntry* m_index;
+	Uint32 m_sectionCount;
+	Uint64 m_sectionTableOffset;
+
+};
+
+#endif
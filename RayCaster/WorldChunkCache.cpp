@@ -0,0 +1,291 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+
+***************************************************************/
+
+#include "WorldChunkCache.h"
+
+/*** Private ***/
+
+class WorldChunkCache::ChunkLoadJob : public ThreadJob
+{
+public:
+
+	ChunkLoadJob( WorldChunkCache* cache, int chunkIndex )
+		: m_cache( cache )
+		, m_chunkIndex( chunkIndex )
+	{
+	}
+
+	void Run()
+	{
+		WorldTile* tiles = m_cache->ReadChunk( m_chunkIndex );
+		m_cache->PostLoadedChunk( m_chunkIndex, tiles );
+	}
+
+private:
+
+	WorldChunkCache* m_cache;
+	int m_chunkIndex;
+
+};
+
+WorldTile* WorldChunkCache::ReadChunk( int chunkIndex )
+{
+	const WorldChunkFileEntry& entry = m_index[chunkIndex];
+	if( entry.m_size != m_chunkBytes )
+		return NULL;
+
+	WorldTile* tiles = new WorldTile[ m_chunkSize * m_chunkSize ];
+
+	SDL_LockMutex( m_fileMutex );
+	bool isValid = UtilReadAt( m_file, entry.m_offset, tiles, (size_t)m_chunkBytes );
+	SDL_UnlockMutex( m_fileMutex );
+
+	if( !isValid )
+	{
+		delete[] tiles;
+		return NULL;
+	}
+	return tiles;
+}
+
+void WorldChunkCache::PostLoadedChunk( int chunkIndex, WorldTile* tiles )
+{
+	SDL_LockMutex( m_loadedMutex );
+	m_loadedChunks.push_back( std::make_pair( chunkIndex, tiles ) );
+	SDL_CondBroadcast( m_loadedCondition );
+	SDL_UnlockMutex( m_loadedMutex );
+}
+
+bool WorldChunkCache::RequestChunk( int chunkIndex )
+{
+	Uint8 state = m_chunkStates[chunkIndex];
+	m_chunkLastUsed[chunkIndex] = m_updateIndex;
+
+	if( state == ChunkState_Resident )
+	{
+		// Most recently used goes to the front
+		m_lruList.splice( m_lruList.begin(), m_lruList, m_lruPositions[chunkIndex] );
+		m_stats.m_hits++;
+		return true;
+	}
+
+	// Hits and misses are both counted per update the chunk is needed, so a chunk
+	// still in flight is a miss on every one of them; only the first queues a load
+	m_stats.m_misses++;
+	if( state == ChunkState_Unloaded )
+	{
+		m_chunkStates[chunkIndex] = ChunkState_Loading;
+		m_loaderPool->Push( new ChunkLoadJob( this, chunkIndex ) );
+	}
+	return false;
+}
+
+void WorldChunkCache::InstallLoadedChunks()
+{
+	// Take the list as-is, so the workers aren't held up while we install
+	std::vector< std::pair< int, WorldTile* > > loadedChunks;
+	SDL_LockMutex( m_loadedMutex );
+	loadedChunks.swap( m_loadedChunks );
+	SDL_UnlockMutex( m_loadedMutex );
+
+	for(size_t i = 0; i < loadedChunks.size(); i++)
+	{
+		int chunkIndex = loadedChunks[i].first;
+		WorldTile* tiles = loadedChunks[i].second;
+
+		if( tiles == NULL )
+		{
+			m_chunkStates[chunkIndex] = ChunkState_Failed;
+			continue;
+		}
+
+		m_chunkTable[chunkIndex] = tiles;
+		m_chunkStates[chunkIndex] = ChunkState_Resident;
+		m_lruList.push_front( chunkIndex );
+		m_lruPositions[chunkIndex] = m_lruList.begin();
+		AddChangedChunk( chunkIndex );
+
+		m_stats.m_loads++;
+		m_stats.m_residentChunks++;
+		m_stats.m_residentBytes += m_chunkBytes;
+	}
+}
+
+void WorldChunkCache::EvictOverBudget()
+{
+	// Never evict what was requested this update, even if that means going over budget
+	while( m_stats.m_residentBytes > m_memoryBudget && !m_lruList.empty() )
+	{
+		int chunkIndex = m_lruList.back();
+		if( m_chunkLastUsed[chunkIndex] == m_updateIndex )
+			break;
+
+		m_lruList.pop_back();
+		delete[] m_chunkTable[chunkIndex];
+		m_chunkTable[chunkIndex] = m_solidChunk;
+		m_chunkStates[chunkIndex] = ChunkState_Unloaded;
+		AddChangedChunk( chunkIndex );
+
+		m_stats.m_evictions++;
+		m_stats.m_residentChunks--;
+		m_stats.m_residentBytes -= m_chunkBytes;
+	}
+}
+
+bool WorldChunkCache::IsChunkPosted( int chunkIndex )
+{
+	for(size_t i = 0; i < m_loadedChunks.size(); i++)
+	{
+		if( m_loadedChunks[i].first == chunkIndex )
+			return true;
+	}
+	return false;
+}
+
+/*** Public ***/
+
+WorldChunkCache::WorldChunkCache( const std::string& worldFileName )
+	: m_file( NULL )
+	, m_fileMutex( NULL )
+	, m_chunkSize( 0 )
+	, m_chunkShift( 0 )
+	, m_chunkMask( 0 )
+	, m_chunkBytes( 0 )
+	, m_solidChunk( NULL )
+	, m_updateIndex( 0 )
+	, m_loadedMutex( NULL )
+	, m_loadedCondition( NULL )
+	, m_loaderPool( NULL )
+	, m_memoryBudget( 64 * 1024 * 1024 )
+	, m_loadRadius( 4 )
+{
+	m_file = fopen( worldFileName.c_str(), "rb" );
+	UtilAssert( m_file != NULL, "Unable to load world file \"%s\"", worldFileName.c_str() );
+
+	// Validate the header
+	WorldChunkFileHeader header;
+	UtilAssert( fread( &header, sizeof(header), 1, m_file ) == 1, "Truncated world file header" );
+	UtilAssert( memcmp( header.m_magic, WorldChunkFile_Magic, sizeof(header.m_magic) ) == 0, "Not a chunked world file" );
+	UtilAssert( header.m_version == WorldChunkFile_Version, "Unsupported chunked world file version %u; convert it again from the text world", header.m_version );
+	UtilAssert( header.m_tileSize == sizeof(WorldTile), "World file tile size mismatch" );
+	UtilAssert( header.m_chunkSize > 0 && (header.m_chunkSize & (header.m_chunkSize - 1)) == 0, "Chunk size must be a power of two" );
+	UtilAssert( header.m_width > 0 && header.m_height > 0, "Invalid world size" );
+
+	m_worldSize = Vector2i( header.m_width, header.m_height );
+	m_chunkCount = Vector2i( header.m_chunkCountX, header.m_chunkCountY );
+	m_chunkSize = (int)header.m_chunkSize;
+	m_chunkMask = m_chunkSize - 1;
+	while( (1 << m_chunkShift) < m_chunkSize )
+		m_chunkShift++;
+	m_chunkBytes = (Uint64)m_chunkSize * (Uint64)m_chunkSize * sizeof(WorldTile);
+
+	UtilAssert( m_chunkCount.x * m_chunkSize >= m_worldSize.x && m_chunkCount.y * m_chunkSize >= m_worldSize.y, "Chunks do not cover the world" );
+
+	// Read the chunk index; small enough to always keep around
+	int chunkCount = m_chunkCount.x * m_chunkCount.y;
+	m_index.resize( chunkCount );
+	UtilAssert( UtilReadAt( m_file, header.m_indexOffset, &m_index[0], chunkCount * sizeof(WorldChunkFileEntry) ), "Truncated chunk index" );
+
+	// Everything starts out pointing at the solid chunk
+	m_solidChunk = new WorldTile[ m_chunkSize * m_chunkSize ];
+	for(int i = 0; i < m_chunkSize * m_chunkSize; i++)
+		m_solidChunk[i].m_tileId = WorldTile_Solid;
+
+	m_chunkTable.resize( chunkCount, m_solidChunk );
+	m_chunkStates.resize( chunkCount, ChunkState_Unloaded );
+	m_chunkLastUsed.resize( chunkCount, 0 );
+	m_lruPositions.resize( chunkCount, m_lruList.end() );
+
+	// A single loader thread is enough; reads are serialized on the file anyway
+	m_fileMutex = SDL_CreateMutex();
+	m_loadedMutex = SDL_CreateMutex();
+	m_loadedCondition = SDL_CreateCond();
+	m_loaderPool = new ThreadPool( 1 );
+}
+
+WorldChunkCache::~WorldChunkCache()
+{
+	// Let any in-flight loads finish before tearing down what they use
+	delete m_loaderPool;
+
+	for(size_t i = 0; i < m_loadedChunks.size(); i++)
+		delete[] m_loadedChunks[i].second;
+
+	for(size_t i = 0; i < m_chunkTable.size(); i++)
+	{
+		if( m_chunkStates[i] == ChunkState_Resident )
+			delete[] m_chunkTable[i];
+	}
+	delete[] m_solidChunk;
+
+	SDL_DestroyCond( m_loadedCondition );
+	SDL_DestroyMutex( m_loadedMutex );
+	SDL_DestroyMutex( m_fileMutex );
+	fclose( m_file );
+}
+
+void WorldChunkCache::Update( const Vector3f& position )
+{
+	m_updateIndex++;
+	InstallLoadedChunks();
+
+	// Request chunks ring by ring, so the nearest get queued first
+	int centerX = (int)floor( position.x ) >> m_chunkShift;
+	int centerY = (int)floor( position.y ) >> m_chunkShift;
+	for(int radius = 0; radius <= m_loadRadius; radius++)
+	for(int dy = -radius; dy <= radius; dy++)
+	for(int dx = -radius; dx <= radius; dx++)
+	{
+		if( max( abs(dx), abs(dy) ) != radius )
+			continue;
+
+		int chunkX = centerX + dx;
+		int chunkY = centerY + dy;
+		if( chunkX >= 0 && chunkX < m_chunkCount.x && chunkY >= 0 && chunkY < m_chunkCount.y )
+			RequestChunk( chunkY * m_chunkCount.x + chunkX );
+	}
+
+	// The chunk we're standing in can't be skipped; wait for it
+	if( centerX >= 0 && centerX < m_chunkCount.x && centerY >= 0 && centerY < m_chunkCount.y )
+	{
+		int centerIndex = centerY * m_chunkCount.x + centerX;
+		if( m_chunkStates[centerIndex] == ChunkState_Loading )
+		{
+			UtilHighresClock stallClock( true );
+
+			SDL_LockMutex( m_loadedMutex );
+			while( !IsChunkPosted( centerIndex ) )
+				SDL_CondWait( m_loadedCondition, m_loadedMutex );
+			SDL_UnlockMutex( m_loadedMutex );
+			InstallLoadedChunks();
+
+			stallClock.Stop();
+			m_stats.m_stallTime += stallClock.GetTime();
+		}
+	}
+
+	EvictOverBudget();
+}
+
+void WorldChunkCache::PopChangedRegions( std::vector< WorldRegion >& regions )
+{
+	// Edge chunks are clipped to the world
+	for(size_t i = 0; i < m_changedChunks.size(); i++)
+	{
+		int chunkX = m_changedChunks[i] % m_chunkCount.x;
+		int chunkY = m_changedChunks[i] / m_chunkCount.x;
+
+		WorldRegion region;
+		region.m_x = chunkX * m_chunkSize;
+		region.m_y = chunkY * m_chunkSize;
+		region.m_width = min( m_chunkSize, m_worldSize.x - region.m_x );
+		region.m_height = min( m_chunkSize, m_worldSize.y - region.m_y );
+		regions.push_back( region );
+	}
+
+	m_changedChunks.clear();
+}
@@ -0,0 +1,170 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: WorldChunkCache.cpp/h
+ Desc: Streams the chunks of a chunked world file (see WorldFile.h)
+ in and out of memory around a given position. Chunks are read on a
+ background thread, and evicted in least-recently-used order once the
+ memory budget is exceeded. Tiles of chunks that are not resident read
+ as solid walls, so rays never wait on the disk.
+
+***************************************************************/
+
+#ifndef __WORLDCHUNKCACHE_H__
+#define __WORLDCHUNKCACHE_H__
+
+#include <list>
+#include <vector>
+
+#include "Utilities.h"
+#include "VectorMath.h"
+#include "World.h"
+#include "WorldFile.h"
+#include "ThreadPool.h"
+
+// Streaming counters, accumulated since the cache was opened
+struct WorldChunkStats
+{
+	Uint64 m_hits;				// Chunk requests that were already resident
+	Uint64 m_misses;			// Chunk requests that were not (yet) resident; one per update
+								// the chunk is needed, for as long as it is in flight
+	Uint64 m_loads;				// Chunks paged in
+	Uint64 m_evictions;			// Chunks paged out
+	float m_stallTime;			// Seconds the main thread was blocked waiting on a chunk
+
+	int m_residentChunks;
+	Uint64 m_residentBytes;
+
+	WorldChunkStats()
+		: m_hits( 0 ), m_misses( 0 ), m_loads( 0 ), m_evictions( 0 )
+		, m_stallTime( 0.0f ), m_residentChunks( 0 ), m_residentBytes( 0 )
+	{
+	}
+
+	// Fraction of chunk requests that were already resident; every update requests
+	// each chunk in the load radius once, so both counts are on the same scale
+	float GetHitRate() const
+	{
+		Uint64 requestCount = m_hits + m_misses;
+		return (requestCount > 0) ? (float)m_hits / (float)requestCount : 1.0f;
+	}
+};
+
+class WorldChunkCache
+{
+public:
+
+	// Opens the given chunked world file; no chunk is loaded until the first update
+	WorldChunkCache( const std::string& worldFileName );
+	~WorldChunkCache();
+
+	// World size, in tiles
+	const Vector2i GetWorldSize() const { return m_worldSize; }
+
+	// Constant-time tile look-up; tiles of non-resident chunks are solid
+	inline const WorldTile* GetTile( int x, int y ) const
+	{
+		const WorldTile* chunk = m_chunkTable[ (y >> m_chunkShift) * m_chunkCount.x + (x >> m_chunkShift) ];
+		return &chunk[ ((y & m_chunkMask) << m_chunkShift) + (x & m_chunkMask) ];
+	}
+
+	// Main-thread, once per frame: requests the chunks around the given position,
+	// takes in the chunks that finished loading, and evicts any over the budget.
+	// Only the chunk under the position itself is waited on, if not yet resident
+	void Update( const Vector3f& position );
+
+	// Memory budget for resident chunks, in bytes
+	void SetMemoryBudget( Uint64 memoryBudget ) { m_memoryBudget = memoryBudget; }
+	Uint64 GetMemoryBudget() const { return m_memoryBudget; }
+
+	// Chunks kept loaded in each direction around the update position
+	void SetLoadRadius( int loadRadius ) { m_loadRadius = max( 0, loadRadius ); }
+	int GetLoadRadius() const { return m_loadRadius; }
+
+	const WorldChunkStats& GetStats() const { return m_stats; }
+
+	// Hands over the tile regions of all chunks installed or evicted since the
+	// last call (their tiles changed as far as readers are concerned), and clears them
+	void PopChangedRegions( std::vector< WorldRegion >& regions );
+
+private:
+
+	// Background job that reads one chunk
+	class ChunkLoadJob;
+	friend class ChunkLoadJob;
+
+	enum ChunkState
+	{
+		ChunkState_Unloaded,
+		ChunkState_Loading,
+		ChunkState_Resident,
+		ChunkState_Failed,		// Could not be read; stays solid
+	};
+
+	// Worker thread: reads the chunk's tiles; returns NULL on failure
+	WorldTile* ReadChunk( int chunkIndex );
+
+	// Worker thread: hands over a finished chunk to the main thread
+	void PostLoadedChunk( int chunkIndex, WorldTile* tiles );
+
+	// Main thread: requests the chunk if not resident; returns true if resident
+	bool RequestChunk( int chunkIndex );
+
+	// Main thread: moves the finished chunks into the chunk table
+	void InstallLoadedChunks();
+
+	// Main thread: evicts least-recently-used chunks not in use this frame
+	void EvictOverBudget();
+
+	// Main thread: true if the given chunk has finished loading, but isn't installed yet
+	bool IsChunkPosted( int chunkIndex );
+
+	// Main thread: remembers that the given chunk's tiles changed
+	void AddChangedChunk( int chunkIndex ) { m_changedChunks.push_back( chunkIndex ); }
+
+	// Source file, shared by the loader threads
+	FILE* m_file;
+	SDL_mutex* m_fileMutex;
+	std::vector< WorldChunkFileEntry > m_index;
+
+	Vector2i m_worldSize;
+	Vector2i m_chunkCount;
+	int m_chunkSize;
+	int m_chunkShift;
+	int m_chunkMask;
+	Uint64 m_chunkBytes;
+
+	// Per-chunk pointer to the tiles, or to the solid chunk when not resident
+	std::vector< const WorldTile* > m_chunkTable;
+	std::vector< Uint8 > m_chunkStates;
+	std::vector< Uint32 > m_chunkLastUsed;
+	WorldTile* m_solidChunk;
+
+	// Resident chunks, most recently used at the front
+	std::list< int > m_lruList;
+	std::vector< std::list< int >::iterator > m_lruPositions;
+	Uint32 m_updateIndex;
+
+	// Chunks installed or evicted since the last PopChangedRegions(...)
+	std::vector< int > m_changedChunks;
+
+	// Finished loads waiting to be installed by the main thread
+	SDL_mutex* m_loadedMutex;
+	SDL_cond* m_loadedCondition;
+	std::vector< std::pair< int, WorldTile* > > m_loadedChunks;
+
+	ThreadPool* m_loaderPool;
+
+	Uint64 m_memoryBudget;
+	int m_loadRadius;
+
+	WorldChunkStats m_stats;
+
+};
+
+#endif
@@ -0,0 +1,543 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+
+***************************************************************/
+
+#include "WorldCodec.h"
+
+#include <string.h>
+#include <vector>
+
+/*** Private ***/
+
+// LZ: shortest match worth encoding, farthest match offset, and match-finder hash size
+static const size_t WorldCodec_MinMatch = 4;
+static const size_t WorldCodec_MaxOffset = 65535;
+static const int WorldCodec_HashBits = 12;
+
+// Bounds-checked output, for the compressors
+class CodecWriter
+{
+public:
+
+	CodecWriter( Uint8* output, size_t capacity )
+		: m_output( output )
+		, m_size( 0 )
+		, m_capacity( capacity )
+		, m_isOverflow( false )
+	{
+	}
+
+	void PutByte( Uint8 value )
+	{
+		if( m_size < m_capacity )
+			m_output[m_size++] = value;
+		else
+			m_isOverflow = true;
+	}
+
+	void PutBytes( const Uint8* data, size_t size )
+	{
+		if( size <= m_capacity - m_size )
+		{
+			memcpy( m_output + m_size, data, size );
+			m_size += size;
+		}
+		else
+			m_isOverflow = true;
+	}
+
+	// Seven bits per byte, low bits first; the top bit flags more bytes to come
+	void PutVarint( size_t value )
+	{
+		while( value >= 0x80 )
+		{
+			PutByte( (Uint8)(value | 0x80) );
+			value >>= 7;
+		}
+		PutByte( (Uint8)value );
+	}
+
+	// LZ length extension: bytes of 255 followed by the remainder
+	void PutLengthExtension( size_t value )
+	{
+		for(; value >= 255; value -= 255)
+			PutByte( 255 );
+		PutByte( (Uint8)value );
+	}
+
+	// Compressed size, or zero if it didn't fit
+	size_t GetSize() const { return m_isOverflow ? 0 : m_size; }
+
+private:
+
+	Uint8* m_output;
+	size_t m_size;
+	size_t m_capacity;
+	bool m_isOverflow;
+
+};
+
+static inline bool ReadVarint( const Uint8*& input, const Uint8* inputEnd, size_t* value )
+{
+	*value = 0;
+	for(int shift = 0; shift < 35; shift += 7)
+	{
+		if( input >= inputEnd )
+			return false;
+
+		Uint8 byte = *input++;
+		*value |= (size_t)(byte & 0x7F) << shift;
+		if( (byte & 0x80) == 0 )
+			return true;
+	}
+	return false;
+}
+
+static inline bool ReadLengthExtension( const Uint8*& input, const Uint8* inputEnd, size_t maxValue, size_t* value )
+{
+	Uint8 byte = 255;
+	while( byte == 255 )
+	{
+		if( input >= inputEnd || *value > maxValue )
+			return false;
+
+		byte = *input++;
+		*value += byte;
+	}
+	return true;
+}
+
+static inline Uint32 Read32( const Uint8* data )
+{
+	Uint32 value;
+	memcpy( &value, data, sizeof(value) );
+	return value;
+}
+
+static inline Uint32 HashSequence( Uint32 sequence )
+{
+	return (sequence * 2654435761u) >> (32 - WorldCodec_HashBits);
+}
+
+/*** Run-length encoding ***/
+
+// Items are a varint of (length - 1) << 1 | isRun, followed by either the one
+// repeated byte of a run, or the bytes of a literal stretch
+
+static void PutLiterals( CodecWriter& writer, const Uint8* literals, size_t size )
+{
+	if( size == 0 )
+		return;
+
+	writer.PutVarint( (size - 1) << 1 );
+	writer.PutBytes( literals, size );
+}
+
+static size_t CompressRLE( const Uint8* source, size_t sourceSize, Uint8* output, size_t outputCapacity )
+{
+	CodecWriter writer( output, outputCapacity );
+
+	size_t literalStart = 0;
+	size_t position = 0;
+	while( position < sourceSize )
+	{
+		size_t runLength = 1;
+		while( position + runLength < sourceSize && source[position + runLength] == source[position] )
+			runLength++;
+
+		// Runs shorter than three cost more than they save
+		if( runLength >= 3 )
+		{
+			PutLiterals( writer, source + literalStart, position - literalStart );
+			writer.PutVarint( ((runLength - 1) << 1) | 1 );
+			writer.PutByte( source[position] );
+			literalStart = position + runLength;
+		}
+		position += runLength;
+	}
+	PutLiterals( writer, source + literalStart, sourceSize - literalStart );
+
+	return writer.GetSize();
+}
+
+static bool DecompressRLE( const Uint8* source, size_t sourceSize, Uint8* output, size_t outputSize )
+{
+	const Uint8* input = source;
+	const Uint8* inputEnd = source + sourceSize;
+	Uint8* outputEnd = output + outputSize;
+
+	while( input < inputEnd )
+	{
+		size_t header = 0;
+		if( !ReadVarint( input, inputEnd, &header ) )
+			return false;
+
+		size_t length = (header >> 1) + 1;
+		if( length > (size_t)(outputEnd - output) )
+			return false;
+
+		if( header & 1 )
+		{
+			if( input >= inputEnd )
+				return false;
+			memset( output, *input++, length );
+		}
+		else
+		{
+			if( length > (size_t)(inputEnd - input) )
+				return false;
+			memcpy( output, input, length );
+			input += length;
+		}
+		output += length;
+	}
+
+	return output == outputEnd;
+}
+
+/*** LZ ***/
+
+// Sequences of a token byte (literal count in the high nibble, match length
+// minus four in the low one; 15 means more follows as a length extension),
+// the literals, then a 16-bit match offset and the match length extension.
+// The last sequence is literals only, and ends the input
+
+static void PutSequence( CodecWriter& writer, const Uint8* literals, size_t literalCount, size_t offset, size_t matchLength )
+{
+	bool isLast = (matchLength == 0);
+	size_t matchCode = isLast ? 0 : matchLength - WorldCodec_MinMatch;
+
+	size_t literalNibble = (literalCount < 15) ? literalCount : 15;
+	size_t matchNibble = (matchCode < 15) ? matchCode : 15;
+	writer.PutByte( (Uint8)((literalNibble << 4) | matchNibble) );
+	if( literalCount >= 15 )
+		writer.PutLengthExtension( literalCount - 15 );
+	writer.PutBytes( literals, literalCount );
+
+	if( isLast )
+		return;
+
+	writer.PutByte( (Uint8)(offset & 0xFF) );
+	writer.PutByte( (Uint8)(offset >> 8) );
+	if( matchCode >= 15 )
+		writer.PutLengthExtension( matchCode - 15 );
+}
+
+static size_t CompressLZ( const Uint8* source, size_t sourceSize, Uint8* output, size_t outputCapacity )
+{
+	CodecWriter writer( output, outputCapacity );
+
+	// Last position each hashed four-byte sequence was seen at
+	int table[1 << WorldCodec_HashBits];
+	for(int i = 0; i < (1 << WorldCodec_HashBits); i++)
+		table[i] = -1;
+
+	// Greedy: take the first match found, and extend it as far as it goes
+	size_t anchor = 0;
+	size_t position = 0;
+	while( position + WorldCodec_MinMatch <= sourceSize )
+	{
+		Uint32 sequence = Read32( source + position );
+		Uint32 hash = HashSequence( sequence );
+		int candidate = table[hash];
+		table[hash] = (int)position;
+
+		if( candidate < 0 || position - candidate > WorldCodec_MaxOffset || Read32( source + candidate ) != sequence )
+		{
+			position++;
+			continue;
+		}
+
+		size_t matchLength = WorldCodec_MinMatch;
+		while( position + matchLength < sourceSize && source[candidate + matchLength] == source[position + matchLength] )
+			matchLength++;
+
+		PutSequence( writer, source + anchor, position - anchor, position - candidate, matchLength );
+		position += matchLength;
+		anchor = position;
+	}
+	PutSequence( writer, source + anchor, sourceSize - anchor, 0, 0 );
+
+	return writer.GetSize();
+}
+
+// Copies in 8-byte steps when both sides have the room to overrun by up to 7
+// bytes, which beats memcpy on the short copies LZ is made of; the overrun is
+// overwritten by whatever comes next. Source and destination may overlap as
+// long as they are at least 8 bytes apart
+static inline void CopyShort( Uint8* output, const Uint8* source, size_t size, size_t sourceRoom, size_t outputRoom )
+{
+	if( size + 8 > sourceRoom || size + 8 > outputRoom )
+	{
+		for(size_t i = 0; i < size; i++)
+			output[i] = source[i];
+		return;
+	}
+
+	for(size_t i = 0; i < size; i += 8)
+		memcpy( output + i, source + i, 8 );
+}
+
+static bool DecompressLZ( const Uint8* source, size_t sourceSize, Uint8* output, size_t outputSize )
+{
+	const Uint8* input = source;
+	const Uint8* inputEnd = source + sourceSize;
+	Uint8* outputStart = output;
+	Uint8* outputEnd = output + outputSize;
+
+	for(;;)
+	{
+		if( input >= inputEnd )
+			return false;
+		Uint8 token = *input++;
+
+		// Literals
+		size_t literalCount = token >> 4;
+		if( literalCount == 15 && !ReadLengthExtension( input, inputEnd, outputSize, &literalCount ) )
+			return false;
+		if( literalCount > (size_t)(inputEnd - input) || literalCount > (size_t)(outputEnd - output) )
+			return false;
+
+		CopyShort( output, input, literalCount, (size_t)(inputEnd - input), (size_t)(outputEnd - output) );
+		input += literalCount;
+		output += literalCount;
+
+		if( input == inputEnd )
+			break;
+
+		// Match
+		if( inputEnd - input < 2 )
+			return false;
+		size_t offset = input[0] | (input[1] << 8);
+		input += 2;
+
+		size_t matchLength = (token & 15);
+		if( matchLength == 15 && !ReadLengthExtension( input, inputEnd, outputSize, &matchLength ) )
+			return false;
+		matchLength += WorldCodec_MinMatch;
+
+		if( offset == 0 || offset > (size_t)(output - outputStart) || matchLength > (size_t)(outputEnd - output) )
+			return false;
+
+		// Overlapping matches repeat the last offset bytes; runs are the common case
+		const Uint8* match = output - offset;
+		if( offset == 1 )
+			memset( output, *match, matchLength );
+		else if( offset >= 8 )
+			CopyShort( output, match, matchLength, (size_t)(outputEnd - match), (size_t)(outputEnd - output) );
+		else
+		{
+			for(size_t i = 0; i < matchLength; i++)
+				output[i] = match[i];
+		}
+		output += matchLength;
+	}
+
+	return output == outputEnd;
+}
+
+/*** Palette packing ***/
+
+// Blocks rarely use more than a handful of tile ids: the ids are replaced by
+// indices into the block's palette, packed 1, 2 or 4 bits each (lowest bits
+// first), and the packed bytes are then run through RLE or LZ. The palette
+// leads: its entry count minus one, then the ids. A one-entry palette needs
+// no indices at all
+
+// Bits per index for the given palette size; zero if it's too large to pack
+static inline int GetPackedBits( int paletteCount )
+{
+	if( paletteCount <= 1 )
+		return 0;
+	else if( paletteCount <= 2 )
+		return 1;
+	else if( paletteCount <= 4 )
+		return 2;
+	else if( paletteCount <= 16 )
+		return 4;
+	return -1;
+}
+
+static size_t CompressPacked( WorldCodec innerCodec, const Uint8* source, size_t sourceSize, Uint8* output, size_t outputCapacity )
+{
+	// Palette, in order of first use
+	int paletteIndices[256];
+	for(int i = 0; i < 256; i++)
+		paletteIndices[i] = -1;
+
+	Uint8 palette[256];
+	int paletteCount = 0;
+	for(size_t i = 0; i < sourceSize; i++)
+	{
+		if( paletteIndices[source[i]] < 0 )
+		{
+			paletteIndices[source[i]] = paletteCount;
+			palette[paletteCount++] = source[i];
+		}
+	}
+
+	int bits = GetPackedBits( paletteCount );
+	if( bits < 0 || sourceSize == 0 || 1 + (size_t)paletteCount > outputCapacity )
+		return 0;
+
+	output[0] = (Uint8)(paletteCount - 1);
+	memcpy( output + 1, palette, paletteCount );
+	size_t headerSize = 1 + paletteCount;
+	if( bits == 0 )
+		return headerSize;
+
+	std::vector< Uint8 > packed( (sourceSize * bits + 7) / 8, 0 );
+	for(size_t i = 0; i < sourceSize; i++)
+	{
+		size_t bit = i * bits;
+		packed[bit >> 3] |= (Uint8)(paletteIndices[source[i]] << (bit & 7));
+	}
+
+	size_t innerSize = WorldCodecCompress( innerCodec, &packed[0], packed.size(), output + headerSize, outputCapacity - headerSize );
+	return (innerSize > 0) ? headerSize + innerSize : 0;
+}
+
+static bool DecompressPacked( WorldCodec innerCodec, const Uint8* source, size_t sourceSize, Uint8* output, size_t outputSize )
+{
+	if( sourceSize < 1 || sourceSize < 2 + (size_t)source[0] )
+		return false;
+
+	int paletteCount = source[0] + 1;
+	const Uint8* palette = source + 1;
+	size_t headerSize = 1 + paletteCount;
+
+	int bits = GetPackedBits( paletteCount );
+	if( bits < 0 )
+		return false;
+	if( bits == 0 )
+	{
+		memset( output, palette[0], outputSize );
+		return sourceSize == headerSize;
+	}
+
+	std::vector< Uint8 > packed( (outputSize * bits + 7) / 8 );
+	if( packed.empty() || !WorldCodecDecompress( innerCodec, source + headerSize, sourceSize - headerSize, &packed[0], packed.size() ) )
+		return false;
+
+	// Corrupt indices past the palette read one of its unused entries, never past it
+	Uint8 fullPalette[16];
+	memset( fullPalette, palette[0], sizeof(fullPalette) );
+	memcpy( fullPalette, palette, paletteCount );
+
+	// Every packed byte value expands to the same tiles, so expand each once
+	int indicesPerByte = 8 / bits;
+	Uint8 indexMask = (Uint8)((1 << bits) - 1);
+	Uint8 expanded[256][8];
+	for(int byte = 0; byte < 256; byte++)
+	{
+		for(int j = 0; j < indicesPerByte; j++)
+			expanded[byte][j] = fullPalette[ (byte >> (j * bits)) & indexMask ];
+	}
+
+	// Constant copy sizes compile down to single stores
+	size_t fullBytes = outputSize / indicesPerByte;
+	if( bits == 1 )
+	{
+		for(size_t i = 0; i < fullBytes; i++)
+			memcpy( output + i * 8, expanded[ packed[i] ], 8 );
+	}
+	else if( bits == 2 )
+	{
+		for(size_t i = 0; i < fullBytes; i++)
+			memcpy( output + i * 4, expanded[ packed[i] ], 4 );
+	}
+	else
+	{
+		for(size_t i = 0; i < fullBytes; i++)
+			memcpy( output + i * 2, expanded[ packed[i] ], 2 );
+	}
+	for(size_t i = fullBytes * indicesPerByte; i < outputSize; i++)
+		output[i] = expanded[ packed[i / indicesPerByte] ][ i % indicesPerByte ];
+
+	return true;
+}
+
+/*** Public ***/
+
+size_t WorldCodecGetBound( size_t size )
+{
+	return size + size / 255 + 16;
+}
+
+size_t WorldCodecCompress( WorldCodec codec, const Uint8* source, size_t sourceSize, Uint8* output, size_t outputCapacity )
+{
+	switch( codec )
+	{
+	case WorldCodec_RLE:
+		return CompressRLE( source, sourceSize, output, outputCapacity );
+
+	case WorldCodec_LZ:
+		return CompressLZ( source, sourceSize, output, outputCapacity );
+
+	case WorldCodec_PackedRLE:
+		return CompressPacked( WorldCodec_RLE, source, sourceSize, output, outputCapacity );
+
+	case WorldCodec_PackedLZ:
+		return CompressPacked( WorldCodec_LZ, source, sourceSize, output, outputCapacity );
+
+	default:
+		if( sourceSize > outputCapacity )
+			return 0;
+		memcpy( output, source, sourceSize );
+		return sourceSize;
+	}
+}
+
+size_t WorldCodecCompressBest( const Uint8* source, size_t sourceSize, Uint8* output, WorldCodec* codec )
+{
+	// Anything not smaller than the source is stored as is
+	size_t bestSize = sourceSize;
+	*codec = WorldCodec_None;
+
+	std::vector< Uint8 > scratch( sourceSize );
+	static const WorldCodec codecs[] = { WorldCodec_RLE, WorldCodec_LZ, WorldCodec_PackedRLE, WorldCodec_PackedLZ };
+	for(int i = 0; i < (int)(sizeof(codecs) / sizeof(codecs[0])); i++)
+	{
+		size_t size = (sourceSize > 0) ? WorldCodecCompress( codecs[i], source, sourceSize, &scratch[0], bestSize ) : 0;
+		if( size > 0 && size < bestSize )
+		{
+			memcpy( output, &scratch[0], size );
+			bestSize = size;
+			*codec = codecs[i];
+		}
+	}
+
+	if( *codec == WorldCodec_None )
+		memcpy( output, source, sourceSize );
+	return bestSize;
+}
+
+bool WorldCodecDecompress( WorldCodec codec, const Uint8* source, size_t sourceSize, Uint8* output, size_t outputSize )
+{
+	switch( codec )
+	{
+	case WorldCodec_None:
+		if( sourceSize != outputSize )
+			return false;
+		memcpy( output, source, outputSize );
+		return true;
+
+	case WorldCodec_RLE:
+		return DecompressRLE( source, sourceSize, output, outputSize );
+
+	case WorldCodec_LZ:
+		return DecompressLZ( source, sourceSize, output, outputSize );
+
+	case WorldCodec_PackedRLE:
+		return DecompressPacked( WorldCodec_RLE, source, sourceSize, output, outputSize );
+
+	case WorldCodec_PackedLZ:
+		return DecompressPacked( WorldCodec_LZ, source, sourceSize, output, outputSize );
+
+	default:
+		return false;
+	}
+}
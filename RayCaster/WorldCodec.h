@@ -0,0 +1,54 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: WorldCodec.cpp/h
+ Desc: Byte compression for the blocks of compressed world files
+ (see WorldFile.h), picked per block by whichever does best. Two
+ codecs: run-length encoding, for blocks that are mostly long runs
+ of one tile, and an LZ77 variant (byte-aligned, 64KB window, in the
+ spirit of LZ4) for blocks with repeating patterns. Either can run
+ after palette packing, which turns blocks of a few distinct tile
+ ids (walls and floor, usually) into 1, 2 or 4 bits per tile. All
+ are built for fast decompression rather than ratio.
+
+***************************************************************/
+
+#ifndef __WORLDCODEC_H__
+#define __WORLDCODEC_H__
+
+#include <stddef.h>
+
+#include "SDL.h"
+
+// Codec of a block; stored in the files, so never renumber
+enum WorldCodec
+{
+	WorldCodec_None = 0,	// Stored as is
+	WorldCodec_RLE = 1,
+	WorldCodec_LZ = 2,
+	WorldCodec_PackedRLE = 3,	// Palette packing, then RLE
+	WorldCodec_PackedLZ = 4,	// Palette packing, then LZ
+};
+
+// Largest output any codec can produce for the given input size
+size_t WorldCodecGetBound( size_t size );
+
+// Compresses the source bytes; returns the compressed size, or zero if
+// the output would not fit in the given capacity
+size_t WorldCodecCompress( WorldCodec codec, const Uint8* source, size_t sourceSize, Uint8* output, size_t outputCapacity );
+
+// Compresses with every codec and keeps the smallest result, storing the
+// bytes as is if nothing helps; returns the compressed size, and the codec
+// through the given pointer. The output must hold WorldCodecGetBound bytes
+size_t WorldCodecCompressBest( const Uint8* source, size_t sourceSize, Uint8* output, WorldCodec* codec );
+
+// Decompresses into exactly outputSize bytes; returns false on corrupt input,
+// never reading or writing out of the given bounds
+bool WorldCodecDecompress( WorldCodec codec, const Uint8* source, size_t sourceSize, Uint8* output, size_t outputSize );
+
+#endif
@@ -0,0 +1,161 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: WorldFile.h
+ Desc: On-disk layout of the binary world formats. All values are
+ stored in native (little-endian) byte order.
+ 
+ The binary world format lays the tile array out exactly as the
+ World keeps it in memory, so a loader can memory-map the file and
+ use the tiles in place:
+   WorldFileHeader
+   WorldFileTileType[ m_tileTypeCount ]
+   (padding to WorldFile_Alignment)
+   Tile array, in the layout given by m_layout (see WorldLayout):
+     row-major, m_width * m_height tiles, or Morton-ordered 8x8
+     blocks covering the map plus a one-tile solid border ring,
+     padded with solid tiles to whole power-of-two blocks
+   WorldFileSection[ m_sectionCount ], each followed by its data
+ 
+ The chunked world format splits the map into square chunks, so
+ that worlds larger than memory can be streamed in around the player:
+   WorldChunkFileHeader
+   Chunks, each m_chunkSize * m_chunkSize tiles, row-major
+   WorldChunkFileEntry[ m_chunkCountX * m_chunkCountY ], row-major
+ 
+ The compressed world format splits the map into square blocks that
+ are compressed independently (see WorldCodec.h), so that they can be
+ decompressed in parallel, or only those covering a given region:
+   WorldBlockFileHeader
+   Blocks, each m_blockSize * m_blockSize tiles, row-major, compressed
+   WorldBlockFileEntry[ m_blockCountX * m_blockCountY ], row-major
+   WorldFileSection[ m_sectionCount ], each followed by its data
+
+***************************************************************/
+
+#ifndef __WORLDFILE_H__
+#define __WORLDFILE_H__
+
+#include "SDL.h"
+
+// File identification; bump the version on any layout change
+// Version 2: tiles are single-byte ids (were 32-bit)
+// Version 3: adds m_layout (version 2 files are always row-major)
+// Version 4: Morton tile arrays include the border ring
+static const char WorldFile_Magic[4] = { 'R', 'C', 'W', 'B' };
+static const Uint32 WorldFile_Version = 4;
+
+// The tile array starts on this boundary (a cache line)
+static const Uint32 WorldFile_Alignment = 64;
+
+// File header, at the very start of the file
+struct WorldFileHeader
+{
+	char m_magic[4];				// Always WorldFile_Magic
+	Uint32 m_version;				// Always WorldFile_Version
+	Uint32 m_headerSize;			// Size of this header, so newer readers can skip unknown fields
+
+	Sint32 m_width;					// World size, in tiles
+	Sint32 m_height;
+
+	Uint32 m_tileSize;				// Bytes per tile in the tile array
+	Uint32 m_tileTypeCount;			// Entries in the tile-type table
+	Uint32 m_tileTypeOffset;		// Offset of the tile-type table from the start of the file
+
+	Uint64 m_tileArrayOffset;		// Offset of the tile array from the start of the file
+	Uint64 m_tileArraySize;			// Size of the tile array, in bytes
+
+	Uint32 m_sectionCount;			// Number of optional metadata sections
+	Uint32 m_layout;				// WorldLayout of the tile array
+	Uint64 m_sectionTableOffset;	// Offset of the first section, if any
+};
+
+// Tile-type table entry: each distinct tile id used by the map
+struct WorldFileTileType
+{
+	Sint32 m_tileId;
+	Uint32 m_tileCount;				// Number of tiles of this type in the map
+};
+
+// Optional metadata section; sections are chained one after the other,
+// each header being directly followed by its data
+struct WorldFileSection
+{
+	char m_tag[4];					// Four-character identifier, e.g. "SRCE"
+	Uint32 m_reserved;
+	Uint64 m_size;					// Bytes of data following this header
+};
+
+/*** Chunked world format ***/
+
+// File identification; bump the version on any layout change
+// Version 2: tiles are single-byte ids (were 32-bit)
+static const char WorldChunkFile_Magic[4] = { 'R', 'C', 'W', 'C' };
+static const Uint32 WorldChunkFile_Version = 2;
+
+// File header, at the very start of the file
+struct WorldChunkFileHeader
+{
+	char m_magic[4];				// Always WorldChunkFile_Magic
+	Uint32 m_version;				// Always WorldChunkFile_Version
+	Uint32 m_headerSize;			// Size of this header, so newer readers can skip unknown fields
+
+	Sint32 m_width;					// World size, in tiles
+	Sint32 m_height;
+
+	Uint32 m_tileSize;				// Bytes per tile
+	Uint32 m_chunkSize;				// Chunk edge length, in tiles; always a power of two
+	Sint32 m_chunkCountX;			// Chunks across / down; edge chunks are padded with solid tiles
+	Sint32 m_chunkCountY;
+	Uint32 m_reserved;
+
+	Uint64 m_indexOffset;			// Offset of the chunk index from the start of the file
+};
+
+// Chunk index entry: where to find the tiles of one chunk
+struct WorldChunkFileEntry
+{
+	Uint64 m_offset;				// Offset of the chunk's tiles from the start of the file
+	Uint64 m_size;					// Size of the chunk's tiles, in bytes
+};
+
+/*** Compressed world format ***/
+
+// File identification; bump the version on any layout change
+static const char WorldBlockFile_Magic[4] = { 'R', 'C', 'W', 'Z' };
+static const Uint32 WorldBlockFile_Version = 1;
+
+// File header, at the very start of the file
+struct WorldBlockFileHeader
+{
+	char m_magic[4];				// Always WorldBlockFile_Magic
+	Uint32 m_version;				// Always WorldBlockFile_Version
+	Uint32 m_headerSize;			// Size of this header, so newer readers can skip unknown fields
+
+	Sint32 m_width;					// World size, in tiles
+	Sint32 m_height;
+
+	Uint32 m_tileSize;				// Bytes per tile
+	Uint32 m_blockSize;				// Block edge length, in tiles; always a power of two
+	Sint32 m_blockCountX;			// Blocks across / down; edge blocks are padded with solid tiles
+	Sint32 m_blockCountY;
+	Uint32 m_sectionCount;			// Number of optional metadata sections
+
+	Uint64 m_indexOffset;			// Offset of the block index from the start of the file
+	Uint64 m_sectionTableOffset;	// Offset of the first section, if any
+};
+
+// Block index entry: where to find the compressed tiles of one block
+struct WorldBlockFileEntry
+{
+	Uint64 m_offset;				// Offset of the block's data from the start of the file
+	Uint32 m_size;					// Size of the block's data, in bytes
+	Uint32 m_codec;					// WorldCodec the block's data is compressed with
+};
+
+#endif
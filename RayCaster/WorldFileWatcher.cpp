@@ -0,0 +1,440 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+
+***************************************************************/
+
+#include "WorldFileWatcher.h"
+
+#include <ctype.h>
+
+// Directory change notifications
+#ifdef __linux__
+	#include <sys/inotify.h>
+	#include <poll.h>
+	#include <unistd.h>
+#endif
+
+/*** Private ***/
+
+// How often the watcher checks whether it got cancelled (and, without inotify,
+// polls the file's time stamp), and how long a time stamp must stay the same
+// before the file is read: editors often write in several steps
+static const int WorldFileWatcher_PollTime = 100;
+static const int WorldFileWatcher_SettleTime = 10;
+
+// Bytes read first on a reload, for the world size; files that don't start
+// with one aren't read any further
+static const long WorldFileWatcher_HeaderSize = 64;
+
+// Changed rows are merged into one region for as long as the region's area
+// stays within this many times the changed spans, plus some slack
+static const int WorldFileWatcher_MergeFactor = 2;
+static const int WorldFileWatcher_MergeSlack = 1024;
+
+static inline bool IsLineEnd( char character )
+{
+	return character == '\n' || character == '\r';
+}
+
+class WorldFileWatcher::WatchJob : public ThreadJob
+{
+public:
+
+	WatchJob( WorldFileWatcher* watcher )
+		: m_watcher( watcher )
+	{
+	}
+
+	void Run()
+	{
+		m_watcher->Watch();
+	}
+
+private:
+
+	WorldFileWatcher* m_watcher;
+
+};
+
+void WorldFileWatcher::Watch()
+{
+	if( !IsWatching() )
+		return;
+
+	// Saves are only reloaded once there is a version to compare them against;
+	// until the main thread hands it over, they wait
+	UtilHighresClock saveClock;
+	bool isSaved = false;
+
+#ifdef __linux__
+
+	// Events are variable-length, but always whole within one read
+	char eventData[ 4096 ];
+	while( !IsCancelled() )
+	{
+		// Both events mean the save is complete, so there is nothing to wait for
+		// beyond any more events already queued
+		bool canReload = isSaved && TakeBaseline();
+		pollfd pollHandle = { m_notifyHandle, POLLIN, 0 };
+		if( poll( &pollHandle, 1, canReload ? 0 : WorldFileWatcher_PollTime ) > 0 )
+		{
+			ssize_t dataSize = read( m_notifyHandle, eventData, sizeof(eventData) );
+			for(ssize_t offset = 0; offset < dataSize; )
+			{
+				const inotify_event* event = (const inotify_event*)&eventData[offset];
+				if( !isSaved && event->len > 0 && m_baseName == event->name )
+				{
+					saveClock.Start();
+					isSaved = true;
+				}
+				offset += sizeof(inotify_event) + event->len;
+			}
+		}
+		else if( canReload )
+		{
+			Reload( saveClock );
+			isSaved = false;
+		}
+	}
+
+#else
+
+	// No change notifications; poll the file's size and time stamp instead
+	while( !IsCancelled() )
+	{
+		SDL_Delay( isSaved ? WorldFileWatcher_SettleTime : WorldFileWatcher_PollTime );
+
+		struct stat stamp;
+		if( stat( m_fileName.c_str(), &stamp ) != 0 )
+			continue;
+
+		if( stamp.st_mtime != m_lastStamp.st_mtime || stamp.st_size != m_lastStamp.st_size )
+		{
+			if( !isSaved )
+				saveClock.Start();
+			isSaved = true;
+			m_lastStamp = stamp;
+		}
+		else if( isSaved && TakeBaseline() )
+		{
+			// Settled
+			Reload( saveClock );
+			isSaved = false;
+		}
+	}
+
+#endif
+}
+
+bool WorldFileWatcher::IsCancelled()
+{
+	SDL_LockMutex( m_mutex );
+	bool isCancelled = m_isCancelled;
+	SDL_UnlockMutex( m_mutex );
+	return isCancelled;
+}
+
+bool WorldFileWatcher::TakeBaseline()
+{
+	if( !m_tileIds.empty() )
+		return true;
+
+	SDL_LockMutex( m_mutex );
+	m_tileIds.swap( m_baselineTileIds );
+	m_worldSize = m_baselineSize;
+	SDL_UnlockMutex( m_mutex );
+	return !m_tileIds.empty();
+}
+
+bool WorldFileWatcher::Reload( const UtilHighresClock& saveClock )
+{
+	FILE* file = fopen( m_fileName.c_str(), "rb" );
+	if( file == NULL )
+		return false;
+
+	fseek( file, 0, SEEK_END );
+	long fileSize = ftell( file );
+	fseek( file, 0, SEEK_SET );
+
+	// The header first: a file that isn't a text world, or is too short to hold
+	// the rows its size calls for, isn't read any further
+	m_fileData.resize( min( max( fileSize, 0L ), WorldFileWatcher_HeaderSize ) );
+	bool isRead = fileSize > 0 && fread( &m_fileData[0], 1, m_fileData.size(), file ) == m_fileData.size();
+
+	size_t offset = 0;
+	Vector2i worldSize;
+	if( !isRead || !ParseWorldSize( &offset, &worldSize ) || (Uint64)fileSize < (Uint64)offset + (Uint64)worldSize.x * (Uint64)worldSize.y )
+	{
+		fclose( file );
+		return false;
+	}
+
+	// Then the rest of the file in one read, into a buffer kept from the last reload
+	size_t headerSize = m_fileData.size();
+	m_fileData.resize( fileSize );
+	if( m_fileData.size() > headerSize )
+		isRead = fread( &m_fileData[headerSize], 1, m_fileData.size() - headerSize, file ) == m_fileData.size() - headerSize;
+	fclose( file );
+
+	if( !isRead )
+		return false;
+
+	int width = worldSize.x;
+	std::vector< Uint8 > scratchRow( width );
+	if( worldSize.x != m_worldSize.x || worldSize.y != m_worldSize.y )
+	{
+		printf( "World file \"%s\" changed size; restart to reload it\n", m_fileName.c_str() );
+		return true;
+	}
+
+	// Rows are compared straight from the file, and the ones that differ are
+	// narrowed to the columns that differ, then copied over the last version
+	// (kept aside, in case the file turns out truncated). Rows next to each
+	// other are merged into one region while that stays tight
+	std::vector< WorldFileChange > changes;
+	std::vector< std::pair< int, std::vector< Uint8 > > > replacedRows;
+	int firstX = 0, lastX = -1, firstY = 0, lastY = -1;
+	int spanTiles = 0;
+	for(int y = 0; y < m_worldSize.y; y++)
+	{
+		Uint8* oldRow = &m_tileIds[ (size_t)y * width ];
+		const Uint8* newRow = ReadRow( &offset, width, &scratchRow[0] );
+		if( newRow == NULL )
+		{
+			for(size_t i = 0; i < replacedRows.size(); i++)
+				memcpy( &m_tileIds[ (size_t)replacedRows[i].first * width ], &replacedRows[i].second[0], width );
+			return false;
+		}
+
+		if( memcmp( oldRow, newRow, width ) == 0 )
+			continue;
+
+		int rowFirstX = 0;
+		while( oldRow[rowFirstX] == newRow[rowFirstX] )
+			rowFirstX++;
+		int rowLastX = width - 1;
+		while( oldRow[rowLastX] == newRow[rowLastX] )
+			rowLastX--;
+
+		replacedRows.push_back( std::make_pair( y, std::vector< Uint8 >( oldRow, oldRow + width ) ) );
+		memcpy( oldRow, newRow, width );
+
+		if( lastY == y - 1 && lastX >= 0 )
+		{
+			int mergedWidth = max( lastX, rowLastX ) - min( firstX, rowFirstX ) + 1;
+			int mergedTiles = spanTiles + (rowLastX - rowFirstX + 1);
+			if( mergedWidth * (y - firstY + 1) <= WorldFileWatcher_MergeFactor * mergedTiles + WorldFileWatcher_MergeSlack )
+			{
+				firstX = min( firstX, rowFirstX );
+				lastX = max( lastX, rowLastX );
+				lastY = y;
+				spanTiles = mergedTiles;
+				continue;
+			}
+		}
+
+		if( lastX >= 0 )
+			AddChange( changes, firstX, lastX, firstY, lastY );
+
+		firstX = rowFirstX;
+		lastX = rowLastX;
+		firstY = y;
+		lastY = y;
+		spanTiles = rowLastX - rowFirstX + 1;
+	}
+
+	if( lastX >= 0 )
+		AddChange( changes, firstX, lastX, firstY, lastY );
+
+	// Saves that changed nothing don't count as reloads
+	if( changes.empty() )
+		return true;
+
+	SDL_LockMutex( m_mutex );
+	if( m_reloadCount == 0 )
+		m_reloadClock = saveClock;
+	m_changes.insert( m_changes.end(), changes.begin(), changes.end() );
+	m_reloadCount++;
+	SDL_UnlockMutex( m_mutex );
+
+	return true;
+}
+
+bool WorldFileWatcher::ParseWorldSize( size_t* offset, Vector2i* worldSize ) const
+{
+	// The file data isn't null-terminated, so parse it by hand
+	int size[2] = { 0, 0 };
+	for(int i = 0; i < 2; i++)
+	{
+		while( *offset < m_fileData.size() && isspace( (unsigned char)m_fileData[*offset] ) )
+			(*offset)++;
+		if( *offset == m_fileData.size() || !isdigit( (unsigned char)m_fileData[*offset] ) )
+			return false;
+		while( *offset < m_fileData.size() && isdigit( (unsigned char)m_fileData[*offset] ) && size[i] < (1 << 20) )
+			size[i] = size[i] * 10 + (m_fileData[(*offset)++] - '0');
+	}
+
+	// Digits running up to the end may go on in the part not read yet
+	*worldSize = Vector2i( size[0], size[1] );
+	return *offset < m_fileData.size() && size[0] > 0 && size[1] > 0 && size[0] < (1 << 20) && size[1] < (1 << 20);
+}
+
+const Uint8* WorldFileWatcher::ReadRow( size_t* offset, int width, Uint8* scratchRow ) const
+{
+	// Line endings anywhere are skipped, like World::LoadText does
+	const char* data = &m_fileData[0];
+	size_t dataSize = m_fileData.size();
+	while( *offset < dataSize && IsLineEnd( data[*offset] ) )
+		(*offset)++;
+
+	// Usually the whole row is there as is
+	if( *offset + width <= dataSize && memchr( data + *offset, '\n', width ) == NULL && memchr( data + *offset, '\r', width ) == NULL )
+	{
+		const Uint8* row = (const Uint8*)(data + *offset);
+		*offset += width;
+		return row;
+	}
+
+	for(int x = 0; x < width; x++)
+	{
+		while( *offset < dataSize && IsLineEnd( data[*offset] ) )
+			(*offset)++;
+		if( *offset == dataSize )
+			return NULL;
+		scratchRow[x] = (Uint8)data[(*offset)++];
+	}
+	return scratchRow;
+}
+
+void WorldFileWatcher::AddChange( std::vector< WorldFileChange >& changes, int firstX, int lastX, int firstY, int lastY ) const
+{
+	changes.push_back( WorldFileChange() );
+	WorldFileChange& change = changes.back();
+	WorldRegion region = { firstX, firstY, lastX - firstX + 1, lastY - firstY + 1 };
+	change.m_region = region;
+
+	change.m_tileIds.resize( region.m_width * region.m_height );
+	for(int y = 0; y < region.m_height; y++)
+		memcpy( &change.m_tileIds[ y * region.m_width ], &m_tileIds[ (size_t)(firstY + y) * m_worldSize.x + firstX ], region.m_width );
+}
+
+/*** Public ***/
+
+WorldFileWatcher::WorldFileWatcher( const std::string& worldFileName )
+	: m_fileName( worldFileName )
+	, m_worldSize( 0, 0 )
+#ifdef __linux__
+	, m_notifyHandle( -1 )
+#endif
+	, m_isBaselineGiven( false )
+	, m_mutex( NULL )
+	, m_baselineSize( 0, 0 )
+	, m_reloadCount( 0 )
+	, m_isWatching( false )
+	, m_isCancelled( false )
+	, m_watcherPool( NULL )
+{
+	m_mutex = SDL_CreateMutex();
+
+	// Start watching right away, on this thread, so that saves made while the
+	// world is being loaded are caught as well
+
+#ifdef __linux__
+
+	// Watch the directory rather than the file: editors often save to a new
+	// file, then rename it over the old one
+	std::string directoryName = ".";
+	m_baseName = m_fileName;
+	size_t slash = m_fileName.find_last_of( '/' );
+	if( slash != std::string::npos )
+	{
+		directoryName = (slash == 0) ? "/" : m_fileName.substr( 0, slash );
+		m_baseName = m_fileName.substr( slash + 1 );
+	}
+
+	m_notifyHandle = inotify_init();
+	m_isWatching = m_notifyHandle >= 0 && inotify_add_watch( m_notifyHandle, directoryName.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO ) >= 0;
+
+#else
+
+	memset( &m_lastStamp, 0, sizeof(m_lastStamp) );
+	m_isWatching = stat( m_fileName.c_str(), &m_lastStamp ) == 0;
+
+#endif
+
+	if( !m_isWatching )
+		printf( "Unable to watch world file \"%s\"\n", m_fileName.c_str() );
+
+	m_watcherPool = new ThreadPool( 1 );
+	m_watcherPool->Push( new WatchJob( this ) );
+}
+
+WorldFileWatcher::~WorldFileWatcher()
+{
+	SDL_LockMutex( m_mutex );
+	m_isCancelled = true;
+	SDL_UnlockMutex( m_mutex );
+
+	// Waits for the watch job to notice
+	delete m_watcherPool;
+
+#ifdef __linux__
+	if( m_notifyHandle >= 0 )
+		close( m_notifyHandle );
+#endif
+
+	SDL_DestroyMutex( m_mutex );
+}
+
+bool WorldFileWatcher::IsWatching()
+{
+	SDL_LockMutex( m_mutex );
+	bool isWatching = m_isWatching;
+	SDL_UnlockMutex( m_mutex );
+	return isWatching;
+}
+
+int WorldFileWatcher::ApplyChanges( World* world, float* latency )
+{
+	// Edits have to wait for the world to be fully in
+	if( world->IsLoading() )
+		return 0;
+
+	// The world as loaded is the version saves get compared against; any save
+	// since the watch started is then diffed against it, so none gets lost
+	if( !m_isBaselineGiven )
+	{
+		Vector2i worldSize = world->GetWorldSize();
+		std::vector< Uint8 > tileIds( (size_t)worldSize.x * worldSize.y );
+		for(int y = 0; y < worldSize.y; y++)
+		for(int x = 0; x < worldSize.x; x++)
+			tileIds[ (size_t)y * worldSize.x + x ] = world->GetWorldTile( x, y )->m_tileId;
+
+		SDL_LockMutex( m_mutex );
+		m_baselineSize = worldSize;
+		m_baselineTileIds.swap( tileIds );
+		SDL_UnlockMutex( m_mutex );
+		m_isBaselineGiven = true;
+	}
+
+	std::vector< WorldFileChange > changes;
+	SDL_LockMutex( m_mutex );
+	changes.swap( m_changes );
+	int reloadCount = m_reloadCount;
+	UtilHighresClock reloadClock = m_reloadClock;
+	m_reloadCount = 0;
+	SDL_UnlockMutex( m_mutex );
+
+	// Only the tiles that really differ from the world get written
+	for(size_t i = 0; i < changes.size(); i++)
+		world->SetRegion( changes[i].m_region, &changes[i].m_tileIds[0] );
+
+	if( latency != NULL )
+	{
+		reloadClock.Stop();
+		*latency = (reloadCount > 0) ? reloadClock.GetTime() : 0.0f;
+	}
+	return reloadCount;
+}
@@ -0,0 +1,133 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: WorldFileWatcher.cpp/h
+ Desc: Hot-reload of text worlds. A background thread watches the
+ world file (through inotify on Linux, by polling its time stamp
+ elsewhere), and when it gets saved, parses it again and diffs it
+ against the version it last read. Only the regions that changed
+ are handed to the main thread, which applies them as regular world
+ edits, so the views update incrementally. Tiles changed in-game
+ are kept, unless the file changes them too. The first version is
+ the world as it was loaded; the watch starts before the load, so
+ saves made while the world is read aren't missed.
+
+***************************************************************/
+
+#ifndef __WORLDFILEWATCHER_H__
+#define __WORLDFILEWATCHER_H__
+
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "Utilities.h"
+#include "VectorMath.h"
+#include "ThreadPool.h"
+#include "World.h"
+
+// Tiles of one changed region of a reloaded world, row-major
+struct WorldFileChange
+{
+	WorldRegion m_region;
+	std::vector< Uint8 > m_tileIds;
+};
+
+class WorldFileWatcher
+{
+public:
+
+	// Starts watching the given text world file; create it before the world
+	// gets loaded from the file, so that saves made meanwhile are noticed too
+	WorldFileWatcher( const std::string& worldFileName );
+
+	// Stops the watcher thread, within about a tenth of a second
+	~WorldFileWatcher();
+
+	// True if saves of the file get noticed; false if it couldn't be watched
+	bool IsWatching();
+
+	// Main thread: applies the changes of every reload since the last call to
+	// the given world, through World::SetRegion, and returns how many reloads
+	// that was; nothing is applied while the world is still loading. The first
+	// call after the load hands the world's tiles over, as the version saves are
+	// compared against. The time from the first reload noticing the save up to
+	// now is posted to latency
+	int ApplyChanges( World* world, float* latency = NULL );
+
+private:
+
+	// Background job running the whole watch
+	class WatchJob;
+	friend class WatchJob;
+
+	// Worker thread: waits for saves until cancelled
+	void Watch();
+
+	// Worker thread: true if cancelled
+	bool IsCancelled();
+
+	// Worker thread: takes the world's tiles once the main thread handed them
+	// over; true if there is a version to compare saves against
+	bool TakeBaseline();
+
+	// Worker thread: reads the file and diffs it against the last version read,
+	// then posts the changes, timed from when the save was noticed; returns false
+	// if the file couldn't be parsed (it may be half-written; the next save tries
+	// again). The header is checked before the whole file is read
+	bool Reload( const UtilHighresClock& saveClock );
+
+	// Worker thread: parses the world size at the start of the file data, and
+	// moves the given offset past it; returns false if it is malformed, or runs
+	// up to the end of the data read so far
+	bool ParseWorldSize( size_t* offset, Vector2i* worldSize ) const;
+
+	// Worker thread: reads the row of tiles at the given offset of the file data,
+	// and moves the offset past it; the row is read in place unless it has line
+	// endings within, then it goes to the scratch row. Returns NULL if truncated
+	const Uint8* ReadRow( size_t* offset, int width, Uint8* scratchRow ) const;
+
+	// Worker thread: adds a region of changed rows (whose columns span from
+	// firstX up to lastX inclusive) to the given change list, from the last
+	// version read
+	void AddChange( std::vector< WorldFileChange >& changes, int firstX, int lastX, int firstY, int lastY ) const;
+
+	std::string m_fileName;
+
+	// Worker thread only: the last version of the file read, and the buffer
+	// the file is read into (kept, as it is as big as the file)
+	Vector2i m_worldSize;
+	std::vector< Uint8 > m_tileIds;
+	std::vector< char > m_fileData;
+
+	// Set up before the world gets loaded, so no save is missed
+#ifdef __linux__
+	int m_notifyHandle;
+	std::string m_baseName;
+#else
+	struct stat m_lastStamp;
+#endif
+
+	// Main thread only: true once the world's tiles were handed over
+	bool m_isBaselineGiven;
+
+	// Shared with the watcher thread
+	SDL_mutex* m_mutex;
+	Vector2i m_baselineSize;
+	std::vector< Uint8 > m_baselineTileIds;
+	std::vector< WorldFileChange > m_changes;
+	int m_reloadCount;
+	UtilHighresClock m_reloadClock;
+	bool m_isWatching;
+	bool m_isCancelled;
+
+	ThreadPool* m_watcherPool;
+
+};
+
+#endif
@@ -0,0 +1,444 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+
+***************************************************************/
+
+#include "WorldGenerator.h"
+#include "ThreadPool.h"
+
+#include <vector>
+
+/*** Private ***/
+
+// Size limits of generated worlds and rooms, in tiles
+static const int WorldGenerator_MaxWorldSize = 16384;
+static const int WorldGenerator_MinLeafSize = 8;	// Smallest BSP leaf, walls included
+static const int WorldGenerator_MinRoomSize = 3;
+static const int WorldGenerator_MinRoomChunk = 16;	// Chunks smaller than this (on world edges) stay solid
+
+// Caves: initial wall density in percent, and number of smoothing passes
+static const int WorldGenerator_CaveFill = 45;
+static const int WorldGenerator_CavePasses = 4;
+
+// Arena: pillar density in percent
+static const int WorldGenerator_ArenaPillars = 3;
+
+// Seed salts of the doors on chunk edges, kept apart from the pass numbers
+static const int WorldGenerator_VerticalDoorSalt = -1;
+static const int WorldGenerator_HorizontalDoorSalt = -2;
+
+// Random number in [0, count); the LCG's low bits are weak, so only the high ones are used
+static inline int RandRange( UtilRand& rand, int count )
+{
+	return (int)((rand.Rand() >> 8) % (unsigned int)count);
+}
+
+class WorldGenerator::ChunkJob : public ThreadJob
+{
+public:
+
+	ChunkJob( WorldGenerator* generator, int pass, int chunkX, int chunkY )
+		: m_generator( generator )
+		, m_pass( pass )
+		, m_chunkX( chunkX )
+		, m_chunkY( chunkY )
+	{
+	}
+
+	void Run()
+	{
+		m_generator->GenerateChunk( m_pass, m_chunkX, m_chunkY );
+	}
+
+private:
+
+	WorldGenerator* m_generator;
+	int m_pass;
+	int m_chunkX;
+	int m_chunkY;
+
+};
+
+void WorldGenerator::RunPass( int pass )
+{
+	for(int chunkY = 0; chunkY < m_chunkCount.y; chunkY++)
+	for(int chunkX = 0; chunkX < m_chunkCount.x; chunkX++)
+		m_threadPool->Push( new ChunkJob( this, pass, chunkX, chunkY ) );
+
+	m_threadPool->WaitAll();
+}
+
+void WorldGenerator::GenerateChunk( int pass, int chunkX, int chunkY )
+{
+	switch( m_settings.m_type )
+	{
+		case WorldGeneratorType_Maze:	GenerateMaze( chunkX, chunkY ); break;
+		case WorldGeneratorType_Caves:	GenerateCaves( pass, chunkX, chunkY ); break;
+		case WorldGeneratorType_Rooms:	GenerateRooms( chunkX, chunkY ); break;
+		case WorldGeneratorType_Arena:	GenerateArena( chunkX, chunkY ); break;
+	}
+}
+
+void WorldGenerator::GenerateMaze( int chunkX, int chunkY )
+{
+	int x0, y0, width, height;
+	GetChunkBounds( chunkX, chunkY, &x0, &y0, &width, &height );
+	for(int y = y0; y < y0 + height; y++)
+	for(int x = x0; x < x0 + width; x++)
+		GetTile( x, y ).m_tileId = WorldTile_Solid;
+
+	// Cells sit on odd tiles, with walls in between; chunks start on even tiles,
+	// so the cells of neighbouring chunks are always one wall apart
+	int cellCountX = (min( x0 + width, m_settings.m_worldSize.x - 1 ) - x0) / 2;
+	int cellCountY = (min( y0 + height, m_settings.m_worldSize.y - 1 ) - y0) / 2;
+	if( cellCountX <= 0 || cellCountY <= 0 )
+		return;
+
+	// Recursive backtracker, with an explicit stack
+	UtilRand rand( GetChunkSeed( chunkX, chunkY, 0 ) );
+	std::vector< Uint8 > isVisited( cellCountX * cellCountY, 0 );
+	std::vector< int > cellStack;
+
+	int startCell = RandRange( rand, cellCountX * cellCountY );
+	isVisited[startCell] = 1;
+	cellStack.push_back( startCell );
+	GetTile( x0 + 2 * (startCell % cellCountX) + 1, y0 + 2 * (startCell / cellCountX) + 1 ).m_tileId = WorldTile_Empty;
+
+	static const int offsetX[4] = { 1, -1, 0, 0 };
+	static const int offsetY[4] = { 0, 0, 1, -1 };
+	while( !cellStack.empty() )
+	{
+		int cell = cellStack.back();
+		int cellX = cell % cellCountX;
+		int cellY = cell / cellCountX;
+
+		int neighbours[4];
+		int neighbourCount = 0;
+		for(int i = 0; i < 4; i++)
+		{
+			int nextX = cellX + offsetX[i];
+			int nextY = cellY + offsetY[i];
+			if( nextX >= 0 && nextX < cellCountX && nextY >= 0 && nextY < cellCountY && !isVisited[nextY * cellCountX + nextX] )
+				neighbours[neighbourCount++] = i;
+		}
+
+		// Dead end; back up
+		if( neighbourCount == 0 )
+		{
+			cellStack.pop_back();
+			continue;
+		}
+
+		// Knock down the wall to a random unvisited neighbour, and move there
+		int direction = neighbours[ RandRange( rand, neighbourCount ) ];
+		int nextX = cellX + offsetX[direction];
+		int nextY = cellY + offsetY[direction];
+		GetTile( x0 + 2 * cellX + 1 + offsetX[direction], y0 + 2 * cellY + 1 + offsetY[direction] ).m_tileId = WorldTile_Empty;
+		GetTile( x0 + 2 * nextX + 1, y0 + 2 * nextY + 1 ).m_tileId = WorldTile_Empty;
+
+		isVisited[nextY * cellCountX + nextX] = 1;
+		cellStack.push_back( nextY * cellCountX + nextX );
+	}
+
+	// Each chunk opens the doors on its own left and top edges
+	if( chunkX > 0 )
+		GetTile( x0, y0 + 2 * GetDoorOffset( chunkX, chunkY, true, cellCountY ) + 1 ).m_tileId = WorldTile_Empty;
+	if( chunkY > 0 )
+		GetTile( x0 + 2 * GetDoorOffset( chunkX, chunkY, false, cellCountX ) + 1, y0 ).m_tileId = WorldTile_Empty;
+}
+
+void WorldGenerator::GenerateCaves( int pass, int chunkX, int chunkY )
+{
+	int x0, y0, width, height;
+	GetChunkBounds( chunkX, chunkY, &x0, &y0, &width, &height );
+
+	// First pass is noise
+	if( pass == 0 )
+	{
+		UtilRand rand( GetChunkSeed( chunkX, chunkY, pass ) );
+		for(int y = y0; y < y0 + height; y++)
+		for(int x = x0; x < x0 + width; x++)
+		{
+			bool isSolid = IsBorder( x, y ) || RandRange( rand, 100 ) < WorldGenerator_CaveFill;
+			GetTile( x, y ).m_tileId = isSolid ? WorldTile_Solid : WorldTile_Empty;
+		}
+		return;
+	}
+
+	// Then smoothing: a tile becomes a wall if most of its 3x3 neighbourhood is;
+	// reads the tiles, writes the scratch tiles, which get swapped between passes.
+	// The world's border is always solid, so only the inside is sampled
+	const Vector2i& worldSize = m_settings.m_worldSize;
+	for(int y = y0; y < y0 + height; y++)
+	{
+		WorldTile* output = &m_scratchTiles[ y * worldSize.x ];
+		if( y == 0 || y == worldSize.y - 1 )
+		{
+			for(int x = x0; x < x0 + width; x++)
+				output[x].m_tileId = WorldTile_Solid;
+			continue;
+		}
+
+		// Slide a window of three column sums along the row
+		const WorldTile* rows[3] = { &GetTile( 0, y - 1 ), &GetTile( 0, y ), &GetTile( 0, y + 1 ) };
+		int startX = max( x0, 1 );
+		int endX = min( x0 + width, worldSize.x - 1 );
+		int columnSums[3] = { 0, 0, 0 };
+		for(int i = 0; i < 2; i++)
+		for(int row = 0; row < 3; row++)
+			columnSums[i + 1] += (rows[row][startX - 1 + i].m_tileId == WorldTile_Solid) ? 1 : 0;
+
+		for(int x = startX; x < endX; x++)
+		{
+			columnSums[0] = columnSums[1];
+			columnSums[1] = columnSums[2];
+			columnSums[2] = 0;
+			for(int row = 0; row < 3; row++)
+				columnSums[2] += (rows[row][x + 1].m_tileId == WorldTile_Solid) ? 1 : 0;
+
+			bool isSolid = (columnSums[0] + columnSums[1] + columnSums[2]) >= 5;
+			output[x].m_tileId = isSolid ? WorldTile_Solid : WorldTile_Empty;
+		}
+
+		// Left and right world edges
+		if( x0 == 0 )
+			output[0].m_tileId = WorldTile_Solid;
+		if( x0 + width == worldSize.x )
+			output[worldSize.x - 1].m_tileId = WorldTile_Solid;
+	}
+}
+
+void WorldGenerator::GenerateRooms( int chunkX, int chunkY )
+{
+	int x0, y0, width, height;
+	GetChunkBounds( chunkX, chunkY, &x0, &y0, &width, &height );
+	for(int y = y0; y < y0 + height; y++)
+	for(int x = x0; x < x0 + width; x++)
+		GetTile( x, y ).m_tileId = WorldTile_Solid;
+
+	// Slivers of chunks on the world's edges stay solid
+	if( width < WorldGenerator_MinRoomChunk || height < WorldGenerator_MinRoomChunk )
+		return;
+
+	// Rooms stay off the chunk's edges, which only corridors to the doors cross
+	UtilRand rand( GetChunkSeed( chunkX, chunkY, 0 ) );
+	Vector2i roomPoint = SplitRooms( rand, x0 + 1, y0 + 1, width - 2, height - 2 );
+
+	// Doors sit on the edge tiles: this chunk carves up to its side of each
+	// door, the neighbour up to its own side, which meet in the middle. Left and
+	// right doors are reached across, top and bottom ones down, so corridors
+	// never run along a chunk's edge
+	int neighbourX, neighbourY, neighbourWidth, neighbourHeight;
+	if( chunkX > 0 )
+	{
+		GetChunkBounds( chunkX - 1, chunkY, &neighbourX, &neighbourY, &neighbourWidth, &neighbourHeight );
+		if( neighbourWidth >= WorldGenerator_MinRoomChunk )
+			CarveCorridor( roomPoint, Vector2i( x0, y0 + 1 + GetDoorOffset( chunkX, chunkY, true, height - 2 ) ), false );
+	}
+	if( chunkX + 1 < m_chunkCount.x )
+	{
+		GetChunkBounds( chunkX + 1, chunkY, &neighbourX, &neighbourY, &neighbourWidth, &neighbourHeight );
+		if( neighbourWidth >= WorldGenerator_MinRoomChunk )
+			CarveCorridor( roomPoint, Vector2i( x0 + width - 1, y0 + 1 + GetDoorOffset( chunkX + 1, chunkY, true, height - 2 ) ), false );
+	}
+	if( chunkY > 0 )
+	{
+		GetChunkBounds( chunkX, chunkY - 1, &neighbourX, &neighbourY, &neighbourWidth, &neighbourHeight );
+		if( neighbourHeight >= WorldGenerator_MinRoomChunk )
+			CarveCorridor( roomPoint, Vector2i( x0 + 1 + GetDoorOffset( chunkX, chunkY, false, width - 2 ), y0 ), true );
+	}
+	if( chunkY + 1 < m_chunkCount.y )
+	{
+		GetChunkBounds( chunkX, chunkY + 1, &neighbourX, &neighbourY, &neighbourWidth, &neighbourHeight );
+		if( neighbourHeight >= WorldGenerator_MinRoomChunk )
+			CarveCorridor( roomPoint, Vector2i( x0 + 1 + GetDoorOffset( chunkX, chunkY + 1, false, width - 2 ), y0 + height - 1 ), true );
+	}
+}
+
+void WorldGenerator::GenerateArena( int chunkX, int chunkY )
+{
+	int x0, y0, width, height;
+	GetChunkBounds( chunkX, chunkY, &x0, &y0, &width, &height );
+
+	UtilRand rand( GetChunkSeed( chunkX, chunkY, 0 ) );
+	for(int y = y0; y < y0 + height; y++)
+	for(int x = x0; x < x0 + width; x++)
+	{
+		bool isSolid = IsBorder( x, y ) || RandRange( rand, 100 ) < WorldGenerator_ArenaPillars;
+		GetTile( x, y ).m_tileId = isSolid ? WorldTile_Solid : WorldTile_Empty;
+	}
+}
+
+Vector2i WorldGenerator::SplitRooms( UtilRand& rand, int x, int y, int width, int height )
+{
+	// Split along whichever sides are long enough for two leaves; leaves that
+	// are already small enough sometimes stay whole, for more varied rooms
+	bool canSplitX = width >= 2 * WorldGenerator_MinLeafSize;
+	bool canSplitY = height >= 2 * WorldGenerator_MinLeafSize;
+	bool isSmall = width < 3 * WorldGenerator_MinLeafSize && height < 3 * WorldGenerator_MinLeafSize;
+	if( (!canSplitX && !canSplitY) || (isSmall && RandRange( rand, 4 ) == 0) )
+	{
+		// Room within the leaf, keeping a wall on every side
+		int roomWidth = WorldGenerator_MinRoomSize + RandRange( rand, width - 2 - WorldGenerator_MinRoomSize + 1 );
+		int roomHeight = WorldGenerator_MinRoomSize + RandRange( rand, height - 2 - WorldGenerator_MinRoomSize + 1 );
+		int roomX = x + 1 + RandRange( rand, width - 2 - roomWidth + 1 );
+		int roomY = y + 1 + RandRange( rand, height - 2 - roomHeight + 1 );
+
+		for(int tileY = roomY; tileY < roomY + roomHeight; tileY++)
+		for(int tileX = roomX; tileX < roomX + roomWidth; tileX++)
+			GetTile( tileX, tileY ).m_tileId = WorldTile_Empty;
+
+		return Vector2i( roomX + roomWidth / 2, roomY + roomHeight / 2 );
+	}
+
+	// Prefer cutting the longer side
+	bool isSplitX = canSplitX && (!canSplitY || width > height || (width == height && RandRange( rand, 2 ) == 0));
+	Vector2i first, second;
+	if( isSplitX )
+	{
+		int cut = WorldGenerator_MinLeafSize + RandRange( rand, width - 2 * WorldGenerator_MinLeafSize + 1 );
+		first = SplitRooms( rand, x, y, cut, height );
+		second = SplitRooms( rand, x + cut, y, width - cut, height );
+	}
+	else
+	{
+		int cut = WorldGenerator_MinLeafSize + RandRange( rand, height - 2 * WorldGenerator_MinLeafSize + 1 );
+		first = SplitRooms( rand, x, y, width, cut );
+		second = SplitRooms( rand, x, y + cut, width, height - cut );
+	}
+
+	CarveCorridor( first, second, RandRange( rand, 2 ) == 0 );
+	return (RandRange( rand, 2 ) == 0) ? first : second;
+}
+
+void WorldGenerator::CarveCorridor( Vector2i from, Vector2i to, bool isHorizontalFirst )
+{
+	Vector2i corner = isHorizontalFirst ? Vector2i( to.x, from.y ) : Vector2i( from.x, to.y );
+	for(int x = min( from.x, corner.x ); x <= max( from.x, corner.x ); x++)
+	for(int y = min( from.y, corner.y ); y <= max( from.y, corner.y ); y++)
+		GetTile( x, y ).m_tileId = WorldTile_Empty;
+	for(int x = min( corner.x, to.x ); x <= max( corner.x, to.x ); x++)
+	for(int y = min( corner.y, to.y ); y <= max( corner.y, to.y ); y++)
+		GetTile( x, y ).m_tileId = WorldTile_Empty;
+}
+
+int WorldGenerator::GetDoorOffset( int chunkX, int chunkY, bool isVertical, int length ) const
+{
+	UtilRand rand( GetChunkSeed( chunkX, chunkY, isVertical ? WorldGenerator_VerticalDoorSalt : WorldGenerator_HorizontalDoorSalt ) );
+	return RandRange( rand, length );
+}
+
+unsigned int WorldGenerator::GetChunkSeed( int chunkX, int chunkY, int pass ) const
+{
+	// Integer hash mix, so that neighbouring chunks get unrelated sequences
+	Uint32 hash = m_settings.m_seed;
+	hash = (hash ^ (Uint32)chunkX) * 0x85EBCA6Bu;
+	hash ^= hash >> 13;
+	hash = (hash ^ (Uint32)chunkY) * 0xC2B2AE35u;
+	hash ^= hash >> 16;
+	hash = (hash ^ (Uint32)pass) * 0x85EBCA6Bu;
+	hash ^= hash >> 13;
+	return hash;
+}
+
+void WorldGenerator::GetChunkBounds( int chunkX, int chunkY, int* x, int* y, int* width, int* height ) const
+{
+	*x = chunkX * m_settings.m_chunkSize;
+	*y = chunkY * m_settings.m_chunkSize;
+	*width = min( m_settings.m_chunkSize, m_settings.m_worldSize.x - *x );
+	*height = min( m_settings.m_chunkSize, m_settings.m_worldSize.y - *y );
+}
+
+Vector2i WorldGenerator::FindSpawn() const
+{
+	// Search in growing square rings around the center
+	const Vector2i& worldSize = m_settings.m_worldSize;
+	Vector2i center( worldSize.x / 2, worldSize.y / 2 );
+	int maxRadius = max( worldSize.x, worldSize.y );
+	for(int radius = 0; radius <= maxRadius; radius++)
+	for(int y = center.y - radius; y <= center.y + radius; y++)
+	for(int x = center.x - radius; x <= center.x + radius; x++)
+	{
+		// Only the ring itself; and skip straight across its inside
+		if( y != center.y - radius && y != center.y + radius && x != center.x - radius )
+			x = center.x + radius;
+
+		if( x >= 0 && y >= 0 && x < worldSize.x && y < worldSize.y && m_tiles[ y * worldSize.x + x ].m_tileId == WorldTile_Empty )
+			return Vector2i( x, y );
+	}
+
+	return center;
+}
+
+/*** Public ***/
+
+WorldGenerator::WorldGenerator( const WorldGeneratorSettings& settings )
+	: m_settings( settings )
+	, m_chunkCount( 0, 0 )
+	, m_passCount( 1 )
+	, m_tiles( NULL )
+	, m_scratchTiles( NULL )
+	, m_threadPool( NULL )
+{
+	const Vector2i& worldSize = m_settings.m_worldSize;
+	UtilAssert( worldSize.x >= 3 && worldSize.y >= 3 && worldSize.x <= WorldGenerator_MaxWorldSize && worldSize.y <= WorldGenerator_MaxWorldSize, "Generated worlds must be 3x3 to %dx%d tiles", WorldGenerator_MaxWorldSize, WorldGenerator_MaxWorldSize );
+	UtilAssert( m_settings.m_chunkSize >= 16 && (m_settings.m_chunkSize & (m_settings.m_chunkSize - 1)) == 0, "Generator chunk size must be a power of two, at least 16" );
+
+	m_chunkCount = Vector2i( (worldSize.x + m_settings.m_chunkSize - 1) / m_settings.m_chunkSize, (worldSize.y + m_settings.m_chunkSize - 1) / m_settings.m_chunkSize );
+	if( m_settings.m_type == WorldGeneratorType_Caves )
+		m_passCount = 1 + WorldGenerator_CavePasses;
+
+	m_threadPool = new ThreadPool( m_settings.m_threadCount );
+}
+
+WorldGenerator::~WorldGenerator()
+{
+	delete m_threadPool;
+	delete[] m_tiles;
+	delete[] m_scratchTiles;
+}
+
+World* WorldGenerator::Generate()
+{
+	const Vector2i& worldSize = m_settings.m_worldSize;
+	m_tiles = new WorldTile[ worldSize.x * worldSize.y ];
+	if( m_passCount > 1 )
+		m_scratchTiles = new WorldTile[ worldSize.x * worldSize.y ];
+
+	// Every pass but the first writes to the scratch tiles, which then take over
+	for(int pass = 0; pass < m_passCount; pass++)
+	{
+		RunPass( pass );
+		if( pass > 0 )
+			std::swap( m_tiles, m_scratchTiles );
+	}
+
+	Vector2i spawn = FindSpawn();
+	char spawnText[32];
+	sprintf( spawnText, "%d %d", spawn.x, spawn.y );
+
+	// The tiles are gifted to the world
+	World* world = new World( worldSize, m_tiles );
+	world->SetMetadata( "SPWN", spawnText );
+	m_tiles = NULL;
+
+	delete[] m_scratchTiles;
+	m_scratchTiles = NULL;
+	return world;
+}
+
+bool WorldGenerator::GetTypeFromName( const char* name, WorldGeneratorType* type )
+{
+	static const char* typeNames[] = { "maze", "caves", "rooms", "arena" };
+	for(int i = 0; i < (int)(sizeof(typeNames) / sizeof(typeNames[0])); i++)
+	{
+		if( strcmp( name, typeNames[i] ) == 0 )
+		{
+			*type = (WorldGeneratorType)i;
+			return true;
+		}
+	}
+	return false;
+}
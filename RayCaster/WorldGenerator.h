@@ -0,0 +1,124 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: WorldGenerator.cpp/h
+ Desc: Procedural world generator, for building large maps to
+ stress the renderer and loaders with. The world is split into
+ square chunks that are generated in parallel on a thread pool;
+ each chunk is seeded from the world seed and its own position, so
+ the same settings always produce the same world, no matter how
+ many threads are used.
+
+***************************************************************/
+
+#ifndef __WORLDGENERATOR_H__
+#define __WORLDGENERATOR_H__
+
+#include "Utilities.h"
+#include "VectorMath.h"
+#include "World.h"
+
+class ThreadPool;
+
+// Kinds of worlds; all are enclosed by a solid outer wall
+enum WorldGeneratorType
+{
+	WorldGeneratorType_Maze,	// Recursive-backtracker maze per chunk, chunks joined by one door per edge
+	WorldGeneratorType_Caves,	// Cellular-automata caves; not guaranteed to be all connected
+	WorldGeneratorType_Rooms,	// BSP rooms and corridors per chunk, chunks joined by corridors
+	WorldGeneratorType_Arena,	// Open space with scattered pillars
+};
+
+struct WorldGeneratorSettings
+{
+	WorldGeneratorType m_type;
+	Vector2i m_worldSize;		// In tiles; up to 16k x 16k
+	unsigned int m_seed;
+	int m_chunkSize;			// Chunk edge length, in tiles; a power of two, at least 16
+	int m_threadCount;			// Zero means one per CPU core
+
+	WorldGeneratorSettings()
+		: m_type( WorldGeneratorType_Maze )
+		, m_worldSize( 256, 256 )
+		, m_seed( 0 )
+		, m_chunkSize( 256 )
+		, m_threadCount( 0 )
+	{
+	}
+};
+
+class WorldGenerator
+{
+public:
+
+	WorldGenerator( const WorldGeneratorSettings& settings );
+	~WorldGenerator();
+
+	// Generates the world; the returned world is gifted to the caller. The
+	// empty tile closest to the world's center is stored as "SPWN" metadata
+	// ("x y"), as a spawn point
+	World* Generate();
+
+	// Generator type from its name ("maze", "caves", "rooms" or "arena");
+	// returns false on an unknown name
+	static bool GetTypeFromName( const char* name, WorldGeneratorType* type );
+
+private:
+
+	// Work on one chunk during one pass
+	class ChunkJob;
+	friend class ChunkJob;
+
+	// Runs the given pass on every chunk in parallel, and waits for all of them
+	void RunPass( int pass );
+
+	// Called on a worker thread for each chunk of each pass
+	void GenerateChunk( int pass, int chunkX, int chunkY );
+
+	// Per-generator chunk work
+	void GenerateMaze( int chunkX, int chunkY );
+	void GenerateCaves( int pass, int chunkX, int chunkY );
+	void GenerateRooms( int chunkX, int chunkY );
+	void GenerateArena( int chunkX, int chunkY );
+
+	// Rooms: splits the given area until it is room-sized, carves the rooms and
+	// joins the halves with corridors; returns a point inside one of the rooms
+	Vector2i SplitRooms( UtilRand& rand, int x, int y, int width, int height );
+
+	// Carves an L-shaped corridor between the two points
+	void CarveCorridor( Vector2i from, Vector2i to, bool isHorizontalFirst );
+
+	// Door position along the edge shared by the given chunk and its left (or
+	// upper) neighbour; both chunks compute the same value
+	int GetDoorOffset( int chunkX, int chunkY, bool isVertical, int length ) const;
+
+	// Seed for the given chunk and pass, mixed from the world seed
+	unsigned int GetChunkSeed( int chunkX, int chunkY, int pass ) const;
+
+	// Chunk bounds, in tiles, clipped to the world
+	void GetChunkBounds( int chunkX, int chunkY, int* x, int* y, int* width, int* height ) const;
+
+	// Empty tile closest to the world's center, or the center itself if there's none
+	Vector2i FindSpawn() const;
+
+	inline WorldTile& GetTile( int x, int y ) { return m_tiles[ y * m_settings.m_worldSize.x + x ]; }
+	inline bool IsBorder( int x, int y ) const { return x == 0 || y == 0 || x == m_settings.m_worldSize.x - 1 || y == m_settings.m_worldSize.y - 1; }
+
+	WorldGeneratorSettings m_settings;
+	Vector2i m_chunkCount;
+	int m_passCount;
+
+	// Row-major tiles being generated; caves double-buffer through the scratch tiles
+	WorldTile* m_tiles;
+	WorldTile* m_scratchTiles;
+
+	ThreadPool* m_threadPool;
+
+};
+
+#endif
@@ -0,0 +1,172 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+
+***************************************************************/
+
+#include "WorldStack.h"
+
+#include <ctype.h>
+
+/*** Private ***/
+
+// First word of a levels file
+static const char* const WorldStack_LevelsTag = "levels";
+
+void WorldStack::InitLevels()
+{
+	Vector2i worldSize = m_levels[0]->GetWorldSize();
+	int cellSize = 1 << WorldStack_CellShift;
+	m_cellStride = (worldSize.x + cellSize - 1) / cellSize;
+	m_openFloorCells.assign( m_levels.size(), std::vector< Uint8 >( m_cellStride * ((worldSize.y + cellSize - 1) / cellSize), 0 ) );
+	m_openFloorCellCounts.assign( m_levels.size(), 0 );
+
+	for(int level = 0; level < (int)m_levels.size(); level++)
+	{
+		World* world = m_levels[level];
+		UtilAssert( world->GetWorldSize().x == m_levels[0]->GetWorldSize().x && world->GetWorldSize().y == m_levels[0]->GetWorldSize().y, "Levels must all be the same size" );
+		world->AddListener( this );
+
+		// Worlds still coming in, or streamed, report their tiles as dirty regions
+		// as they arrive; the others are looked through once here
+		if( !world->IsLoading() && world->GetChunkCache() == NULL )
+		{
+			WorldRegion region = { 0, 0, world->GetWorldSize().x, world->GetWorldSize().y };
+			FindOpenFloor( level, region );
+		}
+	}
+}
+
+void WorldStack::FindOpenFloor( int level, const WorldRegion& region )
+{
+	if( region.m_width <= 0 || region.m_height <= 0 )
+		return;
+
+	// Whole cells, as edits can remove holes as well as add them
+	const World* world = m_levels[level];
+	const TileTypeTable& tileTypes = world->GetTileTypes();
+	Vector2i worldSize = world->GetWorldSize();
+	int cellSize = 1 << WorldStack_CellShift;
+	for(int cellY = region.m_y >> WorldStack_CellShift; cellY <= (region.m_y + region.m_height - 1) >> WorldStack_CellShift; cellY++)
+	for(int cellX = region.m_x >> WorldStack_CellShift; cellX <= (region.m_x + region.m_width - 1) >> WorldStack_CellShift; cellX++)
+	{
+		bool hasOpenFloor = false;
+		for(int y = cellY * cellSize; y < min( (cellY + 1) * cellSize, worldSize.y ) && !hasOpenFloor; y++)
+		for(int x = cellX * cellSize; x < min( (cellX + 1) * cellSize, worldSize.x ) && !hasOpenFloor; x++)
+			hasOpenFloor = tileTypes.IsOpenFloor( world->GetWorldTile( x, y )->m_tileId );
+
+		Uint8& cell = m_openFloorCells[level][ cellY * m_cellStride + cellX ];
+		m_openFloorCellCounts[level] += (hasOpenFloor ? 1 : 0) - cell;
+		cell = hasOpenFloor ? 1 : 0;
+	}
+}
+
+/*** Public ***/
+
+WorldStack::WorldStack( const std::string& levelsFileName, bool isBackgroundLoad, const Vector2i& loadOrigin, const TileTypeTable& tileTypes )
+{
+	FILE* file = fopen( levelsFileName.c_str(), "r" );
+	UtilAssert( file != NULL, "Unable to load levels file \"%s\"", levelsFileName.c_str() );
+
+	char line[1024];
+	UtilAssert( fscanf( file, "%1023s", line ) == 1 && strcmp( line, WorldStack_LevelsTag ) == 0, "Not a levels file" );
+
+	// Level paths are relative to the levels file
+	std::string directoryName;
+	size_t slash = levelsFileName.find_last_of( "/\\" );
+	if( slash != std::string::npos )
+		directoryName = levelsFileName.substr( 0, slash + 1 );
+
+	while( fgets( line, sizeof(line), file ) != NULL )
+	{
+		// Trim the line ending and any surrounding blanks; skip empty lines
+		char* start = line;
+		while( isspace( (unsigned char)*start ) )
+			start++;
+		char* end = start + strlen( start );
+		while( end > start && isspace( (unsigned char)end[-1] ) )
+			end--;
+		if( end == start )
+			continue;
+
+		std::string levelFileName( start, end );
+		m_levels.push_back( new World( directoryName + levelFileName, isBackgroundLoad, loadOrigin, tileTypes ) );
+	}
+	fclose( file );
+
+	UtilAssert( !m_levels.empty(), "Levels file \"%s\" lists no levels", levelsFileName.c_str() );
+	InitLevels();
+}
+
+WorldStack::WorldStack( World* world )
+{
+	m_levels.push_back( world );
+	InitLevels();
+}
+
+WorldStack::~WorldStack()
+{
+	for(size_t i = 0; i < m_levels.size(); i++)
+	{
+		m_levels[i]->RemoveListener( this );
+		delete m_levels[i];
+	}
+}
+
+bool WorldStack::IsLevelsFile( const std::string& fileName )
+{
+	FILE* file = fopen( fileName.c_str(), "r" );
+	if( file == NULL )
+		return false;
+
+	char tag[16];
+	bool isLevelsFile = fscanf( file, "%15s", tag ) == 1 && strcmp( tag, WorldStack_LevelsTag ) == 0;
+	fclose( file );
+	return isLevelsFile;
+}
+
+int WorldStack::GetLevelAt( float height ) const
+{
+	int level = (int)floor( height );
+	return max( 0, min( level, (int)m_levels.size() - 1 ) );
+}
+
+void WorldStack::UpdateStreaming( const Vector3f& position )
+{
+	for(size_t i = 0; i < m_levels.size(); i++)
+		m_levels[i]->UpdateStreaming( position );
+}
+
+void WorldStack::FlushEdits()
+{
+	for(size_t i = 0; i < m_levels.size(); i++)
+		m_levels[i]->FlushEdits();
+}
+
+bool WorldStack::IsLoading() const
+{
+	for(size_t i = 0; i < m_levels.size(); i++)
+	{
+		if( m_levels[i]->IsLoading() )
+			return true;
+	}
+	return false;
+}
+
+float WorldStack::GetLoadProgress() const
+{
+	float progress = 0.0f;
+	for(size_t i = 0; i < m_levels.size(); i++)
+		progress += m_levels[i]->GetLoadProgress();
+	return progress / (float)m_levels.size();
+}
+
+void WorldStack::OnWorldChanged( const World* world, const WorldRegion& region )
+{
+	for(int level = 0; level < (int)m_levels.size(); level++)
+	{
+		if( m_levels[level] == world )
+			FindOpenFloor( level, region );
+	}
+}
@@ -0,0 +1,97 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: WorldStack.cpp/h
+ Desc: Floors stacked on top of each other, each one a World of
+ the same size; level n spans heights n to n + 1, so the player's
+ height picks its level. Levels are linked by stairs, which move
+ the player up or down a level, and by holes in the floor (see
+ TileTypes.h), through which the level below can be seen.
+ 
+ A stack is loaded from a levels file, a text file starting with
+ the word "levels" and listing one world file per line, from the
+ bottom level up; paths are relative to the levels file.
+
+***************************************************************/
+
+#ifndef __WORLDSTACK_H__
+#define __WORLDSTACK_H__
+
+#include <string>
+#include <vector>
+
+#include "Utilities.h"
+#include "VectorMath.h"
+#include "World.h"
+
+// Edge length of the cells holes are tracked in, as a power of two
+static const int WorldStack_CellShift = 4;
+
+class WorldStack : public WorldListener
+{
+public:
+
+	// Loads every level of the given levels file, in the background like a
+	// single world would be, with the given tile types (see World.h); they
+	// must all be the same size
+	WorldStack( const std::string& levelsFileName, bool isBackgroundLoad = false, const Vector2i& loadOrigin = Vector2i( 0, 0 ),
+		const TileTypeTable& tileTypes = TileTypeTable() );
+
+	// A stack of just the given world, which is gifted to the stack
+	WorldStack( World* world );
+	~WorldStack();
+
+	// True if the given file is a levels file, rather than a world file
+	static bool IsLevelsFile( const std::string& fileName );
+
+	// Levels, from the bottom up; NULL out of range
+	int GetLevelCount() const { return (int)m_levels.size(); }
+	World* GetLevel( int level ) const { return (level >= 0 && level < (int)m_levels.size()) ? m_levels[level] : NULL; }
+
+	// Level holding the given height, clamped to the stack
+	int GetLevelAt( float height ) const;
+
+	// True if the level has any hole in its floor, and if there is any in the
+	// cell of tiles around the given in-bounds position; kept up to date as the
+	// level gets loaded and edited, so that the renderer only looks for holes
+	// where there are some
+	bool HasOpenFloor( int level ) const { return m_openFloorCellCounts[level] > 0; }
+	inline bool HasOpenFloorNear( int level, int x, int y ) const
+	{
+		return m_openFloorCells[level][ (y >> WorldStack_CellShift) * m_cellStride + (x >> WorldStack_CellShift) ] != 0;
+	}
+
+	// Calls World::UpdateStreaming and World::FlushEdits on every level
+	void UpdateStreaming( const Vector3f& position );
+	void FlushEdits();
+
+	// True while any level is loading, and how far along all of them are (0 to 1)
+	bool IsLoading() const;
+	float GetLoadProgress() const;
+
+	// Looks for holes in the floor of the changed region
+	void OnWorldChanged( const World* world, const WorldRegion& region );
+
+private:
+
+	// Subscribes to the levels, and looks for holes in those already loaded
+	void InitLevels();
+
+	// Looks through every cell the given region touches for holes
+	void FindOpenFloor( int level, const WorldRegion& region );
+
+	std::vector< World* > m_levels;
+
+	// Per level: one flag per cell with a hole in it, and how many are set
+	std::vector< std::vector< Uint8 > > m_openFloorCells;
+	std::vector< int > m_openFloorCellCounts;
+	int m_cellStride;
+
+};
+
+#endif
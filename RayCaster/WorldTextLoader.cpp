@@ -0,0 +1,265 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+
+***************************************************************/
+
+#include "WorldTextLoader.h"
+
+/*** Private ***/
+
+// Rows per band, at most; wide worlds use fewer, so that bands stay around this many tiles
+static const int WorldTextLoader_BandHeight = 64;
+static const int WorldTextLoader_BandTiles = 1024 * 1024;
+
+static inline bool IsLineEnd( char character )
+{
+	return character == '\n' || character == '\r';
+}
+
+class WorldTextLoader::LoadJob : public ThreadJob
+{
+public:
+
+	LoadJob( WorldTextLoader* loader )
+		: m_loader( loader )
+	{
+	}
+
+	void Run()
+	{
+		if( !m_loader->LoadSeeking() )
+			m_loader->LoadSequential();
+	}
+
+private:
+
+	WorldTextLoader* m_loader;
+
+};
+
+bool WorldTextLoader::LoadSeeking()
+{
+	// Row length from the first row; the line ending is whatever follows it
+	int width = m_worldSize.x;
+	std::vector< char > rowData( width + 2 );
+	size_t firstRowSize = (size_t)min( (Uint64)rowData.size(), m_fileSize - m_dataOffset );
+	if( !UtilReadAt( m_file, m_dataOffset, &rowData[0], firstRowSize ) || firstRowSize < (size_t)width )
+		return false;
+
+	int lineEndSize = 0;
+	while( width + lineEndSize < (int)firstRowSize && IsLineEnd( rowData[width + lineEndSize] ) )
+		lineEndSize++;
+	if( lineEndSize == 0 && m_worldSize.y > 1 )
+		return false;
+
+	// Every row must fit, the last one may lack its line ending
+	Uint64 rowStride = (Uint64)(width + lineEndSize);
+	if( m_dataOffset + rowStride * (m_worldSize.y - 1) + width > m_fileSize )
+		return false;
+
+	// Bands outwards from the origin's band: 0, +1, -1, +2, -2...
+	int bandCount = (m_worldSize.y + m_bandHeight - 1) / m_bandHeight;
+	int originBand = min( max( m_loadOrigin.y, 0 ), m_worldSize.y - 1 ) / m_bandHeight;
+	std::vector< char > bandData;
+	for(int step = 0; step < 2 * bandCount; step++)
+	{
+		int band = originBand + ((step & 1) ? -(step + 1) / 2 : step / 2);
+		if( band < 0 || band >= bandCount )
+			continue;
+
+		int firstRow = band * m_bandHeight;
+		int rowCount = min( m_bandHeight, m_worldSize.y - firstRow );
+		Uint64 offset = m_dataOffset + rowStride * firstRow;
+		size_t readSize = (size_t)min( rowStride * rowCount, m_fileSize - offset );
+
+		bandData.resize( readSize );
+		if( !UtilReadAt( m_file, offset, &bandData[0], readSize ) )
+			return RestartLoad();
+
+		// Any line ending that isn't where we expect it means rows of different lengths
+		WorldTile* tiles = new WorldTile[ width * rowCount ];
+		bool isValid = true;
+		for(int row = 0; row < rowCount && isValid; row++)
+		{
+			const char* rowStart = &bandData[ (size_t)(row * rowStride) ];
+			for(int x = 0; x < width && isValid; x++)
+			{
+				isValid = !IsLineEnd( rowStart[x] );
+				tiles[row * width + x].m_tileId = (Uint8)rowStart[x];
+			}
+			for(int i = width; i < (int)rowStride && (size_t)(row * rowStride + i) < readSize && isValid; i++)
+				isValid = IsLineEnd( rowStart[i] );
+		}
+
+		if( !isValid )
+		{
+			delete[] tiles;
+			return RestartLoad();
+		}
+
+		if( !PostBand( firstRow, rowCount, tiles ) )
+			return true;
+	}
+
+	return true;
+}
+
+bool WorldTextLoader::RestartLoad()
+{
+	// Whatever was posted gets posted again, and overwritten, by the sequential load
+	SDL_LockMutex( m_mutex );
+	m_rowsLoaded = 0;
+	SDL_UnlockMutex( m_mutex );
+	return false;
+}
+
+void WorldTextLoader::LoadSequential()
+{
+	// Same parse as World::LoadText, line endings anywhere are skipped
+	fseek( m_file, (long)m_dataOffset, SEEK_SET );
+
+	int width = m_worldSize.x;
+	for(int firstRow = 0; firstRow < m_worldSize.y; firstRow += m_bandHeight)
+	{
+		int rowCount = min( m_bandHeight, m_worldSize.y - firstRow );
+		WorldTile* tiles = new WorldTile[ width * rowCount ];
+		for(int i = 0; i < width * rowCount; i++)
+		{
+			int character = ' ';
+			while( (character = getc( m_file )) == '\n' || character == '\r' );
+			tiles[i].m_tileId = (Uint8)character;
+		}
+
+		if( !PostBand( firstRow, rowCount, tiles ) )
+			return;
+	}
+}
+
+bool WorldTextLoader::PostBand( int firstRow, int rowCount, WorldTile* tiles )
+{
+	// Leaves the main thread only a copy to do
+	int width = m_worldSize.x;
+	int stride = World::GetOccupancyStride( width );
+	Uint32* solidBits = new Uint32[ stride * rowCount ];
+	for(int row = 0; row < rowCount; row++)
+		World::BuildOccupancyRow( m_tileTypes, &tiles[row * width], width, &solidBits[row * stride] );
+
+	SDL_LockMutex( m_mutex );
+	bool isCancelled = m_isCancelled;
+	if( !isCancelled )
+	{
+		WorldTextBand band = { firstRow, rowCount, tiles, solidBits };
+		m_loadedBands.push_back( band );
+		m_rowsLoaded += rowCount;
+
+		if( m_rowsLoaded == m_worldSize.y )
+		{
+			m_loadClock.Stop();
+			m_isDone = true;
+		}
+	}
+	SDL_UnlockMutex( m_mutex );
+
+	if( isCancelled )
+	{
+		delete[] tiles;
+		delete[] solidBits;
+	}
+	return !isCancelled;
+}
+
+/*** Public ***/
+
+WorldTextLoader::WorldTextLoader( const std::string& worldFileName, const Vector2i& loadOrigin, const TileTypeTable& tileTypes )
+	: m_file( NULL )
+	, m_worldSize( 0, 0 )
+	, m_dataOffset( 0 )
+	, m_fileSize( 0 )
+	, m_loadOrigin( loadOrigin )
+	, m_bandHeight( WorldTextLoader_BandHeight )
+	, m_tileTypes( tileTypes )
+	, m_mutex( NULL )
+	, m_rowsLoaded( 0 )
+	, m_isDone( false )
+	, m_isCancelled( false )
+	, m_loaderPool( NULL )
+{
+	m_loadClock.Start();
+
+	m_file = fopen( worldFileName.c_str(), "rb" );
+	UtilAssert( m_file != NULL, "Unable to load world file \"%s\"", worldFileName.c_str() );
+
+	// World size, then the rows start after the line ending
+	UtilAssert( fscanf( m_file, "%d %d", &m_worldSize.x, &m_worldSize.y ) == 2 && m_worldSize.x > 0 && m_worldSize.y > 0, "Invalid world size" );
+	int character = ' ';
+	while( (character = getc( m_file )) == '\n' || character == '\r' );
+	ungetc( character, m_file );
+	m_dataOffset = (Uint64)ftell( m_file );
+
+	#ifdef _WIN32
+		_fseeki64( m_file, 0, SEEK_END );
+		m_fileSize = (Uint64)_ftelli64( m_file );
+	#else
+		fseeko( m_file, 0, SEEK_END );
+		m_fileSize = (Uint64)ftello( m_file );
+	#endif
+
+	m_bandHeight = max( 1, min( WorldTextLoader_BandHeight, WorldTextLoader_BandTiles / m_worldSize.x ) );
+
+	m_mutex = SDL_CreateMutex();
+	m_loaderPool = new ThreadPool( 1 );
+	m_loaderPool->Push( new LoadJob( this ) );
+}
+
+WorldTextLoader::~WorldTextLoader()
+{
+	SDL_LockMutex( m_mutex );
+	m_isCancelled = true;
+	SDL_UnlockMutex( m_mutex );
+
+	// Waits for the load job to notice
+	delete m_loaderPool;
+
+	for(size_t i = 0; i < m_loadedBands.size(); i++)
+	{
+		delete[] m_loadedBands[i].m_tiles;
+		delete[] m_loadedBands[i].m_solidBits;
+	}
+
+	SDL_DestroyMutex( m_mutex );
+	fclose( m_file );
+}
+
+void WorldTextLoader::PopLoadedBands( std::vector< WorldTextBand >& bands )
+{
+	SDL_LockMutex( m_mutex );
+	bands.insert( bands.end(), m_loadedBands.begin(), m_loadedBands.end() );
+	m_loadedBands.clear();
+	SDL_UnlockMutex( m_mutex );
+}
+
+float WorldTextLoader::GetProgress()
+{
+	SDL_LockMutex( m_mutex );
+	float progress = (float)m_rowsLoaded / (float)m_worldSize.y;
+	SDL_UnlockMutex( m_mutex );
+	return progress;
+}
+
+bool WorldTextLoader::IsDone()
+{
+	SDL_LockMutex( m_mutex );
+	bool isDone = m_isDone;
+	SDL_UnlockMutex( m_mutex );
+	return isDone;
+}
+
+float WorldTextLoader::GetLoadTime()
+{
+	SDL_LockMutex( m_mutex );
+	float loadTime = m_isDone ? m_loadClock.GetTime() : 0.0f;
+	SDL_UnlockMutex( m_mutex );
+	return loadTime;
+}
@@ -0,0 +1,105 @@
+/***************************************************************
+ 
+ RayCaster - A Simple C++ Ray Caster Game
+ Copyright 2013 Core S2 - See License.txt for details
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: WorldTextLoader.cpp/h
+ Desc: Loads a text world on a background thread, in bands of rows
+ handed over to the main thread as they complete. When every row has
+ the same length (the usual case), rows are read with seeks so that
+ the band around a given origin comes first, then the bands next to
+ it, alternating outwards; otherwise the file is read top to bottom.
+
+***************************************************************/
+
+#ifndef __WORLDTEXTLOADER_H__
+#define __WORLDTEXTLOADER_H__
+
+#include <string>
+#include <vector>
+
+#include "Utilities.h"
+#include "VectorMath.h"
+#include "ThreadPool.h"
+#include "World.h"
+
+// Rows of tiles, row-major, handed from the loader to the main thread along
+// with their occupancy bits (see World::BuildOccupancyRow)
+struct WorldTextBand
+{
+	int m_firstRow;
+	int m_rowCount;
+	WorldTile* m_tiles;		// Gifted; allocated with new WorldTile[width * row count]
+	Uint32* m_solidBits;	// Gifted; allocated with new Uint32[occupancy stride * row count]
+};
+
+class WorldTextLoader
+{
+public:
+
+	// Opens the text world and reads its size, then starts loading the rows in
+	// the background, starting with the band around the given origin; the tile
+	// types are copied, for the occupancy bits
+	WorldTextLoader( const std::string& worldFileName, const Vector2i& loadOrigin, const TileTypeTable& tileTypes );
+
+	// Stops loading after the current band, and waits for the loader thread
+	~WorldTextLoader();
+
+	// World size, in tiles
+	const Vector2i GetWorldSize() const { return m_worldSize; }
+
+	// Main thread: hands over the bands finished since the last call
+	void PopLoadedBands( std::vector< WorldTextBand >& bands );
+
+	// Fraction of rows loaded so far, from 0 to 1; the first band posted is always
+	// the one around the origin
+	float GetProgress();
+
+	// True once every row was posted; the load time is then known
+	bool IsDone();
+	float GetLoadTime();
+
+private:
+
+	// Background job running the whole load
+	class LoadJob;
+	friend class LoadJob;
+
+	// Worker thread: loads every row, origin band first, through seeks; returns
+	// false if the rows turn out not to be all the same length
+	bool LoadSeeking();
+
+	// Worker thread: gives up on seeking; returns false, for LoadSeeking to return
+	bool RestartLoad();
+
+	// Worker thread: loads every row top to bottom, whatever the line endings
+	void LoadSequential();
+
+	// Worker thread: builds the occupancy bits of a finished band of tiles (gifted)
+	// and hands it over; returns false if loading got cancelled
+	bool PostBand( int firstRow, int rowCount, WorldTile* tiles );
+
+	FILE* m_file;
+	Vector2i m_worldSize;
+	Uint64 m_dataOffset;	// Start of the first row in the file
+	Uint64 m_fileSize;
+	Vector2i m_loadOrigin;
+	int m_bandHeight;
+	TileTypeTable m_tileTypes;
+
+	// Shared with the loader thread
+	SDL_mutex* m_mutex;
+	std::vector< WorldTextBand > m_loadedBands;
+	int m_rowsLoaded;
+	bool m_isDone;
+	bool m_isCancelled;
+	UtilHighresClock m_loadClock;
+
+	ThreadPool* m_loaderPool;
+
+};
+
+#endif
@@ -10,6 +10,17 @@
 WorldView::WorldView( const World* world, const Player* player )
 	: m_gameWorld( world )
 	, m_player( player )
+	, m_worldStack( NULL )
+	, m_level( 0 )
+	, m_columnCount( 300 )
+	, m_fieldOfView( 1.2f ) // In radians (130 degrees)
+	, m_shading( WorldViewShading_Full )
+	, m_previousFacing( 0.0f )
+	, m_previousWorld( NULL )
+	, m_previousRevision( 0 )
+	, m_frameIndex( 0 )
+	, m_maxReprojectRotation( 0.3f )
+	, m_maxReprojectTranslation( 1.0f )
 {
 }
 
@@ -17,101 +28,539 @@ WorldView::~WorldView()
 {
 }
 
-void WorldView::Render( SDL_Renderer* renderer, Vector2i windowSize )
+WorldView::ColumnHit::ColumnHit()
+	: m_hitPos( 0.0f, 0.0f, 0.0f )
+	, m_wallHeight( 0.0f )
+	, m_isCast( false )
+	, m_isValid( false )
+	, m_spanCount( 0 )
 {
-	SDL_Rect rect;
+}
 
-	// Important properties for how we render our ray-casted world
-	static float columnCount = 300.0f;
-	static float fieldOfView = 1.2f; // In radians (130 degrees)
+WorldView::ColumnHit::ColumnHit( const ColumnHit& other )
+{
+	*this = other;
+}
 
-	// For each column ray we want to cast..
-	for(int x = 0; x < columnCount; x++)
-	{
-		// What is the theta offset?
-		float normx = (float)x / columnCount;
-		float thetaOffset = (0.5f - normx) * fieldOfView;
+WorldView::ColumnHit& WorldView::ColumnHit::operator=( const ColumnHit& other )
+{
+	m_hitPos = other.m_hitPos;
+	m_wallHeight = other.m_wallHeight;
+	m_isCast = other.m_isCast;
+	m_isValid = other.m_isValid;
+	memcpy( m_spans, other.m_spans, other.m_spanCount * sizeof(ColumnSpan) );
+	m_spanCount = other.m_spanCount;
+	return *this;
+}
 
-		// Compute our casting ray
-		float rayTheta = m_player->GetFacing() + thetaOffset;
-		Vector3f sourcePos = m_player->GetPosition();
-		Vector3f collisionPos = CollisionCheck( sourcePos, rayTheta );
-		float dist = (float)(collisionPos - sourcePos).GetLength() * cos(thetaOffset); // Correction for fish-eye lense effect
-		float wallHeight = (3.0f / dist) * (windowSize.y / 2.0f);
+void WorldView::Render( SDL_Renderer* renderer, Vector2i windowSize )
+{
+	SDL_Rect rect;
+	CastColumns( windowSize );
 
+	// Render each column
+	for(int x = 0; x < m_columnCount; x++)
+	{
 		// What is the x-axis pixel range?
+		float normx = (float)x / (float)m_columnCount;
 		float px0 = normx * (float)windowSize.x;
-		float px1 = px0 + windowSize.x / columnCount;
+		float px1 = px0 + windowSize.x / (float)m_columnCount;
 
 		// Render the pixels column
 		rect.w = (int)(px1 - px0 + 1.0f);
-		rect.h = (int)wallHeight;
+		rect.h = (int)m_columns[x].m_wallHeight;
 		rect.x = (int)px0;
 		rect.y = (int)(windowSize.y / 2.0f - rect.h / 2.0f);
 		
 		SDL_SetRenderDrawColor(renderer, 128, 0, 0, 255);
 		SDL_RenderFillRect(renderer, &rect);
+
+		// Other levels, through holes
+		for(int i = 0; i < m_columns[x].m_spanCount; i++)
+		{
+			const ColumnSpan& span = m_columns[x].m_spans[i];
+			rect.y = (int)span.m_top;
+			rect.h = (int)(span.m_bottom - span.m_top + 1.0f);
+
+			if( span.m_type == ColumnSpanType_LowerFloor )
+				SDL_SetRenderDrawColor(renderer, 48, 48, 56, 255);
+			else if( span.m_type == ColumnSpanType_LowerWall )
+				SDL_SetRenderDrawColor(renderer, 72, 0, 0, 255);
+			else if( span.m_type == ColumnSpanType_UpperCeiling )
+				SDL_SetRenderDrawColor(renderer, 190, 210, 230, 255);
+			else
+				SDL_SetRenderDrawColor(renderer, 170, 64, 64, 255);
+			SDL_RenderFillRect(renderer, &rect);
+		}
+	}
+}
+
+void WorldView::CastColumns( const Vector2i& windowSize )
+{
+	// Stacked worlds: the player's height picks the level
+	if( m_worldStack != NULL )
+	{
+		m_level = m_worldStack->GetLevelAt( m_player->GetPosition().z );
+		m_gameWorld = m_worldStack->GetLevel( m_level );
+	}
+
+	// Reset this frame's column buffer
+	m_columns.resize( m_columnCount );
+	for(int x = 0; x < m_columnCount; x++)
+	{
+		m_columns[x].m_isCast = m_columns[x].m_isValid = false;
+		m_columns[x].m_spanCount = 0;
+	}
+
+	m_stats = WorldViewStats();
+	m_stats.m_columnCount = m_columnCount;
+
+	// Full shading: cast a ray for each column; checkerboard falls back
+	// to it whenever the previous frame can't be reprojected
+	if( m_shading == WorldViewShading_Full || (m_shading == WorldViewShading_Checkerboard && !RenderCheckerboard( windowSize )) )
+	{
+		for(int x = 0; x < m_columnCount; x++)
+			CastColumn( x, windowSize );
+	}
+	// Foveated: walk out from the center of the screen, casting sparser and sparser,
+	// then fill in the gaps from the neighbouring casts
+	else if( m_shading == WorldViewShading_Foveated )
+	{
+		int center = m_columnCount / 2;
+		CastColumn( center, windowSize );
+
+		for(int x = center; x < m_columnCount - 1; )
+		{
+			int next = min( x + GetFoveatedStride(x), m_columnCount - 1 );
+			CastColumn( next, windowSize );
+			ReconstructColumns( x, next );
+			x = next;
+		}
+
+		for(int x = center; x > 0; )
+		{
+			int next = max( x - GetFoveatedStride(x), 0 );
+			CastColumn( next, windowSize );
+			ReconstructColumns( next, x );
+			x = next;
+		}
 	}
+
+	m_stats.m_raysSaved = m_stats.m_columnCount - m_stats.m_raysCast;
+
+	// Keep this frame around for reprojection
+	m_previousColumns = m_columns;
+	m_previousPosition = m_player->GetPosition();
+	m_previousFacing = m_player->GetFacing();
+	m_previousWindowSize = windowSize;
+	m_previousWorld = m_gameWorld;
+	m_previousRevision = m_gameWorld->GetRevision();
+	m_frameIndex++;
+}
+
+void WorldView::CastColumn( int column, const Vector2i& windowSize )
+{
+	// What is the theta offset?
+	float normx = (float)column / (float)m_columnCount;
+	float thetaOffset = (0.5f - normx) * m_fieldOfView;
+
+	// Compute our casting ray
+	float rayTheta = m_player->GetFacing() + thetaOffset;
+	Vector3f sourcePos = m_player->GetPosition();
+	ColumnHit& hit = m_columns[column];
+	hit.m_spanCount = 0;
+
+	// Off the map, the player is inside the solid ground around it: a wall fills the
+	// column. Rays only ever start on the map, so the walks never leave the border ring
+	if( !m_gameWorld->IsOnMap( (int)floor( sourcePos.x ), (int)floor( sourcePos.y ) ) )
+	{
+		hit.m_hitPos = sourcePos;
+		hit.m_wallHeight = (float)windowSize.y;
+		hit.m_isCast = true;
+		hit.m_isValid = true;
+		m_stats.m_raysCast++;
+		return;
+	}
+
+	// Holes in the floor or ceiling are picked up along the way to the wall, so
+	// the tiles are still walked only once; the other levels are then only looked
+	// at through the holes found
+	Vector3f collisionPos;
+	if( HasOpenings() )
+	{
+		float dirX = cos( rayTheta );
+		float dirY = -sin( rayTheta );
+		RayOpening openings[ WorldView_MaxColumnSpans / 2 ];
+		int openingCount = 0;
+		float wallDistance = TraceLevel( m_level, sourcePos, dirX, dirY, 0.0f, 1e30f, openings, WorldView_MaxColumnSpans / 2, &openingCount );
+		collisionPos = Vector3f( sourcePos.x + dirX * wallDistance, sourcePos.y + dirY * wallDistance, sourcePos.z );
+
+		AddOpeningSpans( hit, openings, openingCount, sourcePos, dirX, dirY, (3.0f / cos(thetaOffset)) * (windowSize.y / 2.0f), windowSize );
+	}
+	else
+	{
+		collisionPos = CollisionCheck( sourcePos, rayTheta );
+	}
+	float dist = (float)(collisionPos - sourcePos).GetLength() * cos(thetaOffset); // Correction for fish-eye lense effect
+
+	hit.m_hitPos = collisionPos;
+	hit.m_wallHeight = (3.0f / dist) * (windowSize.y / 2.0f);
+	hit.m_isCast = true;
+	hit.m_isValid = true;
+
+	m_stats.m_raysCast++;
+	m_stats.m_levelSpans += hit.m_spanCount;
+}
+
+bool WorldView::HasOpenings() const
+{
+	if( m_worldStack == NULL )
+		return false;
+
+	return m_worldStack->HasOpenFloor( m_level ) || (m_level + 1 < m_worldStack->GetLevelCount() && m_worldStack->HasOpenFloor( m_level + 1 ));
+}
+
+float WorldView::TraceLevel( int level, const Vector3f& origin, float dirX, float dirY,
+	float startDistance, float maxDistance, RayOpening* openings, int maxOpenings, int* openingCount ) const
+{
+	// Same walk as CollisionCheck, from the given distance along the ray on
+	float startX = origin.x + dirX * startDistance;
+	float startY = origin.y + dirY * startDistance;
+	int tileX = (int)floor( startX );
+	int tileY = (int)floor( startY );
+
+	// As in CollisionCheck, only a walk from a tile on the map is sure to hit the
+	// border ring; one from off the map (the player out of bounds) hits right where
+	// it starts
+	const World* world = m_worldStack->GetLevel( level );
+	if( !world->IsOnMap( tileX, tileY ) )
+	{
+		if( openingCount != NULL )
+			*openingCount = 0;
+		return startDistance;
+	}
+
+	int stepX = (dirX >= 0.0f) ? 1 : -1;
+	int stepY = (dirY >= 0.0f) ? 1 : -1;
+	float deltaX = (dirX != 0.0f) ? fabs( 1.0f / dirX ) : 1e30f;
+	float deltaY = (dirY != 0.0f) ? fabs( 1.0f / dirY ) : 1e30f;
+	float nextX = startDistance + ((dirX >= 0.0f) ? ((float)tileX + 1.0f - startX) : (startX - (float)tileX)) * deltaX;
+	float nextY = startDistance + ((dirY >= 0.0f) ? ((float)tileY + 1.0f - startY) : (startY - (float)tileY)) * deltaY;
+	float distance = startDistance;
+
+	// Holes are only looked for on levels that have some
+	const World* upperWorld = m_worldStack->GetLevel( level + 1 );
+	bool isFloorChecked = openings != NULL && m_worldStack->HasOpenFloor( level );
+	bool isCeilingChecked = openings != NULL && upperWorld != NULL && m_worldStack->HasOpenFloor( level + 1 );
+	if( openingCount != NULL )
+		*openingCount = 0;
+
+	bool isStartTile = true;
+	for(;;)
+	{
+		if( (!isStartTile || startDistance > 0.0f) && world->IsSolid( tileX, tileY ) )
+			return distance;
+		isStartTile = false;
+
+		// Holes under (or over) this tile, if its cell has any; the walk starts on
+		// the map, and stops on the border ring, so every tile here is on it
+		float exitDistance = min( nextX, nextY );
+		for(int side = 0; side < 2; side++)
+		{
+			bool isCeiling = (side == 1);
+			const World* holeWorld = isCeiling ? upperWorld : world;
+			if( !(isCeiling ? isCeilingChecked : isFloorChecked) || !m_worldStack->HasOpenFloorNear( level + side, tileX, tileY ) ||
+				!holeWorld->GetTileTypes().IsOpenFloor( holeWorld->GetWorldTile( tileX, tileY )->m_tileId ) )
+				continue;
+
+			// Continues the last stretch of the same side, if it ends right here
+			bool isMerged = false;
+			for(int i = *openingCount - 1; i >= max( 0, *openingCount - 2 ) && !isMerged; i--)
+			{
+				if( openings[i].m_isCeiling == isCeiling && openings[i].m_far >= distance )
+				{
+					openings[i].m_far = exitDistance;
+					isMerged = true;
+				}
+			}
+
+			if( !isMerged && *openingCount < maxOpenings )
+			{
+				RayOpening opening = { distance, exitDistance, isCeiling };
+				openings[(*openingCount)++] = opening;
+			}
+		}
+
+		if( exitDistance >= maxDistance )
+			return maxDistance;
+
+		if( nextX < nextY )
+		{
+			nextX += deltaX;
+			tileX += stepX;
+		}
+		else
+		{
+			nextY += deltaY;
+			tileY += stepY;
+		}
+		distance = exitDistance;
+	}
+}
+
+void WorldView::AddOpeningSpans( ColumnHit& hit, const RayOpening* openings, int openingCount, const Vector3f& origin, float dirX, float dirY, float scale, const Vector2i& windowSize ) const
+{
+	// The eye is half a level above the floor and below the ceiling, so a height
+	// difference of h at distance d is h * scale / d pixels off the horizon
+	float horizon = windowSize.y / 2.0f;
+
+	for(int i = 0; i < openingCount && hit.m_spanCount + 2 <= WorldView_MaxColumnSpans; i++)
+	{
+		// Per-column vertical occlusion: a hole only covers the rows between its
+		// near and far edges, and holes less than a pixel tall are skipped
+		const RayOpening& opening = openings[i];
+		float nearOffset = (opening.m_near > 0.0f) ? min( 0.5f * scale / opening.m_near, horizon ) : horizon;
+		float farOffset = 0.5f * scale / opening.m_far;
+		if( nearOffset - farOffset < 1.0f )
+			continue;
+
+		// The other level's walls then only need looking for as far as they can
+		// still reach into those rows: a wall one level tall seen from more than
+		// three times the far distance stays beyond the far edge
+		int level = opening.m_isCeiling ? m_level + 1 : m_level - 1;
+		float wallInner = 0.0f;
+		float wallOuter = 0.0f;
+		if( m_worldStack->GetLevel( level ) != NULL )
+		{
+			float maxDistance = 3.0f * opening.m_far;
+			float wallDistance = TraceLevel( level, origin, dirX, dirY, opening.m_near, maxDistance, NULL, 0, NULL );
+			if( wallDistance < maxDistance )
+			{
+				// A wall right under the hole shows its top too, up to the far edge
+				wallInner = (wallDistance <= opening.m_far) ? farOffset : 0.5f * scale / wallDistance;
+				wallOuter = min( nearOffset, 1.5f * scale / wallDistance );
+			}
+		}
+
+		// Floor holes lie below the horizon, ceiling holes above it
+		float sign = opening.m_isCeiling ? -1.0f : 1.0f;
+		ColumnSpan& holeSpan = hit.m_spans[hit.m_spanCount++];
+		holeSpan.m_top = horizon + sign * (opening.m_isCeiling ? nearOffset : farOffset);
+		holeSpan.m_bottom = horizon + sign * (opening.m_isCeiling ? farOffset : nearOffset);
+		holeSpan.m_type = opening.m_isCeiling ? ColumnSpanType_UpperCeiling : ColumnSpanType_LowerFloor;
+
+		if( wallOuter > wallInner )
+		{
+			ColumnSpan& wallSpan = hit.m_spans[hit.m_spanCount++];
+			wallSpan.m_top = horizon + sign * (opening.m_isCeiling ? wallOuter : wallInner);
+			wallSpan.m_bottom = horizon + sign * (opening.m_isCeiling ? wallInner : wallOuter);
+			wallSpan.m_type = opening.m_isCeiling ? ColumnSpanType_UpperWall : ColumnSpanType_LowerWall;
+		}
+	}
+}
+
+int WorldView::GetFoveatedStride( int column ) const
+{
+	// How far off-center is this column? 0 is the center, 1 is either edge
+	float eccentricity = fabs( (float)column / (float)m_columnCount - 0.5f ) * 2.0f;
+	float centerBand = m_foveationCurve.m_centerBand;
+	if( eccentricity <= centerBand || centerBand >= 1.0f || m_foveationCurve.m_maxStride <= 1 )
+		return 1;
+
+	// Grow the stride along the curve, from 1 at the band's edge up to the max stride
+	float t = (eccentricity - centerBand) / (1.0f - centerBand);
+	float stride = 1.0f + (float)(m_foveationCurve.m_maxStride - 1) * pow( t, m_foveationCurve.m_falloff );
+	return max( 1, (int)(stride + 0.5f) );
+}
+
+void WorldView::ReconstructColumns( int leftColumn, int rightColumn )
+{
+	ColumnHit left = m_columns[leftColumn];
+	ColumnHit right = m_columns[rightColumn];
+
+	// Only interpolate across what looks like the same wall; a large jump in
+	// height is a depth edge, which we keep sharp by duplicating instead
+	static const float edgeThreshold = 0.15f;
+	float heightDelta = fabs( left.m_wallHeight - right.m_wallHeight );
+	bool canInterpolate = m_foveationCurve.m_interpolate && heightDelta <= edgeThreshold * max( left.m_wallHeight, right.m_wallHeight );
+
+	for(int x = leftColumn + 1; x < rightColumn; x++)
+	{
+		float t = (float)(x - leftColumn) / (float)(rightColumn - leftColumn);
+		ColumnHit& hit = m_columns[x];
+
+		// Wall heights are proportional to inverse depth, which is what varies
+		// (near) linearly across the screen for a flat wall
+		if( canInterpolate )
+		{
+			const ColumnHit& nearest = (t < 0.5f) ? left : right;
+			hit.m_hitPos = left.m_hitPos + (right.m_hitPos - left.m_hitPos) * t;
+			hit.m_wallHeight = left.m_wallHeight + (right.m_wallHeight - left.m_wallHeight) * t;
+			memcpy( hit.m_spans, nearest.m_spans, nearest.m_spanCount * sizeof(ColumnSpan) );
+			hit.m_spanCount = nearest.m_spanCount;
+		}
+		else
+		{
+			hit = (t < 0.5f) ? left : right;
+		}
+		hit.m_isCast = false;
+		hit.m_isValid = true;
+	}
+}
+
+bool WorldView::RenderCheckerboard( const Vector2i& windowSize )
+{
+	// Large rotations, teleports, or a resized view leave too little to reproject from;
+	// after a world edit or a change of level, the previous hits may be walls that are
+	// gone. Holes show other levels in screen-space spans, which don't reproject
+	Vector3f position = m_player->GetPosition();
+	if( m_previousWorld != m_gameWorld || HasOpenings() )
+		return false;
+	float facing = m_player->GetFacing();
+	if( (int)m_previousColumns.size() != m_columnCount || m_previousWindowSize.x != windowSize.x || m_previousWindowSize.y != windowSize.y )
+		return false;
+	if( m_previousRevision != m_gameWorld->GetRevision() )
+		return false;
+	if( fabs( facing - m_previousFacing ) > m_maxReprojectRotation || (position - m_previousPosition).GetLength() > m_maxReprojectTranslation )
+		return false;
+
+	// Cast this frame's half of the columns
+	int parity = m_frameIndex & 1;
+	for(int x = parity; x < m_columnCount; x += 2)
+		CastColumn( x, windowSize );
+
+	// Move the previous frame's cast hits into our current view; only actual casts
+	// are used, so reconstruction errors never carry over from frame to frame
+	m_reprojected.clear();
+	for(int i = 0; i < m_columnCount; i++)
+	{
+		if( !m_previousColumns[i].m_isCast )
+			continue;
+
+		Vector3f hitPos = m_previousColumns[i].m_hitPos;
+		float dx = hitPos.x - position.x;
+		float dy = hitPos.y - position.y;
+
+		// Same angle convention as the player: 0 along X+, growing counter-clockwise (Y-)
+		float thetaOffset = atan2( -dy, dx ) - facing;
+		thetaOffset = fmod( thetaOffset + (float)UtilPI, 2.0f * (float)UtilPI );
+		if( thetaOffset < 0.0f )
+			thetaOffset += 2.0f * (float)UtilPI;
+		thetaOffset -= (float)UtilPI;
+
+		float dist = sqrt( dx * dx + dy * dy ) * cos( thetaOffset );
+		if( dist <= 0.0f )
+			continue;
+
+		ReprojectedHit reprojected;
+		reprojected.m_column = (0.5f - thetaOffset / m_fieldOfView) * (float)m_columnCount;
+		reprojected.m_hit.m_hitPos = hitPos;
+		reprojected.m_hit.m_wallHeight = (3.0f / dist) * (windowSize.y / 2.0f);
+		reprojected.m_hit.m_isCast = false;
+		reprojected.m_hit.m_isValid = true;
+		reprojected.m_hit.m_spanCount = 0;
+		m_reprojected.push_back( reprojected );
+	}
+
+	// Fill the skipped columns lying between two neighbouring reprojected hits; gaps
+	// that are too wide or cross a depth edge are disocclusions and are left for casting
+	static const float maxGap = 3.0f;
+	static const float edgeThreshold = 0.15f;
+	for(int i = 1; i < (int)m_reprojected.size(); i++)
+	{
+		ReprojectedHit& left = m_reprojected[i - 1];
+		ReprojectedHit& right = m_reprojected[i];
+		float gap = right.m_column - left.m_column;
+		if( gap <= 0.0f || gap > maxGap )
+			continue;
+		
+		float heightDelta = fabs( left.m_hit.m_wallHeight - right.m_hit.m_wallHeight );
+		bool canInterpolate = heightDelta <= edgeThreshold * max( left.m_hit.m_wallHeight, right.m_hit.m_wallHeight );
+
+		int x0 = max( 0, (int)ceil( left.m_column ) );
+		int x1 = min( m_columnCount - 1, (int)floor( right.m_column ) );
+		for(int x = x0; x <= x1; x++)
+		{
+			ColumnHit& hit = m_columns[x];
+			if( hit.m_isValid )
+				continue;
+
+			float t = ((float)x - left.m_column) / gap;
+			if( canInterpolate )
+			{
+				hit.m_hitPos = left.m_hit.m_hitPos + (right.m_hit.m_hitPos - left.m_hit.m_hitPos) * t;
+				hit.m_wallHeight = left.m_hit.m_wallHeight + (right.m_hit.m_wallHeight - left.m_hit.m_wallHeight) * t;
+				hit.m_isCast = false;
+				hit.m_isValid = true;
+			}
+			else
+			{
+				hit = (t < 0.5f) ? left.m_hit : right.m_hit;
+			}
+		}
+	}
+
+	// Whatever is still missing (screen edges, disocclusions) gets cast
+	for(int x = 0; x < m_columnCount; x++)
+	{
+		if( !m_columns[x].m_isValid )
+			CastColumn( x, windowSize );
+	}
+
+	return true;
 }
 
 Vector3f WorldView::CollisionCheck( Vector3f origin, float radians )
 {
-	// Starting position
-	float x = origin.x;
-	float y = origin.y;
-	int worldWidth = m_gameWorld->GetWorldSize().x;
-	int worldHeight = m_gameWorld->GetWorldSize().y;
-
-    // A ray will always move towards one or two surfaces, like if
-    // a ray is defined with R of zero, then it always moves to the right,
-    // and thus we should only search right of us
-    bool goingRight = cos(radians) >= 0.0f; // X+
-    bool goingDown = (-sin(radians)) >= 0.0f; // Y+
-    float slope = (-sin(radians)) / cos(radians);
-    float b = y - slope * x;
-	
-    // Delta-fudge value; used to bump us off for the next test
-    // Specificly it is used as a "look ahead" to see what we're colliding into
-    float df = 0.00001f;
-    float dfx = cos(radians) * df;
-    float dfy = -sin(radians) * df;
-	
-    // Keep moving one unit-length ahead until we collide with something
+	// Starting tile, and the ray direction (the map's Y axis grows downwards)
+	int tileX = (int)floor( origin.x );
+	int tileY = (int)floor( origin.y );
+	float dirX = cos( radians );
+	float dirY = -sin( radians );
+
+	// A ray from off the map could miss the border ring; it hits right away instead
+	if( !m_gameWorld->IsOnMap( tileX, tileY ) )
+		return origin;
+
+    // Walk the grid one tile edge at a time (a DDA): a ray always moves towards
+    // one or two of the tile's edges, and the distance along the ray between two
+    // vertical (or horizontal) edges is constant, so we only keep track of how far
+    // along the ray the next vertical and next horizontal edge crossings are
+    int stepX = (dirX >= 0.0f) ? 1 : -1;
+    int stepY = (dirY >= 0.0f) ? 1 : -1;
+    float deltaX = (dirX != 0.0f) ? fabs( 1.0f / dirX ) : 1e30f;
+    float deltaY = (dirY != 0.0f) ? fabs( 1.0f / dirY ) : 1e30f;
+    float nextX = ((dirX >= 0.0f) ? ((float)tileX + 1.0f - origin.x) : (origin.x - (float)tileX)) * deltaX;
+    float nextY = ((dirY >= 0.0f) ? ((float)tileY + 1.0f - origin.y) : (origin.y - (float)tileY)) * deltaY;
+    float distance = 0.0f;
+
+    // Keep moving one tile ahead until we collide with something; the tile we
+    // start in is never tested. The world's solid border ring stops any ray
+    // from the map before it leaves it, so there are no range checks in here
     bool collisionFound = false;
-    while( x > 0.0f && y > 0.0f && x <= worldWidth && y <= worldHeight && !collisionFound )
+    while( !collisionFound )
     {
-        // What is the Y position if we check the block right/left of us
-        float tx = goingRight ? ceil(x + df) : floor(x - df);
-        float nextY = slope * tx + b;
-		
-        // What is the X position if we check the block above/below us
-        float ty = goingDown ? ceil(y + df) : floor(y - df);
-        float nextX = (ty - b) / slope;
-		
-        // What's closest? (Overkill, we can just use street/hamming-dist)
-        float dx = sqrt( pow(tx - x, 2.0f) + pow(nextY - y, 2.0f) );
-        float dy = sqrt( pow(nextX - x, 2.0f) + pow(ty - y, 2.0f) );
-		
-        if( dx < dy )
+        if( nextX < nextY )
         {
-            x = tx;
-            y = nextY;
+            distance = nextX;
+            nextX += deltaX;
+            tileX += stepX;
         }
         else
         {
-            x = nextX;
-            y = ty;
+            distance = nextY;
+            nextY += deltaY;
+            tileY += stepY;
         }
-		
+
         // Collision check
-		int tileId = m_gameWorld->GetWorldTile( (int)(x + dfx), (int)(y + dfy) )->m_tileId;
-		collisionFound = (tileId != ' ');
+        collisionFound = m_gameWorld->IsSolid( tileX, tileY );
     }
 	
     // Echo off results
     if(collisionFound)
     {
-		return Vector3f( x, y, origin.z );
+		return Vector3f( origin.x + dirX * distance, origin.y + dirY * distance, origin.z );
     }
     else
     {
@@ -15,8 +15,57 @@
 #ifndef __WORLDVIEW_H__
 #define __WORLDVIEW_H__
 
+#include <vector>
+
 #include "Player.h"
 #include "World.h"
+#include "WorldStack.h"
+
+// Most spans of other levels drawn over a single column
+static const int WorldView_MaxColumnSpans = 8;
+
+// How the view decides which columns get a ray cast through them
+enum WorldViewShading
+{
+	WorldViewShading_Full,		// One ray per column
+	WorldViewShading_Foveated,	// Full density in a central band, sparser toward the screen edges
+	WorldViewShading_Checkerboard,	// Even columns on even frames, odd on odd frames; the rest is reprojected
+};
+
+// Density curve used by foveated shading: columns within the central band are
+// always cast; past it the gap between cast columns grows up to the max stride
+struct FoveationCurve
+{
+	float m_centerBand;		// Fraction of the screen width (0 to 1) cast at full density
+	int m_maxStride;		// Largest column step at the very edges of the screen
+	float m_falloff;		// Exponent of the growth; 1 is linear, higher keeps edges denser for longer
+	bool m_interpolate;		// Interpolate skipped columns from neighbour hits, else duplicate the nearest
+
+	FoveationCurve()
+		: m_centerBand( 0.4f )
+		, m_maxStride( 4 )
+		, m_falloff( 1.0f )
+		, m_interpolate( true )
+	{
+	}
+};
+
+// Render statistics of the last frame
+struct WorldViewStats
+{
+	int m_columnCount;	// Columns on screen
+	int m_raysCast;		// Columns we actually cast a ray for
+	int m_raysSaved;	// Columns reconstructed from neighbours instead
+	int m_levelSpans;	// Spans of other levels seen through holes, in cast columns
+
+	WorldViewStats()
+		: m_columnCount( 0 )
+		, m_raysCast( 0 )
+		, m_raysSaved( 0 )
+		, m_levelSpans( 0 )
+	{
+	}
+};
 
 class WorldView
 {
@@ -25,19 +74,152 @@ public:
 	WorldView( const World* world, const Player* player );
 	~WorldView();
 
+	// Renders a stack of levels instead: the level the player is on, and the
+	// levels below and above it where they show through holes in the floor
+	// (or ceiling). Rays stay on one level; a column only looks at another
+	// level for the holes it crosses, within the rows they cover on screen
+	void SetWorldStack( const WorldStack* worldStack ) { m_worldStack = worldStack; }
+
 	void Render( SDL_Renderer* renderer, Vector2i m_windowSize );
 
-protected:
+	// Casts (or reconstructs) this frame's columns without drawing them; the
+	// first half of Render, on its own for benchmarks
+	void CastColumns( const Vector2i& windowSize );
+
+	// Column shading mode, can be changed at any time
+	void SetShading( WorldViewShading shading ) { m_shading = shading; }
+	WorldViewShading GetShading() const { return m_shading; }
+
+	// Foveated density curve, can be changed at any time
+	void SetFoveationCurve( const FoveationCurve& curve ) { m_foveationCurve = curve; }
+	const FoveationCurve& GetFoveationCurve() const { return m_foveationCurve; }
+
+	// Largest per-frame rotation (radians) and movement (tiles) still reprojected
+	// by checkerboard shading; anything beyond that is cast in full
+	void SetReprojectionLimits( float maxRotation, float maxTranslation ) { m_maxReprojectRotation = maxRotation; m_maxReprojectTranslation = maxTranslation; }
+
+	// Statistics of the last rendered frame
+	const WorldViewStats& GetStats() const { return m_stats; }
 
 	// Given a ray origin and direction (through heading)
-	// Returns the point that was hit
+	// Returns the point that was hit (the origin itself, if it is off the map)
 	Vector3f CollisionCheck( Vector3f origin, float radians );
 
 private:
 
+	// What a span of a column shows
+	enum ColumnSpanType
+	{
+		ColumnSpanType_LowerFloor,	// Through a hole in the floor
+		ColumnSpanType_LowerWall,
+		ColumnSpanType_UpperCeiling,	// Through a hole in the ceiling
+		ColumnSpanType_UpperWall,
+	};
+
+	// Rows of a column showing another level, in pixels
+	struct ColumnSpan
+	{
+		float m_top;
+		float m_bottom;
+		ColumnSpanType m_type;
+	};
+
+	// A stretch of a ray over holes in the floor, or in the ceiling (the floor
+	// of the level above); distances are along the ray
+	struct RayOpening
+	{
+		float m_near;
+		float m_far;
+		bool m_isCeiling;
+	};
+
+	// Result of a single column; wall height is kept in pixels so that
+	// reconstructed columns can be interpolated linearly in screen-space.
+	// Copies only carry the spans in use
+	struct ColumnHit
+	{
+		ColumnHit();
+		ColumnHit( const ColumnHit& other );
+		ColumnHit& operator=( const ColumnHit& other );
+
+		Vector3f m_hitPos;
+		float m_wallHeight;
+		bool m_isCast;		// Ray was cast this frame
+		bool m_isValid;		// Has data this frame, either cast or reconstructed
+
+		// Other levels showing through holes, drawn over the background
+		ColumnSpan m_spans[WorldView_MaxColumnSpans];
+		int m_spanCount;
+	};
+
+	// A previous-frame hit, moved into this frame's screen-space
+	struct ReprojectedHit
+	{
+		float m_column;		// Fractional column it now lands on
+		ColumnHit m_hit;
+	};
+
+	// Casts the ray of the given column and fills its column-hit
+	void CastColumn( int column, const Vector2i& windowSize );
+
+	// True if holes in the floor or ceiling of the player's level may be in view
+	bool HasOpenings() const;
+
+	// Walks the tiles of a level of the stack along a ray, from the given distance
+	// on, and returns the distance to the first solid tile (the starting one only
+	// counts past the ray's origin, as CollisionCheck skips it), or the max distance
+	// if none is reached by then. With openings given, also records the stretches
+	// over holes in the level's floor and in the floor of the level above,
+	// neighbouring holes merged, up to the given count
+	float TraceLevel( int level, const Vector3f& origin, float dirX, float dirY,
+		float startDistance, float maxDistance, RayOpening* openings, int maxOpenings, int* openingCount ) const;
+
+	// Adds the spans of the levels below and above that show through the
+	// given holes to the column's hit; the scale is pixels per unit of height
+	// at a distance of one along the ray
+	void AddOpeningSpans( ColumnHit& hit, const RayOpening* openings, int openingCount, const Vector3f& origin, float dirX, float dirY, float scale, const Vector2i& windowSize ) const;
+
+	// Column step to take from the given column, based on the foveation curve
+	int GetFoveatedStride( int column ) const;
+
+	// Fills in all non-cast columns found between the two given cast columns
+	void ReconstructColumns( int leftColumn, int rightColumn );
+
+	// Checkerboard shading: casts every other column, and reprojects the
+	// previous frame's hits into the rest; returns false if it could not
+	bool RenderCheckerboard( const Vector2i& windowSize );
+
 	const World* m_gameWorld;
 	const Player* m_player;
 
+	// Stacked worlds: all the levels, and the index of the one rendered (m_gameWorld)
+	const WorldStack* m_worldStack;
+	int m_level;
+
+	// Important properties for how we render our ray-casted world
+	int m_columnCount;
+	float m_fieldOfView; // In radians
+
+	WorldViewShading m_shading;
+	FoveationCurve m_foveationCurve;
+	WorldViewStats m_stats;
+
+	// Per-column results of the current frame
+	std::vector< ColumnHit > m_columns;
+
+	// Checkerboard state: what the previous frame saw, and from where
+	std::vector< ColumnHit > m_previousColumns;
+	std::vector< ReprojectedHit > m_reprojected;
+	Vector3f m_previousPosition;
+	float m_previousFacing;
+	Vector2i m_previousWindowSize;
+	const World* m_previousWorld;
+	Uint32 m_previousRevision;
+	unsigned int m_frameIndex;
+
+	float m_maxReprojectRotation;
+	float m_maxReprojectTranslation;
+
 };
 
 #endif